@@ -37,14 +37,22 @@
 #ifdef _WIN32
 #include <windows.h>
 #include <sys/timeb.h>
+#include <io.h>
+#include <fcntl.h>
 #else
 #include <sys/time.h>
 #endif
 #include "libapultra.h"
+#include "cache.h"
+#include "matchfinder.h"
+#include "matchlen.h"
+#include "thread.h"
 
 #define OPT_VERBOSE        1
 #define OPT_STATS          2
 #define OPT_ENHANCED       4
+#define OPT_LEVEL_SHIFT    8
+#define OPT_LEVEL_MASK     (15 << OPT_LEVEL_SHIFT)
 
 #define TOOL_VERSION "1.0.9"
 
@@ -90,6 +98,13 @@ static long long do_get_time() {
 
 /*---------------------------------------------------------------------------*/
 
+static int get_compression_flags(const unsigned int nOptions) {
+   int nFlags = (nOptions & OPT_ENHANCED) ? APULTRA_FLAG_ENHANCED : 0;
+
+   nFlags |= APULTRA_FLAG_LEVEL((nOptions & OPT_LEVEL_MASK) >> OPT_LEVEL_SHIFT);
+   return nFlags;
+}
+
 static void compression_progress(long long nOriginalSize, long long nCompressedSize) {
    if (nOriginalSize >= 512 * 1024) {
       fprintf(stdout, "\r%lld => %lld (%g %%)     \b\b\b\b\b", nOriginalSize, nCompressedSize, (double)(nCompressedSize * 100.0 / nOriginalSize));
@@ -97,25 +112,44 @@ static void compression_progress(long long nOriginalSize, long long nCompressedS
    }
 }
 
-static int do_compress(const char *pszInFilename, const char *pszOutFilename, const char *pszDictionaryFilename, const unsigned int nOptions, const unsigned int nMaxWindowSize) {
+static int do_load_dictionary(const char *pszDictionaryFilename, apultra_dictionary *pDictionary) {
+   memset(pDictionary, 0, sizeof(apultra_dictionary));
+
+   if (pszDictionaryFilename) {
+      if (apultra_dictionary_load(pDictionary, pszDictionaryFilename) != 0) {
+         fprintf(stderr, "error reading dictionary '%s'\n", pszDictionaryFilename);
+         return 100;
+      }
+   }
+
+   return 0;
+}
+
+static int do_compress(const char *pszInFilename, const char *pszOutFilename, const char *pszDictionaryFilename, const char *pszCacheDir, const unsigned int nOptions, const unsigned int nMaxWindowSize, const int nThreads) {
    long long nStartTime = 0LL, nEndTime = 0LL;
    size_t nOriginalSize = 0L, nCompressedSize = 0L, nMaxCompressedSize;
    int nSafeDist = 0;
    int nFlags;
    apultra_stats stats;
+   apultra_dictionary dictionary;
+   unsigned char cCacheKey[APULTRA_CACHE_KEY_SIZE];
    unsigned char *pDecompressedData;
    unsigned char *pCompressedData;
 
-   nFlags = (nOptions & OPT_ENHANCED) ? APULTRA_FLAG_ENHANCED : 0;
+   nFlags = get_compression_flags(nOptions);
+
+   if (do_load_dictionary(pszDictionaryFilename, &dictionary) != 0)
+      return 100;
 
    if (nOptions & OPT_VERBOSE) {
       nStartTime = do_get_time();
    }
 
-   /* Read the whole original file in memory */
+   /* Read the whole original file in memory, after the dictionary */
 
    FILE *f_in = fopen(pszInFilename, "rb");
    if (!f_in) {
+      apultra_dictionary_free(&dictionary);
       fprintf(stderr, "error opening '%s' for reading\n", pszInFilename);
       return 100;
    }
@@ -124,22 +158,56 @@ static int do_compress(const char *pszInFilename, const char *pszOutFilename, co
    nOriginalSize = (size_t)ftell(f_in);
    fseek(f_in, 0, SEEK_SET);
 
-   pDecompressedData = (unsigned char*)malloc(nOriginalSize);
+   pDecompressedData = (unsigned char*)malloc(dictionary.size + nOriginalSize);
    if (!pDecompressedData) {
       fclose(f_in);
+      apultra_dictionary_free(&dictionary);
       fprintf(stderr, "out of memory for reading '%s', %zd bytes needed\n", pszInFilename, nOriginalSize);
       return 100;
    }
 
-   if (fread(pDecompressedData, 1, nOriginalSize, f_in) != nOriginalSize) {
+   memcpy(pDecompressedData, dictionary.data, dictionary.size);
+   if (fread(pDecompressedData + dictionary.size, 1, nOriginalSize, f_in) != nOriginalSize) {
       free(pDecompressedData);
       fclose(f_in);
+      apultra_dictionary_free(&dictionary);
       fprintf(stderr, "I/O error while reading '%s'\n", pszInFilename);
       return 100;
    }
 
    fclose(f_in);
 
+   if (pszCacheDir) {
+      apultra_cache_get_key(pDecompressedData, dictionary.size + nOriginalSize, dictionary.size, nFlags, nMaxWindowSize, nThreads, TOOL_VERSION, cCacheKey);
+
+      /* Statistics are only gathered while compressing, so -stats always compresses, and refreshes the cache entry. A fetched
+       * stream is written out like a compressed one, and -c checks the written file in both cases */
+      if (!(nOptions & OPT_STATS)) {
+         pCompressedData = apultra_cache_lookup(pszCacheDir, cCacheKey, &nCompressedSize);
+         if (pCompressedData) {
+            apultra_dictionary_free(&dictionary);
+            free(pDecompressedData);
+
+            FILE *f_out = fopen(pszOutFilename, "wb");
+            if (!f_out || fwrite(pCompressedData, 1, nCompressedSize, f_out) != nCompressedSize) {
+               if (f_out)
+                  fclose(f_out);
+               free(pCompressedData);
+               fprintf(stderr, "error writing '%s'\n", pszOutFilename);
+               return 100;
+            }
+            fclose(f_out);
+            free(pCompressedData);
+
+            if ((nOptions & OPT_VERBOSE)) {
+               fprintf(stdout, "Fetched '%s' from cache, %d into %d bytes ==> %g %%\n",
+                  pszInFilename, (int)nOriginalSize, (int)nCompressedSize, nOriginalSize ? (double)(nCompressedSize * 100.0 / nOriginalSize) : 0.0);
+            }
+            return 0;
+         }
+      }
+   }
+
    /* Allocate max compressed size */
 
    nMaxCompressedSize = apultra_get_max_compressed_size(nOriginalSize);
@@ -147,18 +215,22 @@ static int do_compress(const char *pszInFilename, const char *pszOutFilename, co
    pCompressedData = (unsigned char*)malloc(nMaxCompressedSize);
    if (!pCompressedData) {
       free(pDecompressedData);
+      apultra_dictionary_free(&dictionary);
       fprintf(stderr, "out of memory for compressing '%s', %zd bytes needed\n", pszInFilename, nMaxCompressedSize);
       return 100;
    }
 
    memset(pCompressedData, 0, nMaxCompressedSize);
 
-   nCompressedSize = apultra_compress(pDecompressedData, pCompressedData, nOriginalSize, nMaxCompressedSize, nFlags, nMaxWindowSize, compression_progress, &stats);
+   nCompressedSize = apultra_compress_parallel(pDecompressedData, pCompressedData, dictionary.size + nOriginalSize, nMaxCompressedSize, nFlags, nMaxWindowSize,
+      pszDictionaryFilename ? &dictionary : NULL, nThreads, compression_progress, &stats);
 
    if ((nOptions & OPT_VERBOSE)) {
       nEndTime = do_get_time();
    }
 
+   apultra_dictionary_free(&dictionary);
+
    if (nCompressedSize == -1) {
       free(pCompressedData);
       free(pDecompressedData);
@@ -178,6 +250,11 @@ static int do_compress(const char *pszInFilename, const char *pszOutFilename, co
       }
    }
 
+   if (pszCacheDir) {
+      if (apultra_cache_store(pszCacheDir, cCacheKey, pCompressedData, nCompressedSize) != 0)
+         fprintf(stderr, "warning: couldn't store '%s' in cache '%s'\n", pszInFilename, pszCacheDir);
+   }
+
    free(pCompressedData);
    free(pDecompressedData);
 
@@ -185,8 +262,8 @@ static int do_compress(const char *pszInFilename, const char *pszOutFilename, co
       double fDelta = ((double)(nEndTime - nStartTime)) / 1000000.0;
       double fSpeed = ((double)nOriginalSize / 1048576.0) / fDelta;
       fprintf(stdout, "\rCompressed '%s' in %g seconds, %.02g Mb/s, %d tokens (%g bytes/token), %d into %d bytes ==> %g %%\n",
-         pszInFilename, fDelta, fSpeed, stats.commands_divisor, (double)nOriginalSize / (double)stats.commands_divisor,
-         (int)nOriginalSize, (int)nCompressedSize, (double)(nCompressedSize * 100.0 / nOriginalSize));
+         pszInFilename, fDelta, fSpeed, stats.commands_divisor, stats.commands_divisor ? (double)nOriginalSize / (double)stats.commands_divisor : 0.0,
+         (int)nOriginalSize, (int)nCompressedSize, nOriginalSize ? (double)(nCompressedSize * 100.0 / nOriginalSize) : 0.0);
    }
 
    if (nOptions & OPT_STATS) {
@@ -218,14 +295,134 @@ static int do_compress(const char *pszInFilename, const char *pszOutFilename, co
 
 /*---------------------------------------------------------------------------*/
 
+#define STREAM_CHUNK_SIZE 65536
+
+/** Write bytes from the streaming compressor or decompressor to a file */
+static int write_stream_data(const unsigned char *pData, size_t nSize, void *pUserData) {
+   return (fwrite(pData, 1, nSize, (FILE *)pUserData) == nSize) ? 0 : 100;
+}
+
+/** Open file for streaming; '-' reads from standard input or writes to standard output, so that apultra can be used in a pipe */
+static FILE *open_stream_file(const char *pszFilename, const int nForWriting) {
+   if (!strcmp(pszFilename, "-")) {
+#ifdef _WIN32
+      _setmode(_fileno(nForWriting ? stdout : stdin), _O_BINARY);
+#endif
+      return nForWriting ? stdout : stdin;
+   }
+   else {
+      return fopen(pszFilename, nForWriting ? "wb" : "rb");
+   }
+}
+
+static void close_stream_file(FILE *f) {
+   if (f != stdin && f != stdout)
+      fclose(f);
+}
+
+static int do_compress_stream(const char *pszInFilename, const char *pszOutFilename, const char *pszDictionaryFilename, const unsigned int nOptions, const unsigned int nMaxWindowSize) {
+   long long nStartTime = 0LL, nEndTime = 0LL;
+   apultra_stream_compressor stream;
+   apultra_dictionary dictionary;
+   unsigned char *pChunk;
+   FILE *f_in, *f_out;
+   int nResult = 0;
+
+   if (do_load_dictionary(pszDictionaryFilename, &dictionary) != 0)
+      return 100;
+
+   if (nOptions & OPT_VERBOSE) {
+      nStartTime = do_get_time();
+   }
+
+   f_in = open_stream_file(pszInFilename, 0);
+   if (!f_in) {
+      apultra_dictionary_free(&dictionary);
+      fprintf(stderr, "error opening '%s' for reading\n", pszInFilename);
+      return 100;
+   }
+
+   f_out = open_stream_file(pszOutFilename, 1);
+   if (!f_out) {
+      close_stream_file(f_in);
+      apultra_dictionary_free(&dictionary);
+      fprintf(stderr, "error opening '%s' for writing\n", pszOutFilename);
+      return 100;
+   }
+
+   pChunk = (unsigned char*)malloc(STREAM_CHUNK_SIZE);
+   if (!pChunk || apultra_stream_compressor_init(&stream, get_compression_flags(nOptions), nMaxWindowSize, pszDictionaryFilename ? &dictionary : NULL, write_stream_data, f_out) != 0) {
+      if (pChunk)
+         free(pChunk);
+      close_stream_file(f_out);
+      close_stream_file(f_in);
+      apultra_dictionary_free(&dictionary);
+      fprintf(stderr, "out of memory for compressing '%s'\n", pszInFilename);
+      return 100;
+   }
+
+   /* Compressed bytes are written out as soon as each block is compressed */
+   while (!nResult) {
+      size_t nChunkSize = fread(pChunk, 1, STREAM_CHUNK_SIZE, f_in);
+
+      if (nChunkSize == 0) {
+         if (ferror(f_in)) {
+            fprintf(stderr, "I/O error while reading '%s'\n", pszInFilename);
+            nResult = 100;
+         }
+         break;
+      }
+
+      if (apultra_stream_compressor_feed(&stream, pChunk, nChunkSize) != 0) {
+         fprintf(stderr, "compression error for '%s'\n", pszInFilename);
+         nResult = 100;
+      }
+   }
+
+   if (!nResult && apultra_stream_compressor_end(&stream, NULL) != 0) {
+      fprintf(stderr, "compression error for '%s'\n", pszInFilename);
+      nResult = 100;
+   }
+
+   if ((nOptions & OPT_VERBOSE)) {
+      nEndTime = do_get_time();
+   }
+
+   if (!nResult && fflush(f_out) != 0) {
+      fprintf(stderr, "error writing '%s'\n", pszOutFilename);
+      nResult = 100;
+   }
+
+   if (!nResult && (nOptions & OPT_VERBOSE)) {
+      double fDelta = ((double)(nEndTime - nStartTime)) / 1000000.0;
+      double fSpeed = ((double)stream.original_size / 1048576.0) / fDelta;
+
+      /* Keep standard output clean when the compressed stream is written to it */
+      fprintf((f_out == stdout) ? stderr : stdout, "Compressed '%s' in %g seconds, %.02g Mb/s, %lld into %lld bytes ==> %g %%\n",
+         pszInFilename, fDelta, fSpeed, stream.original_size, stream.compressed_size,
+         stream.original_size ? ((double)stream.compressed_size * 100.0 / (double)stream.original_size) : 0.0);
+   }
+
+   apultra_stream_compressor_destroy(&stream);
+   free(pChunk);
+   close_stream_file(f_out);
+   close_stream_file(f_in);
+   apultra_dictionary_free(&dictionary);
+
+   return nResult;
+}
+
+/*---------------------------------------------------------------------------*/
+
 static int do_decompress(const char *pszInFilename, const char *pszOutFilename, const char *pszDictionaryFilename, const unsigned int nOptions) {
    long long nStartTime = 0LL, nEndTime = 0LL;
    size_t nCompressedSize, nMaxDecompressedSize, nOriginalSize;
    unsigned char *pCompressedData;
    unsigned char *pDecompressedData;
+   apultra_dictionary dictionary;
    int nFlags;
 
-   nFlags = (nOptions & OPT_ENHANCED) ? APULTRA_FLAG_ENHANCED : 0;
+   nFlags = get_compression_flags(nOptions);
 
    /* Read the whole compressed file in memory */
 
@@ -255,7 +452,7 @@ static int do_decompress(const char *pszInFilename, const char *pszOutFilename,
 
    fclose(f_in);
 
-   /* Allocate max decompressed size */
+   /* Allocate max decompressed size, after the dictionary */
 
    nMaxDecompressedSize = apultra_get_max_decompressed_size(pCompressedData, nCompressedSize, nFlags);
    if (nMaxDecompressedSize == -1) {
@@ -264,23 +461,31 @@ static int do_decompress(const char *pszInFilename, const char *pszOutFilename,
       return 100;
    }
 
-   pDecompressedData = (unsigned char*)malloc(nMaxDecompressedSize);
+   if (do_load_dictionary(pszDictionaryFilename, &dictionary) != 0) {
+      free(pCompressedData);
+      return 100;
+   }
+
+   pDecompressedData = (unsigned char*)malloc(dictionary.size + nMaxDecompressedSize);
    if (!pDecompressedData) {
       free(pCompressedData);
+      apultra_dictionary_free(&dictionary);
       fprintf(stderr, "out of memory for decompressing '%s', %zd bytes needed\n", pszInFilename, nMaxDecompressedSize);
       return 100;
    }
 
-   memset(pDecompressedData, 0, nMaxDecompressedSize);
+   memset(pDecompressedData, 0, dictionary.size + nMaxDecompressedSize);
+   memcpy(pDecompressedData, dictionary.data, dictionary.size);
 
    if (nOptions & OPT_VERBOSE) {
       nStartTime = do_get_time();
    }
 
-   nOriginalSize = apultra_decompress(pCompressedData, pDecompressedData, nCompressedSize, nMaxDecompressedSize, nFlags);
+   nOriginalSize = apultra_decompress(pCompressedData, pDecompressedData, nCompressedSize, nMaxDecompressedSize, dictionary.size, nFlags);
    if (nOriginalSize == -1) {
       free(pDecompressedData);
       free(pCompressedData);
+      apultra_dictionary_free(&dictionary);
 
       fprintf(stderr, "decompression error for '%s'\n", pszInFilename);
       return 100;
@@ -293,11 +498,13 @@ static int do_decompress(const char *pszInFilename, const char *pszOutFilename,
 
       f_out = fopen(pszOutFilename, "wb");
       if (f_out) {
-         fwrite(pDecompressedData, 1, nOriginalSize, f_out);
+         fwrite(pDecompressedData + dictionary.size, 1, nOriginalSize, f_out);
          fclose(f_out);
       }
    }
 
+   apultra_dictionary_free(&dictionary);
+
    free(pDecompressedData);
    free(pCompressedData);
 
@@ -312,6 +519,92 @@ static int do_decompress(const char *pszInFilename, const char *pszOutFilename,
    return 0;
 }
 
+static int do_decompress_stream(const char *pszInFilename, const char *pszOutFilename, const char *pszDictionaryFilename, const unsigned int nOptions, const unsigned int nMaxWindowSize) {
+   long long nStartTime = 0LL, nEndTime = 0LL;
+   apultra_stream_decompressor stream;
+   apultra_dictionary dictionary;
+   unsigned char *pChunk;
+   FILE *f_in, *f_out;
+   int nResult = 0;
+
+   if (do_load_dictionary(pszDictionaryFilename, &dictionary) != 0)
+      return 100;
+
+   if (nOptions & OPT_VERBOSE) {
+      nStartTime = do_get_time();
+   }
+
+   f_in = open_stream_file(pszInFilename, 0);
+   if (!f_in) {
+      apultra_dictionary_free(&dictionary);
+      fprintf(stderr, "error opening '%s' for reading\n", pszInFilename);
+      return 100;
+   }
+
+   f_out = open_stream_file(pszOutFilename, 1);
+   if (!f_out) {
+      close_stream_file(f_in);
+      apultra_dictionary_free(&dictionary);
+      fprintf(stderr, "error opening '%s' for writing\n", pszOutFilename);
+      return 100;
+   }
+
+   pChunk = (unsigned char*)malloc(STREAM_CHUNK_SIZE);
+   if (!pChunk || apultra_stream_decompressor_init(&stream, nMaxWindowSize, dictionary.data, dictionary.size, 0, get_compression_flags(nOptions), write_stream_data, f_out) != 0) {
+      if (pChunk)
+         free(pChunk);
+      close_stream_file(f_out);
+      close_stream_file(f_in);
+      apultra_dictionary_free(&dictionary);
+      fprintf(stderr, "out of memory for decompressing '%s'\n", pszInFilename);
+      return 100;
+   }
+
+   /* Only the window is kept in memory, the compressed and decompressed files never are */
+   while (!nResult) {
+      size_t nChunkSize = fread(pChunk, 1, STREAM_CHUNK_SIZE, f_in);
+
+      if (nChunkSize == 0) {
+         if (ferror(f_in)) {
+            fprintf(stderr, "I/O error while reading '%s'\n", pszInFilename);
+            nResult = 100;
+         }
+         break;
+      }
+
+      if (apultra_stream_decompressor_feed(&stream, pChunk, nChunkSize) != 0) {
+         fprintf(stderr, "decompression error for '%s'\n", pszInFilename);
+         nResult = 100;
+      }
+   }
+
+   if (!nResult && apultra_stream_decompressor_end(&stream) != 0) {
+      fprintf(stderr, "decompression error for '%s': truncated data\n", pszInFilename);
+      nResult = 100;
+   }
+
+   if (!nResult && fflush(f_out) != 0) {
+      fprintf(stderr, "error writing '%s'\n", pszOutFilename);
+      nResult = 100;
+   }
+
+   if (!nResult && (nOptions & OPT_VERBOSE)) {
+      nEndTime = do_get_time();
+      double fDelta = ((double)(nEndTime - nStartTime)) / 1000000.0;
+      double fSpeed = ((double)stream.decompressed_size / 1048576.0) / fDelta;
+      fprintf((f_out == stdout) ? stderr : stdout, "Decompressed '%s' in %g seconds, %g Mb/s\n",
+         pszInFilename, fDelta, fSpeed);
+   }
+
+   apultra_stream_decompressor_destroy(&stream);
+   free(pChunk);
+   close_stream_file(f_out);
+   close_stream_file(f_in);
+   apultra_dictionary_free(&dictionary);
+
+   return nResult;
+}
+
 /*---------------------------------------------------------------------------*/
 
 static int do_compare(const char *pszInFilename, const char *pszOutFilename, const char *pszDictionaryFilename, const unsigned int nOptions) {
@@ -320,9 +613,10 @@ static int do_compare(const char *pszInFilename, const char *pszOutFilename, con
    unsigned char *pCompressedData = NULL;
    unsigned char *pOriginalData = NULL;
    unsigned char *pDecompressedData = NULL;
+   apultra_dictionary dictionary;
    int nFlags;
 
-   nFlags = (nOptions & OPT_ENHANCED) ? APULTRA_FLAG_ENHANCED : 0;
+   nFlags = get_compression_flags(nOptions);
 
    /* Read the whole compressed file in memory */
 
@@ -393,31 +687,41 @@ static int do_compare(const char *pszInFilename, const char *pszOutFilename, con
       return 100;
    }
 
-   pDecompressedData = (unsigned char*)malloc(nMaxDecompressedSize);
+   if (do_load_dictionary(pszDictionaryFilename, &dictionary) != 0) {
+      free(pOriginalData);
+      free(pCompressedData);
+      return 100;
+   }
+
+   pDecompressedData = (unsigned char*)malloc(dictionary.size + nMaxDecompressedSize);
    if (!pDecompressedData) {
       free(pOriginalData);
       free(pCompressedData);
+      apultra_dictionary_free(&dictionary);
       fprintf(stderr, "out of memory for decompressing '%s', %zd bytes needed\n", pszInFilename, nMaxDecompressedSize);
       return 100;
    }
 
-   memset(pDecompressedData, 0, nMaxDecompressedSize);
+   memset(pDecompressedData, 0, dictionary.size + nMaxDecompressedSize);
+   memcpy(pDecompressedData, dictionary.data, dictionary.size);
 
    if (nOptions & OPT_VERBOSE) {
       nStartTime = do_get_time();
    }
 
-   nDecompressedSize = apultra_decompress(pCompressedData, pDecompressedData, nCompressedSize, nMaxDecompressedSize, nFlags);
+   nDecompressedSize = apultra_decompress(pCompressedData, pDecompressedData, nCompressedSize, nMaxDecompressedSize, dictionary.size, nFlags);
    if (nDecompressedSize == -1) {
       free(pDecompressedData);
       free(pOriginalData);
       free(pCompressedData);
+      apultra_dictionary_free(&dictionary);
 
       fprintf(stderr, "decompression error for '%s'\n", pszInFilename);
       return 100;
    }
 
-   if (nDecompressedSize != nOriginalSize || memcmp(pDecompressedData, pOriginalData, nOriginalSize)) {
+   if (nDecompressedSize != nOriginalSize || memcmp(pDecompressedData + dictionary.size, pOriginalData, nOriginalSize)) {
+      apultra_dictionary_free(&dictionary);
       fprintf(stderr, "error comparing compressed file '%s' with original '%s'\n", pszInFilename, pszOutFilename);
       return 100;
    }
@@ -425,6 +729,7 @@ static int do_compare(const char *pszInFilename, const char *pszOutFilename, con
    free(pDecompressedData);
    free(pOriginalData);
    free(pCompressedData);
+   apultra_dictionary_free(&dictionary);
 
    if (nOptions & OPT_VERBOSE) {
       nEndTime = do_get_time();
@@ -495,90 +800,450 @@ static void xor_data(unsigned char *pBuffer, size_t nBufferSize, unsigned int nS
    }
 }
 
-static int do_self_test(const unsigned int nOptions, const unsigned int nMaxWindowSize, const int nIsQuickTest) {
+static int do_dictionary_self_test(const int nFlags, const unsigned int nMaxWindowSize, const int nThreads, const int nIsQuickTest) {
+   const size_t nMaxDataSize = nIsQuickTest ? 4096 : 65536;
+   const float fMatchProbabilities[4] = { 0.0f, 0.5f, 0.9f, 0.99f };
+   const int nNumLiteralValues[5] = { 1, 2, 15, 96, 256 };
+   const size_t nMaxCompressedDataSize = apultra_get_max_compressed_size(nMaxDataSize);
+   unsigned char *pGeneratedData = (unsigned char*)malloc(nMaxDataSize * 2);
+   unsigned char *pCompressedData = (unsigned char*)malloc(nMaxCompressedDataSize);
+   unsigned char *pIndexedCompressedData = (unsigned char*)malloc(nMaxCompressedDataSize);
+   unsigned char *pDecompressedData = (unsigned char*)malloc(nMaxDataSize * 2);
+   unsigned int nSeed = 456;
+   size_t nDataSize;
+   int nResult = 0;
+   int i, j;
+
+   if (!pGeneratedData || !pCompressedData || !pIndexedCompressedData || !pDecompressedData) {
+      fprintf(stderr, "out of memory, %zd bytes needed\n", nMaxDataSize * 4 + nMaxCompressedDataSize * 2);
+      nResult = 100;
+   }
+
+   /* Compress the second half of generated data, using the first half as the dictionary, with and without a suffix index. Expect
+    * identical output, that decompresses back to the original data */
+   for (nDataSize = 1024; nDataSize <= nMaxDataSize && !nResult; nDataSize <<= 1) {
+      fprintf(stdout, "dictionary size %zd", nDataSize);
+
+      for (i = 0; i < 4 && !nResult; i++) {
+         for (j = 0; j < 5 && !nResult; j++) {
+            apultra_dictionary dictionary;
+            size_t nCompressedSize, nIndexedCompressedSize, nDecompressedSize;
+
+            generate_compressible_data(pGeneratedData, nDataSize * 2, nSeed, nNumLiteralValues[j], fMatchProbabilities[i]);
+
+            memset(&dictionary, 0, sizeof(apultra_dictionary));
+            dictionary.data = pGeneratedData;
+            dictionary.size = (int)nDataSize;
+
+            nCompressedSize = apultra_compress_parallel(pGeneratedData, pCompressedData, nDataSize * 2, nMaxCompressedDataSize, nFlags, nMaxWindowSize, &dictionary, nThreads, NULL, NULL);
+            if (apultra_dictionary_build_index(&dictionary) != 0) {
+               nIndexedCompressedSize = -1;
+            }
+            else {
+               nIndexedCompressedSize = apultra_compress_parallel(pGeneratedData, pIndexedCompressedData, nDataSize * 2, nMaxCompressedDataSize, nFlags, nMaxWindowSize, &dictionary, nThreads, NULL, NULL);
+            }
+            apultra_dictionary_free(&dictionary);
+
+            if (nCompressedSize == -1 || nIndexedCompressedSize != nCompressedSize || memcmp(pCompressedData, pIndexedCompressedData, nCompressedSize)) {
+               fprintf(stderr, "\nself-test: error compressing with dictionary, size %zd, seed %d, match probability %f, literals range %d\n", nDataSize, nSeed, fMatchProbabilities[i], nNumLiteralValues[j]);
+               nResult = 100;
+               break;
+            }
+
+            memset(pDecompressedData, 0, nDataSize * 2);
+            memcpy(pDecompressedData, pGeneratedData, nDataSize);
+            nDecompressedSize = apultra_decompress(pCompressedData, pDecompressedData, nCompressedSize, nDataSize, nDataSize, nFlags);
+            if (nDecompressedSize != nDataSize || memcmp(pDecompressedData, pGeneratedData, nDataSize * 2)) {
+               fprintf(stderr, "\nself-test: error decompressing with dictionary, size %zd, seed %d, match probability %f, literals range %d\n", nDataSize, nSeed, fMatchProbabilities[i], nNumLiteralValues[j]);
+               nResult = 100;
+               break;
+            }
+
+            nSeed++;
+         }
+
+         fputc('.', stdout);
+         fflush(stdout);
+      }
+
+      if (!nResult) {
+         fputc(10, stdout);
+         fflush(stdout);
+      }
+   }
+
+   if (pDecompressedData) free(pDecompressedData);
+   if (pIndexedCompressedData) free(pIndexedCompressedData);
+   if (pCompressedData) free(pCompressedData);
+   if (pGeneratedData) free(pGeneratedData);
+
+   return nResult;
+}
+
+static int do_matchlen_self_test(void) {
+   unsigned char nBuffer1[256], nBuffer2[256];
+   int nKernel, i;
+   int nResult = 0;
+
+   /* Check each match length kernel against a plain byte comparison, for every mismatch position, maximum length and
+    * alignment that the vector loops and their tails can see */
+   for (nKernel = APULTRA_MATCHLEN_SCALAR; nKernel < APULTRA_MATCHLEN_KERNELS && !nResult; nKernel++) {
+      apultra_matchlen_func pMatchLenFunc;
+      int nOffset, nMismatchPos, nMaxLen;
+
+      if (!apultra_is_matchlen_kernel_supported(nKernel))
+         continue;
+
+      fprintf(stdout, "match length kernel %s", apultra_get_matchlen_kernel_name(nKernel));
+      apultra_select_matchlen_kernel(nKernel);
+      pMatchLenFunc = apultra_matchlen_impl;
+
+      for (nOffset = 0; nOffset < 32 && !nResult; nOffset++) {
+         for (nMismatchPos = 0; nMismatchPos <= 96 && !nResult; nMismatchPos++) {
+            for (i = 0; i < 256; i++)
+               nBuffer1[i] = nBuffer2[i] = (unsigned char)(rand() & 0xff);
+            nBuffer2[nOffset + nMismatchPos] ^= (unsigned char)(1 + (rand() % 255));
+
+            for (nMaxLen = 0; nMaxLen <= 96; nMaxLen++) {
+               int nExpectedLen = (nMismatchPos < nMaxLen) ? nMismatchPos : nMaxLen;
+
+               if (pMatchLenFunc(nBuffer1 + nOffset, nBuffer2 + nOffset, nMaxLen) != nExpectedLen) {
+                  fprintf(stderr, "\nself-test: error in match length kernel %s, offset %d, mismatch at %d, max length %d\n",
+                     apultra_get_matchlen_kernel_name(nKernel), nOffset, nMismatchPos, nMaxLen);
+                  nResult = 100;
+                  break;
+               }
+            }
+         }
+
+         if ((nOffset & 7) == 7) {
+            fputc('.', stdout);
+            fflush(stdout);
+         }
+      }
+
+      if (!nResult) {
+         fputc(10, stdout);
+         fflush(stdout);
+      }
+   }
+
+   apultra_select_matchlen_kernel(APULTRA_MATCHLEN_AUTO);
+   return nResult;
+}
+
+static int do_level_self_test(const int nFlags, const unsigned int nMaxWindowSize, const int nIsQuickTest) {
    unsigned char *pGeneratedData;
    unsigned char *pCompressedData;
-   unsigned char *pTmpCompressedData;
    unsigned char *pTmpDecompressedData;
-   size_t nGeneratedDataSize;
-   size_t nMaxCompressedDataSize;
-   unsigned int nSeed = 123;
-   int nFlags;
-   int i;
+   size_t nGeneratedDataSize = nIsQuickTest ? 16384 : (BLOCK_SIZE + 65536);
+   size_t nMaxCompressedDataSize = apultra_get_max_compressed_size(nGeneratedDataSize);
+   unsigned int nSeed = 456;
+   int nLevel;
+   int nResult = 0;
 
-   nFlags = (nOptions & OPT_ENHANCED) ? APULTRA_FLAG_ENHANCED : 0;
+   pGeneratedData = (unsigned char*)malloc(nGeneratedDataSize);
+   pCompressedData = (unsigned char*)malloc(nMaxCompressedDataSize);
+   pTmpDecompressedData = (unsigned char*)malloc(nGeneratedDataSize);
+   if (!pGeneratedData || !pCompressedData || !pTmpDecompressedData) {
+      if (pTmpDecompressedData) free(pTmpDecompressedData);
+      if (pCompressedData) free(pCompressedData);
+      if (pGeneratedData) free(pGeneratedData);
 
-   pGeneratedData = (unsigned char*)malloc(4 * BLOCK_SIZE);
-   if (!pGeneratedData) {
-      fprintf(stderr, "out of memory, %d bytes needed\n", 4 * BLOCK_SIZE);
+      fprintf(stderr, "out of memory, %zd bytes needed\n", nGeneratedDataSize + nMaxCompressedDataSize + nGeneratedDataSize);
       return 100;
    }
 
-   nMaxCompressedDataSize = apultra_get_max_compressed_size(4 * BLOCK_SIZE);
-   pCompressedData = (unsigned char*)malloc(nMaxCompressedDataSize);
-   if (!pCompressedData) {
-      free(pGeneratedData);
-      pGeneratedData = NULL;
+   /* Every level must produce a regular stream that decompresses back to the input */
+   fprintf(stdout, "levels");
+   for (nLevel = APULTRA_MIN_LEVEL; nLevel <= APULTRA_MAX_LEVEL && !nResult; nLevel++) {
+      int nLevelFlags = (nFlags & ~APULTRA_FLAG_LEVEL_MASK) | APULTRA_FLAG_LEVEL(nLevel);
+      float fMatchProbability;
 
-      fprintf(stderr, "out of memory, %zd bytes needed\n", nMaxCompressedDataSize);
-      return 100;
+      for (fMatchProbability = 0.1f; fMatchProbability <= 0.95f && !nResult; fMatchProbability += 0.2f) {
+         size_t nActualCompressedSize, nActualDecompressedSize;
+
+         generate_compressible_data(pGeneratedData, nGeneratedDataSize, nSeed, 56, fMatchProbability);
+
+         nActualCompressedSize = apultra_compress(pGeneratedData, pCompressedData, nGeneratedDataSize, nMaxCompressedDataSize, nLevelFlags, nMaxWindowSize, NULL, NULL, NULL);
+         if (nActualCompressedSize == -1) {
+            fprintf(stderr, "\nself-test: error compressing at level %d, seed %d, match probability %f\n", nLevel, nSeed, fMatchProbability);
+            nResult = 100;
+            break;
+         }
+
+         nActualDecompressedSize = apultra_decompress(pCompressedData, pTmpDecompressedData, nActualCompressedSize, nGeneratedDataSize, 0, nLevelFlags);
+         if (nActualDecompressedSize != nGeneratedDataSize || memcmp(pGeneratedData, pTmpDecompressedData, nGeneratedDataSize)) {
+            fprintf(stderr, "\nself-test: error decompressing level %d output, seed %d, match probability %f\n", nLevel, nSeed, fMatchProbability);
+            nResult = 100;
+            break;
+         }
+
+         nSeed++;
+      }
+
+      fputc('.', stdout);
+      fflush(stdout);
    }
 
-   pTmpCompressedData = (unsigned char*)malloc(nMaxCompressedDataSize);
-   if (!pTmpCompressedData) {
-      free(pCompressedData);
-      pCompressedData = NULL;
-      free(pGeneratedData);
-      pGeneratedData = NULL;
+   if (!nResult) {
+      fputc(10, stdout);
+      fflush(stdout);
+   }
 
-      fprintf(stderr, "out of memory, %zd bytes needed\n", nMaxCompressedDataSize);
+   free(pTmpDecompressedData);
+   free(pCompressedData);
+   free(pGeneratedData);
+   return nResult;
+}
+
+/** Output buffer that the streaming compressor writes to, for self-tests */
+typedef struct {
+   unsigned char *pData;
+   size_t nSize;
+   size_t nCapacity;
+} stream_test_buffer;
+
+static int write_stream_test_data(const unsigned char *pData, size_t nSize, void *pUserData) {
+   stream_test_buffer *pBuffer = (stream_test_buffer *)pUserData;
+
+   if ((pBuffer->nSize + nSize) > pBuffer->nCapacity)
       return 100;
-   }
+   memcpy(pBuffer->pData + pBuffer->nSize, pData, nSize);
+   pBuffer->nSize += nSize;
+   return 0;
+}
 
-   pTmpDecompressedData = (unsigned char*)malloc(4 * BLOCK_SIZE);
-   if (!pTmpDecompressedData) {
-      free(pTmpCompressedData);
-      pTmpCompressedData = NULL;
-      free(pCompressedData);
-      pCompressedData = NULL;
-      free(pGeneratedData);
-      pGeneratedData = NULL;
+static int stream_decompress_test_data(const unsigned char *pCompressedData, size_t nCompressedSize, const size_t nChunkSize, const size_t nWindowSize, const int nFlags,
+   stream_test_buffer *pBuffer) {
+   apultra_stream_decompressor stream;
+   size_t nOffset;
+   int nResult = 0;
 
-      fprintf(stderr, "out of memory, %d bytes needed\n", 4 * BLOCK_SIZE);
+   pBuffer->nSize = 0;
+   if (apultra_stream_decompressor_init(&stream, nWindowSize, NULL, 0, pBuffer->nCapacity, nFlags, write_stream_test_data, pBuffer) != 0)
       return 100;
+
+   for (nOffset = 0; nOffset < nCompressedSize && !nResult; nOffset += nChunkSize) {
+      if (apultra_stream_decompressor_feed(&stream, pCompressedData + nOffset, (nCompressedSize - nOffset) < nChunkSize ? (nCompressedSize - nOffset) : nChunkSize) != 0)
+         nResult = 100;
    }
 
-   memset(pGeneratedData, 0, 4 * BLOCK_SIZE);
-   memset(pCompressedData, 0, nMaxCompressedDataSize);
-   memset(pTmpCompressedData, 0, nMaxCompressedDataSize);
+   if (!nResult && apultra_stream_decompressor_end(&stream) != 0)
+      nResult = 100;
+   apultra_stream_decompressor_destroy(&stream);
+   return nResult;
+}
 
-   /* Test compressing with a too small buffer to do anything, expect to fail cleanly */
-   for (i = 0; i < 12; i++) {
-      generate_compressible_data(pGeneratedData, i, nSeed, 256, 0.5f);
-      apultra_compress(pGeneratedData, pCompressedData, i, i, nFlags, nMaxWindowSize, NULL, NULL);
+static int do_stream_self_test(const int nFlags) {
+   const size_t nGeneratedDataSize = 50000;
+   const size_t nMaxWindowSize = 8192;
+   const size_t nMaxCompressedDataSize = apultra_get_max_compressed_size(nGeneratedDataSize) + 1024;
+   unsigned char *pGeneratedData;
+   unsigned char *pCompressedData;
+   unsigned char *pTmpDecompressedData;
+   stream_test_buffer buffer;
+   unsigned int nSeed = 789;
+   int nFlushInterval;
+   int nResult = 0;
+   int i;
+
+   pGeneratedData = (unsigned char*)malloc(nGeneratedDataSize);
+   pCompressedData = (unsigned char*)malloc(nMaxCompressedDataSize);
+   pTmpDecompressedData = (unsigned char*)malloc(nGeneratedDataSize);
+   buffer.pData = (unsigned char*)malloc(nMaxCompressedDataSize);
+   buffer.nCapacity = nMaxCompressedDataSize;
+   if (!pGeneratedData || !pCompressedData || !pTmpDecompressedData || !buffer.pData) {
+      if (buffer.pData) free(buffer.pData);
+      if (pTmpDecompressedData) free(pTmpDecompressedData);
+      if (pCompressedData) free(pCompressedData);
+      if (pGeneratedData) free(pGeneratedData);
+
+      fprintf(stderr, "out of memory, %zd bytes needed\n", nGeneratedDataSize + nMaxCompressedDataSize + nGeneratedDataSize + nMaxCompressedDataSize);
+      return 100;
    }
 
-   size_t nDataSizeStep = 128;
-   float fProbabilitySizeStep = nIsQuickTest ? 0.005f : 0.0005f;
+   /* Feed data in chunks of random sizes. Without flushes, the stream must be identical to the one-shot compressor's
+    * output; with flushes, it must still decompress back to the input */
+   fprintf(stdout, "stream");
+   for (nFlushInterval = 0; nFlushInterval <= 4 && !nResult; nFlushInterval++) {
+      apultra_stream_compressor stream;
+      size_t nOffset = 0;
+      size_t nActualCompressedSize;
+      int nChunk = 0;
 
-   for (nGeneratedDataSize = 1024; nGeneratedDataSize <= (nIsQuickTest ? 1024 : (4 * BLOCK_SIZE)); nGeneratedDataSize += nDataSizeStep) {
-      float fMatchProbability;
+      generate_compressible_data(pGeneratedData, nGeneratedDataSize, nSeed, 96, 0.6f);
+      srand(nSeed);
 
-      fprintf(stdout, "size %zd", nGeneratedDataSize);
-      for (fMatchProbability = 0; fMatchProbability <= 0.995f; fMatchProbability += fProbabilitySizeStep) {
-         int nNumLiteralValues[12] = { 1, 2, 3, 15, 30, 56, 96, 137, 178, 191, 255, 256 };
-         float fXorProbability;
+      buffer.nSize = 0;
+      if (apultra_stream_compressor_init(&stream, nFlags, nMaxWindowSize, NULL, write_stream_test_data, &buffer) != 0) {
+         fprintf(stderr, "\nself-test: error initializing streaming compressor\n");
+         nResult = 100;
+         break;
+      }
 
-         fputc('.', stdout);
-         fflush(stdout);
+      while (nOffset < nGeneratedDataSize && !nResult) {
+         size_t nChunkSize = 1 + (rand() % 5000);
 
-         for (i = 0; i < 12; i++) {
-            /* Generate data to compress */
-            generate_compressible_data(pGeneratedData, nGeneratedDataSize, nSeed, nNumLiteralValues[i], fMatchProbability);
+         if (nChunkSize > (nGeneratedDataSize - nOffset))
+            nChunkSize = nGeneratedDataSize - nOffset;
+         if (apultra_stream_compressor_feed(&stream, pGeneratedData + nOffset, nChunkSize) != 0)
+            nResult = 100;
+         nOffset += nChunkSize;
+
+         nChunk++;
+         if (nFlushInterval && (nChunk % nFlushInterval) == 0 && !nResult) {
+            if (apultra_stream_compressor_flush(&stream) != 0)
+               nResult = 100;
+         }
+      }
+
+      if (!nResult && apultra_stream_compressor_end(&stream, NULL) != 0)
+         nResult = 100;
+      apultra_stream_compressor_destroy(&stream);
+
+      if (nResult) {
+         fprintf(stderr, "\nself-test: error streaming, seed %d, flush interval %d\n", nSeed, nFlushInterval);
+         break;
+      }
+
+      if (!nFlushInterval) {
+         nActualCompressedSize = apultra_compress(pGeneratedData, pCompressedData, nGeneratedDataSize, nMaxCompressedDataSize, nFlags, nMaxWindowSize, NULL, NULL, NULL);
+         if (nActualCompressedSize != buffer.nSize || memcmp(pCompressedData, buffer.pData, nActualCompressedSize)) {
+            fprintf(stderr, "\nself-test: streamed data differs from compressed data, seed %d\n", nSeed);
+            nResult = 100;
+            break;
+         }
+      }
+
+      if (apultra_decompress(buffer.pData, pTmpDecompressedData, buffer.nSize, nGeneratedDataSize, 0, nFlags) != nGeneratedDataSize ||
+         memcmp(pGeneratedData, pTmpDecompressedData, nGeneratedDataSize)) {
+         fprintf(stderr, "\nself-test: error decompressing streamed data, seed %d, flush interval %d\n", nSeed, nFlushInterval);
+         nResult = 100;
+         break;
+      }
+
+      /* Decompress again in chunks that split commands everywhere, into a ring buffer of the window size */
+      memcpy(pCompressedData, buffer.pData, buffer.nSize);
+      nActualCompressedSize = buffer.nSize;
+      for (i = 1; i <= 4096 && !nResult; i = (i < 8) ? (i + 1) : (i * 8)) {
+         if (stream_decompress_test_data(pCompressedData, nActualCompressedSize, i, nMaxWindowSize, nFlags, &buffer) != 0 ||
+            buffer.nSize != nGeneratedDataSize || memcmp(pGeneratedData, buffer.pData, nGeneratedDataSize)) {
+            fprintf(stderr, "\nself-test: error in streaming decompression, seed %d, flush interval %d, chunk size %d\n", nSeed, nFlushInterval, i);
+            nResult = 100;
+         }
+      }
+      if (nResult)
+         break;
+
+      /* Corrupted data is expected to fail cleanly, or to decompress to something of bounded size */
+      for (i = 0; i < 8 && nActualCompressedSize <= nGeneratedDataSize; i++) {
+         memcpy(pTmpDecompressedData, pCompressedData, nActualCompressedSize);
+         xor_data(pTmpDecompressedData, nActualCompressedSize, nSeed + i, 0.05f * (i + 1));
+         stream_decompress_test_data(pTmpDecompressedData, nActualCompressedSize, 1 + i * 37, nMaxWindowSize, nFlags, &buffer);
+      }
+
+      nSeed++;
+      fputc('.', stdout);
+      fflush(stdout);
+   }
+
+   if (!nResult) {
+      fputc(10, stdout);
+      fflush(stdout);
+   }
+
+   free(buffer.pData);
+   free(pTmpDecompressedData);
+   free(pCompressedData);
+   free(pGeneratedData);
+   return nResult;
+}
+
+static int do_self_test(const unsigned int nOptions, const unsigned int nMaxWindowSize, const int nThreads, const int nIsQuickTest) {
+   unsigned char *pGeneratedData;
+   unsigned char *pCompressedData;
+   unsigned char *pTmpCompressedData;
+   unsigned char *pTmpDecompressedData;
+   size_t nGeneratedDataSize;
+   size_t nMaxCompressedDataSize;
+   unsigned int nSeed = 123;
+   int nFlags;
+   int i;
+
+   nFlags = get_compression_flags(nOptions);
+
+   pGeneratedData = (unsigned char*)malloc(4 * BLOCK_SIZE);
+   if (!pGeneratedData) {
+      fprintf(stderr, "out of memory, %d bytes needed\n", 4 * BLOCK_SIZE);
+      return 100;
+   }
+
+   nMaxCompressedDataSize = apultra_get_max_compressed_size(4 * BLOCK_SIZE);
+   pCompressedData = (unsigned char*)malloc(nMaxCompressedDataSize);
+   if (!pCompressedData) {
+      free(pGeneratedData);
+      pGeneratedData = NULL;
+
+      fprintf(stderr, "out of memory, %zd bytes needed\n", nMaxCompressedDataSize);
+      return 100;
+   }
+
+   pTmpCompressedData = (unsigned char*)malloc(nMaxCompressedDataSize);
+   if (!pTmpCompressedData) {
+      free(pCompressedData);
+      pCompressedData = NULL;
+      free(pGeneratedData);
+      pGeneratedData = NULL;
+
+      fprintf(stderr, "out of memory, %zd bytes needed\n", nMaxCompressedDataSize);
+      return 100;
+   }
+
+   pTmpDecompressedData = (unsigned char*)malloc(4 * BLOCK_SIZE);
+   if (!pTmpDecompressedData) {
+      free(pTmpCompressedData);
+      pTmpCompressedData = NULL;
+      free(pCompressedData);
+      pCompressedData = NULL;
+      free(pGeneratedData);
+      pGeneratedData = NULL;
+
+      fprintf(stderr, "out of memory, %d bytes needed\n", 4 * BLOCK_SIZE);
+      return 100;
+   }
+
+   memset(pGeneratedData, 0, 4 * BLOCK_SIZE);
+   memset(pCompressedData, 0, nMaxCompressedDataSize);
+   memset(pTmpCompressedData, 0, nMaxCompressedDataSize);
+
+   /* Test compressing with a too small buffer to do anything, expect to fail cleanly */
+   for (i = 0; i < 12; i++) {
+      generate_compressible_data(pGeneratedData, i, nSeed, 256, 0.5f);
+      apultra_compress(pGeneratedData, pCompressedData, i, i, nFlags, nMaxWindowSize, NULL, NULL, NULL);
+   }
+
+   size_t nDataSizeStep = 128;
+   float fProbabilitySizeStep = nIsQuickTest ? 0.005f : 0.0005f;
+
+   for (nGeneratedDataSize = 1024; nGeneratedDataSize <= (nIsQuickTest ? 1024 : (4 * BLOCK_SIZE)); nGeneratedDataSize += nDataSizeStep) {
+      float fMatchProbability;
+
+      fprintf(stdout, "size %zd", nGeneratedDataSize);
+      for (fMatchProbability = 0; fMatchProbability <= 0.995f; fMatchProbability += fProbabilitySizeStep) {
+         int nNumLiteralValues[12] = { 1, 2, 3, 15, 30, 56, 96, 137, 178, 191, 255, 256 };
+         float fXorProbability;
+
+         fputc('.', stdout);
+         fflush(stdout);
+
+         for (i = 0; i < 12; i++) {
+            /* Generate data to compress */
+            generate_compressible_data(pGeneratedData, nGeneratedDataSize, nSeed, nNumLiteralValues[i], fMatchProbability);
 
             /* Try to compress it, expected to succeed */
-            size_t nActualCompressedSize = apultra_compress(pGeneratedData, pCompressedData, nGeneratedDataSize, apultra_get_max_compressed_size(nGeneratedDataSize),
-               nFlags, nMaxWindowSize, NULL, NULL);
+            size_t nActualCompressedSize = apultra_compress_parallel(pGeneratedData, pCompressedData, nGeneratedDataSize, apultra_get_max_compressed_size(nGeneratedDataSize),
+               nFlags, nMaxWindowSize, NULL, nThreads, NULL, NULL);
             if (nActualCompressedSize == -1 || nActualCompressedSize < (1 + 1 + 1 /* footer */)) {
                free(pTmpDecompressedData);
                pTmpDecompressedData = NULL;
@@ -595,7 +1260,7 @@ static int do_self_test(const unsigned int nOptions, const unsigned int nMaxWind
 
             /* Try to decompress it, expected to succeed */
             size_t nActualDecompressedSize;
-            nActualDecompressedSize = apultra_decompress(pCompressedData, pTmpDecompressedData, nActualCompressedSize, nGeneratedDataSize, nFlags);
+            nActualDecompressedSize = apultra_decompress(pCompressedData, pTmpDecompressedData, nActualCompressedSize, nGeneratedDataSize, 0, nFlags);
             if (nActualDecompressedSize == -1) {
                free(pTmpDecompressedData);
                pTmpDecompressedData = NULL;
@@ -628,7 +1293,7 @@ static int do_self_test(const unsigned int nOptions, const unsigned int nMaxWind
             for (fXorProbability = 0.05f; fXorProbability <= 0.5f; fXorProbability += 0.05f) {
                memcpy(pTmpCompressedData, pCompressedData, nActualCompressedSize);
                xor_data(pTmpCompressedData, nActualCompressedSize, nSeed, fXorProbability);
-               apultra_decompress(pTmpCompressedData, pGeneratedData, nActualCompressedSize, nGeneratedDataSize, nFlags);
+               apultra_decompress(pTmpCompressedData, pGeneratedData, nActualCompressedSize, nGeneratedDataSize, 0, nFlags);
             }
          }
 
@@ -658,20 +1323,32 @@ static int do_self_test(const unsigned int nOptions, const unsigned int nMaxWind
    free(pGeneratedData);
    pGeneratedData = NULL;
 
+   if (do_dictionary_self_test(nFlags, nMaxWindowSize, nThreads, nIsQuickTest) != 0)
+      return 100;
+
+   if (do_matchlen_self_test() != 0)
+      return 100;
+
+   if (do_level_self_test(nFlags, nMaxWindowSize, nIsQuickTest) != 0)
+      return 100;
+
+   if (do_stream_self_test(nFlags) != 0)
+      return 100;
+
    fprintf(stdout, "All tests passed.\n");
    return 0;
 }
 
 /*---------------------------------------------------------------------------*/
 
-static int do_compr_benchmark(const char *pszInFilename, const char *pszOutFilename, const char *pszDictionaryFilename, const unsigned int nOptions, const unsigned int nMaxWindowSize) {
+static int do_compr_benchmark(const char *pszInFilename, const char *pszOutFilename, const char *pszDictionaryFilename, const unsigned int nOptions, const unsigned int nMaxWindowSize, const int nThreads) {
    size_t nFileSize, nMaxCompressedSize;
    unsigned char *pFileData;
    unsigned char *pCompressedData;
    int nFlags;
    int i;
 
-   nFlags = (nOptions & OPT_ENHANCED) ? APULTRA_FLAG_ENHANCED : 0;
+   nFlags = get_compression_flags(nOptions);
 
    if (pszDictionaryFilename) {
       fprintf(stderr, "in-memory benchmarking does not support dictionaries\n");
@@ -733,7 +1410,7 @@ static int do_compr_benchmark(const char *pszInFilename, const char *pszOutFilen
       memset(pCompressedData + 1024 + nRightGuardPos, nGuard, 1024);
 
       long long t0 = do_get_time();
-      nActualCompressedSize = apultra_compress(pFileData, pCompressedData + 1024, nFileSize, nRightGuardPos, nFlags, nMaxWindowSize, NULL, NULL);
+      nActualCompressedSize = apultra_compress_parallel(pFileData, pCompressedData + 1024, nFileSize, nRightGuardPos, nFlags, nMaxWindowSize, NULL, nThreads, NULL, NULL);
       long long t1 = do_get_time();
       if (nActualCompressedSize == -1) {
          free(pCompressedData);
@@ -784,6 +1461,7 @@ static int do_compr_benchmark(const char *pszInFilename, const char *pszOutFilen
    free(pCompressedData);
    free(pFileData);
 
+   fprintf(stdout, "compression level: %d\n", ((nFlags & APULTRA_FLAG_LEVEL_MASK) >> APULTRA_FLAG_LEVEL_SHIFT) ? ((nFlags & APULTRA_FLAG_LEVEL_MASK) >> APULTRA_FLAG_LEVEL_SHIFT) : APULTRA_MAX_LEVEL);
    fprintf(stdout, "compressed size: %zd bytes\n", nActualCompressedSize);
    fprintf(stdout, "compression time: %lld microseconds (%g Mb/s)\n", nBestCompTime, ((double)nActualCompressedSize / 1024.0) / ((double)nBestCompTime / 1000.0));
 
@@ -799,7 +1477,7 @@ static int do_dec_benchmark(const char *pszInFilename, const char *pszOutFilenam
    int nFlags;
    int i;
 
-   nFlags = (nOptions & OPT_ENHANCED) ? APULTRA_FLAG_ENHANCED : 0;
+   nFlags = get_compression_flags(nOptions);
 
    if (pszDictionaryFilename) {
       fprintf(stderr, "in-memory benchmarking does not support dictionaries\n");
@@ -857,7 +1535,7 @@ static int do_dec_benchmark(const char *pszInFilename, const char *pszOutFilenam
    size_t nActualDecompressedSize = 0;
    for (i = 0; i < 50; i++) {
       long long t0 = do_get_time();
-      nActualDecompressedSize = apultra_decompress(pFileData, pDecompressedData, nFileSize, nMaxDecompressedSize, nFlags);
+      nActualDecompressedSize = apultra_decompress(pFileData, pDecompressedData, nFileSize, nMaxDecompressedSize, 0, nFlags);
       long long t1 = do_get_time();
       if (nActualDecompressedSize == -1) {
          free(pDecompressedData);
@@ -894,19 +1572,779 @@ static int do_dec_benchmark(const char *pszInFilename, const char *pszOutFilenam
 
 /*---------------------------------------------------------------------------*/
 
+/** One input => output pair listed in a batch manifest */
+typedef struct {
+   char *pszInFilename;
+   char *pszOutFilename;
+   size_t nOriginalSize;
+   size_t nCompressedSize;
+   long long nCompressionTime;
+   int nResult;
+} batch_entry;
+
+/** State shared by all batch worker threads */
+typedef struct {
+   batch_entry *pEntries;
+   int nNumEntries;
+   int nNextEntry;
+   unsigned int nOptions;
+   unsigned int nMaxWindowSize;
+   int nVerifyCompression;
+   const apultra_dictionary *pDictionary;
+   const char *pszCacheDir;
+   apultra_mutex_t lock;
+} batch_state;
+
+/** One batch worker thread, with its own compression context */
+typedef struct {
+   batch_state *pState;
+   apultra_compressor compressor;
+   apultra_thread_t thread;
+} batch_worker;
+
+static unsigned char *read_whole_file(const char *pszFilename, size_t nReserveSize, size_t *pnSize) {
+   unsigned char *pData;
+   size_t nSize;
+
+   FILE *f_in = fopen(pszFilename, "rb");
+   if (!f_in) {
+      fprintf(stderr, "error opening '%s' for reading\n", pszFilename);
+      return NULL;
+   }
+
+   fseek(f_in, 0, SEEK_END);
+   nSize = (size_t)ftell(f_in);
+   fseek(f_in, 0, SEEK_SET);
+
+   pData = (unsigned char*)malloc((nReserveSize + nSize) ? (nReserveSize + nSize) : 1);
+   if (!pData) {
+      fclose(f_in);
+      fprintf(stderr, "out of memory for reading '%s', %zd bytes needed\n", pszFilename, nReserveSize + nSize);
+      return NULL;
+   }
+
+   if (fread(pData + nReserveSize, 1, nSize, f_in) != nSize) {
+      free(pData);
+      fclose(f_in);
+      fprintf(stderr, "I/O error while reading '%s'\n", pszFilename);
+      return NULL;
+   }
+
+   fclose(f_in);
+
+   *pnSize = nSize;
+   return pData;
+}
+
+static int do_batch_entry(batch_state *pState, apultra_compressor *pCompressor, batch_entry *pEntry) {
+   size_t nOriginalSize = 0L, nCompressedSize, nMaxCompressedSize;
+   const size_t nDictionarySize = pState->pDictionary ? (size_t)pState->pDictionary->size : 0;
+   unsigned char cCacheKey[APULTRA_CACHE_KEY_SIZE];
+   unsigned char *pDecompressedData;
+   unsigned char *pCompressedData = NULL;
+   int nFlags;
+
+   nFlags = get_compression_flags(pState->nOptions);
+
+   /* Read file after the dictionary */
+   pDecompressedData = read_whole_file(pEntry->pszInFilename, nDictionarySize, &nOriginalSize);
+   if (!pDecompressedData)
+      return 100;
+   if (nDictionarySize)
+      memcpy(pDecompressedData, pState->pDictionary->data, nDictionarySize);
+
+   long long t0 = do_get_time();
+
+   if (pState->pszCacheDir) {
+      /* Each file is compressed on a single thread */
+      apultra_cache_get_key(pDecompressedData, nDictionarySize + nOriginalSize, nDictionarySize, nFlags, pState->nMaxWindowSize, 1, TOOL_VERSION, cCacheKey);
+      pCompressedData = apultra_cache_lookup(pState->pszCacheDir, cCacheKey, &nCompressedSize);
+   }
+
+   if (!pCompressedData) {
+      nMaxCompressedSize = apultra_get_max_compressed_size(nOriginalSize);
+
+      pCompressedData = (unsigned char*)malloc(nMaxCompressedSize);
+      if (!pCompressedData) {
+         free(pDecompressedData);
+         fprintf(stderr, "out of memory for compressing '%s', %zd bytes needed\n", pEntry->pszInFilename, nMaxCompressedSize);
+         return 100;
+      }
+
+      memset(pCompressedData, 0, nMaxCompressedSize);
+
+      nCompressedSize = apultra_compress_with_context(pCompressor, pDecompressedData, pCompressedData, nDictionarySize + nOriginalSize, nMaxCompressedSize, nFlags, pState->nMaxWindowSize,
+         pState->pDictionary, NULL, NULL);
+
+      if (nCompressedSize == -1) {
+         free(pCompressedData);
+         free(pDecompressedData);
+         fprintf(stderr, "compression error for '%s'\n", pEntry->pszInFilename);
+         return 100;
+      }
+
+      if (pState->pszCacheDir) {
+         if (apultra_cache_store(pState->pszCacheDir, cCacheKey, pCompressedData, nCompressedSize) != 0)
+            fprintf(stderr, "warning: couldn't store '%s' in cache '%s'\n", pEntry->pszInFilename, pState->pszCacheDir);
+      }
+   }
+
+   long long t1 = do_get_time();
+
+   if (pState->nVerifyCompression) {
+      unsigned char *pCheckData = (unsigned char*)malloc((nDictionarySize + nOriginalSize) ? (nDictionarySize + nOriginalSize) : 1);
+
+      if (pCheckData)
+         memcpy(pCheckData, pDecompressedData, nDictionarySize);
+      if (!pCheckData ||
+         apultra_decompress(pCompressedData, pCheckData, nCompressedSize, nOriginalSize, nDictionarySize, nFlags) != nOriginalSize ||
+         memcmp(pCheckData + nDictionarySize, pDecompressedData + nDictionarySize, nOriginalSize)) {
+         if (pCheckData)
+            free(pCheckData);
+         free(pCompressedData);
+         free(pDecompressedData);
+         fprintf(stderr, "error comparing compressed file '%s' with original '%s'\n", pEntry->pszOutFilename, pEntry->pszInFilename);
+         return 100;
+      }
+
+      free(pCheckData);
+   }
+
+   FILE *f_out = fopen(pEntry->pszOutFilename, "wb");
+   if (!f_out || fwrite(pCompressedData, 1, nCompressedSize, f_out) != nCompressedSize) {
+      if (f_out)
+         fclose(f_out);
+      free(pCompressedData);
+      free(pDecompressedData);
+      fprintf(stderr, "error writing '%s'\n", pEntry->pszOutFilename);
+      return 100;
+   }
+   fclose(f_out);
+
+   free(pCompressedData);
+   free(pDecompressedData);
+
+   pEntry->nOriginalSize = nOriginalSize;
+   pEntry->nCompressedSize = nCompressedSize;
+   pEntry->nCompressionTime = t1 - t0;
+   return 0;
+}
+
+static APULTRA_THREAD_PROC(batch_worker_proc, pArg) {
+   batch_worker *pWorker = (batch_worker *)pArg;
+   batch_state *pState = pWorker->pState;
+
+   while (1) {
+      int nEntry;
+
+      apultra_mutex_lock(&pState->lock);
+      nEntry = pState->nNextEntry;
+      if (nEntry < pState->nNumEntries)
+         pState->nNextEntry++;
+      apultra_mutex_unlock(&pState->lock);
+
+      if (nEntry >= pState->nNumEntries)
+         break;
+
+      pState->pEntries[nEntry].nResult = do_batch_entry(pState, &pWorker->compressor, &pState->pEntries[nEntry]);
+   }
+
+   APULTRA_THREAD_RETURN;
+}
+
+static char *get_manifest_field(char **ppszCur) {
+   char *pszCur = *ppszCur;
+   char *pszField;
+
+   while (*pszCur == ' ' || *pszCur == '\t')
+      pszCur++;
+   if (*pszCur == 0)
+      return NULL;
+
+   if (*pszCur == '"') {
+      /* Quoted filename, may contain spaces */
+      pszField = ++pszCur;
+      while (*pszCur && *pszCur != '"')
+         pszCur++;
+      if (*pszCur != '"')
+         return NULL;
+   }
+   else {
+      pszField = pszCur;
+      while (*pszCur && *pszCur != ' ' && *pszCur != '\t')
+         pszCur++;
+   }
+
+   if (*pszCur)
+      *pszCur++ = 0;
+   *ppszCur = pszCur;
+   return pszField;
+}
+
+static int do_batch(const char *pszManifestFilename, const char *pszDictionaryFilename, const char *pszCacheDir, const unsigned int nOptions, const unsigned int nMaxWindowSize, const int nThreads, const int nVerifyCompression) {
+   batch_state state;
+   batch_worker *pWorkers;
+   apultra_dictionary dictionary;
+   char szLine[4096];
+   int nMaxEntries = 0;
+   int nNumWorkers;
+   int nErrors = 0;
+   int nFailedEntries = 0;
+   int i;
+
+   /* Load the dictionary and sort its suffixes once, for all files, unless it was loaded from an index file */
+   if (do_load_dictionary(pszDictionaryFilename, &dictionary) != 0)
+      return 100;
+   if (pszDictionaryFilename && apultra_dictionary_build_index(&dictionary) != 0) {
+      apultra_dictionary_free(&dictionary);
+      fprintf(stderr, "out of memory for indexing dictionary '%s'\n", pszDictionaryFilename);
+      return 100;
+   }
+
+   /* Read manifest: one "<infile> <outfile>" pair per line, blank lines and lines starting with '#' are ignored */
+
+   FILE *f_in = fopen(pszManifestFilename, "r");
+   if (!f_in) {
+      apultra_dictionary_free(&dictionary);
+      fprintf(stderr, "error opening '%s' for reading\n", pszManifestFilename);
+      return 100;
+   }
+
+   memset(&state, 0, sizeof(state));
+   state.nOptions = nOptions;
+   state.nMaxWindowSize = nMaxWindowSize;
+   state.nVerifyCompression = nVerifyCompression;
+   state.pDictionary = pszDictionaryFilename ? &dictionary : NULL;
+   state.pszCacheDir = pszCacheDir;
+
+   while (fgets(szLine, sizeof(szLine), f_in)) {
+      char *pszCur = szLine;
+      char *pszEnd = szLine + strlen(szLine);
+      char *pszIn, *pszOut;
+
+      while (pszEnd > szLine && (pszEnd[-1] == '\n' || pszEnd[-1] == '\r'))
+         *--pszEnd = 0;
+
+      pszIn = get_manifest_field(&pszCur);
+      if (!pszIn || *pszIn == '#')
+         continue;
+
+      pszOut = get_manifest_field(&pszCur);
+      if (!pszOut || get_manifest_field(&pszCur)) {
+         fprintf(stderr, "invalid line in manifest '%s': %s\n", pszManifestFilename, pszIn);
+         nErrors++;
+         break;
+      }
+
+      if (state.nNumEntries == nMaxEntries) {
+         batch_entry *pNewEntries;
+
+         nMaxEntries = nMaxEntries ? (nMaxEntries * 2) : 64;
+         pNewEntries = (batch_entry*)realloc(state.pEntries, nMaxEntries * sizeof(batch_entry));
+         if (!pNewEntries) {
+            fprintf(stderr, "out of memory for reading '%s'\n", pszManifestFilename);
+            nErrors++;
+            break;
+         }
+         state.pEntries = pNewEntries;
+      }
+
+      memset(&state.pEntries[state.nNumEntries], 0, sizeof(batch_entry));
+      state.pEntries[state.nNumEntries].pszInFilename = strdup(pszIn);
+      state.pEntries[state.nNumEntries].pszOutFilename = strdup(pszOut);
+      state.pEntries[state.nNumEntries].nResult = 100;
+      state.nNumEntries++;
+   }
+
+   fclose(f_in);
+
+   /* Compress all files, each worker thread keeps its compression context from one file to the next */
+
+   nNumWorkers = (nThreads > 0) ? nThreads : apultra_get_num_cpus();
+   if (nNumWorkers > state.nNumEntries)
+      nNumWorkers = state.nNumEntries;
+
+   pWorkers = (batch_worker*)calloc(nNumWorkers ? nNumWorkers : 1, sizeof(batch_worker));
+   if (!pWorkers) {
+      fprintf(stderr, "out of memory for compressing '%s'\n", pszManifestFilename);
+      nErrors++;
+   }
+
+   long long nStartTime = do_get_time();
+
+   if (!nErrors && nNumWorkers) {
+      int nNumStarted = 0;
+
+      apultra_mutex_init(&state.lock);
+
+      for (i = 0; i < nNumWorkers; i++) {
+         /* Start with the smallest context, it grows to fit the largest file compressed by this worker */
+         if (apultra_compressor_init(&pWorkers[i].compressor, 1024, 2048, 0) != 0) {
+            fprintf(stderr, "out of memory for compressing '%s'\n", pszManifestFilename);
+            nErrors++;
+            break;
+         }
+         pWorkers[i].pState = &state;
+         nNumStarted++;
+      }
+
+      if (!nErrors) {
+         for (i = 1; i < nNumWorkers; i++) {
+            if (apultra_thread_create(&pWorkers[i].thread, batch_worker_proc, &pWorkers[i]) != 0)
+               break;
+         }
+
+         /* The calling thread is the first worker; if some threads couldn't be started, the others pick up their files */
+         nNumWorkers = i;
+         batch_worker_proc(&pWorkers[0]);
+
+         for (i = 1; i < nNumWorkers; i++) {
+            apultra_thread_join(&pWorkers[i].thread);
+         }
+      }
+
+      for (i = 0; i < nNumStarted; i++) {
+         apultra_compressor_destroy(&pWorkers[i].compressor);
+      }
+
+      apultra_mutex_destroy(&state.lock);
+   }
+
+   long long nEndTime = do_get_time();
+
+   /* Report, in manifest order */
+
+   size_t nTotalOriginalSize = 0L, nTotalCompressedSize = 0L;
+
+   for (i = 0; i < state.nNumEntries; i++) {
+      const batch_entry *pEntry = &state.pEntries[i];
+
+      if (pEntry->nResult == 0) {
+         fprintf(stdout, "'%s' => '%s': %zd into %zd bytes ==> %g %% in %g seconds\n",
+            pEntry->pszInFilename, pEntry->pszOutFilename, pEntry->nOriginalSize, pEntry->nCompressedSize,
+            pEntry->nOriginalSize ? (double)(pEntry->nCompressedSize * 100.0 / pEntry->nOriginalSize) : 0.0,
+            ((double)pEntry->nCompressionTime) / 1000000.0);
+         nTotalOriginalSize += pEntry->nOriginalSize;
+         nTotalCompressedSize += pEntry->nCompressedSize;
+      }
+      else {
+         fprintf(stdout, "'%s' => '%s': failed\n", pEntry->pszInFilename, pEntry->pszOutFilename);
+         nFailedEntries++;
+      }
+
+      free(pEntry->pszInFilename);
+      free(pEntry->pszOutFilename);
+   }
+
+   fprintf(stdout, "Compressed %d files on %d threads in %g seconds, %zd into %zd bytes ==> %g %%\n",
+      state.nNumEntries - nFailedEntries, nNumWorkers, ((double)(nEndTime - nStartTime)) / 1000000.0, nTotalOriginalSize, nTotalCompressedSize,
+      nTotalOriginalSize ? (double)(nTotalCompressedSize * 100.0 / nTotalOriginalSize) : 0.0);
+
+   if (pWorkers)
+      free(pWorkers);
+   if (state.pEntries)
+      free(state.pEntries);
+   apultra_dictionary_free(&dictionary);
+
+   return (nErrors || nFailedEntries) ? 100 : 0;
+}
+
+/*---------------------------------------------------------------------------*/
+
+static int do_index_dictionary(const char *pszDictionaryFilename, const char *pszIndexFilename, const unsigned int nOptions) {
+   long long nStartTime = 0LL, nEndTime = 0LL;
+   apultra_dictionary dictionary;
+
+   if (nOptions & OPT_VERBOSE) {
+      nStartTime = do_get_time();
+   }
+
+   if (do_load_dictionary(pszDictionaryFilename, &dictionary) != 0)
+      return 100;
+
+   if (apultra_dictionary_build_index(&dictionary) != 0) {
+      apultra_dictionary_free(&dictionary);
+      fprintf(stderr, "out of memory for indexing dictionary '%s'\n", pszDictionaryFilename);
+      return 100;
+   }
+
+   if (apultra_dictionary_save_index(&dictionary, pszIndexFilename) != 0) {
+      apultra_dictionary_free(&dictionary);
+      fprintf(stderr, "error writing '%s'\n", pszIndexFilename);
+      return 100;
+   }
+
+   if (nOptions & OPT_VERBOSE) {
+      nEndTime = do_get_time();
+      fprintf(stdout, "Indexed dictionary '%s' in %g seconds, %d bytes\n",
+         pszDictionaryFilename, ((double)(nEndTime - nStartTime)) / 1000000.0, dictionary.size);
+   }
+
+   apultra_dictionary_free(&dictionary);
+   return 0;
+}
+
+/*---------------------------------------------------------------------------*/
+
+/** Number of runs of each kernel benchmark phase; the fastest one is kept */
+#define KERNEL_BENCH_RUNS 3
+
+/** Maximum number of candidate matches per position, to extend against each other */
+#define KERNEL_BENCH_MATCHES 8
+
+/** Results of running one match length kernel */
+typedef struct {
+   long long nSuffixArrayTime;
+   long long nExtendTime;
+   long long nCompressTime;
+   long long nNumExtensions;
+   long long nExtendedLen;
+   size_t nCompressedSize;
+} kernel_bench_result;
+
+static int do_kernel_benchmark_phases(apultra_compressor *pCompressor, const unsigned char *pFileData, const size_t nFileSize, const int nBlockSize, unsigned char *pCompressedData, const size_t nMaxCompressedSize,
+   const int nFlags, const unsigned int nMaxWindowSize, kernel_bench_result *pResult) {
+   int nRun;
+
+   pResult->nSuffixArrayTime = -1;
+   pResult->nExtendTime = -1;
+   pResult->nCompressTime = -1;
+
+   for (nRun = 0; nRun < KERNEL_BENCH_RUNS; nRun++) {
+      long long nSuffixArrayTime = 0, nExtendTime = 0;
+      size_t nOriginalSize = 0;
+      int nPreviousBlockSize = 0;
+
+      pResult->nNumExtensions = 0;
+      pResult->nExtendedLen = 0;
+
+      /* Walk the file in the same windows as the compressor: previous block followed by the block to compress */
+      while (nOriginalSize < nFileSize) {
+         const unsigned char *pInWindow = pFileData + nOriginalSize - nPreviousBlockSize;
+         int nInDataSize = (int)(nFileSize - nOriginalSize);
+         int i;
+
+         if (nInDataSize > nBlockSize)
+            nInDataSize = nBlockSize;
+         const int nEndOffset = nPreviousBlockSize + nInDataSize;
+
+         /* Suffix array and LCP phase */
+         long long t0 = do_get_time();
+         if (apultra_build_suffix_array(pCompressor, pInWindow, nEndOffset, NULL) != 0)
+            return 100;
+         nSuffixArrayTime += do_get_time() - t0;
+
+         if (nPreviousBlockSize)
+            apultra_skip_matches(pCompressor, 0, nPreviousBlockSize);
+         apultra_find_all_matches(pCompressor, NMATCHES_PER_INDEX, NMATCHES_PER_INDEX, nPreviousBlockSize, nEndOffset, (nOriginalSize + nInDataSize) >= nFileSize ? 2 : 0);
+
+         /* Match extension phase: extend each candidate match offset against the others at the same position, as the
+          * optimizer does for rep-matches */
+         t0 = do_get_time();
+         for (i = nPreviousBlockSize; i < nEndOffset; i++) {
+            const apultra_match *pMatch = pCompressor->match + ((i - nPreviousBlockSize) << MATCHES_PER_INDEX_SHIFT);
+            int nMaxLen = nEndOffset - i;
+            int m, n;
+
+            if (nMaxLen > LCP_MAX)
+               nMaxLen = LCP_MAX;
+
+            for (m = 0; m < KERNEL_BENCH_MATCHES && pMatch[m].length; m++) {
+               for (n = m + 1; n < KERNEL_BENCH_MATCHES && pMatch[n].length; n++) {
+                  pResult->nExtendedLen += apultra_get_match_len(pInWindow + i - pMatch[m].offset, pInWindow + i - pMatch[n].offset, nMaxLen);
+                  pResult->nNumExtensions++;
+               }
+            }
+         }
+         nExtendTime += do_get_time() - t0;
+
+         nOriginalSize += nInDataSize;
+         nPreviousBlockSize = nInDataSize;
+      }
+
+      /* Whole compression */
+      long long t0 = do_get_time();
+      pResult->nCompressedSize = apultra_compress_with_context(pCompressor, pFileData, pCompressedData, nFileSize, nMaxCompressedSize, nFlags, nMaxWindowSize, NULL, NULL, NULL);
+      long long nCompressTime = do_get_time() - t0;
+      if (pResult->nCompressedSize == -1)
+         return 100;
+
+      if (pResult->nSuffixArrayTime == -1 || pResult->nSuffixArrayTime > nSuffixArrayTime)
+         pResult->nSuffixArrayTime = nSuffixArrayTime;
+      if (pResult->nExtendTime == -1 || pResult->nExtendTime > nExtendTime)
+         pResult->nExtendTime = nExtendTime;
+      if (pResult->nCompressTime == -1 || pResult->nCompressTime > nCompressTime)
+         pResult->nCompressTime = nCompressTime;
+   }
+
+   return 0;
+}
+
+static void do_print_kernel_phase(const char *pszPhase, const long long nTime, const long long nScalarTime) {
+   fprintf(stdout, "  %-16s %10lld microseconds", pszPhase, nTime);
+   if (nTime > 0 && nScalarTime > 0)
+      fprintf(stdout, " (%.2fx scalar)", (double)nScalarTime / (double)nTime);
+   fputc(10, stdout);
+}
+
+static int do_kernel_benchmark(const char *pszInFilename, const char *pszOutFilename, const char *pszDictionaryFilename, const unsigned int nOptions, const unsigned int nMaxWindowSize) {
+   kernel_bench_result scalarResult = { 0 };
+   apultra_compressor compressor;
+   size_t nFileSize, nMaxCompressedSize;
+   unsigned char *pFileData;
+   unsigned char *pCompressedData;
+   int nFlags, nBlockSize, nKernel;
+   int nResult = 0;
+
+   nFlags = get_compression_flags(nOptions);
+
+   if (pszDictionaryFilename) {
+      fprintf(stderr, "in-memory benchmarking does not support dictionaries\n");
+      return 100;
+   }
+
+   pFileData = read_whole_file(pszInFilename, 0, &nFileSize);
+   if (!pFileData)
+      return 100;
+
+   nMaxCompressedSize = apultra_get_max_compressed_size(nFileSize);
+   pCompressedData = (unsigned char*)malloc(nMaxCompressedSize);
+   if (!pCompressedData) {
+      free(pFileData);
+      fprintf(stderr, "out of memory for compressing '%s', %zd bytes needed\n", pszInFilename, nMaxCompressedSize);
+      return 100;
+   }
+
+   nBlockSize = (nFileSize < BLOCK_SIZE) ? (int)nFileSize : BLOCK_SIZE;
+   if (nBlockSize < 1)
+      nBlockSize = 1;
+   if (apultra_compressor_init(&compressor, nBlockSize, nBlockSize * 2, nFlags) != 0) {
+      free(pCompressedData);
+      free(pFileData);
+      fprintf(stderr, "out of memory for compressing '%s'\n", pszInFilename);
+      return 100;
+   }
+
+   const int nDefaultKernel = apultra_get_matchlen_kernel();
+
+   fprintf(stdout, "match length kernels on '%s', %zd bytes, fastest of %d runs:\n", pszInFilename, nFileSize, KERNEL_BENCH_RUNS);
+
+   for (nKernel = APULTRA_MATCHLEN_SCALAR; nKernel < APULTRA_MATCHLEN_KERNELS && !nResult; nKernel++) {
+      kernel_bench_result result;
+
+      if (!apultra_is_matchlen_kernel_supported(nKernel)) {
+         fprintf(stdout, "%s: not supported on this CPU\n", apultra_get_matchlen_kernel_name(nKernel));
+         continue;
+      }
+
+      apultra_select_matchlen_kernel(nKernel);
+      if (do_kernel_benchmark_phases(&compressor, pFileData, nFileSize, nBlockSize, pCompressedData, nMaxCompressedSize, nFlags, nMaxWindowSize, &result) != 0) {
+         fprintf(stderr, "compression error\n");
+         nResult = 100;
+         break;
+      }
+
+      if (nKernel == APULTRA_MATCHLEN_SCALAR) {
+         scalarResult = result;
+
+         if (pszOutFilename) {
+            FILE *f_out;
+
+            /* Write whole compressed file out */
+
+            f_out = fopen(pszOutFilename, "wb");
+            if (f_out) {
+               fwrite(pCompressedData, 1, result.nCompressedSize, f_out);
+               fclose(f_out);
+            }
+         }
+      }
+      else if (result.nExtendedLen != scalarResult.nExtendedLen || result.nCompressedSize != scalarResult.nCompressedSize) {
+         fprintf(stderr, "error, %s kernel results differ from scalar kernel\n", apultra_get_matchlen_kernel_name(nKernel));
+         nResult = 100;
+         break;
+      }
+
+      fprintf(stdout, "%s%s:\n", apultra_get_matchlen_kernel_name(nKernel), (nKernel == nDefaultKernel) ? " (default)" : "");
+      do_print_kernel_phase("suffix array:", result.nSuffixArrayTime, (nKernel != APULTRA_MATCHLEN_SCALAR) ? scalarResult.nSuffixArrayTime : 0);
+      do_print_kernel_phase("match extension:", result.nExtendTime, (nKernel != APULTRA_MATCHLEN_SCALAR) ? scalarResult.nExtendTime : 0);
+      do_print_kernel_phase("compression:", result.nCompressTime, (nKernel != APULTRA_MATCHLEN_SCALAR) ? scalarResult.nCompressTime : 0);
+   }
+
+   if (!nResult)
+      fprintf(stdout, "compressed size: %zd bytes, %lld match extensions of %lld bytes\n", scalarResult.nCompressedSize, scalarResult.nNumExtensions, scalarResult.nExtendedLen);
+
+   apultra_select_matchlen_kernel(nDefaultKernel);
+   apultra_compressor_destroy(&compressor);
+   free(pCompressedData);
+   free(pFileData);
+
+   return nResult;
+}
+
+/*---------------------------------------------------------------------------*/
+
+/** Totals and output stream for -profile */
+typedef struct {
+   FILE *f_out;
+   int nNumBlocks;
+   long long nWallTime[APULTRA_NUM_PHASES];
+   long long nCPUTime[APULTRA_NUM_PHASES];
+   size_t nAllocSize;
+   long long nArrivalsVisited;
+   long long nMatchesConsidered;
+} profile_state;
+
+static void do_write_json_string(FILE *f_out, const char *pszValue) {
+   fputc('"', f_out);
+   while (*pszValue) {
+      const unsigned char c = (unsigned char)*pszValue++;
+
+      if (c == '"' || c == '\\')
+         fprintf(f_out, "\\%c", c);
+      else if (c < 0x20)
+         fprintf(f_out, "\\u%04x", c);
+      else
+         fputc(c, f_out);
+   }
+   fputc('"', f_out);
+}
+
+static void do_write_json_phases(FILE *f_out, const long long *pWallTime, const long long *pCPUTime) {
+   int nPhase;
+
+   fprintf(f_out, "{");
+   for (nPhase = 0; nPhase < APULTRA_NUM_PHASES; nPhase++) {
+      fprintf(f_out, "%s\"%s\": { \"wall_us\": %lld, \"cpu_us\": %lld }", nPhase ? ", " : " ", apultra_profiler_get_phase_name(nPhase), pWallTime[nPhase], pCPUTime[nPhase]);
+   }
+   fprintf(f_out, " }");
+}
+
+static void profile_block(const apultra_block_profile *pProfile, void *pUserData) {
+   profile_state *pState = (profile_state *)pUserData;
+   FILE *f_out = pState->f_out;
+   int nPhase;
+
+   fprintf(f_out, "%s\n    { \"index\": %d, \"offset\": %zd, \"size\": %d, \"window_size\": %d, \"compressed_size\": %d, \"alloc_bytes\": %zd,\n",
+      pState->nNumBlocks ? "," : "", pProfile->index, pProfile->offset, pProfile->size, pProfile->window_size, pProfile->compressed_size, pProfile->alloc_size);
+   fprintf(f_out, "      \"optimize_passes\": %d, \"reduce_passes\": %d, \"arrivals_visited\": %lld, \"matches_considered\": %lld,\n",
+      pProfile->optimize_passes, pProfile->reduce_passes, pProfile->arrivals_visited, pProfile->matches_considered);
+   fprintf(f_out, "      \"phases\": ");
+   do_write_json_phases(f_out, pProfile->wall_time, pProfile->cpu_time);
+   fprintf(f_out, " }");
+
+   for (nPhase = 0; nPhase < APULTRA_NUM_PHASES; nPhase++) {
+      pState->nWallTime[nPhase] += pProfile->wall_time[nPhase];
+      pState->nCPUTime[nPhase] += pProfile->cpu_time[nPhase];
+   }
+   pState->nAllocSize += pProfile->alloc_size;
+   pState->nArrivalsVisited += pProfile->arrivals_visited;
+   pState->nMatchesConsidered += pProfile->matches_considered;
+   pState->nNumBlocks++;
+}
+
+static int do_profile(const char *pszInFilename, const char *pszOutFilename, const char *pszDictionaryFilename, const unsigned int nOptions, const unsigned int nMaxWindowSize) {
+   apultra_dictionary dictionary;
+   apultra_compressor compressor;
+   profile_state state;
+   size_t nOriginalSize = 0L, nCompressedSize, nMaxCompressedSize, nDictionarySize;
+   unsigned char *pDecompressedData;
+   unsigned char *pCompressedData;
+   int nFlags;
+
+   nFlags = get_compression_flags(nOptions);
+
+   if (do_load_dictionary(pszDictionaryFilename, &dictionary) != 0)
+      return 100;
+   nDictionarySize = (size_t)dictionary.size;
+
+   /* Read file after the dictionary */
+   pDecompressedData = read_whole_file(pszInFilename, nDictionarySize, &nOriginalSize);
+   if (!pDecompressedData) {
+      apultra_dictionary_free(&dictionary);
+      return 100;
+   }
+   if (nDictionarySize)
+      memcpy(pDecompressedData, dictionary.data, nDictionarySize);
+
+   nMaxCompressedSize = apultra_get_max_compressed_size(nOriginalSize);
+
+   pCompressedData = (unsigned char*)malloc(nMaxCompressedSize);
+   if (!pCompressedData) {
+      free(pDecompressedData);
+      apultra_dictionary_free(&dictionary);
+      fprintf(stderr, "out of memory for compressing '%s', %zd bytes needed\n", pszInFilename, nMaxCompressedSize);
+      return 100;
+   }
+
+   if (apultra_compressor_init(&compressor, 1024, 2048, nFlags) != 0) {
+      free(pCompressedData);
+      free(pDecompressedData);
+      apultra_dictionary_free(&dictionary);
+      fprintf(stderr, "out of memory for compressing '%s'\n", pszInFilename);
+      return 100;
+   }
+
+   memset(&state, 0, sizeof(profile_state));
+   state.f_out = stdout;
+   apultra_compressor_set_profile_callback(&compressor, profile_block, &state);
+
+   fprintf(stdout, "{\n  \"input\": ");
+   do_write_json_string(stdout, pszInFilename);
+   fprintf(stdout, ",\n  \"kernel\": \"%s\",\n  \"original_size\": %zd,\n  \"dictionary_size\": %zd,\n  \"blocks\": [", apultra_get_matchlen_kernel_name(apultra_get_matchlen_kernel()), nOriginalSize, nDictionarySize);
+
+   long long t0 = do_get_time();
+   nCompressedSize = apultra_compress_with_context(&compressor, pDecompressedData, pCompressedData, nDictionarySize + nOriginalSize, nMaxCompressedSize, nFlags, nMaxWindowSize,
+      nDictionarySize ? &dictionary : NULL, NULL, NULL);
+   long long t1 = do_get_time();
+
+   apultra_compressor_destroy(&compressor);
+   free(pDecompressedData);
+   apultra_dictionary_free(&dictionary);
+
+   fprintf(stdout, "\n  ],\n  \"compressed_size\": %lld,\n  \"wall_us\": %lld,\n  \"alloc_bytes\": %zd,\n  \"arrivals_visited\": %lld,\n  \"matches_considered\": %lld,\n  \"phases\": ",
+      (nCompressedSize == -1) ? -1LL : (long long)nCompressedSize, t1 - t0, state.nAllocSize, state.nArrivalsVisited, state.nMatchesConsidered);
+   do_write_json_phases(stdout, state.nWallTime, state.nCPUTime);
+   fprintf(stdout, "\n}\n");
+
+   if (nCompressedSize == -1) {
+      free(pCompressedData);
+      fprintf(stderr, "compression error for '%s'\n", pszInFilename);
+      return 100;
+   }
+
+   FILE *f_out = fopen(pszOutFilename, "wb");
+   if (!f_out || fwrite(pCompressedData, 1, nCompressedSize, f_out) != nCompressedSize) {
+      if (f_out)
+         fclose(f_out);
+      free(pCompressedData);
+      fprintf(stderr, "error writing '%s'\n", pszOutFilename);
+      return 100;
+   }
+
+   fclose(f_out);
+   free(pCompressedData);
+   return 0;
+}
+
+/*---------------------------------------------------------------------------*/
+
 int main(int argc, char **argv) {
    int i;
    const char *pszInFilename = NULL;
    const char *pszOutFilename = NULL;
    const char *pszDictionaryFilename = NULL;
+   const char *pszCacheDir = NULL;
    bool bArgsError = false;
    bool bCommandDefined = false;
    bool bVerifyCompression = false;
    bool bMinMatchDefined = false;
    bool bFormatVersionDefined = false;
+   bool bStream = false;
    char cCommand = 'z';
    unsigned int nOptions = 0;
    unsigned int nMaxWindowSize = 0;
+   int nThreads = 0;
 
    for (i = 1; i < argc; i++) {
       if (!strcmp(argv[i], "-d")) {
@@ -932,6 +2370,13 @@ int main(int argc, char **argv) {
          else
             bArgsError = true;
       }
+      else if (!strcmp(argv[i], "-stream")) {
+         if (!bStream) {
+            bStream = true;
+         }
+         else
+            bArgsError = true;
+      }
       else if (!strcmp(argv[i], "-cbench")) {
          if (!bCommandDefined) {
             bCommandDefined = true;
@@ -948,6 +2393,40 @@ int main(int argc, char **argv) {
          else
             bArgsError = true;
       }
+      else if (!strcmp(argv[i], "-kbench")) {
+         if (!bCommandDefined) {
+            bCommandDefined = true;
+            cCommand = 'k';
+         }
+         else
+            bArgsError = true;
+      }
+      else if (!strcmp(argv[i], "-profile")) {
+         if (!bCommandDefined) {
+            bCommandDefined = true;
+            cCommand = 'p';
+         }
+         else
+            bArgsError = true;
+      }
+      else if (!strcmp(argv[i], "-batch")) {
+         if (!bCommandDefined && !pszInFilename && (i + 1) < argc) {
+            bCommandDefined = true;
+            cCommand = 'm';
+            pszInFilename = argv[i + 1];
+            i++;
+         }
+         else
+            bArgsError = true;
+      }
+      else if (!strcmp(argv[i], "-dictindex")) {
+         if (!bCommandDefined) {
+            bCommandDefined = true;
+            cCommand = 'x';
+         }
+         else
+            bArgsError = true;
+      }
       else if (!strcmp(argv[i], "-test")) {
          if (!bCommandDefined) {
             bCommandDefined = true;
@@ -979,6 +2458,14 @@ int main(int argc, char **argv) {
          else
             bArgsError = true;
       }
+      else if (!strcmp(argv[i], "--cache-dir")) {
+         if (!pszCacheDir && (i + 1) < argc) {
+            pszCacheDir = argv[i + 1];
+            i++;
+         }
+         else
+            bArgsError = true;
+      }
       else if (!strcmp(argv[i], "-v")) {
          if ((nOptions & OPT_VERBOSE) == 0) {
             nOptions |= OPT_VERBOSE;
@@ -1021,6 +2508,31 @@ int main(int argc, char **argv) {
          else
             bArgsError = true;
       }
+      else if (!strcmp(argv[i], "-j")) {
+         if (!nThreads && (i + 1) < argc) {
+            char *pEnd = NULL;
+            nThreads = (int)strtol(argv[i + 1], &pEnd, 10);
+            if (pEnd && pEnd != argv[i + 1] && (nThreads >= 1 && nThreads <= APULTRA_MAX_THREADS)) {
+               i++;
+            }
+            else {
+               bArgsError = true;
+            }
+         }
+         else
+            bArgsError = true;
+      }
+      else if (!strncmp(argv[i], "-j", 2)) {
+         if (!nThreads) {
+            char *pEnd = NULL;
+            nThreads = (int)strtol(argv[i] + 2, &pEnd, 10);
+            if (!pEnd || pEnd == (argv[i] + 2) || nThreads < 1 || nThreads > APULTRA_MAX_THREADS) {
+               bArgsError = true;
+            }
+         }
+         else
+            bArgsError = true;
+      }
       else if (!strcmp(argv[i], "-stats")) {
          if ((nOptions & OPT_STATS) == 0) {
             nOptions |= OPT_STATS;
@@ -1028,6 +2540,13 @@ int main(int argc, char **argv) {
          else
             bArgsError = true;
       }
+      else if (argv[i][0] == '-' && argv[i][1] >= ('0' + APULTRA_MIN_LEVEL) && argv[i][1] <= ('0' + APULTRA_MAX_LEVEL) && argv[i][2] == 0) {
+         if ((nOptions & OPT_LEVEL_MASK) == 0) {
+            nOptions |= (unsigned int)(argv[i][1] - '0') << OPT_LEVEL_SHIFT;
+         }
+         else
+            bArgsError = true;
+      }
       else {
          if (!pszInFilename)
             pszInFilename = argv[i];
@@ -1040,22 +2559,42 @@ int main(int argc, char **argv) {
       }
    }
 
+   if (!bArgsError && cCommand == 'm') {
+      do_init_time();
+      return do_batch(pszInFilename, pszDictionaryFilename, pszCacheDir, nOptions, nMaxWindowSize, nThreads, bVerifyCompression ? 1 : 0);
+   }
+
+   if (!nThreads)
+      nThreads = 1;
+
    if (!bArgsError && cCommand == 't') {
-      return do_self_test(nOptions, nMaxWindowSize, 0);
+      return do_self_test(nOptions, nMaxWindowSize, nThreads, 0);
    }
    else if (!bArgsError && cCommand == 'T') {
-      return do_self_test(nOptions, nMaxWindowSize, 1);
+      return do_self_test(nOptions, nMaxWindowSize, nThreads, 1);
    }
 
+   if (bStream && cCommand != 'z' && cCommand != 'd')
+      bArgsError = true;
+
    if (bArgsError || !pszInFilename || !pszOutFilename) {
       fprintf(stderr, "apultra command-line tool v" TOOL_VERSION " by Emmanuel Marty and spke\n");
       fprintf(stderr, "usage: %s [-c] [-d] [-v] [-r] <infile> <outfile>\n", argv[0]);
       fprintf(stderr, "        -c: check resulting stream after compressing\n");
       fprintf(stderr, "        -d: decompress (default: compress)\n");
       fprintf(stderr, "        -e: use enhanced (incompatible) format for 8-bit micros\n");
+      fprintf(stderr, "   -1..-9: compression level, from fastest to smallest output, defaults to -9\n");
       fprintf(stderr, " -w <size>: maximum window size, in bytes (16..2097152), defaults to maximum\n");
+      fprintf(stderr, "    -j <n>: compress blocks in parallel on <n> threads (1..64), defaults to 1\n");
+      fprintf(stderr, "   -stream: compress or decompress with bounded memory, as data is read; files can be '-' for stdin/stdout\n");
+      fprintf(stderr, "-batch <m>: compress each '<infile> <outfile>' line of manifest file <m>, on -j threads (defaults to all cores)\n");
       fprintf(stderr, "   -cbench: benchmark in-memory compression\n");
       fprintf(stderr, "   -dbench: benchmark in-memory decompression\n");
+      fprintf(stderr, "   -kbench: benchmark match length kernels, per compression phase\n");
+      fprintf(stderr, "  -profile: compress and write time spent in each phase of each block to stdout, as JSON\n");
+      fprintf(stderr, "--cache-dir <dir>: reuse stream compressed earlier from identical input and settings, stored in <dir>\n");
+      fprintf(stderr, "-D <file>: use dictionary or dictionary index file, to compress and decompress\n");
+      fprintf(stderr, "-dictindex: write index of dictionary <infile> to <outfile>, to use with -D instead of the dictionary\n");
       fprintf(stderr, "     -test: run full automated self-tests\n");
       fprintf(stderr, "-quicktest: run quick automated self-tests\n");
       fprintf(stderr, "    -stats: show compressed data stats\n");
@@ -1065,8 +2604,14 @@ int main(int argc, char **argv) {
 
    do_init_time();
 
-   if (cCommand == 'z') {
-      int nResult = do_compress(pszInFilename, pszOutFilename, pszDictionaryFilename, nOptions, nMaxWindowSize);
+   if (cCommand == 'z' && bStream) {
+      return do_compress_stream(pszInFilename, pszOutFilename, pszDictionaryFilename, nOptions, nMaxWindowSize);
+   }
+   else if (cCommand == 'd' && bStream) {
+      return do_decompress_stream(pszInFilename, pszOutFilename, pszDictionaryFilename, nOptions, nMaxWindowSize);
+   }
+   else if (cCommand == 'z') {
+      int nResult = do_compress(pszInFilename, pszOutFilename, pszDictionaryFilename, pszCacheDir, nOptions, nMaxWindowSize, nThreads);
       if (nResult == 0 && bVerifyCompression) {
          return do_compare(pszOutFilename, pszInFilename, pszDictionaryFilename, nOptions);
       } else {
@@ -1077,11 +2622,20 @@ int main(int argc, char **argv) {
       return do_decompress(pszInFilename, pszOutFilename, pszDictionaryFilename, nOptions);
    }
    else if (cCommand == 'B') {
-      return do_compr_benchmark(pszInFilename, pszOutFilename, pszDictionaryFilename, nOptions, nMaxWindowSize);
+      return do_compr_benchmark(pszInFilename, pszOutFilename, pszDictionaryFilename, nOptions, nMaxWindowSize, nThreads);
    }
    else if (cCommand == 'b') {
       return do_dec_benchmark(pszInFilename, pszOutFilename, pszDictionaryFilename, nOptions);
    }
+   else if (cCommand == 'p') {
+      return do_profile(pszInFilename, pszOutFilename, pszDictionaryFilename, nOptions, nMaxWindowSize);
+   }
+   else if (cCommand == 'k') {
+      return do_kernel_benchmark(pszInFilename, pszOutFilename, pszDictionaryFilename, nOptions, nMaxWindowSize);
+   }
+   else if (cCommand == 'x') {
+      return do_index_dictionary(pszInFilename, pszOutFilename, nOptions);
+   }
    else {
       return 100;
    }
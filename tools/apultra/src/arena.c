@@ -0,0 +1,108 @@
+/*
+ * arena.c - memory arena implementation
+ *
+ * Copyright (C) 2026 agent
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty.  In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ * 1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation would be
+ *    appreciated but is not required.
+ * 2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ * 3. This notice may not be removed or altered from any source distribution.
+ */
+
+#include <stdlib.h>
+#include "arena.h"
+
+/**
+ * Initialize empty arena
+ *
+ * @param pArena arena to initialize
+ */
+void apultra_arena_init(apultra_arena *pArena) {
+   pArena->buffer = NULL;
+   pArena->capacity = 0;
+   pArena->used = 0;
+}
+
+/**
+ * Make sure that the arena can hold the requested number of bytes, and reset it. Previous allocations are discarded;
+ * the backing buffer is only reallocated if it is too small.
+ *
+ * @param pArena arena
+ * @param nSize number of bytes to reserve, as returned by apultra_arena_get_alloc_size() for all allocations
+ *
+ * @return 0 for success, non-zero for failure
+ */
+int apultra_arena_reserve(apultra_arena *pArena, size_t nSize) {
+   pArena->used = 0;
+
+   if (pArena->capacity < nSize) {
+      apultra_arena_destroy(pArena);
+
+      /* Reserve room to align the start of the buffer. The memory isn't cleared, so that pages only get committed
+       * by the OS when the compressor actually touches them */
+      pArena->buffer = (unsigned char *)malloc(nSize + ARENA_ALIGNMENT);
+      if (!pArena->buffer)
+         return 100;
+      pArena->capacity = nSize;
+   }
+
+   return 0;
+}
+
+/**
+ * Get the number of bytes that an allocation uses up in an arena, including alignment padding
+ *
+ * @param nSize requested allocation size, in bytes
+ *
+ * @return number of bytes used up in the arena
+ */
+size_t apultra_arena_get_alloc_size(size_t nSize) {
+   return (nSize + (ARENA_ALIGNMENT - 1)) & ~((size_t)(ARENA_ALIGNMENT - 1));
+}
+
+/**
+ * Allocate memory from arena
+ *
+ * @param pArena arena
+ * @param nSize number of bytes to allocate
+ *
+ * @return pointer to allocated memory, aligned to ARENA_ALIGNMENT, or NULL if the arena is full
+ */
+void *apultra_arena_alloc(apultra_arena *pArena, size_t nSize) {
+   size_t nAllocSize = apultra_arena_get_alloc_size(nSize);
+   unsigned char *pAlignedBuffer;
+
+   if (!pArena->buffer || (pArena->used + nAllocSize) > pArena->capacity)
+      return NULL;
+
+   pAlignedBuffer = pArena->buffer + ((ARENA_ALIGNMENT - ((size_t)pArena->buffer & (ARENA_ALIGNMENT - 1))) & (ARENA_ALIGNMENT - 1));
+   pAlignedBuffer += pArena->used;
+   pArena->used += nAllocSize;
+
+   return pAlignedBuffer;
+}
+
+/**
+ * Free all memory held by arena
+ *
+ * @param pArena arena to clean up
+ */
+void apultra_arena_destroy(apultra_arena *pArena) {
+   if (pArena->buffer) {
+      free(pArena->buffer);
+      pArena->buffer = NULL;
+   }
+   pArena->capacity = 0;
+   pArena->used = 0;
+}
@@ -0,0 +1,336 @@
+/*
+ * cache.c - content-addressed compression cache
+ *
+ * Copyright (C) 2026 agent
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty.  In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ * 1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation would be
+ *    appreciated but is not required.
+ * 2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ * 3. This notice may not be removed or altered from any source distribution.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef _WIN32
+#include <direct.h>
+#include <process.h>
+#else
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+#endif
+#include "cache.h"
+#include "thread.h"
+
+/** Cache entry header: magic, key, compressed size */
+#define CACHE_MAGIC "APC1"
+#define CACHE_HEADER_SIZE (4 + APULTRA_CACHE_KEY_SIZE + 4)
+
+/** Longest cache directory path that we accept */
+#define CACHE_MAX_PATH 4096
+
+/** Number of temporary entries written by this process, to give each one its own name */
+static volatile long g_nCacheTmpCount = 0;
+
+/** Running state for hashing the cache key */
+typedef struct {
+   unsigned long long h1;
+   unsigned long long h2;
+   unsigned long long length;
+} apultra_cache_hasher;
+
+/**
+ * Rotate 64-bit value left
+ *
+ * @param x value to rotate
+ * @param n number of bits to rotate by (1..63)
+ *
+ * @return rotated value
+ */
+static inline unsigned long long apultra_cache_rotl(const unsigned long long x, const int n) {
+   return (x << n) | (x >> (64 - n));
+}
+
+/**
+ * Mix all bits of a 64-bit value into all others
+ *
+ * @param x value to mix
+ *
+ * @return mixed value
+ */
+static unsigned long long apultra_cache_mix(unsigned long long x) {
+   x ^= x >> 30;
+   x *= 0xbf58476d1ce4e5b9ULL;
+   x ^= x >> 27;
+   x *= 0x94d049bb133111ebULL;
+   x ^= x >> 31;
+   return x;
+}
+
+/**
+ * Hash one 64-bit word
+ *
+ * @param pHasher hashing state
+ * @param w word to hash
+ */
+static inline void apultra_cache_hash_word(apultra_cache_hasher *pHasher, const unsigned long long w) {
+   pHasher->h1 = apultra_cache_rotl(pHasher->h1 ^ (w * 0xc2b2ae3d27d4eb4fULL), 31) * 0x9e3779b185ebca87ULL;
+   pHasher->h2 = (apultra_cache_rotl(pHasher->h2 + w, 27) * 0x165667b19e3779f9ULL) ^ pHasher->h1;
+   pHasher->length += 8;
+}
+
+/**
+ * Hash bytes
+ *
+ * @param pHasher hashing state
+ * @param pData bytes to hash
+ * @param nSize number of bytes
+ */
+static void apultra_cache_hash_bytes(apultra_cache_hasher *pHasher, const unsigned char *pData, size_t nSize) {
+   unsigned long long w;
+   size_t i;
+
+   while (nSize >= 8) {
+      w = 0;
+      for (i = 0; i < 8; i++)
+         w |= ((unsigned long long)pData[i]) << (i << 3);
+      apultra_cache_hash_word(pHasher, w);
+
+      pData += 8;
+      nSize -= 8;
+   }
+
+   /* Pad the tail with its length, so that trailing zeroes change the hash */
+   w = (unsigned long long)nSize << 56;
+   for (i = 0; i < nSize; i++)
+      w |= ((unsigned long long)pData[i]) << (i << 3);
+   apultra_cache_hash_word(pHasher, w);
+}
+
+/**
+ * Compute the cache key for compressing some data with some settings
+ *
+ * @param pInputData data to compress, including the dictionary that it starts with, if any
+ * @param nInputSize number of bytes of data, including the dictionary
+ * @param nDictionarySize number of bytes of dictionary at the start of the data, or 0 for none
+ * @param nFlags compression flags (APULTRA_FLAG_xxx), including the compression level
+ * @param nMaxWindowSize maximum window size (0 for default)
+ * @param nThreads number of threads the data is compressed with, as blocks are split differently on several threads
+ * @param pszVersion compressor version, so that a new compressor doesn't return streams from an older one
+ * @param pKey pointer to returned key, of APULTRA_CACHE_KEY_SIZE bytes
+ */
+void apultra_cache_get_key(const unsigned char *pInputData, const size_t nInputSize, const size_t nDictionarySize, const unsigned int nFlags, const size_t nMaxWindowSize,
+   const int nThreads, const char *pszVersion, unsigned char *pKey) {
+   apultra_cache_hasher hasher;
+   unsigned long long h1, h2;
+   int i;
+
+   hasher.h1 = 0x243f6a8885a308d3ULL;
+   hasher.h2 = 0x13198a2e03707344ULL;
+   hasher.length = 0;
+
+   /* Settings first, then the data */
+   apultra_cache_hash_bytes(&hasher, (const unsigned char *)CACHE_MAGIC, 4);
+   apultra_cache_hash_bytes(&hasher, (const unsigned char *)pszVersion, strlen(pszVersion));
+   apultra_cache_hash_word(&hasher, (unsigned long long)nFlags);
+   apultra_cache_hash_word(&hasher, (unsigned long long)nMaxWindowSize);
+   apultra_cache_hash_word(&hasher, (unsigned long long)nThreads);
+   apultra_cache_hash_word(&hasher, (unsigned long long)nDictionarySize);
+   apultra_cache_hash_word(&hasher, (unsigned long long)nInputSize);
+   apultra_cache_hash_bytes(&hasher, pInputData, nInputSize);
+
+   h1 = apultra_cache_mix(hasher.h1 ^ hasher.length);
+   h2 = apultra_cache_mix(hasher.h2 + h1);
+
+   for (i = 0; i < 8; i++) {
+      pKey[i] = (unsigned char)(h1 >> (56 - (i << 3)));
+      pKey[8 + i] = (unsigned char)(h2 >> (56 - (i << 3)));
+   }
+}
+
+/**
+ * Get the filename of a cache entry
+ *
+ * @param pszCacheDir cache directory
+ * @param pKey cache key
+ * @param pszFilename pointer to returned filename, of CACHE_MAX_PATH bytes
+ *
+ * @return 0 for success, non-zero for failure
+ */
+static int apultra_cache_get_filename(const char *pszCacheDir, const unsigned char *pKey, char *pszFilename) {
+   static const char szHexDigits[] = "0123456789abcdef";
+   size_t nDirLen = strlen(pszCacheDir);
+   char *pszCur;
+   int i;
+
+   if ((nDirLen + 1 + APULTRA_CACHE_KEY_SIZE * 2 + 4 + 32) > CACHE_MAX_PATH)
+      return 100;
+
+   memcpy(pszFilename, pszCacheDir, nDirLen);
+   pszCur = pszFilename + nDirLen;
+   if (nDirLen && pszCur[-1] != '/' && pszCur[-1] != '\\')
+      *pszCur++ = '/';
+
+   for (i = 0; i < APULTRA_CACHE_KEY_SIZE; i++) {
+      *pszCur++ = szHexDigits[pKey[i] >> 4];
+      *pszCur++ = szHexDigits[pKey[i] & 15];
+   }
+
+   strcpy(pszCur, ".apc");
+   return 0;
+}
+
+/**
+ * Create a directory and its missing parents; failures show up when writing to it
+ *
+ * @param pszDir directory to create
+ */
+static void apultra_cache_make_dir(const char *pszDir) {
+   char szPath[CACHE_MAX_PATH];
+   size_t nDirLen = strlen(pszDir);
+   size_t i;
+
+   if (nDirLen >= CACHE_MAX_PATH)
+      return;
+
+   memcpy(szPath, pszDir, nDirLen + 1);
+   for (i = 1; i <= nDirLen; i++) {
+      if (szPath[i] == '/' || szPath[i] == '\\' || szPath[i] == 0) {
+         char c = szPath[i];
+
+         szPath[i] = 0;
+#ifdef _WIN32
+         _mkdir(szPath);
+#else
+         mkdir(szPath, 0777);
+#endif
+         szPath[i] = c;
+      }
+   }
+}
+
+/**
+ * Look up a compressed stream in the cache
+ *
+ * @param pszCacheDir cache directory
+ * @param pKey cache key
+ * @param pnCompressedSize pointer to returned compressed size, in bytes
+ *
+ * @return compressed stream, to be freed by the caller, or NULL if it isn't in the cache
+ */
+unsigned char *apultra_cache_lookup(const char *pszCacheDir, const unsigned char *pKey, size_t *pnCompressedSize) {
+   char szFilename[CACHE_MAX_PATH];
+   unsigned char cHeader[CACHE_HEADER_SIZE];
+   unsigned char *pCompressedData;
+   size_t nCompressedSize;
+   FILE *f_in;
+
+   if (apultra_cache_get_filename(pszCacheDir, pKey, szFilename))
+      return NULL;
+
+   f_in = fopen(szFilename, "rb");
+   if (!f_in)
+      return NULL;
+
+   /* Check that the entry is complete and really is for this key, before trusting it */
+   if (fread(cHeader, 1, CACHE_HEADER_SIZE, f_in) != CACHE_HEADER_SIZE ||
+      memcmp(cHeader, CACHE_MAGIC, 4) ||
+      memcmp(cHeader + 4, pKey, APULTRA_CACHE_KEY_SIZE)) {
+      fclose(f_in);
+      return NULL;
+   }
+
+   nCompressedSize = ((size_t)cHeader[4 + APULTRA_CACHE_KEY_SIZE]) |
+      (((size_t)cHeader[4 + APULTRA_CACHE_KEY_SIZE + 1]) << 8) |
+      (((size_t)cHeader[4 + APULTRA_CACHE_KEY_SIZE + 2]) << 16) |
+      (((size_t)cHeader[4 + APULTRA_CACHE_KEY_SIZE + 3]) << 24);
+
+   pCompressedData = (unsigned char*)malloc(nCompressedSize ? nCompressedSize : 1);
+   if (!pCompressedData) {
+      fclose(f_in);
+      return NULL;
+   }
+
+   if (fread(pCompressedData, 1, nCompressedSize, f_in) != nCompressedSize || fgetc(f_in) != EOF) {
+      free(pCompressedData);
+      fclose(f_in);
+      return NULL;
+   }
+
+   fclose(f_in);
+
+   *pnCompressedSize = nCompressedSize;
+   return pCompressedData;
+}
+
+/**
+ * Store a compressed stream in the cache, creating the cache directory if needed
+ *
+ * @param pszCacheDir cache directory
+ * @param pKey cache key
+ * @param pCompressedData compressed stream
+ * @param nCompressedSize compressed size, in bytes
+ *
+ * @return 0 for success, non-zero for failure
+ */
+int apultra_cache_store(const char *pszCacheDir, const unsigned char *pKey, const unsigned char *pCompressedData, const size_t nCompressedSize) {
+   char szFilename[CACHE_MAX_PATH];
+   char szTmpFilename[CACHE_MAX_PATH];
+   unsigned char cHeader[CACHE_HEADER_SIZE];
+   FILE *f_out;
+   int nResult;
+
+   if (nCompressedSize > 0xffffffffUL)
+      return 100;
+   if (apultra_cache_get_filename(pszCacheDir, pKey, szFilename))
+      return 100;
+
+   apultra_cache_make_dir(pszCacheDir);
+#ifdef _WIN32
+   snprintf(szTmpFilename, CACHE_MAX_PATH, "%s.%d.%ld.tmp", szFilename, _getpid(), apultra_atomic_increment(&g_nCacheTmpCount));
+#else
+   snprintf(szTmpFilename, CACHE_MAX_PATH, "%s.%d.%ld.tmp", szFilename, (int)getpid(), apultra_atomic_increment(&g_nCacheTmpCount));
+#endif
+
+   memcpy(cHeader, CACHE_MAGIC, 4);
+   memcpy(cHeader + 4, pKey, APULTRA_CACHE_KEY_SIZE);
+   cHeader[4 + APULTRA_CACHE_KEY_SIZE] = (unsigned char)(nCompressedSize & 0xff);
+   cHeader[4 + APULTRA_CACHE_KEY_SIZE + 1] = (unsigned char)((nCompressedSize >> 8) & 0xff);
+   cHeader[4 + APULTRA_CACHE_KEY_SIZE + 2] = (unsigned char)((nCompressedSize >> 16) & 0xff);
+   cHeader[4 + APULTRA_CACHE_KEY_SIZE + 3] = (unsigned char)((nCompressedSize >> 24) & 0xff);
+
+   /* Write a temporary file and rename it, so that concurrent builds never see a partial entry */
+   f_out = fopen(szTmpFilename, "wb");
+   if (!f_out)
+      return 100;
+
+   nResult = (fwrite(cHeader, 1, CACHE_HEADER_SIZE, f_out) != CACHE_HEADER_SIZE ||
+      fwrite(pCompressedData, 1, nCompressedSize, f_out) != nCompressedSize) ? 100 : 0;
+   if (fclose(f_out) != 0)
+      nResult = 100;
+
+   if (!nResult) {
+#ifdef _WIN32
+      /* rename() doesn't replace an existing file on Windows; an existing entry holds the same stream */
+      remove(szFilename);
+#endif
+      if (rename(szTmpFilename, szFilename) != 0)
+         nResult = 100;
+   }
+
+   if (nResult)
+      remove(szTmpFilename);
+   return nResult;
+}
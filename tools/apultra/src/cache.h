@@ -0,0 +1,77 @@
+/*
+ * cache.h - content-addressed compression cache definitions
+ *
+ * Copyright (C) 2026 agent
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty.  In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ * 1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation would be
+ *    appreciated but is not required.
+ * 2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ * 3. This notice may not be removed or altered from any source distribution.
+ */
+
+#ifndef _CACHE_H
+#define _CACHE_H
+
+#include <stdlib.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** Size of a cache key, in bytes */
+#define APULTRA_CACHE_KEY_SIZE 16
+
+/**
+ * Compute the cache key for compressing some data with some settings
+ *
+ * @param pInputData data to compress, including the dictionary that it starts with, if any
+ * @param nInputSize number of bytes of data, including the dictionary
+ * @param nDictionarySize number of bytes of dictionary at the start of the data, or 0 for none
+ * @param nFlags compression flags (APULTRA_FLAG_xxx), including the compression level
+ * @param nMaxWindowSize maximum window size (0 for default)
+ * @param nThreads number of threads the data is compressed with, as blocks are split differently on several threads
+ * @param pszVersion compressor version, so that a new compressor doesn't return streams from an older one
+ * @param pKey pointer to returned key, of APULTRA_CACHE_KEY_SIZE bytes
+ */
+void apultra_cache_get_key(const unsigned char *pInputData, const size_t nInputSize, const size_t nDictionarySize, const unsigned int nFlags, const size_t nMaxWindowSize,
+   const int nThreads, const char *pszVersion, unsigned char *pKey);
+
+/**
+ * Look up a compressed stream in the cache
+ *
+ * @param pszCacheDir cache directory
+ * @param pKey cache key
+ * @param pnCompressedSize pointer to returned compressed size, in bytes
+ *
+ * @return compressed stream, to be freed by the caller, or NULL if it isn't in the cache
+ */
+unsigned char *apultra_cache_lookup(const char *pszCacheDir, const unsigned char *pKey, size_t *pnCompressedSize);
+
+/**
+ * Store a compressed stream in the cache, creating the cache directory if needed
+ *
+ * @param pszCacheDir cache directory
+ * @param pKey cache key
+ * @param pCompressedData compressed stream
+ * @param nCompressedSize compressed size, in bytes
+ *
+ * @return 0 for success, non-zero for failure
+ */
+int apultra_cache_store(const char *pszCacheDir, const unsigned char *pKey, const unsigned char *pCompressedData, const size_t nCompressedSize);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _CACHE_H */
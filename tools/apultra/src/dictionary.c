@@ -0,0 +1,567 @@
+/*
+ * dictionary.c - dictionary implementation
+ *
+ * Copyright (C) 2026 agent
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty.  In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ * 1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation would be
+ *    appreciated but is not required.
+ * 2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ * 3. This notice may not be removed or altered from any source distribution.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+#include "dictionary.h"
+#include "format.h"
+#include "matchlen.h"
+
+/** Index file header: magic, version, dictionary size, byte order check */
+#define INDEX_MAGIC 0x58445041U        /* 'APDX' in little-endian order */
+#define INDEX_VERSION 1
+#define INDEX_BYTE_ORDER 0x01020304U
+#define INDEX_HEADER_SIZE 16
+
+/** Maximum number of bytes compared, per window byte, when merging suffixes before giving up and sorting fully */
+#define MERGE_BUDGET_PER_BYTE 32
+
+/** State for comparing suffixes of a window that starts with a dictionary */
+typedef struct _apultra_merge_context {
+   const unsigned char *window;
+   int dictionary_size;
+   int window_size;
+   const int *rank;
+   long long budget;
+} apultra_merge_context;
+
+/**
+ * Get size of dictionary data in index file, including padding
+ *
+ * @param nDictionarySize dictionary size in bytes
+ *
+ * @return padded size in bytes
+ */
+static size_t apultra_dictionary_get_padded_size(const int nDictionarySize) {
+   return ((size_t)nDictionarySize + 3) & ~((size_t)3);
+}
+
+/**
+ * Validate index file header
+ *
+ * @param pHeader index file header, INDEX_HEADER_SIZE bytes
+ * @param nFileSize total size of index file
+ *
+ * @return dictionary size, or -1 if this isn't a valid index file
+ */
+static int apultra_dictionary_check_header(const unsigned char *pHeader, const size_t nFileSize) {
+   unsigned int nHeader[4];
+
+   if (nFileSize < INDEX_HEADER_SIZE)
+      return -1;
+
+   memcpy(nHeader, pHeader, INDEX_HEADER_SIZE);
+   if (nHeader[0] != INDEX_MAGIC || nHeader[1] != INDEX_VERSION || nHeader[2] > BLOCK_SIZE || nHeader[3] != INDEX_BYTE_ORDER)
+      return -1;
+   if (nFileSize != INDEX_HEADER_SIZE + apultra_dictionary_get_padded_size((int)nHeader[2]) + (size_t)nHeader[2] * sizeof(unsigned int))
+      return -1;
+
+   return (int)nHeader[2];
+}
+
+/**
+ * Check that the suffixes in an index file are a permutation of the dictionary's positions
+ *
+ * @param pSuffixes sorted suffixes, with flags
+ * @param nDictionarySize dictionary size in bytes
+ *
+ * @return 0 if the suffixes are valid, non-zero otherwise
+ */
+static int apultra_dictionary_check_suffixes(const unsigned int *pSuffixes, const int nDictionarySize) {
+   unsigned char *pSeen;
+   int i;
+
+   pSeen = (unsigned char*)calloc(nDictionarySize ? nDictionarySize : 1, 1);
+   if (!pSeen)
+      return 100;
+
+   for (i = 0; i < nDictionarySize; i++) {
+      const unsigned int nPos = pSuffixes[i] & DICTIONARY_SUFFIX_POS_MASK;
+
+      if (nPos >= (unsigned int)nDictionarySize || pSeen[nPos]) {
+         free(pSeen);
+         return 1;
+      }
+      pSeen[nPos] = 1;
+   }
+
+   free(pSeen);
+   return 0;
+}
+
+/**
+ * Load index file in memory
+ *
+ * @param pDictionary dictionary to load
+ * @param pszIndexFilename name of index file
+ *
+ * @return 0 for success, 1 if the file isn't an index, other values for failure
+ */
+static int apultra_dictionary_load_index(apultra_dictionary *pDictionary, const char *pszIndexFilename) {
+   const unsigned char *pIndexData;
+   int nDictionarySize;
+
+#ifdef _WIN32
+   unsigned char pHeader[INDEX_HEADER_SIZE];
+   size_t nFileSize;
+
+   FILE *f_in = fopen(pszIndexFilename, "rb");
+   if (!f_in)
+      return 100;
+
+   fseek(f_in, 0, SEEK_END);
+   nFileSize = (size_t)ftell(f_in);
+   fseek(f_in, 0, SEEK_SET);
+
+   if (nFileSize < INDEX_HEADER_SIZE || fread(pHeader, 1, INDEX_HEADER_SIZE, f_in) != INDEX_HEADER_SIZE ||
+      (nDictionarySize = apultra_dictionary_check_header(pHeader, nFileSize)) < 0) {
+      fclose(f_in);
+      return 1;
+   }
+
+   pDictionary->data_buffer = (unsigned char*)malloc(nFileSize);
+   if (!pDictionary->data_buffer) {
+      fclose(f_in);
+      return 100;
+   }
+
+   fseek(f_in, 0, SEEK_SET);
+   if (fread(pDictionary->data_buffer, 1, nFileSize, f_in) != nFileSize) {
+      fclose(f_in);
+      return 100;
+   }
+   fclose(f_in);
+
+   pIndexData = pDictionary->data_buffer;
+#else
+   struct stat st;
+   void *pMapping;
+
+   int fd = open(pszIndexFilename, O_RDONLY);
+   if (fd < 0)
+      return 100;
+
+   if (fstat(fd, &st) != 0) {
+      close(fd);
+      return 100;
+   }
+
+   if ((size_t)st.st_size < INDEX_HEADER_SIZE) {
+      close(fd);
+      return 1;
+   }
+
+   pMapping = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+   close(fd);
+   if (pMapping == MAP_FAILED)
+      return 100;
+
+   nDictionarySize = apultra_dictionary_check_header((const unsigned char*)pMapping, (size_t)st.st_size);
+   if (nDictionarySize < 0) {
+      munmap(pMapping, (size_t)st.st_size);
+      return 1;
+   }
+
+   pDictionary->mapping = pMapping;
+   pDictionary->mapping_size = (size_t)st.st_size;
+   pIndexData = (const unsigned char*)pMapping;
+#endif
+
+   pDictionary->data = pIndexData + INDEX_HEADER_SIZE;
+   pDictionary->size = nDictionarySize;
+   pDictionary->suffixes = (const unsigned int*)(pIndexData + INDEX_HEADER_SIZE + apultra_dictionary_get_padded_size(nDictionarySize));
+
+   /* A damaged index is used as a raw dictionary, its suffixes are sorted again */
+   if (apultra_dictionary_check_suffixes(pDictionary->suffixes, nDictionarySize) != 0)
+      pDictionary->suffixes = NULL;
+   return 0;
+}
+
+/**
+ * Load dictionary contents, either from a raw dictionary file or from an index file written by
+ * apultra_dictionary_save_index(). Index files are memory-mapped where possible. Only the last BLOCK_SIZE bytes of
+ * a raw dictionary are kept.
+ *
+ * @param pDictionary dictionary to load
+ * @param pszDictionaryFilename name of dictionary or index file
+ *
+ * @return 0 for success, non-zero for failure
+ */
+int apultra_dictionary_load(apultra_dictionary *pDictionary, const char *pszDictionaryFilename) {
+   size_t nDictionarySize;
+   int nResult;
+
+   memset(pDictionary, 0, sizeof(apultra_dictionary));
+
+   nResult = apultra_dictionary_load_index(pDictionary, pszDictionaryFilename);
+   if (nResult != 1) {
+      if (nResult)
+         apultra_dictionary_free(pDictionary);
+      return nResult;
+   }
+
+   /* Not an index file, load raw dictionary */
+
+   FILE *f_in = fopen(pszDictionaryFilename, "rb");
+   if (!f_in)
+      return 100;
+
+   fseek(f_in, 0, SEEK_END);
+   nDictionarySize = (size_t)ftell(f_in);
+
+   if (nDictionarySize > BLOCK_SIZE) {
+      /* Keep the end of the dictionary, it is the part closest to the data to compress */
+      fseek(f_in, (long)(nDictionarySize - BLOCK_SIZE), SEEK_SET);
+      nDictionarySize = BLOCK_SIZE;
+   }
+   else {
+      fseek(f_in, 0, SEEK_SET);
+   }
+
+   pDictionary->data_buffer = (unsigned char*)malloc(nDictionarySize ? nDictionarySize : 1);
+   if (!pDictionary->data_buffer) {
+      fclose(f_in);
+      return 100;
+   }
+
+   if (fread(pDictionary->data_buffer, 1, nDictionarySize, f_in) != nDictionarySize) {
+      fclose(f_in);
+      apultra_dictionary_free(pDictionary);
+      return 100;
+   }
+
+   fclose(f_in);
+
+   pDictionary->data = pDictionary->data_buffer;
+   pDictionary->size = (int)nDictionarySize;
+   return 0;
+}
+
+/**
+ * Sort the dictionary's suffixes, so that it doesn't need to be sorted again for each input that it primes
+ *
+ * @param pDictionary dictionary to index
+ *
+ * @return 0 for success, non-zero for failure
+ */
+int apultra_dictionary_build_index(apultra_dictionary *pDictionary) {
+   const unsigned char *pData = pDictionary->data;
+   const int nDictionarySize = pDictionary->size;
+   divsufsort_ctx_t divsufsort_context;
+   unsigned int *pSuffixes;
+   int *PLCP;
+   int i;
+
+   if (pDictionary->suffixes)
+      return 0;
+
+   pSuffixes = (unsigned int*)malloc((nDictionarySize ? nDictionarySize : 1) * sizeof(unsigned int));
+   PLCP = (int*)malloc((nDictionarySize ? nDictionarySize : 1) * sizeof(int));
+   if (!pSuffixes || !PLCP) {
+      if (PLCP) free(PLCP);
+      if (pSuffixes) free(pSuffixes);
+      return 100;
+   }
+
+   if (nDictionarySize) {
+      if (divsufsort_init(&divsufsort_context) != 0) {
+         free(PLCP);
+         free(pSuffixes);
+         return 100;
+      }
+
+      if (divsufsort_build_array(&divsufsort_context, pData, (saidx_t*)pSuffixes, nDictionarySize) != 0) {
+         divsufsort_destroy(&divsufsort_context);
+         free(PLCP);
+         free(pSuffixes);
+         return 100;
+      }
+
+      divsufsort_destroy(&divsufsort_context);
+
+      /* Compute the length of the common prefix of each suffix and the one that follows it in sorted order, using
+       * the permuted LCP like the match finder does. A suffix that is entirely a prefix of the next one is open: its
+       * order depends on the bytes that will follow the dictionary. */
+      int *Phi = PLCP;
+      int nCurLen = 0;
+
+      for (i = 0; i < nDictionarySize - 1; i++)
+         Phi[pSuffixes[i]] = (int)pSuffixes[i + 1];
+      Phi[pSuffixes[nDictionarySize - 1]] = -1;
+
+      for (i = 0; i < nDictionarySize; i++) {
+         if (Phi[i] == -1) {
+            PLCP[i] = 0;
+            nCurLen = 0;
+            continue;
+         }
+         int nMaxLen = (i > Phi[i]) ? (nDictionarySize - i) : (nDictionarySize - Phi[i]);
+         nCurLen += apultra_get_match_len(pData + i + nCurLen, pData + Phi[i] + nCurLen, nMaxLen - nCurLen);
+         PLCP[i] = nCurLen;
+         if (nCurLen > 0)
+            nCurLen--;
+      }
+
+      for (i = 0; i < nDictionarySize; i++) {
+         const int nPos = (int)pSuffixes[i];
+         if (PLCP[nPos] == nDictionarySize - nPos)
+            pSuffixes[i] |= DICTIONARY_SUFFIX_OPEN;
+      }
+   }
+
+   free(PLCP);
+
+   pDictionary->suffix_buffer = pSuffixes;
+   pDictionary->suffixes = pSuffixes;
+   return 0;
+}
+
+/**
+ * Write dictionary and its suffix index to a file, that can be loaded back with apultra_dictionary_load()
+ *
+ * @param pDictionary indexed dictionary
+ * @param pszIndexFilename name of index file to write
+ *
+ * @return 0 for success, non-zero for failure
+ */
+int apultra_dictionary_save_index(const apultra_dictionary *pDictionary, const char *pszIndexFilename) {
+   const unsigned int nHeader[4] = { INDEX_MAGIC, INDEX_VERSION, (unsigned int)pDictionary->size, INDEX_BYTE_ORDER };
+   const unsigned char nPadding[4] = { 0, 0, 0, 0 };
+   const size_t nPaddingSize = apultra_dictionary_get_padded_size(pDictionary->size) - pDictionary->size;
+   int nResult = 0;
+
+   if (!pDictionary->suffixes)
+      return 100;
+
+   FILE *f_out = fopen(pszIndexFilename, "wb");
+   if (!f_out)
+      return 100;
+
+   if (fwrite(nHeader, 1, INDEX_HEADER_SIZE, f_out) != INDEX_HEADER_SIZE ||
+      fwrite(pDictionary->data, 1, pDictionary->size, f_out) != (size_t)pDictionary->size ||
+      fwrite(nPadding, 1, nPaddingSize, f_out) != nPaddingSize ||
+      fwrite(pDictionary->suffixes, sizeof(unsigned int), pDictionary->size, f_out) != (size_t)pDictionary->size) {
+      nResult = 100;
+   }
+
+   if (fclose(f_out) != 0)
+      nResult = 100;
+   return nResult;
+}
+
+/**
+ * Free dictionary contents
+ *
+ * @param pDictionary dictionary to free
+ */
+void apultra_dictionary_free(apultra_dictionary *pDictionary) {
+#ifndef _WIN32
+   if (pDictionary->mapping) {
+      munmap(pDictionary->mapping, pDictionary->mapping_size);
+      pDictionary->mapping = NULL;
+      pDictionary->mapping_size = 0;
+   }
+#endif
+
+   if (pDictionary->suffix_buffer) {
+      free(pDictionary->suffix_buffer);
+      pDictionary->suffix_buffer = NULL;
+   }
+
+   if (pDictionary->data_buffer) {
+      free(pDictionary->data_buffer);
+      pDictionary->data_buffer = NULL;
+   }
+
+   pDictionary->data = NULL;
+   pDictionary->size = 0;
+   pDictionary->suffixes = NULL;
+}
+
+/**
+ * Compare a suffix that starts in the dictionary with a suffix that starts in the data that follows it
+ *
+ * @param pContext merge context
+ * @param nDictionaryPos position of first suffix in window, in the dictionary
+ * @param nDataPos position of second suffix in window, after the dictionary
+ *
+ * @return negative value if the first suffix sorts first, positive value otherwise
+ */
+static int apultra_dictionary_compare_with_data(apultra_merge_context *pContext, const int nDictionaryPos, const int nDataPos) {
+   const unsigned char *pWindow = pContext->window;
+   const int nDictionaryLeft = pContext->dictionary_size - nDictionaryPos;
+   const int nDataLeft = pContext->window_size - nDataPos;
+   const int nMaxLen = (nDictionaryLeft < nDataLeft) ? nDictionaryLeft : nDataLeft;
+   const int nLen = apultra_get_match_len(pWindow + nDictionaryPos, pWindow + nDataPos, nMaxLen);
+
+   pContext->budget -= nLen;
+
+   if (nLen < nMaxLen)
+      return (pWindow[nDictionaryPos + nLen] < pWindow[nDataPos + nLen]) ? -1 : 1;
+
+   /* The data suffix ended first, it is a prefix of the dictionary suffix */
+   if (nDataLeft <= nDictionaryLeft)
+      return 1;
+
+   /* The rest of the dictionary suffix is a prefix of the data suffix. What follows are two suffixes of the data,
+    * the whole data and the rest of the data suffix, whose order is already known */
+   return (pContext->rank[0] < pContext->rank[nDataPos + nDictionaryLeft - pContext->dictionary_size]) ? -1 : 1;
+}
+
+/**
+ * Compare two suffixes that start in the dictionary
+ *
+ * @param pContext merge context
+ * @param nPos1 position of first suffix in window
+ * @param nPos2 position of second suffix in window
+ *
+ * @return negative value if the first suffix sorts first, positive value otherwise
+ */
+static int apultra_dictionary_compare(apultra_merge_context *pContext, const int nPos1, const int nPos2) {
+   const unsigned char *pWindow = pContext->window;
+   const int nLeft1 = pContext->dictionary_size - nPos1;
+   const int nLeft2 = pContext->dictionary_size - nPos2;
+   const int nMaxLen = (nLeft1 < nLeft2) ? nLeft1 : nLeft2;
+   const int nLen = apultra_get_match_len(pWindow + nPos1, pWindow + nPos2, nMaxLen);
+
+   pContext->budget -= nLen;
+
+   if (nLen < nMaxLen)
+      return (pWindow[nPos1 + nLen] < pWindow[nPos2 + nLen]) ? -1 : 1;
+
+   /* One suffix reached the end of the dictionary, and continues with the data */
+   if (nLeft1 < nLeft2)
+      return -apultra_dictionary_compare_with_data(pContext, nPos2 + nLen, pContext->dictionary_size);
+   else
+      return apultra_dictionary_compare_with_data(pContext, nPos1 + nLen, pContext->dictionary_size);
+}
+
+/**
+ * Build the suffix array of an input window that starts with an indexed dictionary, by sorting only the bytes that
+ * follow the dictionary and merging them with the dictionary's presorted suffixes
+ *
+ * @param pDivSufSortContext suffix sorter context
+ * @param pDictionary indexed dictionary, that the window starts with
+ * @param pInWindow pointer to input data window (dictionary + bytes to compress)
+ * @param nInWindowSize total input size in bytes (dictionary + bytes to compress)
+ * @param pSuffixArray output suffix array, nInWindowSize entries
+ * @param pScratch scratch space, nInWindowSize * 2 integers
+ *
+ * @return 0 for success, non-zero if the suffixes could not be merged in reasonable time and must be sorted fully
+ */
+int apultra_dictionary_sort_window(divsufsort_ctx_t *pDivSufSortContext, const apultra_dictionary *pDictionary, const unsigned char *pInWindow, const int nInWindowSize, unsigned long long *pSuffixArray, int *pScratch) {
+   const unsigned int *pDictionarySuffixes = pDictionary->suffixes;
+   const int nDictionarySize = pDictionary->size;
+   const int nDataSize = nInWindowSize - nDictionarySize;
+   apultra_merge_context context;
+   int *pDataSuffixes = pScratch;
+   int *pRank = pDataSuffixes + nDataSize;
+   int *pOpenSuffixes = pRank + nDataSize;
+   int *pMergeBuffer;
+   int nNumOpen = 0;
+   int i;
+
+   if (!pDictionarySuffixes || nDataSize <= 0 || nDictionarySize <= 0)
+      return 100;
+
+   /* Sort the suffixes of the data that follows the dictionary; their order is the same in the whole window */
+   if (divsufsort_build_array(pDivSufSortContext, pInWindow + nDictionarySize, pDataSuffixes, nDataSize) != 0)
+      return 100;
+   for (i = 0; i < nDataSize; i++)
+      pRank[pDataSuffixes[i]] = i;
+
+   context.window = pInWindow;
+   context.dictionary_size = nDictionarySize;
+   context.window_size = nInWindowSize;
+   context.rank = pRank;
+   context.budget = (long long)nInWindowSize * MERGE_BUDGET_PER_BYTE;
+
+   /* Dictionary suffixes that aren't a prefix of another one differ from all others within the dictionary, so
+    * they keep their presorted order. Open suffixes need to be sorted again, now that the data is known */
+   for (i = 0; i < nDictionarySize; i++) {
+      if (pDictionarySuffixes[i] & DICTIONARY_SUFFIX_OPEN)
+         pOpenSuffixes[nNumOpen++] = (int)(pDictionarySuffixes[i] & DICTIONARY_SUFFIX_POS_MASK);
+   }
+
+   pMergeBuffer = pOpenSuffixes + nNumOpen;
+
+   int nRunSize;
+   for (nRunSize = 1; nRunSize < nNumOpen && context.budget >= 0; nRunSize <<= 1) {
+      for (i = 0; i < nNumOpen; i += nRunSize * 2) {
+         int nLeft = i, nLeftEnd = i + nRunSize;
+         int nRight = nLeftEnd, nRightEnd = i + nRunSize * 2;
+         int nOut = i;
+
+         if (nLeftEnd > nNumOpen) nLeftEnd = nNumOpen;
+         if (nRight > nNumOpen) nRight = nNumOpen;
+         if (nRightEnd > nNumOpen) nRightEnd = nNumOpen;
+
+         while (nLeft < nLeftEnd && nRight < nRightEnd) {
+            if (apultra_dictionary_compare(&context, pOpenSuffixes[nRight], pOpenSuffixes[nLeft]) < 0)
+               pMergeBuffer[nOut++] = pOpenSuffixes[nRight++];
+            else
+               pMergeBuffer[nOut++] = pOpenSuffixes[nLeft++];
+         }
+         while (nLeft < nLeftEnd)
+            pMergeBuffer[nOut++] = pOpenSuffixes[nLeft++];
+         while (nRight < nRightEnd)
+            pMergeBuffer[nOut++] = pOpenSuffixes[nRight++];
+      }
+
+      memcpy(pOpenSuffixes, pMergeBuffer, nNumOpen * sizeof(int));
+   }
+
+   /* Merge presorted dictionary suffixes, open dictionary suffixes and data suffixes */
+   int nClosed = 0, nOpen = 0, nData = 0;
+
+   for (i = 0; i < nInWindowSize && context.budget >= 0; i++) {
+      int nBestPos = -1;
+
+      while (nClosed < nDictionarySize && (pDictionarySuffixes[nClosed] & DICTIONARY_SUFFIX_OPEN))
+         nClosed++;
+
+      if (nClosed < nDictionarySize)
+         nBestPos = (int)pDictionarySuffixes[nClosed];
+      if (nOpen < nNumOpen && (nBestPos < 0 || apultra_dictionary_compare(&context, pOpenSuffixes[nOpen], nBestPos) < 0))
+         nBestPos = pOpenSuffixes[nOpen];
+      if (nData < nDataSize && (nBestPos < 0 || apultra_dictionary_compare_with_data(&context, nBestPos, pDataSuffixes[nData] + nDictionarySize) > 0))
+         nBestPos = pDataSuffixes[nData] + nDictionarySize;
+
+      if (nBestPos >= nDictionarySize)
+         nData++;
+      else if (nOpen < nNumOpen && nBestPos == pOpenSuffixes[nOpen])
+         nOpen++;
+      else
+         nClosed++;
+
+      pSuffixArray[i] = (unsigned long long)nBestPos;
+   }
+
+   return (context.budget >= 0) ? 0 : 100;
+}
@@ -0,0 +1,107 @@
+/*
+ * dictionary.h - dictionary definitions
+ *
+ * Copyright (C) 2026 agent
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty.  In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ * 1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation would be
+ *    appreciated but is not required.
+ * 2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ * 3. This notice may not be removed or altered from any source distribution.
+ */
+
+#ifndef _DICTIONARY_H
+#define _DICTIONARY_H
+
+#include <stdlib.h>
+#include "divsufsort.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** Flag set in a sorted dictionary suffix, if the suffix is a prefix of the next one in the dictionary's order */
+#define DICTIONARY_SUFFIX_OPEN 0x80000000U
+
+/** Mask for getting the position out of a sorted dictionary suffix */
+#define DICTIONARY_SUFFIX_POS_MASK 0x7fffffffU
+
+/** Dictionary to prime compression with, optionally with a precomputed suffix index */
+typedef struct _apultra_dictionary {
+   const unsigned char *data;
+   int size;
+   const unsigned int *suffixes;
+   unsigned char *data_buffer;
+   unsigned int *suffix_buffer;
+   void *mapping;
+   size_t mapping_size;
+} apultra_dictionary;
+
+/**
+ * Load dictionary contents, either from a raw dictionary file or from an index file written by
+ * apultra_dictionary_save_index(). Index files are memory-mapped where possible. Only the last BLOCK_SIZE bytes of
+ * a raw dictionary are kept.
+ *
+ * @param pDictionary dictionary to load
+ * @param pszDictionaryFilename name of dictionary or index file
+ *
+ * @return 0 for success, non-zero for failure
+ */
+int apultra_dictionary_load(apultra_dictionary *pDictionary, const char *pszDictionaryFilename);
+
+/**
+ * Sort the dictionary's suffixes, so that it doesn't need to be sorted again for each input that it primes
+ *
+ * @param pDictionary dictionary to index
+ *
+ * @return 0 for success, non-zero for failure
+ */
+int apultra_dictionary_build_index(apultra_dictionary *pDictionary);
+
+/**
+ * Write dictionary and its suffix index to a file, that can be loaded back with apultra_dictionary_load()
+ *
+ * @param pDictionary indexed dictionary
+ * @param pszIndexFilename name of index file to write
+ *
+ * @return 0 for success, non-zero for failure
+ */
+int apultra_dictionary_save_index(const apultra_dictionary *pDictionary, const char *pszIndexFilename);
+
+/**
+ * Free dictionary contents
+ *
+ * @param pDictionary dictionary to free
+ */
+void apultra_dictionary_free(apultra_dictionary *pDictionary);
+
+/**
+ * Build the suffix array of an input window that starts with an indexed dictionary, by sorting only the bytes that
+ * follow the dictionary and merging them with the dictionary's presorted suffixes
+ *
+ * @param pDivSufSortContext suffix sorter context
+ * @param pDictionary indexed dictionary, that the window starts with
+ * @param pInWindow pointer to input data window (dictionary + bytes to compress)
+ * @param nInWindowSize total input size in bytes (dictionary + bytes to compress)
+ * @param pSuffixArray output suffix array, nInWindowSize entries
+ * @param pScratch scratch space, nInWindowSize * 2 integers
+ *
+ * @return 0 for success, non-zero if the suffixes could not be merged in reasonable time and must be sorted fully
+ */
+int apultra_dictionary_sort_window(divsufsort_ctx_t *pDivSufSortContext, const apultra_dictionary *pDictionary, const unsigned char *pInWindow, const int nInWindowSize, unsigned long long *pSuffixArray, int *pScratch);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _DICTIONARY_H */
@@ -235,16 +235,17 @@ size_t apultra_get_max_decompressed_size(const unsigned char *pInputData, size_t
  * Decompress data in memory
  *
  * @param pInputData compressed data
- * @param pOutBuffer buffer for decompressed data
+ * @param pOutBuffer buffer for decompressed data, that starts with the dictionary if there is one
  * @param nInputSize compressed size in bytes
- * @param nMaxOutBufferSize maximum capacity of decompression buffer
+ * @param nMaxOutBufferSize maximum capacity of decompression buffer, not including the dictionary
+ * @param nDictionarySize size of dictionary in front of decompressed data, in bytes (0 for none)
  * @param nFlags compression flags (a bitmask of APULTRA_FLAG_xxx, or 0)
  *
- * @return actual decompressed size, or -1 for error
+ * @return actual decompressed size, not including the dictionary, or -1 for error
  */
-size_t apultra_decompress(const unsigned char *pInputData, unsigned char *pOutData, size_t nInputSize, size_t nMaxOutBufferSize, const unsigned int nFlags) {
+size_t apultra_decompress(const unsigned char *pInputData, unsigned char *pOutData, size_t nInputSize, size_t nMaxOutBufferSize, size_t nDictionarySize, const unsigned int nFlags) {
    const unsigned char *pInputDataEnd = pInputData + nInputSize;
-   unsigned char *pCurOutData = pOutData;
+   unsigned char *pCurOutData = pOutData + nDictionarySize;
    const unsigned char *pOutDataEnd = pCurOutData + nMaxOutBufferSize;
    const unsigned char *pOutDataFastEnd = pOutDataEnd - 20;
    int nCurBitMask[3] = { 0, 0, 0 };
@@ -441,5 +442,397 @@ size_t apultra_decompress(const unsigned char *pInputData, unsigned char *pOutDa
       }
    }
 
-   return (size_t)(pCurOutData - pOutData);
+   return (size_t)(pCurOutData - pOutData) - nDictionarySize;
+}
+
+/**
+ * Pass decompressed bytes that haven't been written yet to the write function
+ *
+ * @param pStream streaming decompression context
+ *
+ * @return 0 for success, non-zero for failure
+ */
+static int apultra_stream_flush_window(apultra_stream_decompressor *pStream) {
+   if (pStream->window_pos > pStream->flush_pos) {
+      if (pStream->write(pStream->window + pStream->flush_pos, pStream->window_pos - pStream->flush_pos, pStream->user_data) != 0)
+         return -1;
+   }
+
+   if (pStream->window_pos == pStream->window_size)
+      pStream->window_pos = 0;
+   pStream->flush_pos = pStream->window_pos;
+   return 0;
+}
+
+/**
+ * Append one decompressed byte to the ring buffer
+ *
+ * @param pStream streaming decompression context
+ * @param nValue byte value
+ *
+ * @return 0 for success, non-zero for failure
+ */
+static int apultra_stream_put_byte(apultra_stream_decompressor *pStream, const unsigned char nValue) {
+   if (pStream->max_out_size && (size_t)pStream->decompressed_size >= pStream->max_out_size)
+      return -1;
+
+   pStream->window[pStream->window_pos++] = nValue;
+   pStream->decompressed_size++;
+   if (pStream->history_size < pStream->window_size)
+      pStream->history_size++;
+
+   if (pStream->window_pos == pStream->window_size)
+      return apultra_stream_flush_window(pStream);
+   return 0;
+}
+
+/**
+ * Copy a match from earlier in the ring buffer
+ *
+ * @param pStream streaming decompression context
+ * @param nMatchOffset match offset, in bytes
+ * @param nMatchLen match length, in bytes
+ *
+ * @return 0 for success, non-zero for failure
+ */
+static int apultra_stream_copy_match(apultra_stream_decompressor *pStream, const size_t nMatchOffset, size_t nMatchLen) {
+   if (nMatchOffset < 1 || nMatchOffset > pStream->history_size)
+      return -1;
+   if (pStream->max_out_size && ((size_t)pStream->decompressed_size + nMatchLen) > pStream->max_out_size)
+      return -1;
+
+   while (nMatchLen) {
+      const size_t nSrcPos = (pStream->window_pos + pStream->window_size - nMatchOffset) % pStream->window_size;
+      size_t nCopySize = nMatchLen;
+
+      /* Copy runs that neither wrap around nor overlap the bytes they produce */
+      if (nCopySize > (pStream->window_size - pStream->window_pos))
+         nCopySize = pStream->window_size - pStream->window_pos;
+      if (nCopySize > (pStream->window_size - nSrcPos))
+         nCopySize = pStream->window_size - nSrcPos;
+      if (nCopySize > nMatchOffset)
+         nCopySize = nMatchOffset;
+
+      memmove(pStream->window + pStream->window_pos, pStream->window + nSrcPos, nCopySize);
+      pStream->window_pos += nCopySize;
+      pStream->decompressed_size += nCopySize;
+      pStream->history_size += nCopySize;
+      if (pStream->history_size > pStream->window_size)
+         pStream->history_size = pStream->window_size;
+      nMatchLen -= nCopySize;
+
+      if (pStream->window_pos == pStream->window_size) {
+         if (apultra_stream_flush_window(pStream) != 0)
+            return -1;
+      }
+   }
+
+   return 0;
+}
+
+/**
+ * Decompress commands until the input runs out in the middle of one, or the end of the stream is reached. A command is
+ * only consumed once all of its bits and bytes are available, so that it can be resumed from its start with more input.
+ *
+ * @param pStream streaming decompression context
+ * @param ppInputData pointer to compressed data, updated to the start of the first command that isn't decompressed
+ * @param pInputDataEnd end of compressed data
+ *
+ * @return 1 if more input is needed, 2 at the end of the stream, -1 for error
+ */
+static int apultra_stream_decode(apultra_stream_decompressor *pStream, const unsigned char **ppInputData, const unsigned char *pInputDataEnd) {
+   const int nSingleBitBufferIdx = 0;
+   const int nGammaBitBufferIdx = (pStream->flags & APULTRA_FLAG_ENHANCED) ? 1 : 0;
+   const int nNibblesBitBufferIdx = (pStream->flags & APULTRA_FLAG_ENHANCED) ? 2 : 0;
+
+   if (!pStream->started) {
+      /* The first byte is always a literal */
+      if (*ppInputData >= pInputDataEnd)
+         return 1;
+      if (apultra_stream_put_byte(pStream, *(*ppInputData)++) != 0)
+         return -1;
+      pStream->compressed_size++;
+      pStream->started = 1;
+   }
+
+   while (1) {
+      const unsigned char *pInputData = *ppInputData;
+      int nCurBitMask[3];
+      unsigned char bits[3];
+      int nMatchOffset = pStream->match_offset;
+      int nFollowsLiteral;
+      int nCopyOffset = 0;
+      unsigned int nCopyLen = 0;
+      int nLiteral = -1;
+      int nIsEndOfData = 0;
+      int nResult;
+
+      memcpy(nCurBitMask, pStream->cur_bit_mask, sizeof(nCurBitMask));
+      memcpy(bits, pStream->bits, sizeof(bits));
+
+      /* Parse one command into local state */
+      nResult = apultra_read_bit(&pInputData, pInputDataEnd, nCurBitMask, bits, nSingleBitBufferIdx);
+      if (nResult < 0) return 1;
+
+      if (!nResult) {
+         /* '0': literal */
+         if (pInputData >= pInputDataEnd) return 1;
+         nLiteral = *pInputData++;
+         nFollowsLiteral = 1;
+      }
+      else {
+         nResult = apultra_read_bit(&pInputData, pInputDataEnd, nCurBitMask, bits, nSingleBitBufferIdx);
+         if (nResult < 0) return 1;
+
+         if (nResult == 0) {
+            int nMatchOffsetHi;
+            int nMatchLen;
+            unsigned int nMatchLenBias = 0;
+            unsigned int nIsRepMatch = 0;
+
+            /* '10': 8+n bits offset */
+            nMatchOffsetHi = apultra_read_gamma2(&pInputData, pInputDataEnd, nCurBitMask, bits, nGammaBitBufferIdx);
+            if (nMatchOffsetHi < 0) return 1;
+            if (pStream->follows_literal == 0 || nMatchOffsetHi != 2) {
+               if (pInputData >= pInputDataEnd) return 1;
+               if (pStream->follows_literal)
+                  nMatchOffset = (nMatchOffsetHi - 3) << 8;
+               else
+                  nMatchOffset = (nMatchOffsetHi - 2) << 8;
+               nMatchOffset |= (unsigned int)(*pInputData++);
+
+               if (nMatchOffset < 128)
+                  nMatchLenBias = 2;
+            }
+            else {
+               /* else rep-match */
+               nIsRepMatch = 1;
+            }
+
+            nMatchLen = apultra_read_gamma2(&pInputData, pInputDataEnd, nCurBitMask, bits, nGammaBitBufferIdx);
+            if (nMatchLen < 0) return 1;
+
+            nCopyLen = (unsigned int)nMatchLen;
+            if (!nIsRepMatch) {
+               if (nMatchOffset >= MINMATCH3_OFFSET)
+                  nCopyLen++;
+               if (nMatchOffset >= MINMATCH4_OFFSET)
+                  nCopyLen++;
+            }
+            nCopyLen += nMatchLenBias;
+            nCopyOffset = nMatchOffset;
+            nFollowsLiteral = 0;
+         }
+         else {
+            nResult = apultra_read_bit(&pInputData, pInputDataEnd, nCurBitMask, bits, nSingleBitBufferIdx);
+            if (nResult < 0) return 1;
+
+            if (nResult == 0) {
+               unsigned int nCommand;
+
+               /* '110': 7 bits offset + 1 bit length */
+               if (pInputData >= pInputDataEnd) return 1;
+               nCommand = (unsigned int)(*pInputData++);
+               if (nCommand == 0x00) {
+                  /* EOD. No match len follows. */
+                  nIsEndOfData = 1;
+               }
+               else {
+                  /* Bits 7-1: offset; bit 0: length */
+                  nMatchOffset = (nCommand >> 1);
+                  nCopyOffset = nMatchOffset;
+                  nCopyLen = (nCommand & 1) + 2;
+               }
+               nFollowsLiteral = 0;
+            }
+            else {
+               int nShortMatchOffset = 0;
+               int i;
+
+               /* '111': 4 bit offset */
+               for (i = 0; i < 4; i++) {
+                  nResult = apultra_read_bit(&pInputData, pInputDataEnd, nCurBitMask, bits, nNibblesBitBufferIdx);
+                  if (nResult < 0) return 1;
+                  nShortMatchOffset = (nShortMatchOffset << 1) | nResult;
+               }
+
+               if (nShortMatchOffset) {
+                  /* Short offset, 1-15 */
+                  nCopyOffset = nShortMatchOffset;
+                  nCopyLen = 1;
+               }
+               else {
+                  /* Write zero */
+                  nLiteral = 0;
+               }
+               nFollowsLiteral = 1;
+            }
+         }
+      }
+
+      /* The whole command is available: consume it and run it */
+      pStream->compressed_size += (long long)(pInputData - *ppInputData);
+      *ppInputData = pInputData;
+      memcpy(pStream->cur_bit_mask, nCurBitMask, sizeof(nCurBitMask));
+      memcpy(pStream->bits, bits, sizeof(bits));
+      pStream->match_offset = nMatchOffset;
+      pStream->follows_literal = nFollowsLiteral;
+
+      if (nIsEndOfData)
+         return 2;
+
+      if (nLiteral >= 0) {
+         if (apultra_stream_put_byte(pStream, (unsigned char)nLiteral) != 0)
+            return -1;
+      }
+      else {
+         if (apultra_stream_copy_match(pStream, (size_t)nCopyOffset, (size_t)nCopyLen) != 0)
+            return -1;
+      }
+   }
+}
+
+/**
+ * Initialize streaming decompression context
+ *
+ * @param pStream streaming decompression context to initialize
+ * @param nWindowSize size of ring buffer, at least the largest match offset in the stream, or 0 for the largest offset the format allows
+ * @param pDictionaryData dictionary that the data was compressed with, or NULL for none
+ * @param nDictionarySize size of dictionary in bytes (0 for none)
+ * @param nMaxOutSize maximum number of bytes to decompress before failing, or 0 for no limit
+ * @param nFlags compression flags (a bitmask of APULTRA_FLAG_xxx, or 0)
+ * @param write function that receives decompressed bytes
+ * @param pUserData value passed to the write function
+ *
+ * @return 0 for success, non-zero for failure
+ */
+int apultra_stream_decompressor_init(apultra_stream_decompressor *pStream, size_t nWindowSize, const unsigned char *pDictionaryData, size_t nDictionarySize,
+      size_t nMaxOutSize, const unsigned int nFlags, apultra_stream_write_func write, void *pUserData) {
+   memset(pStream, 0, sizeof(apultra_stream_decompressor));
+   pStream->write = write;
+   pStream->user_data = pUserData;
+   pStream->window_size = nWindowSize ? nWindowSize : (MAX_OFFSET + 1);
+   pStream->max_out_size = nMaxOutSize;
+   pStream->match_offset = 1;
+   pStream->follows_literal = 1;
+   pStream->flags = nFlags;
+
+   pStream->window = (unsigned char *)malloc(pStream->window_size);
+   if (!pStream->window)
+      return 100;
+
+   /* The end of the dictionary is the history that the first matches can refer to; it isn't written out */
+   if (pDictionaryData && nDictionarySize) {
+      const size_t nHistorySize = (nDictionarySize < pStream->window_size) ? nDictionarySize : pStream->window_size;
+
+      memcpy(pStream->window, pDictionaryData + nDictionarySize - nHistorySize, nHistorySize);
+      pStream->history_size = nHistorySize;
+      pStream->window_pos = (nHistorySize < pStream->window_size) ? nHistorySize : 0;
+      pStream->flush_pos = pStream->window_pos;
+   }
+
+   return 0;
+}
+
+/**
+ * Feed compressed data to streaming decompression context
+ *
+ * @param pStream streaming decompression context
+ * @param pInputData compressed data
+ * @param nInputSize number of compressed bytes
+ *
+ * @return 0 for success, non-zero for failure
+ */
+int apultra_stream_decompressor_feed(apultra_stream_decompressor *pStream, const unsigned char *pInputData, size_t nInputSize) {
+   const unsigned char *pInputDataEnd = pInputData + nInputSize;
+   int nResult = 1;
+
+   if (pStream->error)
+      return 100;
+
+   if (pStream->pending_size && !pStream->done) {
+      /* Complete the command that was held back with the start of the new data */
+      const int nOldPendingSize = pStream->pending_size;
+      int nCopySize = APULTRA_STREAM_MAX_COMMAND_SIZE - nOldPendingSize;
+      const unsigned char *pPendingData = pStream->pending;
+
+      if ((size_t)nCopySize > nInputSize)
+         nCopySize = (int)nInputSize;
+      memcpy(pStream->pending + nOldPendingSize, pInputData, nCopySize);
+      pStream->pending_size += nCopySize;
+
+      nResult = apultra_stream_decode(pStream, &pPendingData, pStream->pending + pStream->pending_size);
+      if (nResult < 0 || (nResult == 1 && pStream->pending_size == APULTRA_STREAM_MAX_COMMAND_SIZE && pPendingData == pStream->pending)) {
+         pStream->error = 1;
+         return 100;
+      }
+
+      if ((pPendingData - pStream->pending) >= nOldPendingSize) {
+         /* All held back bytes are consumed, carry on from the new data */
+         pInputData += (pPendingData - pStream->pending) - nOldPendingSize;
+         pStream->pending_size = 0;
+      }
+      else {
+         /* Still short of a full command; all new data is in the pending buffer */
+         pStream->pending_size -= (int)(pPendingData - pStream->pending);
+         memmove(pStream->pending, pPendingData, pStream->pending_size);
+         pInputData = pInputDataEnd;
+      }
+
+      if (nResult == 2)
+         pStream->done = 1;
+   }
+
+   if (!pStream->done && !pStream->pending_size && pInputData < pInputDataEnd) {
+      nResult = apultra_stream_decode(pStream, &pInputData, pInputDataEnd);
+      if (nResult < 0 || (nResult == 1 && (pInputDataEnd - pInputData) >= APULTRA_STREAM_MAX_COMMAND_SIZE)) {
+         pStream->error = 1;
+         return 100;
+      }
+
+      if (nResult == 2) {
+         pStream->done = 1;
+      }
+      else {
+         /* Hold back the start of the command that the data ends in */
+         pStream->pending_size = (int)(pInputDataEnd - pInputData);
+         memcpy(pStream->pending, pInputData, pStream->pending_size);
+      }
+   }
+
+   if (apultra_stream_flush_window(pStream) != 0) {
+      pStream->error = 1;
+      return 100;
+   }
+
+   return 0;
+}
+
+/**
+ * Check that the compressed stream is complete
+ *
+ * @param pStream streaming decompression context
+ *
+ * @return 0 if the end of the stream was decompressed, non-zero if the stream is truncated or corrupted
+ */
+int apultra_stream_decompressor_end(apultra_stream_decompressor *pStream) {
+   if (pStream->error)
+      return 100;
+
+   /* Like the streaming compressor, empty input stands for empty data */
+   if (pStream->done || (!pStream->started && !pStream->pending_size))
+      return 0;
+   return 100;
+}
+
+/**
+ * Clean up streaming decompression context and free up any associated resources
+ *
+ * @param pStream streaming decompression context to clean up
+ */
+void apultra_stream_decompressor_destroy(apultra_stream_decompressor *pStream) {
+   if (pStream->window) {
+      free(pStream->window);
+      pStream->window = NULL;
+   }
 }
@@ -39,6 +39,39 @@
 extern "C" {
 #endif
 
+/** Largest command in a compressed stream, in bytes, that a streaming decompression context may have to hold back */
+#define APULTRA_STREAM_MAX_COMMAND_SIZE 64
+
+/** Function that receives decompressed bytes from a streaming decompression context; returns 0 for success */
+#ifndef _APULTRA_STREAM_WRITE_FUNC
+#define _APULTRA_STREAM_WRITE_FUNC
+typedef int (*apultra_stream_write_func)(const unsigned char *pData, size_t nSize, void *pUserData);
+#endif
+
+/** Streaming decompression context */
+typedef struct _apultra_stream_decompressor {
+   apultra_stream_write_func write;
+   void *user_data;
+   unsigned char *window;
+   size_t window_size;
+   size_t window_pos;
+   size_t flush_pos;
+   size_t history_size;
+   size_t max_out_size;
+   unsigned char pending[APULTRA_STREAM_MAX_COMMAND_SIZE];
+   int pending_size;
+   int cur_bit_mask[3];
+   unsigned char bits[3];
+   int match_offset;
+   int follows_literal;
+   int flags;
+   int started;
+   int done;
+   int error;
+   long long compressed_size;
+   long long decompressed_size;
+} apultra_stream_decompressor;
+
 /**
  * Get maximum decompressed size of compressed data
  *
@@ -54,14 +87,64 @@ size_t apultra_get_max_decompressed_size(const unsigned char *pInputData, size_t
  * Decompress data in memory
  *
  * @param pInputData compressed data
- * @param pOutBuffer buffer for decompressed data
+ * @param pOutBuffer buffer for decompressed data, that starts with the dictionary if there is one
  * @param nInputSize compressed size in bytes
- * @param nMaxOutBufferSize maximum capacity of decompression buffer
+ * @param nMaxOutBufferSize maximum capacity of decompression buffer, not including the dictionary
+ * @param nDictionarySize size of dictionary in front of decompressed data, in bytes (0 for none)
  * @param nFlags compression flags (a bitmask of APULTRA_FLAG_xxx, or 0)
  *
- * @return actual decompressed size, or -1 for error
+ * @return actual decompressed size, not including the dictionary, or -1 for error
+ */
+size_t apultra_decompress(const unsigned char *pInputData, unsigned char *pOutBuffer, size_t nInputSize, size_t nMaxOutBufferSize, size_t nDictionarySize, const unsigned int nFlags);
+
+/**
+ * Initialize streaming decompression context
+ *
+ * Compressed data can then be fed in chunks of any size. Decompressed bytes are kept in a ring buffer of the window
+ * size, that matches are copied from, and passed to the write function as the ring buffer fills up and at the end of
+ * each call to apultra_stream_decompressor_feed(). Memory use only depends on the window size.
+ *
+ * @param pStream streaming decompression context to initialize
+ * @param nWindowSize size of ring buffer, at least the largest match offset in the stream, or 0 for the largest offset the format allows
+ * @param pDictionaryData dictionary that the data was compressed with, or NULL for none
+ * @param nDictionarySize size of dictionary in bytes (0 for none)
+ * @param nMaxOutSize maximum number of bytes to decompress before failing, or 0 for no limit
+ * @param nFlags compression flags (a bitmask of APULTRA_FLAG_xxx, or 0)
+ * @param write function that receives decompressed bytes
+ * @param pUserData value passed to the write function
+ *
+ * @return 0 for success, non-zero for failure
+ */
+int apultra_stream_decompressor_init(apultra_stream_decompressor *pStream, size_t nWindowSize, const unsigned char *pDictionaryData, size_t nDictionarySize,
+   size_t nMaxOutSize, const unsigned int nFlags, apultra_stream_write_func write, void *pUserData);
+
+/**
+ * Feed compressed data to streaming decompression context. A command that is split across calls is decompressed when
+ * the rest of it is fed. Data after the end of the stream is ignored.
+ *
+ * @param pStream streaming decompression context
+ * @param pInputData compressed data
+ * @param nInputSize number of compressed bytes
+ *
+ * @return 0 for success, non-zero for failure
+ */
+int apultra_stream_decompressor_feed(apultra_stream_decompressor *pStream, const unsigned char *pInputData, size_t nInputSize);
+
+/**
+ * Check that the compressed stream is complete
+ *
+ * @param pStream streaming decompression context
+ *
+ * @return 0 if the end of the stream was decompressed, non-zero if the stream is truncated or corrupted
+ */
+int apultra_stream_decompressor_end(apultra_stream_decompressor *pStream);
+
+/**
+ * Clean up streaming decompression context and free up any associated resources
+ *
+ * @param pStream streaming decompression context to clean up
  */
-size_t apultra_decompress(const unsigned char *pInputData, unsigned char *pOutBuffer, size_t nInputSize, size_t nMaxOutBufferSize, const unsigned int nFlags);
+void apultra_stream_decompressor_destroy(apultra_stream_decompressor *pStream);
 
 #ifdef __cplusplus
 }
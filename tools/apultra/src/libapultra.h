@@ -36,5 +36,6 @@
 #include "format.h"
 #include "shrink.h"
 #include "expand.h"
+#include "dictionary.h"
 
 #endif /* _LIB_APULTRA_H */
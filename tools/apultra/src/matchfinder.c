@@ -34,6 +34,8 @@
 #include "matchfinder.h"
 #include "format.h"
 #include "libapultra.h"
+#include "dictionary.h"
+#include "matchlen.h"
 
 /**
  * Hash index into TAG_BITS
@@ -52,24 +54,29 @@ static inline int apultra_get_index_tag(unsigned int nIndex) {
  * @param pCompressor compression context
  * @param pInWindow pointer to input data window (previously compressed bytes + bytes to compress)
  * @param nInWindowSize total input size in bytes (previously compressed bytes + bytes to compress)
+ * @param pDictionary indexed dictionary that the window starts with, or NULL to sort the whole window
  *
  * @return 0 for success, non-zero for failure
  */
-int apultra_build_suffix_array(apultra_compressor *pCompressor, const unsigned char *pInWindow, const int nInWindowSize) {
+int apultra_build_suffix_array(apultra_compressor *pCompressor, const unsigned char *pInWindow, const int nInWindowSize, const apultra_dictionary *pDictionary) {
    unsigned long long *intervals = pCompressor->intervals;
-
-   /* Build suffix array from input data */
-   saidx_t *suffixArray = (saidx_t*)intervals;
-   if (divsufsort_build_array(&pCompressor->divsufsort_context, pInWindow, suffixArray, nInWindowSize) != 0) {
-      return 100;
-   }
-
    int i;
 
-   for (i = nInWindowSize - 1; i >= 0; i--) {
-      intervals[i] = suffixArray[i];
+   /* If the window starts with an indexed dictionary, only sort the bytes that follow it. Otherwise, or if merging
+    * with the dictionary's suffixes would take too long, build suffix array from the whole input data */
+   if (!pDictionary || apultra_dictionary_sort_window(&pCompressor->divsufsort_context, pDictionary, pInWindow, nInWindowSize, intervals, (int*)pCompressor->pos_data) != 0) {
+      saidx_t *suffixArray = (saidx_t*)intervals;
+      if (divsufsort_build_array(&pCompressor->divsufsort_context, pInWindow, suffixArray, nInWindowSize) != 0) {
+         return 100;
+      }
+
+      for (i = nInWindowSize - 1; i >= 0; i--) {
+         intervals[i] = suffixArray[i];
+      }
    }
 
+   apultra_profiler_end_phase(&pCompressor->profiler, APULTRA_PHASE_DIVSUFSORT);
+
    int *PLCP = (int*)pCompressor->pos_data;  /* Use temporarily */
    int *Phi = PLCP;
    int nCurLen = 0;
@@ -84,7 +91,7 @@ int apultra_build_suffix_array(apultra_compressor *pCompressor, const unsigned c
          continue;
       }
       int nMaxLen = (i > Phi[i]) ? (nInWindowSize - i) : (nInWindowSize - Phi[i]);
-      while (nCurLen < nMaxLen && pInWindow[i + nCurLen] == pInWindow[Phi[i] + nCurLen]) nCurLen++;
+      nCurLen += apultra_get_match_len(pInWindow + i + nCurLen, pInWindow + Phi[i] + nCurLen, nMaxLen - nCurLen);
       PLCP[i] = nCurLen;
       if (nCurLen > 0)
          nCurLen--;
@@ -173,6 +180,8 @@ int apultra_build_suffix_array(apultra_compressor *pCompressor, const unsigned c
    for (; top > pCompressor->open_intervals; top--)
       intervals[*top & POS_MASK] = *(top - 1);
 
+   apultra_profiler_end_phase(&pCompressor->profiler, APULTRA_PHASE_LCP_INTERVALS);
+
    /* Success */
    return 0;
 }
@@ -364,19 +373,20 @@ void apultra_skip_matches(apultra_compressor *pCompressor, const int nStartOffse
  * Find all matches for the data to be compressed
  *
  * @param pCompressor compression context
- * @param nMatchesPerOffset maximum number of matches to store for each offset
+ * @param nMatchesPerOffset number of match slots for each offset
+ * @param nMaxMatches maximum number of matches to find for each offset, up to nMatchesPerOffset
  * @param nStartOffset current offset in input window (typically the number of previously compressed bytes)
  * @param nEndOffset offset to end finding matches at (typically the size of the total input window in bytes
  * @param nBlockFlags bit 0: 1 for first block, 0 otherwise; bit 1: 1 for last block, 0 otherwise
  */
-void apultra_find_all_matches(apultra_compressor *pCompressor, const int nMatchesPerOffset, const int nStartOffset, const int nEndOffset, const int nBlockFlags) {
+void apultra_find_all_matches(apultra_compressor *pCompressor, const int nMatchesPerOffset, const int nMaxMatches, const int nStartOffset, const int nEndOffset, const int nBlockFlags) {
    apultra_match *pMatch = pCompressor->match;
    unsigned short *pMatchDepth = pCompressor->match_depth;
    unsigned char *pMatch1 = pCompressor->match1;
    int i;
 
    for (i = nStartOffset; i < nEndOffset; i++) {
-      int nMatches = apultra_find_matches_at(pCompressor, i, pMatch, pMatchDepth, pMatch1, nMatchesPerOffset, nBlockFlags);
+      int nMatches = apultra_find_matches_at(pCompressor, i, pMatch, pMatchDepth, pMatch1, nMaxMatches, nBlockFlags);
 
       while (nMatches < nMatchesPerOffset) {
          pMatch[nMatches].length = 0;
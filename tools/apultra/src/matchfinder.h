@@ -40,6 +40,7 @@ extern "C" {
 /* Forward declarations */
 typedef struct _apultra_match apultra_match;
 typedef struct _apultra_compressor apultra_compressor;
+typedef struct _apultra_dictionary apultra_dictionary;
 
 /**
  * Parse input data, build suffix array and overlaid data structures to speed up match finding
@@ -47,10 +48,11 @@ typedef struct _apultra_compressor apultra_compressor;
  * @param pCompressor compression context
  * @param pInWindow pointer to input data window (previously compressed bytes + bytes to compress)
  * @param nInWindowSize total input size in bytes (previously compressed bytes + bytes to compress)
+ * @param pDictionary indexed dictionary that the window starts with, or NULL to sort the whole window
  *
  * @return 0 for success, non-zero for failure
  */
-int apultra_build_suffix_array(apultra_compressor *pCompressor, const unsigned char *pInWindow, const int nInWindowSize);
+int apultra_build_suffix_array(apultra_compressor *pCompressor, const unsigned char *pInWindow, const int nInWindowSize, const apultra_dictionary *pDictionary);
 
 /**
  * Find matches at the specified offset in the input window
@@ -80,12 +82,13 @@ void apultra_skip_matches(apultra_compressor *pCompressor, const int nStartOffse
  * Find all matches for the data to be compressed
  *
  * @param pCompressor compression context
- * @param nMatchesPerOffset maximum number of matches to store for each offset
+ * @param nMatchesPerOffset number of match slots for each offset
+ * @param nMaxMatches maximum number of matches to find for each offset, up to nMatchesPerOffset
  * @param nStartOffset current offset in input window (typically the number of previously compressed bytes)
  * @param nEndOffset offset to end finding matches at (typically the size of the total input window in bytes
  * @param nBlockFlags bit 0: 1 for first block, 0 otherwise; bit 1: 1 for last block, 0 otherwise
  */
-void apultra_find_all_matches(apultra_compressor *pCompressor, const int nMatchesPerOffset, const int nStartOffset, const int nEndOffset, const int nBlockFlags);
+void apultra_find_all_matches(apultra_compressor *pCompressor, const int nMatchesPerOffset, const int nMaxMatches, const int nStartOffset, const int nEndOffset, const int nBlockFlags);
 
 #ifdef __cplusplus
 }
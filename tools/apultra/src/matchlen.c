@@ -0,0 +1,281 @@
+/*
+ * matchlen.c - match length kernels implementation
+ *
+ * Copyright (C) 2026 agent
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty.  In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ * 1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation would be
+ *    appreciated but is not required.
+ * 2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ * 3. This notice may not be removed or altered from any source distribution.
+ */
+
+#include <stdlib.h>
+#include "matchlen.h"
+#include "thread.h"
+
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#define MATCHLEN_X86_GNUC
+#define MATCHLEN_TARGET(__target) __attribute__((target(__target)))
+#include <immintrin.h>
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#define MATCHLEN_X86_MSVC
+#define MATCHLEN_TARGET(__target)
+#include <intrin.h>
+#include <immintrin.h>
+#endif
+
+static int apultra_get_match_len_scalar(const unsigned char *pSrc1, const unsigned char *pSrc2, const int nMaxLen);
+
+apultra_matchlen_func apultra_matchlen_impl = apultra_get_match_len_scalar;
+static int g_nMatchLenKernel = APULTRA_MATCHLEN_AUTO;
+static apultra_once_t g_MatchLenOnce = APULTRA_ONCE_INIT;
+
+/**
+ * Get number of identical bytes at the start of two buffers, one byte at a time
+ *
+ * @param pSrc1 first buffer
+ * @param pSrc2 second buffer
+ * @param nMaxLen maximum number of bytes to compare
+ *
+ * @return number of identical leading bytes, at most nMaxLen
+ */
+static int apultra_get_match_len_scalar(const unsigned char *pSrc1, const unsigned char *pSrc2, const int nMaxLen) {
+   int nLen = 0;
+
+   while (nLen < nMaxLen && pSrc1[nLen] == pSrc2[nLen])
+      nLen++;
+   return nLen;
+}
+
+#if defined(MATCHLEN_X86_GNUC) || defined(MATCHLEN_X86_MSVC)
+
+/**
+ * Get index of lowest set bit
+ *
+ * @param nMask non-zero mask
+ *
+ * @return bit index
+ */
+static inline int apultra_get_first_set_bit(const unsigned int nMask) {
+#ifdef MATCHLEN_X86_MSVC
+   unsigned long nIndex;
+   _BitScanForward(&nIndex, nMask);
+   return (int)nIndex;
+#else
+   return __builtin_ctz(nMask);
+#endif
+}
+
+/**
+ * Get number of identical bytes at the start of two buffers, 16 bytes at a time
+ *
+ * @param pSrc1 first buffer
+ * @param pSrc2 second buffer
+ * @param nMaxLen maximum number of bytes to compare
+ *
+ * @return number of identical leading bytes, at most nMaxLen
+ */
+MATCHLEN_TARGET("sse2")
+static int apultra_get_match_len_sse2(const unsigned char *pSrc1, const unsigned char *pSrc2, const int nMaxLen) {
+   int nLen = 0;
+
+   while ((nLen + 16) <= nMaxLen) {
+      const __m128i vSrc1 = _mm_loadu_si128((const __m128i *)(pSrc1 + nLen));
+      const __m128i vSrc2 = _mm_loadu_si128((const __m128i *)(pSrc2 + nLen));
+      const unsigned int nMismatch = ((unsigned int)_mm_movemask_epi8(_mm_cmpeq_epi8(vSrc1, vSrc2))) ^ 0xffffU;
+
+      if (nMismatch)
+         return nLen + apultra_get_first_set_bit(nMismatch);
+      nLen += 16;
+   }
+
+   while (nLen < nMaxLen && pSrc1[nLen] == pSrc2[nLen])
+      nLen++;
+   return nLen;
+}
+
+/**
+ * Get number of identical bytes at the start of two buffers, 32 bytes at a time
+ *
+ * @param pSrc1 first buffer
+ * @param pSrc2 second buffer
+ * @param nMaxLen maximum number of bytes to compare
+ *
+ * @return number of identical leading bytes, at most nMaxLen
+ */
+MATCHLEN_TARGET("avx2")
+static int apultra_get_match_len_avx2(const unsigned char *pSrc1, const unsigned char *pSrc2, const int nMaxLen) {
+   int nLen = 0;
+
+   while ((nLen + 32) <= nMaxLen) {
+      const __m256i vSrc1 = _mm256_loadu_si256((const __m256i *)(pSrc1 + nLen));
+      const __m256i vSrc2 = _mm256_loadu_si256((const __m256i *)(pSrc2 + nLen));
+      const unsigned int nMismatch = ~((unsigned int)_mm256_movemask_epi8(_mm256_cmpeq_epi8(vSrc1, vSrc2)));
+
+      if (nMismatch)
+         return nLen + apultra_get_first_set_bit(nMismatch);
+      nLen += 32;
+   }
+
+   if ((nLen + 16) <= nMaxLen) {
+      const __m128i vSrc1 = _mm_loadu_si128((const __m128i *)(pSrc1 + nLen));
+      const __m128i vSrc2 = _mm_loadu_si128((const __m128i *)(pSrc2 + nLen));
+      const unsigned int nMismatch = ((unsigned int)_mm_movemask_epi8(_mm_cmpeq_epi8(vSrc1, vSrc2))) ^ 0xffffU;
+
+      if (nMismatch)
+         return nLen + apultra_get_first_set_bit(nMismatch);
+      nLen += 16;
+   }
+
+   while (nLen < nMaxLen && pSrc1[nLen] == pSrc2[nLen])
+      nLen++;
+   return nLen;
+}
+
+#endif
+
+/**
+ * Check if a match length kernel can run on this CPU
+ *
+ * @param nKernel kernel to check (APULTRA_MATCHLEN_xxx)
+ *
+ * @return non-zero if supported, 0 if not
+ */
+int apultra_is_matchlen_kernel_supported(const int nKernel) {
+   switch (nKernel) {
+   case APULTRA_MATCHLEN_SCALAR:
+      return 1;
+
+#if defined(MATCHLEN_X86_GNUC)
+   case APULTRA_MATCHLEN_SSE2:
+      __builtin_cpu_init();
+      return __builtin_cpu_supports("sse2") ? 1 : 0;
+
+   case APULTRA_MATCHLEN_AVX2:
+      __builtin_cpu_init();
+      return __builtin_cpu_supports("avx2") ? 1 : 0;
+#elif defined(MATCHLEN_X86_MSVC)
+   case APULTRA_MATCHLEN_SSE2: {
+      int nCPUInfo[4];
+      __cpuid(nCPUInfo, 1);
+      return (nCPUInfo[3] & (1 << 26)) ? 1 : 0;
+   }
+
+   case APULTRA_MATCHLEN_AVX2: {
+      int nCPUInfo[4];
+
+      /* AVX2 needs both the instructions and the OS saving the YMM registers */
+      __cpuid(nCPUInfo, 0);
+      if (nCPUInfo[0] < 7)
+         return 0;
+      __cpuid(nCPUInfo, 1);
+      if ((nCPUInfo[2] & (1 << 27)) == 0 || (nCPUInfo[2] & (1 << 28)) == 0)
+         return 0;
+      if ((_xgetbv(0) & 6) != 6)
+         return 0;
+      __cpuidex(nCPUInfo, 7, 0);
+      return (nCPUInfo[1] & (1 << 5)) ? 1 : 0;
+   }
+#endif
+
+   default:
+      return 0;
+   }
+}
+
+/**
+ * Select match length kernel
+ *
+ * @param nKernel kernel to use (APULTRA_MATCHLEN_xxx), or APULTRA_MATCHLEN_AUTO for the fastest one that this CPU supports
+ *
+ * @return 0 for success, non-zero if the kernel isn't supported on this CPU
+ */
+int apultra_select_matchlen_kernel(const int nKernel) {
+   int nSelectedKernel = nKernel;
+
+   if (nSelectedKernel == APULTRA_MATCHLEN_AUTO) {
+      nSelectedKernel = APULTRA_MATCHLEN_KERNELS - 1;
+      while (nSelectedKernel > APULTRA_MATCHLEN_SCALAR && !apultra_is_matchlen_kernel_supported(nSelectedKernel))
+         nSelectedKernel--;
+   }
+   else if (!apultra_is_matchlen_kernel_supported(nSelectedKernel)) {
+      return 100;
+   }
+
+   switch (nSelectedKernel) {
+#if defined(MATCHLEN_X86_GNUC) || defined(MATCHLEN_X86_MSVC)
+   case APULTRA_MATCHLEN_SSE2:
+      apultra_matchlen_impl = apultra_get_match_len_sse2;
+      break;
+
+   case APULTRA_MATCHLEN_AVX2:
+      apultra_matchlen_impl = apultra_get_match_len_avx2;
+      break;
+#endif
+
+   default:
+      nSelectedKernel = APULTRA_MATCHLEN_SCALAR;
+      apultra_matchlen_impl = apultra_get_match_len_scalar;
+      break;
+   }
+
+   g_nMatchLenKernel = nSelectedKernel;
+   return 0;
+}
+
+/**
+ * Select the fastest kernel for this CPU, if none was selected yet; run through apultra_once()
+ */
+static void apultra_select_default_matchlen_kernel(void) {
+   if (g_nMatchLenKernel == APULTRA_MATCHLEN_AUTO)
+      apultra_select_matchlen_kernel(APULTRA_MATCHLEN_AUTO);
+}
+
+/**
+ * Select the fastest kernel for this CPU, once, unless a kernel was selected already. Called by
+ * apultra_compressor_init(), so that the kernel is set before any compression thread reads it.
+ */
+void apultra_init_matchlen_kernel(void) {
+   apultra_once(&g_MatchLenOnce, apultra_select_default_matchlen_kernel);
+}
+
+/**
+ * Get currently selected match length kernel
+ *
+ * @return kernel in use (APULTRA_MATCHLEN_xxx)
+ */
+int apultra_get_matchlen_kernel(void) {
+   apultra_init_matchlen_kernel();
+   return g_nMatchLenKernel;
+}
+
+/**
+ * Get name of match length kernel
+ *
+ * @param nKernel kernel (APULTRA_MATCHLEN_xxx)
+ *
+ * @return name, or "unknown"
+ */
+const char *apultra_get_matchlen_kernel_name(const int nKernel) {
+   switch (nKernel) {
+   case APULTRA_MATCHLEN_SCALAR:
+      return "scalar";
+   case APULTRA_MATCHLEN_SSE2:
+      return "sse2";
+   case APULTRA_MATCHLEN_AVX2:
+      return "avx2";
+   default:
+      return "unknown";
+   }
+}
@@ -0,0 +1,100 @@
+/*
+ * matchlen.h - match length kernels definitions
+ *
+ * Copyright (C) 2026 agent
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty.  In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ * 1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation would be
+ *    appreciated but is not required.
+ * 2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ * 3. This notice may not be removed or altered from any source distribution.
+ */
+
+#ifndef _MATCHLEN_H
+#define _MATCHLEN_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** Match length kernels */
+#define APULTRA_MATCHLEN_AUTO -1
+#define APULTRA_MATCHLEN_SCALAR 0
+#define APULTRA_MATCHLEN_SSE2 1
+#define APULTRA_MATCHLEN_AVX2 2
+#define APULTRA_MATCHLEN_KERNELS 3
+
+/** Match length kernel: number of identical leading bytes in two buffers, up to a maximum */
+typedef int (*apultra_matchlen_func)(const unsigned char *pSrc1, const unsigned char *pSrc2, const int nMaxLen);
+
+/** Currently selected kernel; apultra_init_matchlen_kernel() sets the best one for the CPU */
+extern apultra_matchlen_func apultra_matchlen_impl;
+
+/**
+ * Get number of identical bytes at the start of two buffers
+ *
+ * @param pSrc1 first buffer
+ * @param pSrc2 second buffer
+ * @param nMaxLen maximum number of bytes to compare; neither buffer is read past this length
+ *
+ * @return number of identical leading bytes, at most nMaxLen
+ */
+static inline int apultra_get_match_len(const unsigned char *pSrc1, const unsigned char *pSrc2, const int nMaxLen) {
+   return apultra_matchlen_impl(pSrc1, pSrc2, nMaxLen);
+}
+
+/**
+ * Check if a match length kernel can run on this CPU
+ *
+ * @param nKernel kernel to check (APULTRA_MATCHLEN_xxx)
+ *
+ * @return non-zero if supported, 0 if not
+ */
+int apultra_is_matchlen_kernel_supported(const int nKernel);
+
+/**
+ * Select match length kernel
+ *
+ * @param nKernel kernel to use (APULTRA_MATCHLEN_xxx), or APULTRA_MATCHLEN_AUTO for the fastest one that this CPU supports
+ *
+ * @return 0 for success, non-zero if the kernel isn't supported on this CPU
+ */
+int apultra_select_matchlen_kernel(const int nKernel);
+
+/**
+ * Select the fastest kernel for this CPU, once, unless a kernel was selected already. Called by
+ * apultra_compressor_init(), so that the kernel is set before any compression thread reads it.
+ */
+void apultra_init_matchlen_kernel(void);
+
+/**
+ * Get currently selected match length kernel
+ *
+ * @return kernel in use (APULTRA_MATCHLEN_xxx)
+ */
+int apultra_get_matchlen_kernel(void);
+
+/**
+ * Get name of match length kernel
+ *
+ * @param nKernel kernel (APULTRA_MATCHLEN_xxx)
+ *
+ * @return name, or "unknown"
+ */
+const char *apultra_get_matchlen_kernel_name(const int nKernel);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _MATCHLEN_H */
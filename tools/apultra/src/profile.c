@@ -0,0 +1,162 @@
+/*
+ * profile.c - compressor profiling implementation
+ *
+ * Copyright (C) 2026 agent
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty.  In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ * 1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation would be
+ *    appreciated but is not required.
+ * 2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ * 3. This notice may not be removed or altered from any source distribution.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+#include "profile.h"
+
+/**
+ * Get wall clock time
+ *
+ * @return time in microseconds, from an arbitrary starting point
+ */
+static long long apultra_profiler_get_wall_time(void) {
+#ifdef _WIN32
+   LARGE_INTEGER nFrequency, nCounter;
+
+   QueryPerformanceFrequency(&nFrequency);
+   QueryPerformanceCounter(&nCounter);
+   return (long long)((double)nCounter.QuadPart * 1000000.0 / (double)nFrequency.QuadPart);
+#else
+   struct timespec ts;
+
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return (long long)ts.tv_sec * 1000000LL + (long long)(ts.tv_nsec / 1000);
+#endif
+}
+
+/**
+ * Get CPU time used by the calling thread
+ *
+ * @return time in microseconds
+ */
+static long long apultra_profiler_get_cpu_time(void) {
+#ifdef _WIN32
+   FILETIME ftCreation, ftExit, ftKernel, ftUser;
+
+   if (!GetThreadTimes(GetCurrentThread(), &ftCreation, &ftExit, &ftKernel, &ftUser))
+      return 0;
+   return (long long)(((((unsigned long long)ftKernel.dwHighDateTime) << 32) | ftKernel.dwLowDateTime) +
+      ((((unsigned long long)ftUser.dwHighDateTime) << 32) | ftUser.dwLowDateTime)) / 10LL;
+#else
+   struct timespec ts;
+
+   clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+   return (long long)ts.tv_sec * 1000000LL + (long long)(ts.tv_nsec / 1000);
+#endif
+}
+
+/**
+ * Initialize profiler, disabled
+ *
+ * @param pProfiler profiler to initialize
+ */
+void apultra_profiler_init(apultra_profiler *pProfiler) {
+   memset(pProfiler, 0, sizeof(apultra_profiler));
+}
+
+/**
+ * Account for memory allocated for the compression context; it is reported with the next block
+ *
+ * @param pProfiler profiler
+ * @param nSize number of bytes allocated
+ */
+void apultra_profiler_add_alloc(apultra_profiler *pProfiler, const size_t nSize) {
+   pProfiler->pending_alloc_size += nSize;
+}
+
+/**
+ * Start profiling a block
+ *
+ * @param pProfiler profiler
+ * @param nIndex block number
+ * @param nOffset offset of block in input data, in bytes
+ * @param nSize number of bytes to compress
+ * @param nWindowSize number of bytes in window (previously compressed bytes + bytes to compress)
+ */
+void apultra_profiler_start_block(apultra_profiler *pProfiler, const int nIndex, const size_t nOffset, const int nSize, const int nWindowSize) {
+   memset(&pProfiler->block, 0, sizeof(apultra_block_profile));
+   pProfiler->block.index = nIndex;
+   pProfiler->block.offset = nOffset;
+   pProfiler->block.size = nSize;
+   pProfiler->block.window_size = nWindowSize;
+   pProfiler->block.alloc_size = pProfiler->pending_alloc_size;
+   pProfiler->pending_alloc_size = 0;
+
+   if (pProfiler->callback) {
+      pProfiler->mark_wall_time = apultra_profiler_get_wall_time();
+      pProfiler->mark_cpu_time = apultra_profiler_get_cpu_time();
+   }
+}
+
+/**
+ * Charge the time elapsed since the previous phase ended to a phase of the current block
+ *
+ * @param pProfiler profiler
+ * @param nPhase phase that just ended (APULTRA_PHASE_xxx)
+ */
+void apultra_profiler_end_phase(apultra_profiler *pProfiler, const int nPhase) {
+   if (pProfiler->callback) {
+      const long long nWallTime = apultra_profiler_get_wall_time();
+      const long long nCPUTime = apultra_profiler_get_cpu_time();
+
+      pProfiler->block.wall_time[nPhase] += nWallTime - pProfiler->mark_wall_time;
+      pProfiler->block.cpu_time[nPhase] += nCPUTime - pProfiler->mark_cpu_time;
+      pProfiler->mark_wall_time = nWallTime;
+      pProfiler->mark_cpu_time = nCPUTime;
+   }
+}
+
+/**
+ * Finish profiling a block and report it to the callback
+ *
+ * @param pProfiler profiler
+ * @param nCompressedSize compressed size, in bytes, or -1 for error
+ */
+void apultra_profiler_end_block(apultra_profiler *pProfiler, const int nCompressedSize) {
+   pProfiler->block.compressed_size = nCompressedSize;
+   if (pProfiler->callback)
+      pProfiler->callback(&pProfiler->block, pProfiler->user_data);
+}
+
+/**
+ * Get phase name, for reporting
+ *
+ * @param nPhase phase (APULTRA_PHASE_xxx)
+ *
+ * @return name
+ */
+const char *apultra_profiler_get_phase_name(const int nPhase) {
+   static const char *_phase_name[APULTRA_NUM_PHASES] = {
+      "divsufsort", "lcp_intervals", "find_matches", "optimize_forward", "reduce_commands", "write_block"
+   };
+
+   if (nPhase >= 0 && nPhase < APULTRA_NUM_PHASES)
+      return _phase_name[nPhase];
+   else
+      return "unknown";
+}
@@ -0,0 +1,125 @@
+/*
+ * profile.h - compressor profiling definitions
+ *
+ * Copyright (C) 2026 agent
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty.  In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ * 1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation would be
+ *    appreciated but is not required.
+ * 2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ * 3. This notice may not be removed or altered from any source distribution.
+ */
+
+#ifndef _PROFILE_H
+#define _PROFILE_H
+
+#include <stdlib.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** Compression phases that are timed separately */
+#define APULTRA_PHASE_DIVSUFSORT 0        /**< Sort suffixes of the window */
+#define APULTRA_PHASE_LCP_INTERVALS 1     /**< Compute LCP array and build intervals from it */
+#define APULTRA_PHASE_FIND_MATCHES 2      /**< Skip previous block, find matches for block to compress */
+#define APULTRA_PHASE_OPTIMIZE_FORWARD 3  /**< Forward arrivals passes */
+#define APULTRA_PHASE_REDUCE_COMMANDS 4   /**< Reduction and merge passes */
+#define APULTRA_PHASE_WRITE_BLOCK 5       /**< Emit compressed block */
+#define APULTRA_NUM_PHASES 6
+
+/** Profile of one compressed block */
+typedef struct _apultra_block_profile {
+   int index;                                   /**< Block number, starting at 0 */
+   size_t offset;                               /**< Offset of block in input data, in bytes */
+   int size;                                    /**< Number of bytes compressed */
+   int window_size;                             /**< Number of bytes in window (previously compressed bytes + bytes to compress) */
+   int compressed_size;                         /**< Compressed size, in bytes, or -1 for error */
+   long long wall_time[APULTRA_NUM_PHASES];     /**< Wall clock time spent in each phase, in microseconds */
+   long long cpu_time[APULTRA_NUM_PHASES];      /**< CPU time spent in each phase by the compressing thread, in microseconds */
+   size_t alloc_size;                           /**< Bytes allocated for the compression context to compress this block */
+   int optimize_passes;                         /**< Number of forward arrivals passes */
+   int reduce_passes;                           /**< Number of reduction passes */
+   long long arrivals_visited;                  /**< Number of arrival slots that coding choices were evaluated from */
+   long long matches_considered;                /**< Number of candidate matches evaluated by the forward passes */
+} apultra_block_profile;
+
+/** Callback that receives each block's profile, once the block is compressed */
+typedef void (*apultra_profile_callback)(const apultra_block_profile *pProfile, void *pUserData);
+
+/** Profiler state kept in a compression context */
+typedef struct _apultra_profiler {
+   apultra_profile_callback callback;
+   void *user_data;
+   long long mark_wall_time;
+   long long mark_cpu_time;
+   size_t pending_alloc_size;
+   apultra_block_profile block;
+} apultra_profiler;
+
+/**
+ * Initialize profiler, disabled
+ *
+ * @param pProfiler profiler to initialize
+ */
+void apultra_profiler_init(apultra_profiler *pProfiler);
+
+/**
+ * Account for memory allocated for the compression context; it is reported with the next block
+ *
+ * @param pProfiler profiler
+ * @param nSize number of bytes allocated
+ */
+void apultra_profiler_add_alloc(apultra_profiler *pProfiler, const size_t nSize);
+
+/**
+ * Start profiling a block
+ *
+ * @param pProfiler profiler
+ * @param nIndex block number
+ * @param nOffset offset of block in input data, in bytes
+ * @param nSize number of bytes to compress
+ * @param nWindowSize number of bytes in window (previously compressed bytes + bytes to compress)
+ */
+void apultra_profiler_start_block(apultra_profiler *pProfiler, const int nIndex, const size_t nOffset, const int nSize, const int nWindowSize);
+
+/**
+ * Charge the time elapsed since the previous phase ended to a phase of the current block
+ *
+ * @param pProfiler profiler
+ * @param nPhase phase that just ended (APULTRA_PHASE_xxx)
+ */
+void apultra_profiler_end_phase(apultra_profiler *pProfiler, const int nPhase);
+
+/**
+ * Finish profiling a block and report it to the callback
+ *
+ * @param pProfiler profiler
+ * @param nCompressedSize compressed size, in bytes, or -1 for error
+ */
+void apultra_profiler_end_block(apultra_profiler *pProfiler, const int nCompressedSize);
+
+/**
+ * Get phase name, for reporting
+ *
+ * @param nPhase phase (APULTRA_PHASE_xxx)
+ *
+ * @return name
+ */
+const char *apultra_profiler_get_phase_name(const int nPhase);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _PROFILE_H */
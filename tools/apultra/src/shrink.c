@@ -37,6 +37,10 @@
 #include "matchfinder.h"
 #include "shrink.h"
 #include "format.h"
+#include "thread.h"
+#include "arena.h"
+#include "matchlen.h"
+#include "profile.h"
 
 #define TOKEN_PREFIX_SIZE        1 /* literal/ match bit */
 
@@ -57,6 +61,42 @@ static const int _token_code[3] = { TOKEN_CODE_LARGE_MATCH, TOKEN_CODE_7BIT_MATC
 /** Code sizes for variable 8+gamma2 bits offset + gamma2 len match; 7 bits offset + 1 bit len match; and 4 bits offset + fixed 1 byte len match */
 static const int _token_size[3] = { TOKEN_SIZE_LARGE_MATCH, TOKEN_SIZE_7BIT_MATCH, TOKEN_SIZE_4BIT_MATCH };
 
+/** Optimizer settings for one compression level */
+typedef struct {
+   int max_arrivals;             /**< Maximum number of arrival slots kept for each position (at least 2) */
+   int max_matches;              /**< Maximum number of matches found for each position */
+   int insert_forward_reps;      /**< Non-zero to run the forward pass that inserts future rep-matches, before the final pass */
+   int max_reduce_passes;        /**< Maximum number of reduction and merge passes */
+} apultra_level;
+
+/** Optimizer settings for each compression level, from APULTRA_MIN_LEVEL to APULTRA_MAX_LEVEL */
+static const apultra_level _levels[APULTRA_MAX_LEVEL - APULTRA_MIN_LEVEL + 1] = {
+   {  2,  4, 0,  1 },
+   {  3,  8, 0,  1 },
+   {  4,  8, 0,  2 },
+   {  5, 16, 0,  4 },
+   {  6, 16, 1,  8 },
+   {  8, 32, 1, 20 },
+   {  9, 32, 1, 20 },
+   { 16, 64, 1, 20 },
+   { NMATCHES_PER_ARRIVAL, NMATCHES_PER_INDEX, 1, 20 },
+};
+
+/**
+ * Get optimizer settings for the compression level selected in the flags
+ *
+ * @param nFlags compression flags (a bitmask of APULTRA_FLAG_xxx and APULTRA_FLAG_LEVEL())
+ *
+ * @return settings
+ */
+static const apultra_level *apultra_get_level(const int nFlags) {
+   int nLevel = (nFlags & APULTRA_FLAG_LEVEL_MASK) >> APULTRA_FLAG_LEVEL_SHIFT;
+
+   if (nLevel < APULTRA_MIN_LEVEL || nLevel > APULTRA_MAX_LEVEL)
+      nLevel = APULTRA_MAX_LEVEL;
+   return &_levels[nLevel - APULTRA_MIN_LEVEL];
+}
+
 /** Gamma2 bit counts for common values, up to 255 */
 static char _gamma2_size[256] = {
    0, 0, 2, 2, 4, 4, 4, 4, 6, 6, 6, 6, 6, 6, 6, 6, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14,
@@ -309,17 +349,10 @@ static void apultra_insert_forward_match(apultra_compressor *pCompressor, const
             nRepPos &&
             nRepPos > nMatchOffset &&
             nRepPos < nEndOffset) {
-            int nCurRepLen = 0;
-
             int nMaxRepLen = nEndOffset - nRepPos;
             if (nMaxRepLen > LCP_MAX)
                nMaxRepLen = LCP_MAX;
-            while ((nCurRepLen + 8) < nMaxRepLen && !memcmp(pInWindow + nRepPos + nCurRepLen, pInWindow + nRepPos - nMatchOffset + nCurRepLen, 8))
-               nCurRepLen += 8;
-            while ((nCurRepLen + 4) < nMaxRepLen && !memcmp(pInWindow + nRepPos + nCurRepLen, pInWindow + nRepPos - nMatchOffset + nCurRepLen, 4))
-               nCurRepLen += 4;
-            while (nCurRepLen < nMaxRepLen && pInWindow[nRepPos + nCurRepLen] == pInWindow[nRepPos - nMatchOffset + nCurRepLen])
-               nCurRepLen++;
+            int nCurRepLen = apultra_get_match_len(pInWindow + nRepPos, pInWindow + nRepPos - nMatchOffset, nMaxRepLen);
 
             if (nCurRepLen >= 2) {
                apultra_match *fwd_match = pCompressor->match + ((nRepPos - nStartOffset) << MATCHES_PER_INDEX_SHIFT);
@@ -366,6 +399,7 @@ static void apultra_insert_forward_match(apultra_compressor *pCompressor, const
  */
 static void apultra_optimize_forward(apultra_compressor *pCompressor, const unsigned char *pInWindow, const int nStartOffset, const int nEndOffset, const int nInsertForwardReps, const int *nCurRepMatchOffset, const int nBlockFlags, const int nMatchesPerArrival) {
    apultra_arrival *arrival = pCompressor->arrival - (nStartOffset * NMATCHES_PER_ARRIVAL);
+   long long nArrivalsVisited = 0, nMatchesConsidered = 0;
    int i, j, n;
 
    if ((nEndOffset - nStartOffset) > pCompressor->block_size) return;
@@ -492,6 +526,9 @@ static void apultra_optimize_forward(apultra_compressor *pCompressor, const unsi
          }
       }
 
+      /* Either coding choice above was evaluated from every arrival slot at this position */
+      nArrivalsVisited += j;
+
       if (i == nStartOffset && (nBlockFlags & 1)) continue;
 
       apultra_match *match = pCompressor->match + ((i - nStartOffset) << MATCHES_PER_INDEX_SHIFT);
@@ -515,6 +552,8 @@ static void apultra_optimize_forward(apultra_compressor *pCompressor, const unsi
             const int nMatchOffset = nOrigMatchOffset - d;
             int nMatchLen = nOrigMatchLen - d;
 
+            nMatchesConsidered++;
+
             if ((i + nMatchLen) > nEndOffset)
                nMatchLen = nEndOffset - i;
 
@@ -531,12 +570,7 @@ static void apultra_optimize_forward(apultra_compressor *pCompressor, const unsi
                      if (i > nRepOffset &&
                         (i - nRepOffset + nMatchLen) <= nEndOffset) {
                         nCurMaxLen = nMinRepLen[j];
-                        while ((nCurMaxLen + 8) < nMatchLen && !memcmp(pInWindow + i - nRepOffset + nCurMaxLen, pInWindow + i - nMatchOffset + nCurMaxLen, 8))
-                           nCurMaxLen += 8;
-                        while ((nCurMaxLen + 4) < nMatchLen && !memcmp(pInWindow + i - nRepOffset + nCurMaxLen, pInWindow + i - nMatchOffset + nCurMaxLen, 4))
-                           nCurMaxLen += 4;
-                        while (nCurMaxLen < nMatchLen && pInWindow[i - nRepOffset + nCurMaxLen] == pInWindow[i - nMatchOffset + nCurMaxLen])
-                           nCurMaxLen++;
+                        nCurMaxLen += apultra_get_match_len(pInWindow + i - nRepOffset + nCurMaxLen, pInWindow + i - nMatchOffset + nCurMaxLen, nMatchLen - nCurMaxLen);
                         nMinRepLen[j] = nCurMaxLen;
                      }
                   }
@@ -751,6 +785,10 @@ static void apultra_optimize_forward(apultra_compressor *pCompressor, const unsi
       
       end_arrival = &arrival[(end_arrival->from_pos * NMATCHES_PER_ARRIVAL) + (end_arrival->from_slot-1)];
    }
+
+   pCompressor->profiler.block.optimize_passes++;
+   pCompressor->profiler.block.arrivals_visited += nArrivalsVisited;
+   pCompressor->profiler.block.matches_considered += nMatchesConsidered;
 }
 
 /**
@@ -762,10 +800,11 @@ static void apultra_optimize_forward(apultra_compressor *pCompressor, const unsi
  * @param nStartOffset current offset in input window (typically the number of previously compressed bytes)
  * @param nEndOffset offset to end finding matches at (typically the size of the total input window in bytes
  * @param nCurRepMatchOffset starting rep offset for this block
+ * @param nBlockFlags bit 0: 1 for first block, 0 otherwise; bit 1: 1 for last block, 0 otherwise
  *
  * @return non-zero if the number of tokens was reduced, 0 if it wasn't
  */
-static int apultra_reduce_commands(apultra_compressor *pCompressor, const unsigned char *pInWindow, apultra_final_match *pBestMatch, const int nStartOffset, const int nEndOffset, const int *nCurRepMatchOffset) {
+static int apultra_reduce_commands(apultra_compressor *pCompressor, const unsigned char *pInWindow, apultra_final_match *pBestMatch, const int nStartOffset, const int nEndOffset, const int *nCurRepMatchOffset, const int nBlockFlags) {
    int i;
    int nNumLiterals = 0;
    int nRepMatchOffset = *nCurRepMatchOffset;
@@ -778,6 +817,7 @@ static int apultra_reduce_commands(apultra_compressor *pCompressor, const unsign
       apultra_final_match *pMatch = pBestMatch + i;
 
       if (pMatch->length <= 1 &&
+         (i != nStartOffset || !(nBlockFlags & 1)) /* the first byte of the first block is always a literal */ &&
          (i + 1) < nEndOffset &&
          pBestMatch[i + 1].length >= 2 &&
          pBestMatch[i + 1].length < MAX_VARLEN &&
@@ -1304,44 +1344,65 @@ static int apultra_write_raw_uncompressed_block_v3(apultra_compressor *pCompress
 }
 
 /**
- * Select the most optimal matches, reduce the token count if possible, and then emit a block of compressed data
+ * Select the most optimal matches and reduce the token count if possible, leaving the result in the best_match buffer
  *
  * @param pCompressor compression context
  * @param pInWindow pointer to input data window (previously compressed bytes + bytes to compress)
  * @param nPreviousBlockSize number of previously compressed bytes (or 0 for none)
  * @param nInDataSize number of input bytes to compress
- * @param pOutData pointer to output buffer
- * @param nMaxOutDataSize maximum size of output buffer, in bytes
- * @param nCurBitsOffset write index into output buffer, of current byte being filled with bits
- * @param nCurBitMask bit shifter
- * @param nCurFollowsLiteral non-zero if the next command to be issued follows a literal, 0 if not
- * @param nCurRepMatchOffset starting rep offset for this block, updated after the block is compressed successfully
+ * @param nCurRepMatchOffset starting rep offset for this block
  * @param nBlockFlags bit 0: 1 for first block, 0 otherwise; bit 1: 1 for last block, 0 otherwise
- *
- * @return size of compressed data in output buffer, or -1 if the data is uncompressible
  */
-static int apultra_optimize_and_write_block(apultra_compressor *pCompressor, const unsigned char *pInWindow, const int nPreviousBlockSize, const int nInDataSize, unsigned char *pOutData, const int nMaxOutDataSize, int *nCurBitsOffset, int *nCurBitMask, int *nCurFollowsLiteral, int *nCurRepMatchOffset, const int nBlockFlags) {
-   int nResult;
-   int nOutOffset = 0;
-   const int nMatchesPerArrival = ((nBlockFlags & 3) == 3) ? NMATCHES_PER_ARRIVAL : NMATCHES_PER_ARRIVAL_SMALL;
+static void apultra_optimize_block(apultra_compressor *pCompressor, const unsigned char *pInWindow, const int nPreviousBlockSize, const int nInDataSize, const int *nCurRepMatchOffset, const int nBlockFlags) {
+   const apultra_level *pLevel = apultra_get_level(pCompressor->flags);
+   int nMatchesPerArrival = ((nBlockFlags & 3) == 3) ? NMATCHES_PER_ARRIVAL : NMATCHES_PER_ARRIVAL_SMALL;
+
+   if (nMatchesPerArrival > pLevel->max_arrivals)
+      nMatchesPerArrival = pLevel->max_arrivals;
 
    memset(pCompressor->best_match, 0, pCompressor->block_size * sizeof(apultra_final_match));
-   apultra_optimize_forward(pCompressor, pInWindow, nPreviousBlockSize, nPreviousBlockSize + nInDataSize, 1 /* nInsertForwardReps */, nCurRepMatchOffset, nBlockFlags, nMatchesPerArrival);
+   if (pLevel->insert_forward_reps)
+      apultra_optimize_forward(pCompressor, pInWindow, nPreviousBlockSize, nPreviousBlockSize + nInDataSize, 1 /* nInsertForwardReps */, nCurRepMatchOffset, nBlockFlags, nMatchesPerArrival);
 
    /* Pick optimal matches */
    apultra_optimize_forward(pCompressor, pInWindow, nPreviousBlockSize, nPreviousBlockSize + nInDataSize, 0 /* nInsertForwardReps */, nCurRepMatchOffset, nBlockFlags, nMatchesPerArrival);
+   apultra_profiler_end_phase(&pCompressor->profiler, APULTRA_PHASE_OPTIMIZE_FORWARD);
 
    /* Apply reduction and merge pass */
    int nDidReduce;
    int nPasses = 0;
    do {
-      nDidReduce = apultra_reduce_commands(pCompressor, pInWindow, pCompressor->best_match - nPreviousBlockSize, nPreviousBlockSize, nPreviousBlockSize + nInDataSize, nCurRepMatchOffset);
+      nDidReduce = apultra_reduce_commands(pCompressor, pInWindow, pCompressor->best_match - nPreviousBlockSize, nPreviousBlockSize, nPreviousBlockSize + nInDataSize, nCurRepMatchOffset, nBlockFlags);
       nPasses++;
-   } while (nDidReduce && nPasses < 20);
+   } while (nDidReduce && nPasses < pLevel->max_reduce_passes);
 
-   /* Write compressed block */
+   pCompressor->profiler.block.reduce_passes += nPasses;
+   apultra_profiler_end_phase(&pCompressor->profiler, APULTRA_PHASE_REDUCE_COMMANDS);
+}
 
-   nResult = apultra_write_block(pCompressor, pCompressor->best_match - nPreviousBlockSize, pInWindow, nPreviousBlockSize, nPreviousBlockSize + nInDataSize, pOutData, nOutOffset, nMaxOutDataSize, nCurBitsOffset, nCurBitMask, nCurFollowsLiteral, nCurRepMatchOffset, nBlockFlags);
+/**
+ * Emit a block of compressed data using previously selected matches, falling back to a block of literals if that fails
+ *
+ * @param pCompressor compression context
+ * @param pBestMatch optimal matches to emit
+ * @param pInWindow pointer to input data window (previously compressed bytes + bytes to compress)
+ * @param nPreviousBlockSize number of previously compressed bytes (or 0 for none)
+ * @param nInDataSize number of input bytes to compress
+ * @param pOutData pointer to output buffer
+ * @param nMaxOutDataSize maximum size of output buffer, in bytes
+ * @param nCurBitsOffset write index into output buffer, of current byte being filled with bits
+ * @param nCurBitMask bit shifter
+ * @param nCurFollowsLiteral non-zero if the next command to be issued follows a literal, 0 if not
+ * @param nCurRepMatchOffset starting rep offset for this block, updated after the block is compressed successfully
+ * @param nBlockFlags bit 0: 1 for first block, 0 otherwise; bit 1: 1 for last block, 0 otherwise
+ *
+ * @return size of compressed data in output buffer, or -1 if the data is uncompressible
+ */
+static int apultra_write_optimized_block(apultra_compressor *pCompressor, apultra_final_match *pBestMatch, const unsigned char *pInWindow, const int nPreviousBlockSize, const int nInDataSize, unsigned char *pOutData, const int nMaxOutDataSize, int *nCurBitsOffset, int *nCurBitMask, int *nCurFollowsLiteral, int *nCurRepMatchOffset, const int nBlockFlags) {
+   int nResult;
+   int nOutOffset = 0;
+
+   nResult = apultra_write_block(pCompressor, pBestMatch, pInWindow, nPreviousBlockSize, nPreviousBlockSize + nInDataSize, pOutData, nOutOffset, nMaxOutDataSize, nCurBitsOffset, nCurBitMask, nCurFollowsLiteral, nCurRepMatchOffset, nBlockFlags);
    if (nResult < 0) {
       /* Try to write block as all literals */
       *nCurRepMatchOffset = 0;
@@ -1351,8 +1412,91 @@ static int apultra_optimize_and_write_block(apultra_compressor *pCompressor, con
    return nResult;
 }
 
-/* Forward declaration */
-static void apultra_compressor_destroy(apultra_compressor *pCompressor);
+/**
+ * Select the most optimal matches, reduce the token count if possible, and then emit a block of compressed data
+ *
+ * @param pCompressor compression context
+ * @param pInWindow pointer to input data window (previously compressed bytes + bytes to compress)
+ * @param nPreviousBlockSize number of previously compressed bytes (or 0 for none)
+ * @param nInDataSize number of input bytes to compress
+ * @param pOutData pointer to output buffer
+ * @param nMaxOutDataSize maximum size of output buffer, in bytes
+ * @param nCurBitsOffset write index into output buffer, of current byte being filled with bits
+ * @param nCurBitMask bit shifter
+ * @param nCurFollowsLiteral non-zero if the next command to be issued follows a literal, 0 if not
+ * @param nCurRepMatchOffset starting rep offset for this block, updated after the block is compressed successfully
+ * @param nBlockFlags bit 0: 1 for first block, 0 otherwise; bit 1: 1 for last block, 0 otherwise
+ *
+ * @return size of compressed data in output buffer, or -1 if the data is uncompressible
+ */
+static int apultra_optimize_and_write_block(apultra_compressor *pCompressor, const unsigned char *pInWindow, const int nPreviousBlockSize, const int nInDataSize, unsigned char *pOutData, const int nMaxOutDataSize, int *nCurBitsOffset, int *nCurBitMask, int *nCurFollowsLiteral, int *nCurRepMatchOffset, const int nBlockFlags) {
+   apultra_optimize_block(pCompressor, pInWindow, nPreviousBlockSize, nInDataSize, nCurRepMatchOffset, nBlockFlags);
+
+   /* Write compressed block */
+   int nCompressedSize = apultra_write_optimized_block(pCompressor, pCompressor->best_match - nPreviousBlockSize, pInWindow, nPreviousBlockSize, nInDataSize, pOutData, nMaxOutDataSize, nCurBitsOffset, nCurBitMask, nCurFollowsLiteral, nCurRepMatchOffset, nBlockFlags);
+   apultra_profiler_end_phase(&pCompressor->profiler, APULTRA_PHASE_WRITE_BLOCK);
+   return nCompressedSize;
+}
+
+/**
+ * Reset compression statistics
+ *
+ * @param pCompressor compression context
+ */
+static void apultra_compressor_reset_stats(apultra_compressor *pCompressor) {
+   memset(&pCompressor->stats, 0, sizeof(pCompressor->stats));
+   pCompressor->stats.min_match_len = -1;
+   pCompressor->stats.min_offset = -1;
+   pCompressor->stats.min_rle1_len = -1;
+   pCompressor->stats.min_rle2_len = -1;
+}
+
+/**
+ * Carve the compression context's buffers out of its arena, sized for the specified block and window sizes. The arena
+ * is only reallocated if it is too small, so that a context can be reused for many inputs without allocating.
+ *
+ * @param pCompressor compression context
+ * @param nBlockSize maximum size of input data (bytes to compress only)
+ * @param nMaxWindowSize maximum size of input data window (previously compressed bytes + bytes to compress)
+ *
+ * @return 0 for success, non-zero for failure
+ */
+static int apultra_compressor_reserve(apultra_compressor *pCompressor, const int nBlockSize, const int nMaxWindowSize) {
+   const size_t nIntervalsSize = nMaxWindowSize * sizeof(unsigned long long);
+   const size_t nPosDataSize = nMaxWindowSize * sizeof(unsigned long long);
+   const size_t nOpenIntervalsSize = (LCP_AND_TAG_MAX + 1) * sizeof(unsigned long long);
+   const size_t nArrivalSize = (nBlockSize + 1) * NMATCHES_PER_ARRIVAL * sizeof(apultra_arrival);
+   const size_t nBestMatchSize = nBlockSize * sizeof(apultra_final_match);
+   const size_t nMatchSize = nBlockSize * NMATCHES_PER_INDEX * sizeof(apultra_match);
+   const size_t nMatchDepthSize = nBlockSize * NMATCHES_PER_INDEX * sizeof(unsigned short);
+   const size_t nMatch1Size = nBlockSize * sizeof(unsigned char);
+   const size_t nPreviousCapacity = pCompressor->arena.capacity;
+
+   if (apultra_arena_reserve(&pCompressor->arena,
+      apultra_arena_get_alloc_size(nIntervalsSize) + apultra_arena_get_alloc_size(nPosDataSize) + apultra_arena_get_alloc_size(nOpenIntervalsSize) +
+      apultra_arena_get_alloc_size(nArrivalSize) + apultra_arena_get_alloc_size(nBestMatchSize) + apultra_arena_get_alloc_size(nMatchSize) +
+      apultra_arena_get_alloc_size(nMatchDepthSize) + apultra_arena_get_alloc_size(nMatch1Size)) != 0) {
+      pCompressor->block_size = 0;
+      pCompressor->max_window_size = 0;
+      return 100;
+   }
+
+   pCompressor->intervals = (unsigned long long *)apultra_arena_alloc(&pCompressor->arena, nIntervalsSize);
+   pCompressor->pos_data = (unsigned long long *)apultra_arena_alloc(&pCompressor->arena, nPosDataSize);
+   pCompressor->open_intervals = (unsigned long long *)apultra_arena_alloc(&pCompressor->arena, nOpenIntervalsSize);
+   pCompressor->arrival = (apultra_arrival *)apultra_arena_alloc(&pCompressor->arena, nArrivalSize);
+   pCompressor->best_match = (apultra_final_match *)apultra_arena_alloc(&pCompressor->arena, nBestMatchSize);
+   pCompressor->match = (apultra_match *)apultra_arena_alloc(&pCompressor->arena, nMatchSize);
+   pCompressor->match_depth = (unsigned short *)apultra_arena_alloc(&pCompressor->arena, nMatchDepthSize);
+   pCompressor->match1 = (unsigned char *)apultra_arena_alloc(&pCompressor->arena, nMatch1Size);
+   pCompressor->block_size = nBlockSize;
+   pCompressor->max_window_size = nMaxWindowSize;
+
+   if (pCompressor->arena.capacity != nPreviousCapacity)
+      apultra_profiler_add_alloc(&pCompressor->profiler, pCompressor->arena.capacity);
+
+   return 0;
+}
 
 /**
  * Initialize compression context
@@ -1364,10 +1508,13 @@ static void apultra_compressor_destroy(apultra_compressor *pCompressor);
  *
  * @return 0 for success, non-zero for failure
  */
-static int apultra_compressor_init(apultra_compressor *pCompressor, const int nBlockSize, const int nMaxWindowSize, const int nFlags) {
+int apultra_compressor_init(apultra_compressor *pCompressor, const int nBlockSize, const int nMaxWindowSize, const int nFlags) {
    int nResult;
 
+   apultra_init_matchlen_kernel();
+
    nResult = divsufsort_init(&pCompressor->divsufsort_context);
+   apultra_arena_init(&pCompressor->arena);
    pCompressor->intervals = NULL;
    pCompressor->pos_data = NULL;
    pCompressor->open_intervals = NULL;
@@ -1377,44 +1524,15 @@ static int apultra_compressor_init(apultra_compressor *pCompressor, const int nB
    pCompressor->best_match = NULL;
    pCompressor->arrival = NULL;
    pCompressor->flags = nFlags;
-   pCompressor->block_size = nBlockSize;
+   pCompressor->block_size = 0;
+   pCompressor->max_window_size = 0;
+   apultra_profiler_init(&pCompressor->profiler);
 
-   memset(&pCompressor->stats, 0, sizeof(pCompressor->stats));
-   pCompressor->stats.min_match_len = -1;
-   pCompressor->stats.min_offset = -1;
-   pCompressor->stats.min_rle1_len = -1;
-   pCompressor->stats.min_rle2_len = -1;
+   apultra_compressor_reset_stats(pCompressor);
 
    if (!nResult) {
-      pCompressor->intervals = (unsigned long long *)malloc(nMaxWindowSize * sizeof(unsigned long long));
-
-      if (pCompressor->intervals) {
-         pCompressor->pos_data = (unsigned long long *)malloc(nMaxWindowSize * sizeof(unsigned long long));
-
-         if (pCompressor->pos_data) {
-            pCompressor->open_intervals = (unsigned long long *)malloc((LCP_AND_TAG_MAX + 1) * sizeof(unsigned long long));
-
-            if (pCompressor->open_intervals) {
-               pCompressor->arrival = (apultra_arrival *)malloc((nBlockSize + 1) * NMATCHES_PER_ARRIVAL * sizeof(apultra_arrival));
-
-               if (pCompressor->arrival) {
-                  pCompressor->best_match = (apultra_final_match *)malloc(nBlockSize * sizeof(apultra_final_match));
-
-                  if (pCompressor->best_match) {
-                     pCompressor->match = (apultra_match *)malloc(nBlockSize * NMATCHES_PER_INDEX * sizeof(apultra_match));
-                     if (pCompressor->match) {
-                        pCompressor->match_depth = (unsigned short *)malloc(nBlockSize * NMATCHES_PER_INDEX * sizeof(unsigned short));
-                        if (pCompressor->match_depth) {
-                           pCompressor->match1 = (unsigned char *)malloc(nBlockSize * sizeof(unsigned char));
-                           if (pCompressor->match1)
-                              return 0;
-                        }
-                     }
-                  }
-               }
-            }
-         }
-      }
+      if (!apultra_compressor_reserve(pCompressor, nBlockSize, nMaxWindowSize))
+         return 0;
    }
 
    apultra_compressor_destroy(pCompressor);
@@ -1426,48 +1544,33 @@ static int apultra_compressor_init(apultra_compressor *pCompressor, const int nB
  *
  * @param pCompressor compression context to clean up
  */
-static void apultra_compressor_destroy(apultra_compressor *pCompressor) {
+void apultra_compressor_destroy(apultra_compressor *pCompressor) {
    divsufsort_destroy(&pCompressor->divsufsort_context);
+   apultra_arena_destroy(&pCompressor->arena);
 
-   if (pCompressor->match1) {
-      free(pCompressor->match1);
-      pCompressor->match1 = NULL;
-   }
-
-   if (pCompressor->match_depth) {
-      free(pCompressor->match_depth);
-      pCompressor->match_depth = NULL;
-   }
-
-   if (pCompressor->match) {
-      free(pCompressor->match);
-      pCompressor->match = NULL;
-   }
-
-   if (pCompressor->arrival) {
-      free(pCompressor->arrival);
-      pCompressor->arrival = NULL;
-   }
-
-   if (pCompressor->best_match) {
-      free(pCompressor->best_match);
-      pCompressor->best_match = NULL;
-   }
-
-   if (pCompressor->open_intervals) {
-      free(pCompressor->open_intervals);
-      pCompressor->open_intervals = NULL;
-   }
-
-   if (pCompressor->pos_data) {
-      free(pCompressor->pos_data);
-      pCompressor->pos_data = NULL;
-   }
+   pCompressor->intervals = NULL;
+   pCompressor->pos_data = NULL;
+   pCompressor->open_intervals = NULL;
+   pCompressor->match = NULL;
+   pCompressor->match_depth = NULL;
+   pCompressor->match1 = NULL;
+   pCompressor->best_match = NULL;
+   pCompressor->arrival = NULL;
+   pCompressor->block_size = 0;
+   pCompressor->max_window_size = 0;
+}
 
-   if (pCompressor->intervals) {
-      free(pCompressor->intervals);
-      pCompressor->intervals = NULL;
-   }
+/**
+ * Report the profile of each block compressed with a compression context. Timing the compression phases has a small
+ * cost, and is only done while a callback is set.
+ *
+ * @param pCompressor compression context, initialized with apultra_compressor_init()
+ * @param callback function to call after each block is compressed, or NULL to stop profiling
+ * @param pUserData value passed to the callback
+ */
+void apultra_compressor_set_profile_callback(apultra_compressor *pCompressor, apultra_profile_callback callback, void *pUserData) {
+   pCompressor->profiler.callback = callback;
+   pCompressor->profiler.user_data = pUserData;
 }
 
 /**
@@ -1484,19 +1587,21 @@ static void apultra_compressor_destroy(apultra_compressor *pCompressor) {
  * @param nCurFollowsLiteral non-zero if the next command to be issued follows a literal, 0 if not
  * @param nCurRepMatchOffset starting rep offset for this block, updated after the block is compressed successfully
  * @param nBlockFlags bit 0: 1 for first block, 0 otherwise; bit 1: 1 for last block, 0 otherwise
+ * @param pDictionary indexed dictionary that makes up the previously compressed bytes, or NULL
  *
  * @return size of compressed data in output buffer, or -1 if the data is uncompressible
  */
-static int apultra_compressor_shrink_block(apultra_compressor *pCompressor, const unsigned char *pInWindow, const int nPreviousBlockSize, const int nInDataSize, unsigned char *pOutData, const int nMaxOutDataSize, int *nCurBitsOffset, int *nCurBitMask, int *nCurFollowsLiteral, int *nCurRepMatchOffset, const int nBlockFlags) {
+static int apultra_compressor_shrink_block(apultra_compressor *pCompressor, const unsigned char *pInWindow, const int nPreviousBlockSize, const int nInDataSize, unsigned char *pOutData, const int nMaxOutDataSize, int *nCurBitsOffset, int *nCurBitMask, int *nCurFollowsLiteral, int *nCurRepMatchOffset, const int nBlockFlags, const apultra_dictionary *pDictionary) {
    int nCompressedSize;
 
-   if (apultra_build_suffix_array(pCompressor, pInWindow, nPreviousBlockSize + nInDataSize))
+   if (apultra_build_suffix_array(pCompressor, pInWindow, nPreviousBlockSize + nInDataSize, pDictionary))
       nCompressedSize = -1;
    else {
       if (nPreviousBlockSize) {
          apultra_skip_matches(pCompressor, 0, nPreviousBlockSize);
       }
-      apultra_find_all_matches(pCompressor, NMATCHES_PER_INDEX, nPreviousBlockSize, nPreviousBlockSize + nInDataSize, nBlockFlags);
+      apultra_find_all_matches(pCompressor, NMATCHES_PER_INDEX, apultra_get_level(pCompressor->flags)->max_matches, nPreviousBlockSize, nPreviousBlockSize + nInDataSize, nBlockFlags);
+      apultra_profiler_end_phase(&pCompressor->profiler, APULTRA_PHASE_FIND_MATCHES);
 
       nCompressedSize = apultra_optimize_and_write_block(pCompressor, pInWindow, nPreviousBlockSize, nInDataSize, pOutData, nMaxOutDataSize, nCurBitsOffset, nCurBitMask, nCurFollowsLiteral, nCurRepMatchOffset, nBlockFlags);
    }
@@ -1504,6 +1609,34 @@ static int apultra_compressor_shrink_block(apultra_compressor *pCompressor, cons
    return nCompressedSize;
 }
 
+/**
+ * Find matches and select the optimal ones for one block of data, without emitting it. The block is parsed as if no
+ * rep-match was available when it starts, so that it doesn't depend on how the previous block ends.
+ *
+ * @param pCompressor compression context
+ * @param pInWindow pointer to input data window (previously compressed bytes + bytes to compress)
+ * @param nPreviousBlockSize number of previously compressed bytes (or 0 for none)
+ * @param nInDataSize number of input bytes to compress
+ * @param nBlockFlags bit 0: 1 for first block, 0 otherwise; bit 1: 1 for last block, 0 otherwise
+ * @param pDictionary indexed dictionary that makes up the previously compressed bytes, or NULL
+ *
+ * @return 0 for success, non-zero for failure
+ */
+static int apultra_compressor_plan_block(apultra_compressor *pCompressor, const unsigned char *pInWindow, const int nPreviousBlockSize, const int nInDataSize, const int nBlockFlags, const apultra_dictionary *pDictionary) {
+   int nNoRepMatchOffset = 0;
+
+   if (apultra_build_suffix_array(pCompressor, pInWindow, nPreviousBlockSize + nInDataSize, pDictionary))
+      return 100;
+
+   if (nPreviousBlockSize) {
+      apultra_skip_matches(pCompressor, 0, nPreviousBlockSize);
+   }
+   apultra_find_all_matches(pCompressor, NMATCHES_PER_INDEX, apultra_get_level(pCompressor->flags)->max_matches, nPreviousBlockSize, nPreviousBlockSize + nInDataSize, nBlockFlags);
+
+   apultra_optimize_block(pCompressor, pInWindow, nPreviousBlockSize, nInDataSize, &nNoRepMatchOffset, nBlockFlags);
+   return 0;
+}
+
 /**
  * Get maximum compressed size of input(source) data
  *
@@ -1516,36 +1649,113 @@ size_t apultra_get_max_compressed_size(size_t nInputSize) {
 }
 
 /**
- * Compress memory
+ * Get the size of the blocks that the input is split into
+ *
+ * @param nInputSize input(source) size in bytes
+ * @param nMaxWindowSize maximum window size to use (0 for default)
+ *
+ * @return block size in bytes
+ */
+static int apultra_get_block_size(size_t nInputSize, size_t nMaxWindowSize) {
+   const int nDefaultBlockSize = (nInputSize < BLOCK_SIZE) ? ((nInputSize < 1024) ? 1024 : (int)nInputSize) : BLOCK_SIZE;
+   return nMaxWindowSize ? ((nDefaultBlockSize < nMaxWindowSize / 2) ? nDefaultBlockSize : (int)nMaxWindowSize / 2) : nDefaultBlockSize;
+}
+
+/**
+ * Get the number of dictionary bytes that are kept in the window, in front of the first block
  *
+ * @param nDictionarySize dictionary size in bytes
+ * @param nBlockSize block size in bytes
+ * @param nMaxWindowSize maximum window size to use (0 for default)
+ *
+ * @return number of bytes to use from the end of the dictionary
+ */
+static int apultra_get_dictionary_window_size(size_t nDictionarySize, const int nBlockSize, size_t nMaxWindowSize) {
+   const size_t nMaxDictionaryWindowSize = nMaxWindowSize ? (nMaxWindowSize - nBlockSize) : BLOCK_SIZE;
+   return (int)((nDictionarySize < nMaxDictionaryWindowSize) ? nDictionarySize : nMaxDictionaryWindowSize);
+}
+
+/**
+ * Get the size of the window needed to compress the input, in blocks of the specified size
+ *
+ * @param nInputSize input(source) size in bytes, not including the dictionary
+ * @param nBlockSize block size in bytes
+ * @param nDictionaryWindowSize number of dictionary bytes in front of the first block
+ *
+ * @return window size in bytes
+ */
+static int apultra_get_window_size(size_t nInputSize, const int nBlockSize, const int nDictionaryWindowSize) {
+   /* When the input fits in one block, there is no previously compressed block to keep in the window */
+   int nPreviousBlockSize = (nInputSize <= (size_t)nBlockSize) ? 0 : nBlockSize;
+
+   if (nPreviousBlockSize < nDictionaryWindowSize)
+      nPreviousBlockSize = nDictionaryWindowSize;
+   return nBlockSize + nPreviousBlockSize;
+}
+
+/**
+ * Check if the dictionary's suffix index can be used for the first block
+ *
+ * @param pInputData pointer to input(source) data, that starts with the dictionary
+ * @param pDictionary dictionary, or NULL for none
+ * @param nDictionaryWindowSize number of dictionary bytes in front of the first block
+ *
+ * @return dictionary if its index covers the bytes in front of the first block, NULL otherwise
+ */
+static const apultra_dictionary *apultra_get_indexed_dictionary(const unsigned char *pInputData, const apultra_dictionary *pDictionary, const int nDictionaryWindowSize) {
+   if (pDictionary && pDictionary->suffixes && pDictionary->size > 0 && pDictionary->size == nDictionaryWindowSize &&
+      !memcmp(pInputData, pDictionary->data, pDictionary->size))
+      return pDictionary;
+   else
+      return NULL;
+}
+
+/**
+ * Compress memory, using a compression context that is kept across calls
+ *
+ * The context's buffers are only reallocated if they are too small for this input, so that compressing many files with
+ * the same context avoids most allocations. The output is identical to that of apultra_compress().
+ *
+ * @param pCompressor compression context, initialized with apultra_compressor_init()
  * @param pInputData pointer to input(source) data to compress
  * @param pOutBuffer buffer for compressed data
  * @param nInputSize input(source) size in bytes
  * @param nMaxOutBufferSize maximum capacity of compression buffer
  * @param nFlags compression flags (a bitmask of APULTRA_FLAG_xxx, or 0)
+ * @param nMaxWindowSize maximum window size to use (0 for default)
+ * @param pDictionary dictionary that the input data starts with and that is not compressed, or NULL for none
  * @param progress progress function, called after compressing each block, or NULL for none
  * @param pStats pointer to compression stats that are filled if this function is successful, or NULL
- * @param nMaxWindowSize maximum window size to use (0 for default)
  *
  * @return actual compressed size, or -1 for error
  */
-size_t apultra_compress(const unsigned char *pInputData, unsigned char *pOutBuffer, size_t nInputSize, size_t nMaxOutBufferSize,
-      const unsigned int nFlags, size_t nMaxWindowSize, void(*progress)(long long nOriginalSize, long long nCompressedSize), apultra_stats *pStats) {
-   apultra_compressor compressor;
-   size_t nOriginalSize = 0;
+size_t apultra_compress_with_context(apultra_compressor *pCompressor, const unsigned char *pInputData, unsigned char *pOutBuffer, size_t nInputSize, size_t nMaxOutBufferSize,
+      const unsigned int nFlags, size_t nMaxWindowSize, const apultra_dictionary *pDictionary, void(*progress)(long long nOriginalSize, long long nCompressedSize), apultra_stats *pStats) {
+   const size_t nDictionarySize = pDictionary ? (size_t)pDictionary->size : 0;
+   size_t nOriginalSize = nDictionarySize;
    size_t nCompressedSize = 0L;
-   int nResult;
    int nError = 0;
-   const int nDefaultBlockSize = (nInputSize < BLOCK_SIZE) ? ((nInputSize < 1024) ? 1024 : (int)nInputSize) : BLOCK_SIZE;
-   const int nBlockSize = nMaxWindowSize ? ((nDefaultBlockSize < nMaxWindowSize / 2) ? nDefaultBlockSize : (int)nMaxWindowSize / 2) : nDefaultBlockSize;
-   const int nMaxOutBlockSize = (int)apultra_get_max_compressed_size(nBlockSize);
 
-   nResult = apultra_compressor_init(&compressor, nBlockSize, nBlockSize * 2, nFlags);
-   if (nResult != 0) {
+   if (nDictionarySize > nInputSize)
       return -1;
+
+   const int nBlockSize = apultra_get_block_size(nInputSize - nDictionarySize, nMaxWindowSize);
+   const int nDictionaryWindowSize = apultra_get_dictionary_window_size(nDictionarySize, nBlockSize, nMaxWindowSize);
+   const int nWindowSize = apultra_get_window_size(nInputSize - nDictionarySize, nBlockSize, nDictionaryWindowSize);
+   const int nMaxOutBlockSize = (int)apultra_get_max_compressed_size(nBlockSize);
+   const apultra_dictionary *pIndexedDictionary = apultra_get_indexed_dictionary(pInputData, pDictionary, nDictionaryWindowSize);
+
+   if (pCompressor->block_size != nBlockSize || pCompressor->max_window_size < nWindowSize) {
+      /* Resize context; this only allocates memory if it needs to grow */
+      if (apultra_compressor_reserve(pCompressor, nBlockSize, nWindowSize) != 0) {
+         return -1;
+      }
    }
 
-   int nPreviousBlockSize = 0;
+   pCompressor->flags = nFlags;
+   apultra_compressor_reset_stats(pCompressor);
+
+   int nPreviousBlockSize = nDictionaryWindowSize;
    int nNumBlocks = 0;
    int nCurBitsOffset[3] = { INT_MIN, INT_MIN, INT_MIN }, nCurBitMask[3] = { 0, 0, 0 }, nCurFollowsLiteral = 0;
    int nBlockFlags = 1;
@@ -1567,8 +1777,10 @@ size_t apultra_compress(const unsigned char *pInputData, unsigned char *pOutBuff
 
          if ((nOriginalSize + nInDataSize) >= nInputSize)
             nBlockFlags |= 2;
-         nOutDataSize = apultra_compressor_shrink_block(&compressor, pInputData + nOriginalSize - nPreviousBlockSize, nPreviousBlockSize, nInDataSize, pOutBuffer + nCompressedSize, nOutDataEnd,
-            nCurBitsOffset, nCurBitMask, &nCurFollowsLiteral, &nCurRepMatchOffset, nBlockFlags);
+         apultra_profiler_start_block(&pCompressor->profiler, nNumBlocks, nOriginalSize - nDictionarySize, nInDataSize, nPreviousBlockSize + nInDataSize);
+         nOutDataSize = apultra_compressor_shrink_block(pCompressor, pInputData + nOriginalSize - nPreviousBlockSize, nPreviousBlockSize, nInDataSize, pOutBuffer + nCompressedSize, nOutDataEnd,
+            nCurBitsOffset, nCurBitMask, &nCurFollowsLiteral, &nCurRepMatchOffset, nBlockFlags, nNumBlocks ? NULL : pIndexedDictionary);
+         apultra_profiler_end_block(&pCompressor->profiler, nOutDataSize);
          nBlockFlags &= (~1);
 
          if (nOutDataSize >= 0) {
@@ -1595,16 +1807,249 @@ size_t apultra_compress(const unsigned char *pInputData, unsigned char *pOutBuff
 
       if (!nError && nOriginalSize < nInputSize) {
          if (progress)
-            progress(nOriginalSize, nCompressedSize);
+            progress(nOriginalSize - nDictionarySize, nCompressedSize);
       }
    }
 
    if (progress)
-      progress(nOriginalSize, nCompressedSize);
+      progress(nOriginalSize - nDictionarySize, nCompressedSize);
    if (pStats)
-      *pStats = compressor.stats;
+      *pStats = pCompressor->stats;
+
+   if (nError) {
+      return -1;
+   }
+   else {
+      return nCompressedSize;
+   }
+}
+
+/**
+ * Compress memory
+ *
+ * @param pInputData pointer to input(source) data to compress
+ * @param pOutBuffer buffer for compressed data
+ * @param nInputSize input(source) size in bytes
+ * @param nMaxOutBufferSize maximum capacity of compression buffer
+ * @param nFlags compression flags (a bitmask of APULTRA_FLAG_xxx, or 0)
+ * @param progress progress function, called after compressing each block, or NULL for none
+ * @param pStats pointer to compression stats that are filled if this function is successful, or NULL
+ * @param nMaxWindowSize maximum window size to use (0 for default)
+ * @param pDictionary dictionary that the input data starts with and that is not compressed, or NULL for none
+ *
+ * @return actual compressed size, or -1 for error
+ */
+size_t apultra_compress(const unsigned char *pInputData, unsigned char *pOutBuffer, size_t nInputSize, size_t nMaxOutBufferSize,
+      const unsigned int nFlags, size_t nMaxWindowSize, const apultra_dictionary *pDictionary, void(*progress)(long long nOriginalSize, long long nCompressedSize), apultra_stats *pStats) {
+   apultra_compressor compressor;
+   size_t nCompressedSize;
+   const size_t nDictionarySize = pDictionary ? (size_t)pDictionary->size : 0;
+   const size_t nDataSize = (nInputSize > nDictionarySize) ? (nInputSize - nDictionarySize) : 0;
+   const int nBlockSize = apultra_get_block_size(nDataSize, nMaxWindowSize);
+   const int nWindowSize = apultra_get_window_size(nDataSize, nBlockSize, apultra_get_dictionary_window_size(nDictionarySize, nBlockSize, nMaxWindowSize));
+
+   if (apultra_compressor_init(&compressor, nBlockSize, nWindowSize, nFlags) != 0) {
+      return -1;
+   }
+
+   nCompressedSize = apultra_compress_with_context(&compressor, pInputData, pOutBuffer, nInputSize, nMaxOutBufferSize, nFlags, nMaxWindowSize, pDictionary, progress, pStats);
 
    apultra_compressor_destroy(&compressor);
+   return nCompressedSize;
+}
+
+/** One block planned by a worker thread, for parallel compression */
+typedef struct _apultra_block_job {
+   apultra_compressor compressor;
+   const unsigned char *pInWindow;
+   const apultra_dictionary *pDictionary;
+   int nPreviousBlockSize;
+   int nInDataSize;
+   int nBlockFlags;
+   int nResult;
+   apultra_thread_t thread;
+} apultra_block_job;
+
+/**
+ * Worker thread: plan one block
+ *
+ * @param pArg block job
+ */
+static APULTRA_THREAD_PROC(apultra_block_job_proc, pArg) {
+   apultra_block_job *pJob = (apultra_block_job *)pArg;
+
+   pJob->nResult = apultra_compressor_plan_block(&pJob->compressor, pJob->pInWindow, pJob->nPreviousBlockSize, pJob->nInDataSize, pJob->nBlockFlags, pJob->pDictionary);
+   APULTRA_THREAD_RETURN;
+}
+
+/**
+ * Compress memory, finding and selecting matches for several blocks at once on worker threads
+ *
+ * The input is split in up to nThreads blocks per round. Each block only uses the block before it as its dictionary,
+ * and is parsed without assuming any rep-match offset at its start, so that all blocks of a round can be parsed
+ * independently. The blocks are then emitted in order into a single bitstream, which is identical in format to the
+ * output of apultra_compress() and can be decompressed with any aPLib depacker. The output is usually slightly larger
+ * than apultra_compress() would produce, as blocks are smaller and the parse can't use rep-matches across blocks.
+ *
+ * @param pInputData pointer to input(source) data to compress
+ * @param pOutBuffer buffer for compressed data
+ * @param nInputSize input(source) size in bytes
+ * @param nMaxOutBufferSize maximum capacity of compression buffer
+ * @param nFlags compression flags (a bitmask of APULTRA_FLAG_xxx, or 0)
+ * @param nMaxWindowSize maximum window size to use (0 for default)
+ * @param pDictionary dictionary that the input data starts with and that is not compressed, or NULL for none
+ * @param nThreads number of worker threads to use (1 to compress on the calling thread only)
+ * @param progress progress function, called after compressing each block, or NULL for none
+ * @param pStats pointer to compression stats that are filled if this function is successful, or NULL
+ *
+ * @return actual compressed size, or -1 for error
+ */
+size_t apultra_compress_parallel(const unsigned char *pInputData, unsigned char *pOutBuffer, size_t nInputSize, size_t nMaxOutBufferSize,
+      const unsigned int nFlags, size_t nMaxWindowSize, const apultra_dictionary *pDictionary, int nThreads, void(*progress)(long long nOriginalSize, long long nCompressedSize), apultra_stats *pStats) {
+   const size_t nDictionarySize = pDictionary ? (size_t)pDictionary->size : 0;
+   apultra_block_job *pJobs;
+   size_t nOriginalSize = nDictionarySize;
+   size_t nCompressedSize = 0L;
+   int nError = 0;
+   int nNumJobs;
+   int nSegmentSize;
+   int i;
+
+   if (nDictionarySize > nInputSize)
+      return -1;
+   if (nThreads > APULTRA_MAX_THREADS)
+      nThreads = APULTRA_MAX_THREADS;
+
+   /* Split the input in blocks of equal size, one per thread, but don't make them so small that the ratio suffers too much */
+   const size_t nDataSize = nInputSize - nDictionarySize;
+   const int nBlockSize = apultra_get_block_size(nDataSize, nMaxWindowSize);
+
+   nSegmentSize = (nThreads > 1) ? (int)((nDataSize + nThreads - 1) / nThreads) : nBlockSize;
+   if (nSegmentSize < PARALLEL_MIN_BLOCK_SIZE)
+      nSegmentSize = PARALLEL_MIN_BLOCK_SIZE;
+   if (nSegmentSize > nBlockSize)
+      nSegmentSize = nBlockSize;
+
+   if (nThreads <= 1 || nSegmentSize <= 0 || (size_t)nSegmentSize >= nDataSize) {
+      /* Nothing to run in parallel */
+      return apultra_compress(pInputData, pOutBuffer, nInputSize, nMaxOutBufferSize, nFlags, nMaxWindowSize, pDictionary, progress, pStats);
+   }
+
+   nNumJobs = (int)((nDataSize + nSegmentSize - 1) / nSegmentSize);
+   if (nNumJobs > nThreads)
+      nNumJobs = nThreads;
+
+   const int nDictionaryWindowSize = apultra_get_dictionary_window_size(nDictionarySize, nSegmentSize, nMaxWindowSize);
+   const int nWindowSize = apultra_get_window_size(nDataSize, nSegmentSize, nDictionaryWindowSize);
+   const apultra_dictionary *pIndexedDictionary = apultra_get_indexed_dictionary(pInputData, pDictionary, nDictionaryWindowSize);
+
+   pJobs = (apultra_block_job *)malloc(nNumJobs * sizeof(apultra_block_job));
+   if (!pJobs)
+      return -1;
+
+   for (i = 0; i < nNumJobs; i++) {
+      if (apultra_compressor_init(&pJobs[i].compressor, nSegmentSize, nWindowSize, nFlags) != 0) {
+         while (i > 0) {
+            i--;
+            apultra_compressor_destroy(&pJobs[i].compressor);
+         }
+         free(pJobs);
+         return -1;
+      }
+   }
+
+   /* All blocks are emitted through the first context, so that it gathers the stats for the whole stream */
+   apultra_compressor *pWriter = &pJobs[0].compressor;
+   const int nMaxOutBlockSize = (int)apultra_get_max_compressed_size(nSegmentSize);
+   int nPreviousBlockSize = nDictionaryWindowSize;
+   int nCurBitsOffset[3] = { INT_MIN, INT_MIN, INT_MIN }, nCurBitMask[3] = { 0, 0, 0 }, nCurFollowsLiteral = 0;
+   int nCurRepMatchOffset = 0;
+
+   while (nOriginalSize < nInputSize && !nError) {
+      size_t nRoundOffset = nOriginalSize;
+      int nRoundPreviousBlockSize = nPreviousBlockSize;
+      int nRoundJobs = 0;
+      int nThreadStarted[APULTRA_MAX_THREADS];
+
+      /* Assign one block to each worker */
+      while (nRoundJobs < nNumJobs && nRoundOffset < nInputSize) {
+         apultra_block_job *pJob = &pJobs[nRoundJobs];
+         int nInDataSize = (int)(nInputSize - nRoundOffset);
+
+         if (nInDataSize > nSegmentSize)
+            nInDataSize = nSegmentSize;
+
+         pJob->pInWindow = pInputData + nRoundOffset - nRoundPreviousBlockSize;
+         pJob->pDictionary = (nRoundOffset == nDictionarySize) ? pIndexedDictionary : NULL;
+         pJob->nPreviousBlockSize = nRoundPreviousBlockSize;
+         pJob->nInDataSize = nInDataSize;
+         pJob->nBlockFlags = ((nRoundOffset == nDictionarySize) ? 1 : 0) | (((nRoundOffset + nInDataSize) >= nInputSize) ? 2 : 0);
+         pJob->nResult = 100;
+
+         nRoundOffset += nInDataSize;
+         nRoundPreviousBlockSize = nInDataSize;
+         nRoundJobs++;
+      }
+
+      /* Plan all blocks of this round, using the calling thread for the first one */
+      for (i = 1; i < nRoundJobs; i++) {
+         nThreadStarted[i] = (apultra_thread_create(&pJobs[i].thread, apultra_block_job_proc, &pJobs[i]) == 0) ? 1 : 0;
+      }
+
+      apultra_block_job_proc(&pJobs[0]);
+
+      for (i = 1; i < nRoundJobs; i++) {
+         if (nThreadStarted[i])
+            apultra_thread_join(&pJobs[i].thread);
+         else
+            apultra_block_job_proc(&pJobs[i]);
+      }
+
+      /* Emit the blocks in order */
+      for (i = 0; i < nRoundJobs && !nError; i++) {
+         apultra_block_job *pJob = &pJobs[i];
+         int nOutDataSize = -1;
+         int nOutDataEnd = (int)(nMaxOutBufferSize - nCompressedSize);
+
+         if (nOutDataEnd > nMaxOutBlockSize)
+            nOutDataEnd = nMaxOutBlockSize;
+
+         if (pJob->nResult == 0) {
+            nOutDataSize = apultra_write_optimized_block(pWriter, pJob->compressor.best_match - pJob->nPreviousBlockSize, pJob->pInWindow, pJob->nPreviousBlockSize, pJob->nInDataSize,
+               pOutBuffer + nCompressedSize, nOutDataEnd, nCurBitsOffset, nCurBitMask, &nCurFollowsLiteral, &nCurRepMatchOffset, pJob->nBlockFlags);
+         }
+
+         if (nOutDataSize >= 0) {
+            nOriginalSize += pJob->nInDataSize;
+            nCompressedSize += nOutDataSize;
+            if (nCurBitsOffset[0] != INT_MIN)
+               nCurBitsOffset[0] -= nOutDataSize;
+            if (nCurBitsOffset[1] != INT_MIN)
+               nCurBitsOffset[1] -= nOutDataSize;
+            if (nCurBitsOffset[2] != INT_MIN)
+               nCurBitsOffset[2] -= nOutDataSize;
+         }
+         else {
+            nError = -1;
+         }
+
+         nPreviousBlockSize = pJob->nInDataSize;
+
+         if (!nError && nOriginalSize < nInputSize) {
+            if (progress)
+               progress(nOriginalSize - nDictionarySize, nCompressedSize);
+         }
+      }
+   }
+
+   if (progress)
+      progress(nOriginalSize - nDictionarySize, nCompressedSize);
+   if (pStats)
+      *pStats = pWriter->stats;
+
+   for (i = 0; i < nNumJobs; i++)
+      apultra_compressor_destroy(&pJobs[i].compressor);
+   free(pJobs);
 
    if (nError) {
       return -1;
@@ -1613,3 +2058,253 @@ size_t apultra_compress(const unsigned char *pInputData, unsigned char *pOutBuff
       return nCompressedSize;
    }
 }
+
+/**
+ * Write the compressed bytes of a streaming compression context that are final, and drop them from its output buffer
+ *
+ * @param pStream streaming compression context
+ * @param nIsStreamEnd non-zero if the stream is complete and all bytes are final, 0 if bits may still be added
+ *
+ * @return 0 for success, non-zero for failure
+ */
+static int apultra_stream_write_final_bytes(apultra_stream_compressor *pStream, const int nIsStreamEnd) {
+   int nFinalSize = pStream->out_size;
+   int i;
+
+   if (!nIsStreamEnd) {
+      /* Bytes from the first one that is still being filled with bits onwards aren't final yet */
+      for (i = 0; i < 3; i++) {
+         if (pStream->cur_bits_offset[i] != INT_MIN && (pStream->out_size + pStream->cur_bits_offset[i]) < nFinalSize)
+            nFinalSize = pStream->out_size + pStream->cur_bits_offset[i];
+      }
+   }
+
+   if (nFinalSize > 0) {
+      if (pStream->write(pStream->out_data, nFinalSize, pStream->user_data) != 0) {
+         pStream->error = 1;
+         return 100;
+      }
+
+      /* Bit offsets are relative to the end of the buffer, and don't change */
+      memmove(pStream->out_data, pStream->out_data + nFinalSize, pStream->out_size - nFinalSize);
+      pStream->out_size -= nFinalSize;
+   }
+
+   return 0;
+}
+
+/**
+ * Compress the input bytes that are pending in a streaming compression context as one block, and write the compressed
+ * bytes that are final
+ *
+ * @param pStream streaming compression context
+ * @param nIsLastBlock non-zero to end the compressed stream after this block, 0 if more blocks follow
+ *
+ * @return 0 for success, non-zero for failure
+ */
+static int apultra_stream_compress_block(apultra_stream_compressor *pStream, const int nIsLastBlock) {
+   const int nMaxOutBlockSize = (int)apultra_get_max_compressed_size(pStream->block_size);
+   const int nBlockFlags = pStream->block_flags | (nIsLastBlock ? 2 : 0);
+   int nOutDataSize;
+   int i;
+
+   if (pStream->error)
+      return 100;
+
+   if ((pStream->out_size + nMaxOutBlockSize) > pStream->out_capacity) {
+      /* Only grows when a bits byte stays open for long, which can happen in enhanced mode */
+      unsigned char *pNewOutData = (unsigned char *)realloc(pStream->out_data, pStream->out_size + nMaxOutBlockSize);
+      if (!pNewOutData) {
+         pStream->error = 1;
+         return 100;
+      }
+      pStream->out_data = pNewOutData;
+      pStream->out_capacity = pStream->out_size + nMaxOutBlockSize;
+   }
+
+   if (pStream->pending_size) {
+      const apultra_dictionary *pIndexedDictionary = NULL;
+
+      if (!pStream->num_blocks)
+         pIndexedDictionary = apultra_get_indexed_dictionary(pStream->window, pStream->dictionary, pStream->previous_block_size);
+
+      apultra_profiler_start_block(&pStream->compressor.profiler, pStream->num_blocks, (size_t)pStream->original_size, pStream->pending_size, pStream->previous_block_size + pStream->pending_size);
+      nOutDataSize = apultra_compressor_shrink_block(&pStream->compressor, pStream->window, pStream->previous_block_size, pStream->pending_size, pStream->out_data + pStream->out_size, nMaxOutBlockSize,
+         pStream->cur_bits_offset, pStream->cur_bit_mask, &pStream->cur_follows_literal, &pStream->cur_rep_match_offset, nBlockFlags, pIndexedDictionary);
+      apultra_profiler_end_block(&pStream->compressor.profiler, nOutDataSize);
+   }
+   else {
+      /* Input ended right after a flush; only emit the end of data marker */
+      nOutDataSize = apultra_write_block(&pStream->compressor, pStream->compressor.best_match, pStream->window, pStream->previous_block_size, pStream->previous_block_size,
+         pStream->out_data + pStream->out_size, 0, nMaxOutBlockSize, pStream->cur_bits_offset, pStream->cur_bit_mask, &pStream->cur_follows_literal, &pStream->cur_rep_match_offset, nBlockFlags);
+   }
+
+   if (nOutDataSize < 0) {
+      pStream->error = 1;
+      return 100;
+   }
+
+   pStream->block_flags &= (~1);
+   pStream->num_blocks++;
+   pStream->original_size += pStream->pending_size;
+   pStream->compressed_size += nOutDataSize;
+   pStream->out_size += nOutDataSize;
+   for (i = 0; i < 3; i++) {
+      if (pStream->cur_bits_offset[i] != INT_MIN)
+         pStream->cur_bits_offset[i] -= nOutDataSize;
+   }
+
+   /* Keep the end of the window, up to one block, as history for the next block */
+   if ((pStream->previous_block_size + pStream->pending_size) > pStream->block_size) {
+      memmove(pStream->window, pStream->window + pStream->previous_block_size + pStream->pending_size - pStream->block_size, pStream->block_size);
+      pStream->previous_block_size = pStream->block_size;
+   }
+   else {
+      pStream->previous_block_size += pStream->pending_size;
+   }
+   pStream->pending_size = 0;
+
+   return apultra_stream_write_final_bytes(pStream, nIsLastBlock);
+}
+
+/**
+ * Initialize streaming compression context
+ *
+ * @param pStream streaming compression context to initialize
+ * @param nFlags compression flags (a bitmask of APULTRA_FLAG_xxx, or 0)
+ * @param nMaxWindowSize maximum window size to use (0 for default); blocks are half this size, which bounds memory use
+ * @param pDictionary dictionary that is used as history for the first block, or NULL for none. It must stay valid until the first block is compressed.
+ * @param write function that receives compressed bytes
+ * @param pUserData value passed to the write function
+ *
+ * @return 0 for success, non-zero for failure
+ */
+int apultra_stream_compressor_init(apultra_stream_compressor *pStream, const unsigned int nFlags, size_t nMaxWindowSize, const apultra_dictionary *pDictionary,
+      apultra_stream_write_func write, void *pUserData) {
+   const size_t nDictionarySize = pDictionary ? (size_t)pDictionary->size : 0;
+   const int nBlockSize = apultra_get_block_size(BLOCK_SIZE, nMaxWindowSize);
+   const int nDictionaryWindowSize = apultra_get_dictionary_window_size(nDictionarySize, nBlockSize, nMaxWindowSize);
+   const int nWindowSize = nBlockSize + ((nDictionaryWindowSize > nBlockSize) ? nDictionaryWindowSize : nBlockSize);
+   int i;
+
+   memset(pStream, 0, sizeof(apultra_stream_compressor));
+   pStream->dictionary = pDictionary;
+   pStream->write = write;
+   pStream->user_data = pUserData;
+   pStream->block_size = nBlockSize;
+   pStream->window_size = nWindowSize;
+   pStream->out_capacity = (int)apultra_get_max_compressed_size(nBlockSize);
+   pStream->block_flags = 1;
+   for (i = 0; i < 3; i++)
+      pStream->cur_bits_offset[i] = INT_MIN;
+
+   if (apultra_compressor_init(&pStream->compressor, nBlockSize, nWindowSize, nFlags) != 0)
+      return 100;
+
+   pStream->window = (unsigned char *)malloc(nWindowSize);
+   pStream->out_data = (unsigned char *)malloc(pStream->out_capacity);
+   if (!pStream->window || !pStream->out_data) {
+      apultra_stream_compressor_destroy(pStream);
+      return 100;
+   }
+
+   /* The end of the dictionary is the history of the first block */
+   if (nDictionaryWindowSize)
+      memcpy(pStream->window, pDictionary->data + nDictionarySize - nDictionaryWindowSize, nDictionaryWindowSize);
+   pStream->previous_block_size = nDictionaryWindowSize;
+
+   apultra_compressor_reset_stats(&pStream->compressor);
+   return 0;
+}
+
+/**
+ * Feed input to streaming compression context, compressing and writing each block that it completes
+ *
+ * @param pStream streaming compression context
+ * @param pInputData input(source) data
+ * @param nInputSize number of input bytes
+ *
+ * @return 0 for success, non-zero for failure
+ */
+int apultra_stream_compressor_feed(apultra_stream_compressor *pStream, const unsigned char *pInputData, size_t nInputSize) {
+   while (nInputSize) {
+      int nCopySize;
+
+      if (pStream->error)
+         return 100;
+
+      if (pStream->pending_size == pStream->block_size) {
+         /* A full block is only compressed once more input arrives, as the last block must be flagged as such */
+         if (apultra_stream_compress_block(pStream, 0) != 0)
+            return 100;
+      }
+
+      nCopySize = pStream->block_size - pStream->pending_size;
+      if ((size_t)nCopySize > nInputSize)
+         nCopySize = (int)nInputSize;
+
+      memcpy(pStream->window + pStream->previous_block_size + pStream->pending_size, pInputData, nCopySize);
+      pStream->pending_size += nCopySize;
+      pInputData += nCopySize;
+      nInputSize -= nCopySize;
+   }
+
+   return pStream->error ? 100 : 0;
+}
+
+/**
+ * Compress all input fed so far, ending the current block early, and write all compressed bytes that are final.
+ *
+ * @param pStream streaming compression context
+ *
+ * @return 0 for success, non-zero for failure
+ */
+int apultra_stream_compressor_flush(apultra_stream_compressor *pStream) {
+   if (pStream->error)
+      return 100;
+   if (!pStream->pending_size)
+      return 0;
+   return apultra_stream_compress_block(pStream, 0);
+}
+
+/**
+ * Compress remaining input, end the compressed stream and write all of it
+ *
+ * @param pStream streaming compression context
+ * @param pStats pointer to compression stats that are filled if this function is successful, or NULL
+ *
+ * @return 0 for success, non-zero for failure
+ */
+int apultra_stream_compressor_end(apultra_stream_compressor *pStream, apultra_stats *pStats) {
+   if (pStream->error)
+      return 100;
+
+   /* Like apultra_compress(), empty input compresses to nothing */
+   if (pStream->pending_size || pStream->num_blocks) {
+      if (apultra_stream_compress_block(pStream, 1) != 0)
+         return 100;
+   }
+
+   if (pStats)
+      *pStats = pStream->compressor.stats;
+   return 0;
+}
+
+/**
+ * Clean up streaming compression context and free up any associated resources
+ *
+ * @param pStream streaming compression context to clean up
+ */
+void apultra_stream_compressor_destroy(apultra_stream_compressor *pStream) {
+   apultra_compressor_destroy(&pStream->compressor);
+
+   if (pStream->out_data) {
+      free(pStream->out_data);
+      pStream->out_data = NULL;
+   }
+
+   if (pStream->window) {
+      free(pStream->window);
+      pStream->window = NULL;
+   }
+}
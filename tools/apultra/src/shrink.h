@@ -34,6 +34,9 @@
 #define _SHRINK_H
 
 #include "divsufsort.h"
+#include "arena.h"
+#include "dictionary.h"
+#include "profile.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -57,6 +60,8 @@ extern "C" {
 
 #define LEAVE_ALONE_MATCH_SIZE 120
 
+#define PARALLEL_MIN_BLOCK_SIZE 4096
+
 /** One match option */
 typedef struct _apultra_match {
    unsigned int length:11;
@@ -125,14 +130,64 @@ typedef struct _apultra_compressor {
    unsigned char *match1;
    apultra_final_match *best_match;
    apultra_arrival *arrival;
+   apultra_arena arena;
    int flags;
    int block_size;
+   int max_window_size;
    apultra_stats stats;
+   apultra_profiler profiler;
 } apultra_compressor;
 
+/**
+ * Function that receives compressed bytes from a streaming compression context, or decompressed bytes from a
+ * streaming decompression context
+ *
+ * @param pData compressed or decompressed bytes
+ * @param nSize number of bytes
+ * @param pUserData value passed to apultra_stream_compressor_init() or apultra_stream_decompressor_init()
+ *
+ * @return 0 for success, non-zero to stop with an error
+ */
+#ifndef _APULTRA_STREAM_WRITE_FUNC
+#define _APULTRA_STREAM_WRITE_FUNC
+typedef int (*apultra_stream_write_func)(const unsigned char *pData, size_t nSize, void *pUserData);
+#endif
+
+/** Streaming compression context */
+typedef struct _apultra_stream_compressor {
+   apultra_compressor compressor;
+   const apultra_dictionary *dictionary;
+   apultra_stream_write_func write;
+   void *user_data;
+   unsigned char *window;
+   unsigned char *out_data;
+   int block_size;
+   int window_size;
+   int previous_block_size;
+   int pending_size;
+   int out_size;
+   int out_capacity;
+   int cur_bits_offset[3];
+   int cur_bit_mask[3];
+   int cur_follows_literal;
+   int cur_rep_match_offset;
+   int block_flags;
+   int num_blocks;
+   int error;
+   long long original_size;
+   long long compressed_size;
+} apultra_stream_compressor;
+
 /** Compression flags */
 #define APULTRA_FLAG_ENHANCED   1  /**< Use enhanced (incompatible) format */
 
+/** Compression levels, passed in the flags with APULTRA_FLAG_LEVEL(); 0 selects the default */
+#define APULTRA_MIN_LEVEL 1           /**< Fastest compression */
+#define APULTRA_MAX_LEVEL 9           /**< Best compression, and the default */
+#define APULTRA_FLAG_LEVEL_SHIFT 8
+#define APULTRA_FLAG_LEVEL_MASK (15 << APULTRA_FLAG_LEVEL_SHIFT)
+#define APULTRA_FLAG_LEVEL(__level) ((__level) << APULTRA_FLAG_LEVEL_SHIFT)
+
 /**
  * Get maximum compressed size of input(source) data
  *
@@ -153,11 +208,139 @@ size_t apultra_get_max_compressed_size(size_t nInputSize);
  * @param progress progress function, called after compressing each block, or NULL for none
  * @param pStats pointer to compression stats that are filled if this function is successful, or NULL
  * @param nMaxWindowSize maximum window size to use (0 for default)
+ * @param pDictionary dictionary that the input data starts with and that is not compressed, or NULL for none
  *
  * @return actual compressed size, or -1 for error
  */
 size_t apultra_compress(const unsigned char *pInputData, unsigned char *pOutBuffer, size_t nInputSize, size_t nMaxOutBufferSize,
-   const unsigned int nFlags, size_t nMaxWindowSize, void(*progress)(long long nOriginalSize, long long nCompressedSize), apultra_stats *pStats);
+   const unsigned int nFlags, size_t nMaxWindowSize, const apultra_dictionary *pDictionary, void(*progress)(long long nOriginalSize, long long nCompressedSize), apultra_stats *pStats);
+
+/**
+ * Initialize compression context
+ *
+ * @param pCompressor compression context to initialize
+ * @param nBlockSize maximum size of input data (bytes to compress only)
+ * @param nMaxWindowSize maximum size of input data window (previously compressed bytes + bytes to compress)
+ * @param nFlags compression flags
+ *
+ * @return 0 for success, non-zero for failure
+ */
+int apultra_compressor_init(apultra_compressor *pCompressor, const int nBlockSize, const int nMaxWindowSize, const int nFlags);
+
+/**
+ * Clean up compression context and free up any associated resources
+ *
+ * @param pCompressor compression context to clean up
+ */
+void apultra_compressor_destroy(apultra_compressor *pCompressor);
+
+/**
+ * Report the profile of each block compressed with a compression context. Timing the compression phases has a small
+ * cost, and is only done while a callback is set.
+ *
+ * @param pCompressor compression context, initialized with apultra_compressor_init()
+ * @param callback function to call after each block is compressed, or NULL to stop profiling
+ * @param pUserData value passed to the callback
+ */
+void apultra_compressor_set_profile_callback(apultra_compressor *pCompressor, apultra_profile_callback callback, void *pUserData);
+
+/**
+ * Compress memory, using a compression context that is kept across calls
+ *
+ * @param pCompressor compression context, initialized with apultra_compressor_init()
+ * @param pInputData pointer to input(source) data to compress
+ * @param pOutBuffer buffer for compressed data
+ * @param nInputSize input(source) size in bytes
+ * @param nMaxOutBufferSize maximum capacity of compression buffer
+ * @param nFlags compression flags (a bitmask of APULTRA_FLAG_xxx, or 0)
+ * @param nMaxWindowSize maximum window size to use (0 for default)
+ * @param pDictionary dictionary that the input data starts with and that is not compressed, or NULL for none
+ * @param progress progress function, called after compressing each block, or NULL for none
+ * @param pStats pointer to compression stats that are filled if this function is successful, or NULL
+ *
+ * @return actual compressed size, or -1 for error
+ */
+size_t apultra_compress_with_context(apultra_compressor *pCompressor, const unsigned char *pInputData, unsigned char *pOutBuffer, size_t nInputSize, size_t nMaxOutBufferSize,
+   const unsigned int nFlags, size_t nMaxWindowSize, const apultra_dictionary *pDictionary, void(*progress)(long long nOriginalSize, long long nCompressedSize), apultra_stats *pStats);
+
+/**
+ * Compress memory, finding and selecting matches for several blocks at once on worker threads
+ *
+ * @param pInputData pointer to input(source) data to compress
+ * @param pOutBuffer buffer for compressed data
+ * @param nInputSize input(source) size in bytes
+ * @param nMaxOutBufferSize maximum capacity of compression buffer
+ * @param nFlags compression flags (a bitmask of APULTRA_FLAG_xxx, or 0)
+ * @param nMaxWindowSize maximum window size to use (0 for default)
+ * @param pDictionary dictionary that the input data starts with and that is not compressed, or NULL for none
+ * @param nThreads number of worker threads to use (1 to compress on the calling thread only)
+ * @param progress progress function, called after compressing each block, or NULL for none
+ * @param pStats pointer to compression stats that are filled if this function is successful, or NULL
+ *
+ * @return actual compressed size, or -1 for error
+ */
+size_t apultra_compress_parallel(const unsigned char *pInputData, unsigned char *pOutBuffer, size_t nInputSize, size_t nMaxOutBufferSize,
+   const unsigned int nFlags, size_t nMaxWindowSize, const apultra_dictionary *pDictionary, int nThreads, void(*progress)(long long nOriginalSize, long long nCompressedSize), apultra_stats *pStats);
+
+/**
+ * Initialize streaming compression context
+ *
+ * Input is compressed in blocks as it is fed, and compressed bytes are passed to the write function as soon as they
+ * are final. Only the previous block and the block being filled are kept in memory, whatever the size of the input.
+ * Unless apultra_stream_compressor_flush() is called, the output is identical to that of apultra_compress() for the
+ * same input, flags and window size. With both a dictionary and a maximum window size, a smaller part of the dictionary
+ * may be used than apultra_compress() would for small inputs, as the total input size isn't known in advance.
+ *
+ * @param pStream streaming compression context to initialize
+ * @param nFlags compression flags (a bitmask of APULTRA_FLAG_xxx, or 0)
+ * @param nMaxWindowSize maximum window size to use (0 for default); blocks are half this size, which bounds memory use
+ * @param pDictionary dictionary that is used as history for the first block, or NULL for none. It must stay valid until the first block is compressed.
+ * @param write function that receives compressed bytes
+ * @param pUserData value passed to the write function
+ *
+ * @return 0 for success, non-zero for failure
+ */
+int apultra_stream_compressor_init(apultra_stream_compressor *pStream, const unsigned int nFlags, size_t nMaxWindowSize, const apultra_dictionary *pDictionary,
+   apultra_stream_write_func write, void *pUserData);
+
+/**
+ * Feed input to streaming compression context, compressing and writing each block that it completes
+ *
+ * @param pStream streaming compression context
+ * @param pInputData input(source) data
+ * @param nInputSize number of input bytes
+ *
+ * @return 0 for success, non-zero for failure
+ */
+int apultra_stream_compressor_feed(apultra_stream_compressor *pStream, const unsigned char *pInputData, size_t nInputSize);
+
+/**
+ * Compress all input fed so far, ending the current block early, and write all compressed bytes that are final.
+ * Up to a few bytes that still receive bits of the next commands are held back until more input is compressed.
+ * Flushing often makes blocks smaller and costs compression ratio.
+ *
+ * @param pStream streaming compression context
+ *
+ * @return 0 for success, non-zero for failure
+ */
+int apultra_stream_compressor_flush(apultra_stream_compressor *pStream);
+
+/**
+ * Compress remaining input, end the compressed stream and write all of it
+ *
+ * @param pStream streaming compression context
+ * @param pStats pointer to compression stats that are filled if this function is successful, or NULL
+ *
+ * @return 0 for success, non-zero for failure
+ */
+int apultra_stream_compressor_end(apultra_stream_compressor *pStream, apultra_stats *pStats);
+
+/**
+ * Clean up streaming compression context and free up any associated resources
+ *
+ * @param pStream streaming compression context to clean up
+ */
+void apultra_stream_compressor_destroy(apultra_stream_compressor *pStream);
 
 #ifdef __cplusplus
 }
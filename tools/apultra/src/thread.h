@@ -0,0 +1,205 @@
+/*
+ * thread.h - portable threading definitions
+ *
+ * Copyright (C) 2026 agent
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty.  In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ * 1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation would be
+ *    appreciated but is not required.
+ * 2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ * 3. This notice may not be removed or altered from any source distribution.
+ */
+
+#ifndef _THREAD_H
+#define _THREAD_H
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <unistd.h>
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** Maximum number of worker threads */
+#define APULTRA_MAX_THREADS 64
+
+#ifdef _WIN32
+typedef HANDLE apultra_thread_t;
+typedef CRITICAL_SECTION apultra_mutex_t;
+typedef INIT_ONCE apultra_once_t;
+#define APULTRA_ONCE_INIT INIT_ONCE_STATIC_INIT
+#define APULTRA_THREAD_PROC(name, arg) DWORD WINAPI name(LPVOID arg)
+#define APULTRA_THREAD_RETURN return 0
+typedef DWORD (WINAPI *apultra_thread_proc_t)(LPVOID);
+#else
+typedef pthread_t apultra_thread_t;
+typedef pthread_mutex_t apultra_mutex_t;
+typedef pthread_once_t apultra_once_t;
+#define APULTRA_ONCE_INIT PTHREAD_ONCE_INIT
+#define APULTRA_THREAD_PROC(name, arg) void *name(void *arg)
+#define APULTRA_THREAD_RETURN return NULL
+typedef void *(*apultra_thread_proc_t)(void *);
+#endif
+
+/**
+ * Start a thread
+ *
+ * @param pThread thread handle to initialize
+ * @param pProc thread function, declared with APULTRA_THREAD_PROC()
+ * @param pArg argument to pass to the thread function
+ *
+ * @return 0 for success, non-zero for failure
+ */
+static inline int apultra_thread_create(apultra_thread_t *pThread, apultra_thread_proc_t pProc, void *pArg) {
+#ifdef _WIN32
+   *pThread = CreateThread(NULL, 0, pProc, pArg, 0, NULL);
+   return (*pThread != NULL) ? 0 : 100;
+#else
+   return pthread_create(pThread, NULL, pProc, pArg) ? 100 : 0;
+#endif
+}
+
+/**
+ * Wait for a thread to finish and release it
+ *
+ * @param pThread thread to wait for
+ */
+static inline void apultra_thread_join(apultra_thread_t *pThread) {
+#ifdef _WIN32
+   WaitForSingleObject(*pThread, INFINITE);
+   CloseHandle(*pThread);
+#else
+   pthread_join(*pThread, NULL);
+#endif
+}
+
+/**
+ * Initialize mutex
+ *
+ * @param pMutex mutex to initialize
+ */
+static inline void apultra_mutex_init(apultra_mutex_t *pMutex) {
+#ifdef _WIN32
+   InitializeCriticalSection(pMutex);
+#else
+   pthread_mutex_init(pMutex, NULL);
+#endif
+}
+
+/**
+ * Acquire mutex
+ *
+ * @param pMutex mutex to lock
+ */
+static inline void apultra_mutex_lock(apultra_mutex_t *pMutex) {
+#ifdef _WIN32
+   EnterCriticalSection(pMutex);
+#else
+   pthread_mutex_lock(pMutex);
+#endif
+}
+
+/**
+ * Release mutex
+ *
+ * @param pMutex mutex to unlock
+ */
+static inline void apultra_mutex_unlock(apultra_mutex_t *pMutex) {
+#ifdef _WIN32
+   LeaveCriticalSection(pMutex);
+#else
+   pthread_mutex_unlock(pMutex);
+#endif
+}
+
+/**
+ * Clean up mutex
+ *
+ * @param pMutex mutex to destroy
+ */
+static inline void apultra_mutex_destroy(apultra_mutex_t *pMutex) {
+#ifdef _WIN32
+   DeleteCriticalSection(pMutex);
+#else
+   pthread_mutex_destroy(pMutex);
+#endif
+}
+
+#ifdef _WIN32
+static BOOL CALLBACK apultra_once_proc(PINIT_ONCE pOnce, PVOID pParam, PVOID *ppContext) {
+   ((void (*)(void))pParam)();
+   return TRUE;
+}
+#endif
+
+/**
+ * Run a function exactly once, other callers wait until it has returned
+ *
+ * @param pOnce once flag, initialized with APULTRA_ONCE_INIT
+ * @param pProc function to run
+ */
+static inline void apultra_once(apultra_once_t *pOnce, void (*pProc)(void)) {
+#ifdef _WIN32
+   InitOnceExecuteOnce(pOnce, apultra_once_proc, (PVOID)pProc, NULL);
+#else
+   pthread_once(pOnce, pProc);
+#endif
+}
+
+/**
+ * Atomically increment a counter shared between threads
+ *
+ * @param pValue counter to increment
+ *
+ * @return incremented value
+ */
+static inline long apultra_atomic_increment(volatile long *pValue) {
+#ifdef _WIN32
+   return InterlockedIncrement(pValue);
+#else
+   return __sync_add_and_fetch(pValue, 1);
+#endif
+}
+
+/**
+ * Get number of online CPU cores
+ *
+ * @return number of cores, at least 1
+ */
+static inline int apultra_get_num_cpus(void) {
+   int nCPUs;
+
+#ifdef _WIN32
+   SYSTEM_INFO info;
+   GetSystemInfo(&info);
+   nCPUs = (int)info.dwNumberOfProcessors;
+#else
+   nCPUs = (int)sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+
+   if (nCPUs < 1)
+      nCPUs = 1;
+   if (nCPUs > APULTRA_MAX_THREADS)
+      nCPUs = APULTRA_MAX_THREADS;
+   return nCPUs;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _THREAD_H */
@@ -20,13 +20,19 @@
 # OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
 # THE SOFTWARE.
 #
-__version__ = "1.1"
+__version__ = "1.2"
 
 import os
+import subprocess
+import tempfile
 from argparse import ArgumentParser
 
 DEF_ADDR = 0x4000
-TYPES = ("binary", "basic", "ascii", "custom-header", "custom")
+DEF_APULTRA = "apultra"
+# the loader's APLIB depacker runs from here, custom-aplib blocks call it
+DEPACK_ADDR = 0xf200
+STUB_SIZE = 11
+TYPES = ("binary", "basic", "ascii", "custom-header", "custom-aplib", "custom")
 TYPE_BLOCK = {
     "binary": bytes((0xd0 for _ in range(10))),
     "basic": bytes((0xd3 for _ in range(10))),
@@ -44,6 +50,98 @@ def auto_int(value):
     return int(value, 0)
 
 
+def aplib_compress(apultra, data):
+    with tempfile.TemporaryDirectory() as tmp:
+        inf = os.path.join(tmp, "in.bin")
+        outf = os.path.join(tmp, "out.apl")
+        with open(inf, "wb") as fd:
+            fd.write(data)
+        subprocess.run([apultra, inf, outf], check=True,
+                       stdout=subprocess.DEVNULL)
+        with open(outf, "rb") as fd:
+            return fd.read()
+
+
+def aplib_depack(packed):
+    """
+    Depacks an aPLib stream reading it in the same order the Z80 depacker
+    does, and returns the data and the minimum distance between the
+    depack address and the packed data for it to be depacked in place.
+    """
+    out = bytearray()
+    state = {"pos": 0, "tag": 0, "bits": 0}
+    safe = 0
+
+    def getbyte():
+        b = packed[state["pos"]]
+        state["pos"] += 1
+        return b
+
+    def getbit():
+        if not state["bits"]:
+            state["tag"] = getbyte()
+            state["bits"] = 8
+        state["bits"] -= 1
+        return (state["tag"] >> state["bits"]) & 1
+
+    def getgamma():
+        v = 1
+        while True:
+            v = (v << 1) | getbit()
+            if not getbit():
+                return v
+
+    def put(b):
+        nonlocal safe
+        out.append(b)
+        # the byte written can't overlap packed data still to be read
+        safe = max(safe, len(out) - state["pos"])
+
+    def copy(offs, length):
+        for _ in range(length):
+            put(out[-offs])
+
+    put(getbyte())
+    lwm = 0
+    r0 = 0
+    while True:
+        if not getbit():
+            put(getbyte())
+            lwm = 0
+        elif not getbit():
+            offs = getgamma() - 2
+            if not lwm and not offs:
+                copy(r0, getgamma())
+            else:
+                if not lwm:
+                    offs -= 1
+                offs = (offs << 8) | getbyte()
+                length = getgamma()
+                if offs >= 32000:
+                    length += 1
+                if offs >= 1280:
+                    length += 1
+                if offs < 128:
+                    length += 2
+                copy(offs, length)
+                r0 = offs
+            lwm = 1
+        elif not getbit():
+            b = getbyte()
+            offs = b >> 1
+            if not offs:
+                return bytes(out), safe
+            copy(offs, 2 + (b & 1))
+            r0 = offs
+            lwm = 1
+        else:
+            offs = 0
+            for _ in range(4):
+                offs = (offs << 1) | getbit()
+            put(out[-offs] if offs else 0)
+            lwm = 0
+
+
 def main():
 
     parser = ArgumentParser(description="Make a CAS file for the MSX",
@@ -60,6 +158,8 @@ def main():
                         help="address to load if binary file (default: 0x%04x)" % DEF_ADDR)
     parser.add_argument("--exec", dest="exec", default=DEF_ADDR, type=auto_int,
                         help="address to exec if binary file (default: 0x%04x)" % DEF_ADDR)
+    parser.add_argument("--apultra", dest="apultra", default=DEF_APULTRA, type=str,
+                        help="apultra compressor to use for custom-aplib (default: %s)" % DEF_APULTRA)
 
     parser.add_argument("output", help="target .CAS file")
     parser.add_argument("type", help="file type", choices=TYPES)
@@ -133,6 +233,45 @@ def main():
             write_word(out, length)
             out.write(data)
 
+        elif args.type == "custom-aplib":
+
+            addr = args.addr
+
+            if not data:
+                parser.error("Empty input file")
+
+            try:
+                packed = aplib_compress(args.apultra, data)
+            except (OSError, subprocess.CalledProcessError) as ex:
+                parser.error("Failed to compress with %s: %s" % (args.apultra, ex))
+
+            unpacked, safe = aplib_depack(packed)
+            if unpacked != data:
+                parser.error("Compressed data doesn't depack to the input")
+
+            # packed data goes at the end, so it can be depacked in place,
+            # after a stub that runs the loader's depacker:
+            #   di / ld hl, packed data / ld de, addr / push de / jp DEPACK_ADDR
+            packed_addr = addr + max(safe, STUB_SIZE)
+            load_addr = packed_addr - STUB_SIZE
+            stub = bytes((0xf3,
+                          0x21, packed_addr & 0xff, packed_addr >> 8,
+                          0x11, addr & 0xff, addr >> 8,
+                          0xd5,
+                          0xc3, DEPACK_ADDR & 0xff, DEPACK_ADDR >> 8))
+            end_addr = max(packed_addr + len(packed), addr + len(data)) - 1
+
+            if end_addr >= DEPACK_ADDR:
+                parser.error("Binary doesn't fit under the depacker at 0x%04x: "
+                             "depacks to 0x%04x-0x%04x, packed data loads to 0x%04x-0x%04x"
+                             % (DEPACK_ADDR, addr, addr + len(data) - 1,
+                                load_addr, packed_addr + len(packed) - 1))
+
+            write_word(out, load_addr)
+            write_word(out, len(stub) + len(packed))
+            out.write(stub)
+            out.write(packed)
+
         else:
             # custom
             out.write(data)
@@ -61,8 +61,19 @@
 #define PATH_MAX 4096
 #endif
 
-static int _static_library_nbfile_opened=0;
-static int _static_library_nbfile_opened_max=0;
+/* with RASM_THREAD each thread has its own list of opened files and line buffers */
+#ifdef RASM_THREAD
+#ifdef _MSC_VER
+#define MINILIB_TLS __declspec(thread)
+#else
+#define MINILIB_TLS __thread
+#endif
+#else
+#define MINILIB_TLS
+#endif
+
+static MINILIB_TLS int _static_library_nbfile_opened=0;
+static MINILIB_TLS int _static_library_nbfile_opened_max=0;
 
 void _internal_ObjectArrayAddDynamicValue(void **zearray, void *zeobject, int object_size,int curline, char *curfunc, char *cursource);
 void _internal_ObjectArrayAddDynamicValueConcat(void **zearray, int *nbfields, int *maxfields, void *zeobject, int object_size, int curline, char *curfunc, char *cursource);
@@ -320,7 +331,7 @@ struct s_fileid
 	unsigned long curpos;
 };
 
-static struct s_fileid *fileidROOT=NULL;
+static MINILIB_TLS struct s_fileid *fileidROOT=NULL;
 
 /***
 	FileGetStructFromName
@@ -663,7 +674,7 @@ char *_internal_fgetsmulti(char *filename, int read_mode)
 {
 	#undef FUNC
 	#define FUNC "_internal_fgetsmulti"
-	static char buffer[MAX_LINE_BUFFER+1]={0};
+	static MINILIB_TLS char buffer[MAX_LINE_BUFFER+1]={0};
 	FILE *last_id=NULL;
 	char * (*_file_get_string)(char *, int, FILE *);
 	
@@ -699,7 +710,7 @@ char **_internal_fgetsmultilines(char *filename, int read_mode)
 {
 	#undef FUNC
 	#define FUNC "_internal_fgetsmultilines"
-	static char buffer[MAX_LINE_BUFFER+1]={0};
+	static MINILIB_TLS char buffer[MAX_LINE_BUFFER+1]={0};
 	FILE *last_id=NULL;
 	char * (*_file_get_string)(char *, int, FILE *);
 	char **lines_buffer=NULL;
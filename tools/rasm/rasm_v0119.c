@@ -48,6 +48,12 @@ Linux compilation with GCC or Clang:
 cc rasm_v0116.c -O2 -lm -lrt -march=native -o rasm
 strip rasm
 
+apultra cruncher (LZAPU/INCAPU) is linked from the apultra sources, see the Makefile
+or define NO_3RD_PARTIES to build rasm alone
+define RASM_THREAD and link with -lpthread to crunch independent data on all cores
+define RASM_SERVER (POSIX only) to enable the resident server mode, see rasm -h
+z80table.h (keyword hash) is generated by z80gen.py
+
 Windows compilation with Visual studio:
 cl.exe rasm_v0116.c -O2 -Ob3
 
@@ -75,6 +81,11 @@ cc rasm_v0116.c -O2 -lm -march=native -o rasm
 #define OS_WIN 1
 #endif
 
+#if defined(RASM_SERVER) && defined(__linux__) && !defined(_GNU_SOURCE)
+/* struct ucred, to check who owns the other end of the server socket */
+#define _GNU_SOURCE
+#endif
+
 #ifndef RDD
 	/* public lib */
 	#include"minilib.h"
@@ -90,6 +101,26 @@ cc rasm_v0116.c -O2 -lm -march=native -o rasm
 #include"zx7.h"
 #include"lz4.h"
 #include"exomizer.h"
+#include"shrink.h"
+#include"expand.h"
+#endif
+
+#ifdef RASM_THREAD
+/* crunch jobs run on a pool of threads */
+#include<pthread.h>
+#endif
+
+#ifdef OS_WIN
+/* _getpid for cache entries */
+#include<process.h>
+#endif
+
+#ifdef RASM_SERVER
+/* resident server mode, jobs are received on a local socket */
+#include<sys/socket.h>
+#include<sys/un.h>
+#include<sys/wait.h>
+#include<signal.h>
 #endif
 
 #ifdef __MORPHOS__
@@ -163,6 +194,7 @@ struct s_parameter {
 	int nsymb,msymb;
 	char **pathdef;
 	int npath,mpath;
+	char *cachedir;
 };
 
 
@@ -226,6 +258,16 @@ struct s_compute_element {
 enum e_compute_operation_type operator;
 double value;
 int priority;
+int symbol; /* 1+index of the symbol to resolve, 0 for a literal value */
+};
+
+struct s_compute_symbol {
+	char *name;   /* label or variable name, $ for the current address */
+	int iname;    /* offset in symbolname while compiling */
+	int crc;
+	unsigned int hash;
+	int minus;
+	int iprogram; /* PUSH_DATASTC element to patch with the value */
 };
 
 struct s_compute_core_data {
@@ -236,6 +278,19 @@ struct s_compute_core_data {
 	int maxtokenstack;
 	struct s_compute_element *operatorstack;
 	int maxoperatorstack;
+	/* symbols met while tokenizing, for the compiled expression cache */
+	struct s_compute_symbol *symbol;
+	int maxsymbol;
+	char *symbolname;
+	int maxsymbolname;
+};
+
+/* compiled expression: postfix program + symbols resolved at each evaluation */
+struct s_compiled_expression {
+	struct s_compute_element *program;
+	int nbprogram;
+	struct s_compute_symbol *symbol;
+	int nbsymbol;
 };
 
 /***********************************************************
@@ -341,29 +396,28 @@ struct s_ticker {
 };
 
 /***********************************************************************
-   m e r k e l    t r e e s    f o r    l a b e l,  v a r,  a l i a s
+   h a s h    t a b l e s    f o r    l a b e l,  v a r,  u s e d
 ***********************************************************************/
-struct s_crclabel_tree {
-	struct s_crclabel_tree *radix[256];
-	struct s_label *label;
-	int nlabel,mlabel;
-};
-struct s_crcdico_tree {
-	struct s_crcdico_tree *radix[256];
-	struct s_expr_dico *dico;
-	int ndico,mdico;
+/* entries and names never move until the end of the assembly */
+#define RASM_ARENA_CHUNK 65536
+struct s_rasm_arena {
+	unsigned char **chunk;
+	int nchunk,mchunk;
+	int used,size; /* in the last chunk */
 };
-struct s_crcused_tree {
-	struct s_crcused_tree *radix[256];
-	char **used;
-	int nused,mused;
+
+struct s_symbol_slot {
+	unsigned int hash; /* 0 for an empty slot */
+	char *name;        /* interned */
+	void *data;        /* NULL for a deleted slot */
 };
-struct s_crcstring_tree {
-	struct s_crcstring_tree *radix[256];
-	char **text;
-	int ntext,mtext;
-	char **replace;
-	int nreplace,mreplace;
+/* open addressing with linear probing */
+struct s_symbol_table {
+	struct s_symbol_slot *slot;
+	int mslot,nslot,nsymbol;
+	/* entries in declaration order */
+	void **entry;
+	int nentry,mentry;
 };
 /*************************************************
           m e m o r y    s e c t i o n
@@ -371,7 +425,7 @@ struct s_crcstring_tree {
 struct s_lz_section {
 	int iw;
 	int memstart,memend;
-	int lzversion; /* 4 -> LZ4 / 7 -> ZX7 / 48 -> LZ48 / 49 -> LZ49 / 8 -> Exomizer */
+	int lzversion; /* 4 -> LZ4 / 7 -> ZX7 / 48 -> LZ48 / 49 -> LZ49 / 8 -> Exomizer / 17 -> apultra */
 	int iorgzone;
 	int ibank;
 	/* idx backup */
@@ -396,6 +450,20 @@ struct s_hexbin {
 	int crunch;
 };
 
+/* file read or looked for during preprocessing, checked before using the preprocessing cache */
+enum e_cachedep_type {
+E_CACHEDEP_CONTENT=0,
+E_CACHEDEP_MISSING,
+E_CACHEDEP_EXISTS
+};
+
+struct s_cachedep {
+	char *filename;
+	enum e_cachedep_type type;
+	int len;
+	unsigned long long hash;
+};
+
 /**************************************************
           e d s k    m a n a g e m e n t        
 **************************************************/
@@ -522,6 +590,12 @@ struct s_wordlist {
 	char *w;
 	int l,t,e; /* e=1 si egalite dans le mot */
 	int ifile;
+	int link; /* expanded macro call or end of expansion, index of the next word to read */
+};
+
+struct s_macro_slot {
+	int iw;
+	int iparam; /* -1 when every parameter must be replaced in turn */
 };
 
 struct s_macro {
@@ -533,6 +607,9 @@ struct s_macro {
 	/**/
 	char **param;
 	int nbparam;
+	/* words holding a parameter, computed once at definition */
+	struct s_macro_slot *slot;
+	int islot,mslot;
 };
 
 struct s_macro_position {
@@ -572,17 +649,21 @@ E_TAGOPTION_REMOVESPACE=1,
 E_TAGOPTION_PRESERVE=2
 };
 
-#ifdef RASM_THREAD
+/* crunch job, run on a worker thread when RASM_THREAD is defined */
 struct s_rasm_thread {
+#ifdef RASM_THREAD
 	pthread_t thread;
-	int lz;
+#endif
+	int lz;       /* cruncher, same values as lzversion */
+	int ihexbin;  /* hexbin receiving the crunched data or -1 for a LZ section */
 	unsigned char *datain;
 	int datalen;
 	unsigned char *dataout;
 	int lenout;
-	int status;
+	int status;   /* 0 -> queued / 1 -> running / 2 -> done */
+	char *cachedir; /* crunched data cache, NULL if disabled */
+	struct zx7_context_t *zx7; /* ZX7 buffers of the assembly */
 };
-#endif
 
 
 /*********************************************************
@@ -768,6 +849,11 @@ struct s_rasm_info {
         G L O B A L     S T R U C T
 *******************************************/
 struct s_assenv {
+	/* per-assembly storage, released at once by FreeAssenv */
+	struct s_rasm_arena arena;
+	/* output routine and mnemonic dispatch, DEF directives are patched by STRUCT and as80 */
+	void (*output)(struct s_assenv *ae, unsigned char v);
+	void (**makemnemo)(struct s_assenv *ae);
 	/* current memory */
 	int maxptr;
 	/* CPR memory */
@@ -784,14 +870,14 @@ struct s_assenv {
 	int rundefined;
 	/* parsing */
 	struct s_wordlist *wl;
-	int nbword;
+	int nbword,maxword;
+	int iwmacro; /* macro expansions are appended after the program words */
 	int idx,stage;
 	char *label_filename;
 	int label_line;
 	char **filename;
 	int ifile,maxfile;
 	int nberr,flux;
-	int fastmatch[256];
 	unsigned char charset[256];
 	int maxerr,extended_error,nowarning;
 	/* ORG tracking */
@@ -812,14 +898,26 @@ struct s_assenv {
 	/* expressions */
 	struct s_expression *expression;
 	int ie,me;
+	char *referencebuffer;
+	int referencebuffersize;
 	int maxam,as80,dams;
 	float rough;
 	struct s_compute_core_data *computectx,ctx1,ctx2;
-	struct s_crcstring_tree stringtree;
+	/* scratch buffers of the expression engine */
+	struct s_compute_element *computestack;
+	int maxcomputestack;
+	double *accu;
+	int maccu;
+	char *fastvarbuffer;
+	int fastivar,fastmaxivar;
+	char *tradexpression;
+	int popfirst;
+	struct s_symbol_table compiledtable;
+	struct s_symbol_table texttable;
 	/* label */
 	struct s_label *label;
 	int il,ml;
-	struct s_crclabel_tree labeltree; /* fast label access */
+	struct s_symbol_table labeltable; /* fast label access */
 	char *module;
 	int modulen;
 	struct s_breakpoint *breakpoint;
@@ -843,8 +941,8 @@ struct s_assenv {
 	/* expression dictionnary */
 	struct s_expr_dico *dico;
 	int idic,mdic;
-	struct s_crcdico_tree dicotree; /* fast dico access */
-	struct s_crcused_tree usedtree; /* fast used access */
+	struct s_symbol_table dicotable; /* fast dico access */
+	struct s_symbol_table usedtable; /* fast used access */
 	/* ticker */
 	struct s_ticker *ticker;
 	int iticker,mticker;
@@ -866,11 +964,17 @@ struct s_assenv {
 	int ialias,malias;
 	/* hexbin */
 	struct s_rasm_thread **rasm_thread;
-	int irt,mrt;
+	int irt,mrt,maxthread;
 	struct s_hexbin *hexbin;
 	int ih,mh;
 	char **includepath;
 	int ipath,mpath;
+	/* preprocessing and crunch cache */
+	char *cachedir;
+	/* ZX7 buffers reused by every crunch of the assembly */
+	struct zx7_context_t *zx7;
+	struct s_cachedep *cachedep;
+	int icachedep,mcachedep;
 	/* automates */
 	char AutomateExpressionValidCharExtended[256];
 	char AutomateExpressionValidCharFirst[256];
@@ -905,6 +1009,15 @@ struct s_assenv {
 	int checkmode,dependencies;
 	int stop;
 	int warn_unused;
+	/* returned buffers, one set per assembly */
+	char linebuffer[40];
+	char pathbuffer[PATH_MAX];
+	char amsdosname[12];
+	unsigned char amsdosheader[128];
+	unsigned char hobetaheader[17];
+	unsigned char amsdosreal[5];
+	unsigned char *symbolchunk;
+	int symbolchunksize,symbolchunkidx;
 	/* debug */
 	struct s_rasm_info debug;
 	struct s_rasm_info **retdebug;
@@ -1045,6 +1158,10 @@ int ICRC_DEFB,ICRC_DEFW,ICRC_DEFI,ICRC_DEFR,ICRC_DEFS,ICRC_DB,ICRC_DW,ICRC_DR,IC
 /* need to pre-declare var */
 extern struct s_asm_keyword instruction[];
 
+/* keyword hash, generated by z80gen.py */
+#include"z80table.h"
+short keywordslot[1<<KEYWORD_HASH_BITS];
+
 /*
 # base=16
 % base=2
@@ -1068,12 +1185,375 @@ unsigned char *LZ4_crunch(unsigned char *data, int zelen, int *retlen){
 	*retlen=LZ4_compress_HC((char*)data,(char*)lzdest,zelen,65536,9);
 	return lzdest;
 }
+unsigned char *APULTRA_crunch(unsigned char *data, int zelen, int *retlen){
+	unsigned char *lzdest=NULL;
+	size_t maxlen,lzlen;
+	maxlen=apultra_get_max_compressed_size(zelen);
+	lzdest=MemMalloc(maxlen);
+	lzlen=apultra_compress(data,lzdest,zelen,maxlen,0,0,NULL,NULL,NULL);
+	if (lzlen==(size_t)-1) {
+		printf("apultra cannot crunch %d byte(s)\n",zelen);
+		exit(-12);
+	}
+	*retlen=lzlen;
+	return lzdest;
+}
 #endif
 unsigned char *LZ48_encode_legacy(unsigned char *data, int length, int *retlength);
-#define LZ48_crunch LZ48_encode_legacy
+unsigned char *LZ48_encode_optimal(unsigned char *data, int length, int *retlength);
+#define LZ48_crunch LZ48_encode_optimal
 unsigned char *LZ49_encode_legacy(unsigned char *data, int length, int *retlength);
-#define LZ49_crunch LZ49_encode_legacy
+unsigned char *LZ49_encode_optimal(unsigned char *data, int length, int *retlength);
+#define LZ49_crunch LZ49_encode_optimal
+int LZ48_decrunch(unsigned char *src, unsigned char *dst, int lz49);
+
+
+#ifdef RASM_SERVER
+/*
+ server mode (rasm -server) runs every job in a forked child, the resident process keeps
+ file contents and crunched data, children inherit them and send back what they read or crunched
+*/
+struct s_servercache {
+	int lz;                /* -1 for a file content, cruncher number otherwise */
+	unsigned int hash;
+	unsigned char *key;    /* full path for a file, raw data for a crunch */
+	int keylen;
+	long long stamp;       /* file modification time (ns) */
+	unsigned char *data;
+	int datalen;
+	int fresh;             /* created in this job, to send back to the server */
+};
+
+struct s_servercache *servercache=NULL;
+int nservercache=0,mservercache=0;
+long long servercachesize=0;
+int servercache_active=0;
+int servercache_pipe=-1;
+#ifdef RASM_THREAD
+pthread_mutex_t servercache_mutex=PTHREAD_MUTEX_INITIALIZER;
+#endif
+
+#define SERVER_CACHE_MAXSIZE (256*1024*1024)
+
+unsigned int ServerCacheHash(int lz, unsigned char *key, int keylen)
+{
+	#undef FUNC
+	#define FUNC "ServerCacheHash"
+
+	unsigned int hash=2166136261U^lz;
+	int i;
+
+	for (i=0;i<keylen;i++) hash=(hash^key[i])*16777619U;
+	return hash;
+}
+
+/* return a copy of the cached data (one more byte allocated, like file reading) or NULL */
+unsigned char *ServerCacheGet(int lz, unsigned char *key, int keylen, long long stamp, int *datalen)
+{
+	#undef FUNC
+	#define FUNC "ServerCacheGet"
+
+	unsigned char *data=NULL;
+	unsigned int hash;
+	int i;
+
+	if (!servercache_active) return NULL;
+	hash=ServerCacheHash(lz,key,keylen);
+	#ifdef RASM_THREAD
+	pthread_mutex_lock(&servercache_mutex);
+	#endif
+	for (i=0;i<nservercache;i++) {
+		if (servercache[i].hash==hash && servercache[i].lz==lz && servercache[i].keylen==keylen && servercache[i].stamp==stamp
+			&& memcmp(servercache[i].key,key,keylen)==0) {
+			data=MemMalloc(servercache[i].datalen+1);
+			memcpy(data,servercache[i].data,servercache[i].datalen);
+			*datalen=servercache[i].datalen;
+			break;
+		}
+	}
+	#ifdef RASM_THREAD
+	pthread_mutex_unlock(&servercache_mutex);
+	#endif
+	return data;
+}
+
+void _internal_ServerCacheReset(void)
+{
+	#undef FUNC
+	#define FUNC "_internal_ServerCacheReset"
+
+	int i;
+
+	for (i=0;i<nservercache;i++) {
+		MemFree(servercache[i].key);
+		MemFree(servercache[i].data);
+	}
+	nservercache=0;
+	servercachesize=0;
+}
+
+void ServerCachePut(int lz, unsigned char *key, int keylen, long long stamp, unsigned char *data, int datalen, int fresh)
+{
+	#undef FUNC
+	#define FUNC "ServerCachePut"
+
+	struct s_servercache *entry=NULL;
+	unsigned int hash;
+	int i;
+
+	if (!servercache_active) return;
+	hash=ServerCacheHash(lz,key,keylen);
+	#ifdef RASM_THREAD
+	pthread_mutex_lock(&servercache_mutex);
+	#endif
+	/* too much data, start over */
+	if (servercachesize>SERVER_CACHE_MAXSIZE) _internal_ServerCacheReset();
+	/* a modified file replaces its previous content */
+	for (i=0;i<nservercache;i++) {
+		if (servercache[i].hash==hash && servercache[i].lz==lz && servercache[i].keylen==keylen && memcmp(servercache[i].key,key,keylen)==0) {
+			entry=&servercache[i];
+			servercachesize-=entry->datalen;
+			MemFree(entry->data);
+			break;
+		}
+	}
+	if (!entry) {
+		if (nservercache>=mservercache) {
+			mservercache=mservercache*2+16;
+			servercache=MemRealloc(servercache,mservercache*sizeof(struct s_servercache));
+		}
+		entry=&servercache[nservercache++];
+		entry->lz=lz;
+		entry->hash=hash;
+		entry->key=MemMalloc(keylen);
+		memcpy(entry->key,key,keylen);
+		entry->keylen=keylen;
+		servercachesize+=keylen;
+	}
+	entry->stamp=stamp;
+	entry->data=MemMalloc(datalen);
+	memcpy(entry->data,data,datalen);
+	entry->datalen=datalen;
+	entry->fresh=fresh;
+	servercachesize+=datalen;
+	#ifdef RASM_THREAD
+	pthread_mutex_unlock(&servercache_mutex);
+	#endif
+}
+
+/* file key is the full path with its modification time, the content is checked with a stat only */
+int ServerCacheFileKey(char *filename, char *fullpath, long long *stamp)
+{
+	#undef FUNC
+	#define FUNC "ServerCacheFileKey"
+
+	struct stat st;
+
+	if (!servercache_active) return 0;
+	if (stat(filename,&st) || !realpath(filename,fullpath)) return 0;
+	#ifdef __APPLE__
+	*stamp=st.st_mtimespec.tv_sec*1000000000LL+st.st_mtimespec.tv_nsec;
+	#else
+	*stamp=st.st_mtim.tv_sec*1000000000LL+st.st_mtim.tv_nsec;
+	#endif
+	return 1;
+}
+#endif
+
+/*
+ disk cache (-cache option) shared by successive runs
+ entries are named with a hash of their key and hold the full key, a collision is only a miss
+*/
+#define RASM_HASH_INIT 14695981039346656037ULL
+
+unsigned long long RasmHash(unsigned char *data, int len, unsigned long long hash)
+{
+	#undef FUNC
+	#define FUNC "RasmHash"
+
+	int i;
+
+	for (i=0;i<len;i++) hash=(hash^data[i])*1099511628211ULL;
+	return hash;
+}
+
+struct s_cachebuffer {
+	unsigned char *data;
+	int len,max,pos;
+};
+
+void CacheBufferWrite(struct s_cachebuffer *cb, void *data, int len)
+{
+	#undef FUNC
+	#define FUNC "CacheBufferWrite"
+
+	if (cb->len+len>cb->max) {
+		cb->max=(cb->len+len)*2+256;
+		cb->data=MemRealloc(cb->data,cb->max);
+	}
+	memcpy(cb->data+cb->len,data,len);
+	cb->len+=len;
+}
+void CacheBufferWriteInt(struct s_cachebuffer *cb, int v)
+{
+	CacheBufferWrite(cb,&v,sizeof(int));
+}
+void CacheBufferWriteString(struct s_cachebuffer *cb, char *str)
+{
+	int l;
+
+	l=strlen(str);
+	CacheBufferWriteInt(cb,l);
+	CacheBufferWrite(cb,str,l);
+}
+/* return 0 when the entry is too short */
+int CacheBufferRead(struct s_cachebuffer *cb, void *data, int len)
+{
+	#undef FUNC
+	#define FUNC "CacheBufferRead"
+
+	if (len<0 || cb->pos+len>cb->len) return 0;
+	memcpy(data,cb->data+cb->pos,len);
+	cb->pos+=len;
+	return 1;
+}
+int CacheBufferReadInt(struct s_cachebuffer *cb, int *v)
+{
+	return CacheBufferRead(cb,v,sizeof(int));
+}
+char *CacheBufferReadString(struct s_cachebuffer *cb)
+{
+	char *str;
+	int l;
+
+	if (!CacheBufferReadInt(cb,&l) || l<0 || cb->pos+l>cb->len) return NULL;
+	str=MemMalloc(l+1);
+	memcpy(str,cb->data+cb->pos,l);
+	str[l]=0;
+	cb->pos+=l;
+	return str;
+}
+
+char *CacheEntryName(char *cachedir, unsigned long long hash, char *extension)
+{
+	#undef FUNC
+	#define FUNC "CacheEntryName"
+
+	char *entryname;
+
+	entryname=MemMalloc(strlen(cachedir)+strlen(extension)+20);
+	sprintf(entryname,"%s/%016llX%s",cachedir,hash,extension);
+	return entryname;
+}
+
+int CacheReadEntry(char *entryname, struct s_cachebuffer *cb)
+{
+	#undef FUNC
+	#define FUNC "CacheReadEntry"
+
+	memset(cb,0,sizeof(struct s_cachebuffer));
+	if (!FileExists(entryname)) return 0;
+	cb->max=cb->len=FileGetSize(entryname);
+	cb->data=MemMalloc(cb->len+1);
+	if (FileReadBinary(entryname,(char*)cb->data,cb->len+1)!=cb->len) {
+		MemFree(cb->data);
+		cb->data=NULL;
+		return 0;
+	}
+	return 1;
+}
+
+#ifdef RASM_THREAD
+pthread_mutex_t cache_mutex=PTHREAD_MUTEX_INITIALIZER;
+#endif
+int cache_tmpcounter=0;
+
+/* written in a temporary file then renamed so a concurrent run never reads a partial entry */
+void CacheWriteEntry(char *entryname, struct s_cachebuffer *cb)
+{
+	#undef FUNC
+	#define FUNC "CacheWriteEntry"
+
+	char *tmpname;
+	int tmpcounter;
+
+	#ifdef RASM_THREAD
+	pthread_mutex_lock(&cache_mutex);
+	#endif
+	tmpcounter=cache_tmpcounter++;
+	#ifdef RASM_THREAD
+	pthread_mutex_unlock(&cache_mutex);
+	#endif
+	tmpname=MemMalloc(strlen(entryname)+32);
+	#ifdef OS_WIN
+	sprintf(tmpname,"%s.%d.%d",entryname,(int)_getpid(),tmpcounter);
+	#else
+	sprintf(tmpname,"%s.%d.%d",entryname,(int)getpid(),tmpcounter);
+	#endif
+	FileRemoveIfExists(tmpname);
+	FileWriteBinary(tmpname,(char*)cb->data,cb->len);
+	FileWriteBinaryClose(tmpname);
+	#ifdef OS_WIN
+	FileRemoveIfExists(entryname);
+	#endif
+	if (rename(tmpname,entryname)) FileRemoveIfExists(tmpname);
+	MemFree(tmpname);
+}
+
+unsigned long long CacheCrunchHash(int lz, unsigned char *data, int datalen)
+{
+	return RasmHash(data,datalen,RasmHash((unsigned char *)&lz,sizeof(int),RASM_HASH_INIT));
+}
+
+/* crunched data entry: cruncher, raw data, crunched data */
+unsigned char *CacheGetCrunch(char *cachedir, int lz, unsigned char *data, int datalen, int *retlen)
+{
+	#undef FUNC
+	#define FUNC "CacheGetCrunch"
+
+	struct s_cachebuffer cb;
+	unsigned char *lzdata=NULL;
+	char *entryname;
+	char magic[8];
+	int elz,elen,lzlen;
+
+	entryname=CacheEntryName(cachedir,CacheCrunchHash(lz,data,datalen),".lz");
+	if (CacheReadEntry(entryname,&cb)) {
+		if (CacheBufferRead(&cb,magic,8) && memcmp(magic,"RASMLZ01",8)==0
+			&& CacheBufferReadInt(&cb,&elz) && elz==lz
+			&& CacheBufferReadInt(&cb,&elen) && elen==datalen && cb.pos+elen<=cb.len && memcmp(cb.data+cb.pos,data,datalen)==0) {
+			cb.pos+=elen;
+			if (CacheBufferReadInt(&cb,&lzlen) && lzlen>=0 && cb.pos+lzlen==cb.len) {
+				lzdata=MemMalloc(lzlen+1);
+				CacheBufferRead(&cb,lzdata,lzlen);
+				*retlen=lzlen;
+			}
+		}
+		MemFree(cb.data);
+	}
+	MemFree(entryname);
+	return lzdata;
+}
+
+void CachePutCrunch(char *cachedir, int lz, unsigned char *data, int datalen, unsigned char *lzdata, int lzlen)
+{
+	#undef FUNC
+	#define FUNC "CachePutCrunch"
+
+	struct s_cachebuffer cb={0};
+	char *entryname;
 
+	CacheBufferWrite(&cb,"RASMLZ01",8);
+	CacheBufferWriteInt(&cb,lz);
+	CacheBufferWriteInt(&cb,datalen);
+	CacheBufferWrite(&cb,data,datalen);
+	CacheBufferWriteInt(&cb,lzlen);
+	CacheBufferWrite(&cb,lzdata,lzlen);
+	entryname=CacheEntryName(cachedir,CacheCrunchHash(lz,data,datalen),".lz");
+	CacheWriteEntry(entryname,&cb);
+	MemFree(entryname);
+	MemFree(cb.data);
+}
 
 /*
  * optimised reading of text file in one shot
@@ -1084,6 +1564,16 @@ unsigned char *_internal_readbinaryfile(char *filename, int *filelength)
         #define FUNC "_internal_readbinaryfile"
 
         unsigned char *binary_data=NULL;
+#ifdef RASM_SERVER
+        char fullpath[PATH_MAX];
+        long long stamp;
+        int cached;
+
+        cached=ServerCacheFileKey(filename,fullpath,&stamp);
+        if (cached && (binary_data=ServerCacheGet(-1,(unsigned char *)fullpath,strlen(fullpath),stamp,filelength))!=NULL) {
+                return binary_data;
+        }
+#endif
 
         *filelength=FileGetSize(filename);
         binary_data=MemMalloc((*filelength)+1);
@@ -1092,19 +1582,19 @@ unsigned char *_internal_readbinaryfile(char *filename, int *filelength)
                 logerr("Cannot fully read %s",filename);
                 exit(INTERNAL_ERROR);
         }
+#ifdef RASM_SERVER
+        if (cached) ServerCachePut(-1,(unsigned char *)fullpath,strlen(fullpath),stamp,binary_data,*filelength,1);
+#endif
         return binary_data;
 }
-char **_internal_readtextfile(char *filename, char replacechar)
+/* split a text buffer into lines, the buffer is released */
+char **_internal_splittextbuffer(unsigned char *bigbuffer, int file_size, char replacechar)
 {
         #undef FUNC
-        #define FUNC "_internal_readtextfile"
+        #define FUNC "_internal_splittextbuffer"
 
         char **lines_buffer=NULL;
-        unsigned char *bigbuffer;
         int nb_lines=0,max_lines=0,i=0,e=0;
-        int file_size;
-
-        bigbuffer=_internal_readbinaryfile(filename,&file_size);
 
         while (i<file_size) {
                 while (e<file_size && bigbuffer[e]!=0x0A) {
@@ -1140,6 +1630,17 @@ char **_internal_readtextfile(char *filename, char replacechar)
         MemFree(bigbuffer);
         return lines_buffer;
 }
+char **_internal_readtextfile(char *filename, char replacechar)
+{
+        #undef FUNC
+        #define FUNC "_internal_readtextfile"
+
+        unsigned char *bigbuffer;
+        int file_size;
+
+        bigbuffer=_internal_readbinaryfile(filename,&file_size);
+        return _internal_splittextbuffer(bigbuffer,file_size,replacechar);
+}
 
 #define FileReadLines(filename) _internal_readtextfile(filename,':')
 #define FileReadLinesRAW(filename) _internal_readtextfile(filename,0x0D)
@@ -1236,7 +1737,7 @@ char *TxtReplace(char *in_str, char *in_substr, char *out_substr, int recurse)
 				m1=out_str+sl;
 				m2=m1+dif;
 				sl+=dif;
-				while (m1!=str_look+l1-dif)
+				while (m1!=str_look+l1-1)
 				{
 					*m2=*m1;
 					m1--;m2--;
@@ -1306,65 +1807,233 @@ int _internal_LevenshteinDistance(char *s,  char *t)
    return r;
 }
 
-#ifdef RASM_THREAD
+void rasm_printf(struct s_assenv *ae, ...);
+
 /*
- threads used for crunching
+ crunchers are run through jobs so independent data may be crunched at the same time
 */
+#ifdef RASM_THREAD
+/* ZX7 and Exomizer use global variables */
+pthread_mutex_t crunch_mutex=PTHREAD_MUTEX_INITIALIZER;
+#endif
+
+unsigned char *CrunchData(int lz, unsigned char *data, int datalen, int *retlen, char *cachedir, struct zx7_context_t *zx7)
+{
+	#undef FUNC
+	#define FUNC "CrunchData"
+
+	unsigned char *lzdata=NULL;
+	#ifndef NO_3RD_PARTIES
+	ZX7_Context *zx7tmp=NULL;
+	#endif
+	size_t slzlen;
+
+	*retlen=0;
+	#ifdef RASM_SERVER
+	/* the same data crunched with the same cruncher was already done by a previous job */
+	if ((lzdata=ServerCacheGet(lz,data,datalen,0,retlen))!=NULL) return lzdata;
+	#endif
+	if (cachedir && (lzdata=CacheGetCrunch(cachedir,lz,data,datalen,retlen))!=NULL) {
+		#ifdef RASM_SERVER
+		ServerCachePut(lz,data,datalen,0,lzdata,*retlen,1);
+		#endif
+		return lzdata;
+	}
+	switch (lz) {
+		#ifndef NO_3RD_PARTIES
+		case 4:
+			lzdata=LZ4_crunch(data,datalen,retlen);
+			break;
+		case 7:
+			#ifdef RASM_THREAD
+			pthread_mutex_lock(&crunch_mutex);
+			#endif
+			/* no assembly context, use a temporary one */
+			if (!zx7) zx7=zx7tmp=ZX7_context_new();
+			lzdata=ZX7_compress(optimize(zx7, data, datalen), data, datalen, &slzlen);
+			*retlen=slzlen;
+			if (zx7tmp) ZX7_context_free(zx7tmp);
+			#ifdef RASM_THREAD
+			pthread_mutex_unlock(&crunch_mutex);
+			#endif
+			break;
+		case 8:
+			#ifdef RASM_THREAD
+			pthread_mutex_lock(&crunch_mutex);
+			#endif
+			lzdata=Exomizer_crunch(data,datalen,retlen);
+			#ifdef RASM_THREAD
+			pthread_mutex_unlock(&crunch_mutex);
+			#endif
+			break;
+		case 17:
+			lzdata=APULTRA_crunch(data,datalen,retlen);
+			break;
+		#endif
+		case 48:
+			lzdata=LZ48_crunch(data,datalen,retlen);
+			break;
+		case 49:
+			lzdata=LZ49_crunch(data,datalen,retlen);
+			break;
+		default:break;
+	}
+	#ifdef RASM_SERVER
+	if (lzdata) ServerCachePut(lz,data,datalen,0,lzdata,*retlen,1);
+	#endif
+	if (lzdata && cachedir) CachePutCrunch(cachedir,lz,data,datalen,lzdata,*retlen);
+	return lzdata;
+}
+
+#ifdef RASM_THREAD
+void *_internal_CrunchThread(void *param)
+{
+	struct s_rasm_thread *rasm_thread=(struct s_rasm_thread *)param;
+
+	rasm_thread->dataout=CrunchData(rasm_thread->lz,rasm_thread->datain,rasm_thread->datalen,&rasm_thread->lenout,rasm_thread->cachedir,rasm_thread->zx7);
+	return NULL;
+}
 void _internal_ExecuteThreads(struct s_assenv *ae,struct s_rasm_thread *rasm_thread, void *(*fct)(void *))
 {
 	#undef FUNC
 	#define FUNC "_internal_ExecuteThreads"
 
 	pthread_attr_t attr;
-	void *status;
 	int rc;
 	/* launch threads */
 	pthread_attr_init(&attr);
 	pthread_attr_setdetachstate(&attr,PTHREAD_CREATE_JOINABLE);
-	pthread_attr_setstacksize(&attr,65536);
 
-	if ((rc=pthread_create(&image_threads[i].thread,&attr,fct,(void *)rasm_thread))) {
+	if ((rc=pthread_create(&rasm_thread->thread,&attr,fct,(void *)rasm_thread))) {
 		rasm_printf(ae,"FATAL ERROR - Cannot create thread!\n");
 		exit(INTERNAL_ERROR);
 	}
+	pthread_attr_destroy(&attr);
+	rasm_thread->status=1;
 }
 void _internal_WaitForThreads(struct s_assenv *ae,struct s_rasm_thread *rasm_thread)
 {
 	#undef FUNC
 	#define FUNC "_internal_WaitForThreads"
+	void *status;
 	int rc;
 	
 	if ((rc=pthread_join(rasm_thread->thread,&status))) {
 		rasm_printf(ae,"FATAL ERROR - Cannot wait for thread\n");
 		exit(INTERNAL_ERROR);
 	}
+	rasm_thread->status=2;
+}
+/* start queued jobs, oldest first, while there is a free thread */
+void _internal_ScheduleThreads(struct s_assenv *ae)
+{
+	#undef FUNC
+	#define FUNC "_internal_ScheduleThreads"
+	int i,running=0;
+
+	for (i=0;i<ae->irt;i++) {
+		if (ae->rasm_thread[i]->status==1) running++;
+	}
+	for (i=0;i<ae->irt && running<ae->maxthread;i++) {
+		if (ae->rasm_thread[i]->status==0) {
+			_internal_ExecuteThreads(ae,ae->rasm_thread[i],_internal_CrunchThread);
+			running++;
+		}
+	}
 }
-void PushCrunchedFile(struct s_assenv *ae, unsigned char *datain, int datalen, int lz)
+#endif
+
+/*
+ queue a crunch job, the job owns datain
+ ihexbin is the hexbin to update when all jobs are popped, -1 if the caller waits for the job itself
+*/
+int PushCrunchedFile(struct s_assenv *ae, unsigned char *datain, int datalen, int lz, int ihexbin)
 {
 	#undef FUNC
 	#define FUNC "PushCrunchedFile"
 	
 	struct s_rasm_thread *rasm_thread;
 	
+	if (lz==8) {
+		rasm_printf(ae,KWARNING"Exomizer is crunching %.1fkb this may take a while, be patient...\n",datalen/1024.0);
+	}
 	rasm_thread=MemMalloc(sizeof(struct s_rasm_thread));
 	memset(rasm_thread,0,sizeof(struct s_rasm_thread));
 	rasm_thread->datain=datain;
 	rasm_thread->datalen=datalen;
 	rasm_thread->lz=lz;
-	_internal_ExecuteThreads(ae,rasm_thread, void *(*fct)(void *));
+	rasm_thread->ihexbin=ihexbin;
+	rasm_thread->cachedir=ae->cachedir;
+	#ifndef NO_3RD_PARTIES
+	/* allocated once, jobs are serialised on the ZX7 cruncher */
+	if (lz==7 && !ae->zx7) ae->zx7=ZX7_context_new();
+	#endif
+	rasm_thread->zx7=ae->zx7;
 	ObjectArrayAddDynamicValueConcat((void**)&ae->rasm_thread,&ae->irt,&ae->mrt,&rasm_thread,sizeof(struct s_rasm_thread *));
+#ifdef RASM_THREAD
+	_internal_ScheduleThreads(ae);
+#else
+	rasm_thread->dataout=CrunchData(lz,datain,datalen,&rasm_thread->lenout,ae->cachedir,ae->zx7);
+	rasm_thread->status=2;
+#endif
+	return ae->irt-1;
 }
+/*
+ wait for a crunch job, jobs are started in order so waiting for the oldest running one always frees a thread
+*/
+struct s_rasm_thread *WaitCrunchedFile(struct s_assenv *ae, int irt)
+{
+	#undef FUNC
+	#define FUNC "WaitCrunchedFile"
+	
+#ifdef RASM_THREAD
+	int i;
+
+	while (ae->rasm_thread[irt]->status!=2) {
+		for (i=0;i<ae->irt && ae->rasm_thread[i]->status!=1;i++);
+		if (i<ae->irt) {
+			_internal_WaitForThreads(ae,ae->rasm_thread[i]);
+		}
+		_internal_ScheduleThreads(ae);
+	}
+#endif
+	return ae->rasm_thread[irt];
+}
+/*
+ wait for all jobs, update the crunched hexbins and free the jobs
+*/
 void PopAllCrunchedFiles(struct s_assenv *ae)
 {
 	#undef FUNC
 	#define FUNC "PopAllCrunchedFiles"
 	
+	struct s_rasm_thread *rasm_thread;
 	int i;
+
 	for (i=0;i<ae->irt;i++) {
-		_internal_WaitForThreads(ae,ae->rasm_thread[i]);
+		rasm_thread=WaitCrunchedFile(ae,i);
+		if (rasm_thread->ihexbin>=0) {
+			if (rasm_thread->dataout) {
+				MemFree(ae->hexbin[rasm_thread->ihexbin].data);
+				ae->hexbin[rasm_thread->ihexbin].data=rasm_thread->dataout;
+				ae->hexbin[rasm_thread->ihexbin].datalen=rasm_thread->lenout;
+				#if TRACE_PREPRO
+				rasm_printf(ae,KVERBOSE"[%s] crunched into %d byte(s)\n",ae->hexbin[rasm_thread->ihexbin].filename,rasm_thread->lenout);
+				#endif
+			}
+		} else {
+			MemFree(rasm_thread->datain);
+			if (rasm_thread->dataout) MemFree(rasm_thread->dataout);
+		}
+	}
+	/* other jobs are scanned while waiting, free them when all are done */
+	for (i=0;i<ae->irt;i++) {
+		MemFree(ae->rasm_thread[i]);
 	}
+	if (ae->mrt) MemFree(ae->rasm_thread);
+	ae->rasm_thread=NULL;
+	ae->irt=ae->mrt=0;
 }
-#endif
 
 void MaxError(struct s_assenv *ae);
 
@@ -1390,7 +2059,7 @@ char *rasm_getline(struct s_assenv *ae, int offset) {
 	#undef FUNC
 	#define FUNC "rasm_getline"
 	
-	static char myline[40]={0};
+	char *myline=ae->linebuffer;
 	int idx=0,icopy,first=1;
 
 	while (!ae->wl[ae->idx+offset].t && idx<32) {
@@ -1508,11 +2177,10 @@ printf("filename=[%s]\n",filename);
 
 }
 
-char *GetPath(char *filename) {
+char *GetPath(char *filename, char *curpath) {
 	#undef FUNC
 	#define FUNC "GetPath"
 
-	static char curpath[PATH_MAX];
 	int zelen,idx;
 
 	zelen=strlen(filename);
@@ -1555,7 +2223,7 @@ char *MergePath(struct s_assenv *ae,char *dadfilename, char *filename) {
 	#undef FUNC
 	#define FUNC "MergePath"
 
-	static char curpath[PATH_MAX];
+	char *curpath=ae->pathbuffer;
 	int zelen;
 
 #ifdef OS_WIN
@@ -1569,10 +2237,10 @@ char *MergePath(struct s_assenv *ae,char *dadfilename, char *filename) {
 		exit(-111);
 	} else {
 		if (filename[0]=='.' && filename[1]=='\\') {
-			strcpy(curpath,GetPath(dadfilename));
+			GetPath(dadfilename,curpath);
 			strcat(curpath,filename+2);
 		} else {
-			strcpy(curpath,GetPath(dadfilename));
+			GetPath(dadfilename,curpath);
 			strcat(curpath,filename);
 		}
 	}
@@ -1581,10 +2249,10 @@ char *MergePath(struct s_assenv *ae,char *dadfilename, char *filename) {
 		/* chemin absolu */
 		strcpy(curpath,filename);
 	} else if (filename[0]=='.' && filename[1]=='/') {
-		strcpy(curpath,GetPath(dadfilename));
+		GetPath(dadfilename,curpath);
 		strcat(curpath,filename+2);
 	} else {
-		strcpy(curpath,GetPath(dadfilename));
+		GetPath(dadfilename,curpath);
 		strcat(curpath,filename);
 	}
 #endif
@@ -1632,6 +2300,204 @@ int GetCRC(char *label)
 	return crc;
 }
 
+/***********************************************************************
+   a r e n a   a n d   s y m b o l   t a b l e s
+***********************************************************************/
+void *ArenaAlloc(struct s_rasm_arena *arena, int size)
+{
+	#undef FUNC
+	#define FUNC "ArenaAlloc"
+
+	unsigned char *chunk;
+	int chunksize;
+
+	size=(size+7)&~7;
+	if (!arena->nchunk || arena->used+size>arena->size) {
+		chunksize=size>RASM_ARENA_CHUNK?size:RASM_ARENA_CHUNK;
+		chunk=MemMalloc(chunksize);
+		ObjectArrayAddDynamicValueConcat((void **)&arena->chunk,&arena->nchunk,&arena->mchunk,&chunk,sizeof(unsigned char *));
+		arena->size=chunksize;
+		arena->used=0;
+	}
+	chunk=arena->chunk[arena->nchunk-1]+arena->used;
+	arena->used+=size;
+	return chunk;
+}
+char *ArenaStrDup(struct s_rasm_arena *arena, char *str)
+{
+	#undef FUNC
+	#define FUNC "ArenaStrDup"
+
+	int len;
+	char *newstr;
+
+	len=strlen(str)+1;
+	newstr=ArenaAlloc(arena,len);
+	memcpy(newstr,str,len);
+	return newstr;
+}
+void ArenaFree(struct s_rasm_arena *arena)
+{
+	#undef FUNC
+	#define FUNC "ArenaFree"
+
+	int i;
+
+	for (i=0;i<arena->nchunk;i++) MemFree(arena->chunk[i]);
+	if (arena->mchunk) MemFree(arena->chunk);
+	memset(arena,0,sizeof(struct s_rasm_arena));
+}
+
+/* FNV-1a + murmur3 finalizer, GetCRC only keeps the last chars of a name */
+unsigned int SymbolHash(char *name)
+{
+	#undef FUNC
+	#define FUNC "SymbolHash"
+
+	unsigned int hash=2166136261U;
+
+	while (*name) {
+		hash=(hash^(unsigned char)*name++)*16777619U;
+	}
+	hash^=hash>>16;
+	hash*=0x85EBCA6BU;
+	hash^=hash>>13;
+	hash*=0xC2B2AE35U;
+	hash^=hash>>16;
+	/* zero means empty slot */
+	return hash?hash:1;
+}
+struct s_symbol_slot *SymbolTableSearch(struct s_symbol_table *table, char *name, unsigned int hash)
+{
+	#undef FUNC
+	#define FUNC "SymbolTableSearch"
+
+	int i;
+
+	if (!table->mslot) return NULL;
+	i=hash&(table->mslot-1);
+	while (table->slot[i].hash) {
+		if (table->slot[i].hash==hash && table->slot[i].data && strcmp(table->slot[i].name,name)==0) {
+			return &table->slot[i];
+		}
+		i=(i+1)&(table->mslot-1);
+	}
+	return NULL;
+}
+void SymbolTableResize(struct s_symbol_table *table, int mslot)
+{
+	#undef FUNC
+	#define FUNC "SymbolTableResize"
+
+	struct s_symbol_slot *oldslot;
+	int i,j,oldmslot;
+
+	oldslot=table->slot;
+	oldmslot=table->mslot;
+	table->slot=MemMalloc(sizeof(struct s_symbol_slot)*mslot);
+	memset(table->slot,0,sizeof(struct s_symbol_slot)*mslot);
+	table->mslot=mslot;
+	/* deleted slots are dropped */
+	for (i=0;i<oldmslot;i++) {
+		if (oldslot[i].data) {
+			j=oldslot[i].hash&(mslot-1);
+			while (table->slot[j].hash) j=(j+1)&(mslot-1);
+			table->slot[j]=oldslot[i];
+		}
+	}
+	table->nslot=table->nsymbol;
+	if (oldmslot) MemFree(oldslot);
+}
+/* the name must not be in the table yet, data defaults to the interned name */
+struct s_symbol_slot *SymbolTableInsert(struct s_rasm_arena *arena, struct s_symbol_table *table, char *name, unsigned int hash, void *data)
+{
+	#undef FUNC
+	#define FUNC "SymbolTableInsert"
+
+	int i;
+
+	/* keep the load under 3/4 to have short probes */
+	if ((table->nslot+1)*4>table->mslot*3) {
+		i=1024;
+		while (i<(table->nsymbol+1)*4) i*=2;
+		SymbolTableResize(table,i);
+	}
+	i=hash&(table->mslot-1);
+	while (table->slot[i].hash && table->slot[i].data) i=(i+1)&(table->mslot-1);
+	if (!table->slot[i].hash) table->nslot++;
+	table->slot[i].hash=hash;
+	table->slot[i].name=ArenaStrDup(arena,name);
+	table->slot[i].data=data?data:table->slot[i].name;
+	table->nsymbol++;
+	ObjectArrayAddDynamicValueConcat((void **)&table->entry,&table->nentry,&table->mentry,&table->slot[i].data,sizeof(void *));
+	return &table->slot[i];
+}
+void SymbolTableDelete(struct s_symbol_table *table, struct s_symbol_slot *slot)
+{
+	#undef FUNC
+	#define FUNC "SymbolTableDelete"
+
+	int i;
+
+	for (i=table->nentry-1;i>=0;i--) {
+		if (table->entry[i]==slot->data) {
+			if (i<table->nentry-1) MemMove(&table->entry[i],&table->entry[i+1],(table->nentry-i-1)*sizeof(void *));
+			table->nentry--;
+			break;
+		}
+	}
+	/* keep the hash so the probing goes on */
+	slot->data=NULL;
+	table->nsymbol--;
+}
+void FreeSymbolTable(struct s_symbol_table *table)
+{
+	#undef FUNC
+	#define FUNC "FreeSymbolTable"
+
+	if (table->mslot) MemFree(table->slot);
+	if (table->mentry) MemFree(table->entry);
+	memset(table,0,sizeof(struct s_symbol_table));
+}
+
+struct s_symbol_sort {
+	unsigned int crc;
+	int idx;
+	void *data;
+};
+int cmpsymbolsort(const void *a, const void *b)
+{
+	struct s_symbol_sort *sa,*sb;
+	sa=(struct s_symbol_sort *)a;
+	sb=(struct s_symbol_sort *)b;
+	if (sa->crc!=sb->crc) return sa->crc<sb->crc?-1:1;
+	return sa->idx-sb->idx;
+}
+/* entries ordered by CRC then declaration, the listing order of the former CRC trees */
+void **SymbolTableSorted(struct s_symbol_table *table, int crcoffset)
+{
+	#undef FUNC
+	#define FUNC "SymbolTableSorted"
+
+	struct s_symbol_sort *symsort;
+	void **sorted;
+	int i;
+
+	sorted=MemMalloc(sizeof(void *)*(table->nentry+1));
+	if (table->nentry) {
+		symsort=MemMalloc(sizeof(struct s_symbol_sort)*table->nentry);
+		for (i=0;i<table->nentry;i++) {
+			symsort[i].crc=*(unsigned int *)((char *)table->entry[i]+crcoffset);
+			symsort[i].idx=i;
+			symsort[i].data=table->entry[i];
+		}
+		qsort(symsort,table->nentry,sizeof(struct s_symbol_sort),cmpsymbolsort);
+		for (i=0;i<table->nentry;i++) sorted[i]=symsort[i].data;
+		MemFree(symsort);
+	}
+	return sorted;
+}
+
 int IsRegister(char *zeexpression)
 {
 	#undef FUNC
@@ -1701,6 +2567,33 @@ int StringIsMem(char *w)
 	return 1;
 
 }
+/* decimal or #hex value in byte range, nothing to resolve later */
+int StringIsByteLiteral(char *w)
+{
+	#undef FUNC
+	#define FUNC "StringIsByteLiteral"
+
+	int i=0,v=0;
+
+	if (w[0]=='#') {
+		if (!w[1]) return 0;
+		for (i=1;w[i];i++) {
+			if (w[i]>='0' && w[i]<='9') v=v*16+w[i]-'0';
+			else if (w[i]>='A' && w[i]<='F') v=v*16+w[i]-'A'+10;
+			else return 0;
+			if (v>255) return 0;
+		}
+	} else {
+		if (!w[0]) return 0;
+		for (i=0;w[i];i++) {
+			if (w[i]>='0' && w[i]<='9') v=v*10+w[i]-'0';
+			else return 0;
+			if (v>255) return 0;
+		}
+	}
+	return 1;
+}
+
 int StringIsQuote(char *w)
 {
 	#undef FUNC
@@ -1724,47 +2617,26 @@ int StringIsQuote(char *w)
 	}
 	return 0;
 }
-char *StringLooksLikeDicoRecurse(struct s_crcdico_tree *lt, int *score, char *str)
-{
-	#undef FUNC
-	#define FUNC "StringLooksLikeDicoRecurse"
-
-	char *retstr=NULL,*tmpstr;
-	int i,curs;
-
-	for (i=0;i<256;i++) {
-		if (lt->radix[i]) {
-			tmpstr=StringLooksLikeDicoRecurse(lt->radix[i],score,str);
-			if (tmpstr!=NULL) retstr=tmpstr;
-		}
-	}
-	if (lt->mdico) {
-		for (i=0;i<lt->ndico;i++) {
-			if (strlen(lt->dico[i].name)>4) {
-				curs=_internal_LevenshteinDistance(str,lt->dico[i].name);
-				if (curs<*score) {
-					*score=curs;
-					retstr=lt->dico[i].name;
-				}
-			}
-		}
-	}
-	return retstr;
-}
 char *StringLooksLikeDico(struct s_assenv *ae, int *score, char *str)
 {
 	#undef FUNC
 	#define FUNC "StringLooksLikeDico"
 
-	char *retstr=NULL,*tmpstr;
-	int i;
+	struct s_expr_dico **sorted;
+	char *retstr=NULL;
+	int i,curs;
 
-	for (i=0;i<256;i++) {
-		if (ae->dicotree.radix[i]) {
-			tmpstr=StringLooksLikeDicoRecurse(ae->dicotree.radix[i],score,str);
-			if (tmpstr!=NULL) retstr=tmpstr;
+	sorted=(struct s_expr_dico **)SymbolTableSorted(&ae->dicotable,offsetof(struct s_expr_dico,crc));
+	for (i=0;i<ae->dicotable.nentry;i++) {
+		if (strlen(sorted[i]->name)>4) {
+			curs=_internal_LevenshteinDistance(str,sorted[i]->name);
+			if (curs<*score) {
+				*score=curs;
+				retstr=sorted[i]->name;
+			}
 		}
 	}
+	MemFree(sorted);
 	return retstr;
 }
 char *StringLooksLikeMacro(struct s_assenv *ae, char *str, int *retscore)
@@ -1829,6 +2701,7 @@ char *StringLooksLike(struct s_assenv *ae, char *str)
 
 int RoundComputeExpression(struct s_assenv *ae,char *expr, int ptr, int didx, int expression_expected);
 int RoundComputeExpressionCore(struct s_assenv *ae,char *zeexpression,int ptr,int didx);
+void FreeCompiledExpression(struct s_assenv *ae);
 double ComputeExpressionCore(struct s_assenv *ae,char *original_zeexpression,int ptr, int didx);
 char *GetExpFile(struct s_assenv *ae,int didx);
 void __STOP(struct s_assenv *ae);
@@ -1896,7 +2769,7 @@ unsigned char *__internal_MakeAmsdosREAL(struct s_assenv *ae, double v, int iexp
 	#undef FUNC
 	#define FUNC "__internal_MakeAmsdosREAL"
 	
-	static unsigned char rc[5];
+	unsigned char *rc=ae->amsdosreal;
 
 	double tmpval;
 	int j,ib,ibb,exp=0;
@@ -1907,7 +2780,7 @@ unsigned char *__internal_MakeAmsdosREAL(struct s_assenv *ae, double v, int iexp
 	int ibit=0;
 	unsigned int mask;
 
-	memset(rc,0,sizeof(rc));
+	memset(rc,0,5);
 
 	deci=fabs(floor(v));
 	frac=fabs(v)-deci;
@@ -2078,11 +2951,12 @@ char *GetCurrentFile(struct s_assenv *ae)
 /*******************************************************************************************
 			    M E M O R Y       C L E A N U P 
 *******************************************************************************************/
-void FreeLabelTree(struct s_assenv *ae);
-void FreeDicoTree(struct s_assenv *ae);
-void FreeUsedTree(struct s_assenv *ae);
+void FreeLabelTable(struct s_assenv *ae);
+void FreeDicoTable(struct s_assenv *ae);
+void FreeUsedTable(struct s_assenv *ae);
+void FreeTextTable(struct s_assenv *ae);
 void ExpressionFastTranslate(struct s_assenv *ae, char **ptr_expr, int fullreplace);
-char *TradExpression(char *zexp);
+char *TradExpression(struct s_assenv *ae, char *zexp);
 
 
 void _internal_RasmFreeInfoStruct(struct s_rasm_info *debug)
@@ -2122,6 +2996,11 @@ void FreeAssenv(struct s_assenv *ae)
 	/* let the system free the memory in command line except when debug/dev */
 	if (!ae->flux) return;
 #endif
+	/* crunch jobs still running on error */
+	if (ae->irt) PopAllCrunchedFiles(ae);
+	#ifndef NO_3RD_PARTIES
+	if (ae->zx7) ZX7_context_free(ae->zx7);
+	#endif
 	/*** debug info ***/	
 	if (!ae->retdebug) {
 		_internal_RasmFreeInfoStruct(&ae->debug);
@@ -2163,14 +3042,12 @@ void FreeAssenv(struct s_assenv *ae)
 	MemFree(ae->mem);
 	
 	/* expression core buffer free */
-	ComputeExpressionCore(NULL,NULL,0,0);
-	ExpressionFastTranslate(NULL,NULL,0);
+	ComputeExpressionCore(ae,NULL,0,0);
+	ExpressionFastTranslate(ae,NULL,0);
 	/* free labels, expression, orgzone, repeat, ... */
 	if (ae->mo) MemFree(ae->orgzone);
-	if (ae->me) {
-		for (i=0;i<ae->ie;i++) if (ae->expression[i].reference) MemFree(ae->expression[i].reference);
-		MemFree(ae->expression);
-	}
+	if (ae->me) MemFree(ae->expression);
+	if (ae->referencebuffersize) MemFree(ae->referencebuffer);
 	if (ae->mh) {
 		for (i=0;i<ae->ih;i++) {
 			MemFree(ae->hexbin[i].data);
@@ -2178,9 +3055,10 @@ void FreeAssenv(struct s_assenv *ae)
 		}
 		MemFree(ae->hexbin);
 	}
-	for (i=0;i<ae->il;i++) {
-		if (ae->label[i].name && ae->label[i].iw==-1) MemFree(ae->label[i].name);
+	for (i=0;i<ae->icachedep;i++) {
+		MemFree(ae->cachedep[i].filename);
 	}
+	if (ae->mcachedep) MemFree(ae->cachedep);
 	/* structures */
 	for (i=0;i<ae->irasmstructalias;i++) {
 		MemFree(ae->rasmstructalias[i].name);
@@ -2191,6 +3069,7 @@ void FreeAssenv(struct s_assenv *ae)
 		for (j=0;j<ae->rasmstruct[i].irasmstructfield;j++) {
 			MemFree(ae->rasmstruct[i].rasmstructfield[j].fullname);
 			MemFree(ae->rasmstruct[i].rasmstructfield[j].name);
+			if (ae->rasmstruct[i].rasmstructfield[j].mdata) MemFree(ae->rasmstruct[i].rasmstructfield[j].data);
 		}
 		if (ae->rasmstruct[i].mrasmstructfield) MemFree(ae->rasmstruct[i].rasmstructfield);
 		MemFree(ae->rasmstruct[i].name);
@@ -2222,6 +3101,7 @@ void FreeAssenv(struct s_assenv *ae)
 
 	for (i=0;i<ae->imacro;i++) {
 		if (ae->macro[i].maxword) MemFree(ae->macro[i].wc);
+		if (ae->macro[i].mslot) MemFree(ae->macro[i].slot);
 		for (j=0;j<ae->macro[i].nbparam;j++) MemFree(ae->macro[i].param[j]);
 		if (ae->macro[i].nbparam) MemFree(ae->macro[i].param);
 	}
@@ -2235,8 +3115,8 @@ void FreeAssenv(struct s_assenv *ae)
 	}
 	if (ae->malias) MemFree(ae->alias);
 
-	for (i=0;ae->wl[i].t!=2;i++) {
-		MemFree(ae->wl[i].w);
+	for (i=0;i<ae->nbword;i++) {
+		if (ae->wl[i].t!=2) MemFree(ae->wl[i].w);
 	}
 	MemFree(ae->wl);
 
@@ -2258,6 +3138,11 @@ void FreeAssenv(struct s_assenv *ae)
 	if (ae->ctx2.maxoperatorstack) {
 		MemFree(ae->ctx2.operatorstack);
 	}
+	if (ae->ctx1.maxsymbol) MemFree(ae->ctx1.symbol);
+	if (ae->ctx1.maxsymbolname) MemFree(ae->ctx1.symbolname);
+	if (ae->ctx2.maxsymbol) MemFree(ae->ctx2.symbol);
+	if (ae->ctx2.maxsymbolname) MemFree(ae->ctx2.symbolname);
+	FreeCompiledExpression(ae);
 
 	for (i=0;i<ae->iticker;i++) {
 		MemFree(ae->ticker[i].varname);
@@ -2265,11 +3150,16 @@ void FreeAssenv(struct s_assenv *ae)
 	if (ae->mticker) MemFree(ae->ticker);
 
 	MemFree(ae->outputfilename);
-	FreeLabelTree(ae);
-	FreeDicoTree(ae);
-	FreeUsedTree(ae);
+	FreeLabelTable(ae);
+	FreeDicoTable(ae);
+	FreeUsedTable(ae);
+	FreeTextTable(ae);
+	/* labels, variables, references and symbol names */
+	ArenaFree(&ae->arena);
 	if (ae->mmacropos) MemFree(ae->macropos);
-	TradExpression(NULL);
+	if (ae->makemnemo) MemFree(ae->makemnemo);
+	if (ae->symbolchunk) MemFree(ae->symbolchunk);
+	TradExpression(ae,NULL);
 	MemFree(ae);
 }
 
@@ -2308,7 +3198,8 @@ void MaxError(struct s_assenv *ae)
 	}
 }
 
-void (*___output)(struct s_assenv *ae, unsigned char v);
+/* the output routine belongs to the assembly, NOCODE and the output limit switch it */
+#define ___output(ae,v) (ae)->output(ae,v)
 
 void ___internal_output_disabled(struct s_assenv *ae,unsigned char v)
 {
@@ -2326,7 +3217,7 @@ void ___internal_output(struct s_assenv *ae,unsigned char v)
 	} else {
 		MakeError(ae,GetCurrentFile(ae),ae->wl[ae->idx].l,"output exceed limit %d\n",ae->maxptr);
 		ae->stop=1;
-		___output=___internal_output_disabled;
+		ae->output=___internal_output_disabled;
 	}
 }
 void ___internal_output_nocode(struct s_assenv *ae,unsigned char v)
@@ -2353,9 +3244,45 @@ void ___internal_output_nocode(struct s_assenv *ae,unsigned char v)
 	} else {
 		MakeError(ae,GetCurrentFile(ae),ae->wl[ae->idx].l,"output exceed limit %d\n",ae->maxptr);
 		ae->stop=1;
-		___output=___internal_output_disabled;
+		ae->output=___internal_output_disabled;
+	}
+}
+
+/*
+	bulk output for data directives, the range is checked once against the limit
+	then copied (or filled when data is NULL) in the active bank
+	struct definitions keep the byte routine as every byte goes to the field data
+*/
+void ___internal_output_range(struct s_assenv *ae,unsigned char *data,unsigned char v,int len)
+{
+	#undef FUNC
+	#define FUNC "___internal_output_range"
+
+	int i,n;
+
+	if (len<=0 || ae->output==___internal_output_disabled) return;
+	if (ae->output!=___internal_output && ae->getstruct) {
+		for (i=0;i<len;i++) ___output(ae,data?data[i]:v);
+		return;
+	}
+
+	n=ae->maxptr-ae->outputadr;
+	if (n>len) n=len;
+	if (n>0) {
+		if (ae->output==___internal_output) {
+			if (data) memcpy(ae->mem[ae->activebank]+ae->outputadr,data,n); else memset(ae->mem[ae->activebank]+ae->outputadr,v,n);
+		}
+		ae->outputadr+=n;
+		ae->codeadr+=n;
+	}
+	if (n<len) {
+		MakeError(ae,GetCurrentFile(ae),ae->wl[ae->idx].l,"output exceed limit %d\n",ae->maxptr);
+		ae->stop=1;
+		ae->output=___internal_output_disabled;
 	}
 }
+#define ___output_block(ae,data,len) ___internal_output_range(ae,data,0,len)
+#define ___output_fill(ae,v,len) ___internal_output_range(ae,NULL,v,len)
 
 
 void ___output_set_limit(struct s_assenv *ae,int zelimit)
@@ -2379,11 +3306,11 @@ void ___output_set_limit(struct s_assenv *ae,int zelimit)
 	ae->maxptr=limit;
 }
 
-unsigned char *MakeAMSDOSHeader(int run, int minmem, int maxmem, char *amsdos_name) {
+unsigned char *MakeAMSDOSHeader(struct s_assenv *ae, int run, int minmem, int maxmem, char *amsdos_name) {
 	#undef FUNC
 	#define FUNC "MakeAMSDOSHeader"
 	
-	static unsigned char AmsdosHeader[128];
+	unsigned char *AmsdosHeader=ae->amsdosheader;
 	int checksum,i=0;
 	/***  cpcwiki			
 	Byte 00: User number
@@ -2397,7 +3324,7 @@ unsigned char *MakeAMSDOSHeader(int run, int minmem, int maxmem, char *amsdos_na
 	Byte 67 and 68: checksum for byte 00 to byte 66
 	To calculate the checksum, just add byte 00 to byte 66 to each other.
 	*/
-	memset(AmsdosHeader,0,sizeof(AmsdosHeader));
+	memset(AmsdosHeader,0,128);
 	AmsdosHeader[0]=0;
 	memcpy(AmsdosHeader+1,amsdos_name,11);
 
@@ -2438,11 +3365,11 @@ unsigned char *MakeAMSDOSHeader(int run, int minmem, int maxmem, char *amsdos_na
 	return AmsdosHeader;
 }
 
-unsigned char *MakeHobetaHeader(int minmem, int maxmem, char *trdos_name) {
+unsigned char *MakeHobetaHeader(struct s_assenv *ae, int minmem, int maxmem, char *trdos_name) {
 	#undef FUNC
 	#define FUNC "MakeHobetaHeader"
 	
-	static unsigned char HobetaHeader[17];
+	unsigned char *HobetaHeader=ae->hobetaheader;
 	int i,checksum=0;
 	/***  http://rk.nvg.ntnu.no/sinclair/faq/fileform.html#HOBETA			
    0x00     FileName     0x08      TR-DOS file name
@@ -2453,7 +3380,7 @@ unsigned char *MakeHobetaHeader(int minmem, int maxmem, char *trdos_name) {
    0x0E     HdrCRC16     0x02      Control checksum of the 15 byte
                                    header (not sector data!)
    */
-	memset(HobetaHeader,0,sizeof(HobetaHeader));
+	memset(HobetaHeader,0,17);
 
 	strncpy(HobetaHeader,trdos_name,8);
 	HobetaHeader[8]='C';
@@ -2614,568 +3541,256 @@ void CheckAndSortAliases(struct s_assenv *ae)
 	}
 }
 
-void InsertDicoToTree(struct s_assenv *ae, struct s_expr_dico *dico)
+void InsertDicoToTable(struct s_assenv *ae, struct s_expr_dico *dico)
 {
 	#undef FUNC
-	#define FUNC "InsertDicoToTree"
+	#define FUNC "InsertDicoToTable"
 
-	struct s_crcdico_tree *curdicotree;
-	int radix,dek=32;
+	struct s_expr_dico *newdico;
+	struct s_symbol_slot *slot;
 
-	curdicotree=&ae->dicotree;
-	while (dek) {
-		dek=dek-8;
-		radix=(dico->crc>>dek)&0xFF;
-		if (curdicotree->radix[radix]) {
-			curdicotree=curdicotree->radix[radix];
-		} else {
-			curdicotree->radix[radix]=MemMalloc(sizeof(struct s_crcdico_tree));
-			curdicotree=curdicotree->radix[radix];
-			memset(curdicotree,0,sizeof(struct s_crcdico_tree));
-		}
-	}
-	ObjectArrayAddDynamicValueConcat((void**)&curdicotree->dico,&curdicotree->ndico,&curdicotree->mdico,dico,sizeof(struct s_expr_dico));
+	newdico=ArenaAlloc(&ae->arena,sizeof(struct s_expr_dico));
+	*newdico=*dico;
+	slot=SymbolTableInsert(&ae->arena,&ae->dicotable,dico->name,SymbolHash(dico->name),newdico);
+	/* the name is interned */
+	newdico->name=slot->name;
 }
 
-unsigned char *SnapshotDicoInsert(char *symbol_name, int ptr, int *retidx)
+unsigned char *SnapshotDicoInsert(struct s_assenv *ae, char *symbol_name, int ptr, int *retidx)
 {
-	static unsigned char *subchunk=NULL;
-	static int subchunksize=0;
-	static int idx=0;
+	#undef FUNC
+	#define FUNC "SnapshotDicoInsert"
+
+	unsigned char *subchunk;
 	int symbol_len;
 	
 	if (retidx) {
 		if (symbol_name && strcmp(symbol_name,"FREE")==0) {
-			subchunksize=0;
-			idx=0;
-			MemFree(subchunk);
-			subchunk=NULL;
+			ae->symbolchunksize=0;
+			ae->symbolchunkidx=0;
+			MemFree(ae->symbolchunk);
+			ae->symbolchunk=NULL;
 		}
-		*retidx=idx;
-		return subchunk;
+		*retidx=ae->symbolchunkidx;
+		return ae->symbolchunk;
 	}
 	
-	if (idx+65536>subchunksize) {
-		subchunksize=subchunksize+65536;
-		subchunk=MemRealloc(subchunk,subchunksize);
+	if (ae->symbolchunkidx+65536>ae->symbolchunksize) {
+		ae->symbolchunksize=ae->symbolchunksize+65536;
+		ae->symbolchunk=MemRealloc(ae->symbolchunk,ae->symbolchunksize);
 	}
+	subchunk=ae->symbolchunk+ae->symbolchunkidx;
 	
 	symbol_len=strlen(symbol_name);
 	if (symbol_len>255) symbol_len=255;
-	subchunk[idx++]=symbol_len;
-	memcpy(subchunk+idx,symbol_name,symbol_len);
-	idx+=symbol_len;
-	memset(subchunk+idx,0,6);
-	idx+=6;
-	subchunk[idx++]=(ptr&0xFF00)/256;
-	subchunk[idx++]=ptr&0xFF;
+	*subchunk++=symbol_len;
+	memcpy(subchunk,symbol_name,symbol_len);
+	subchunk+=symbol_len;
+	memset(subchunk,0,6);
+	subchunk+=6;
+	*subchunk++=(ptr&0xFF00)/256;
+	*subchunk++=ptr&0xFF;
+	ae->symbolchunkidx=subchunk-ae->symbolchunk;
 	return NULL;
 }
 
-void SnapshotDicoTreeRecurse(struct s_crcdico_tree *lt)
-{
-	#undef FUNC
-	#define FUNC "SnapshottDicoTreeRecurse"
-
-	int i;
-
-	for (i=0;i<256;i++) {
-		if (lt->radix[i]) {
-			SnapshotDicoTreeRecurse(lt->radix[i]);
-		}
-	}
-	if (lt->mdico) {
-		for (i=0;i<lt->ndico;i++) {
-			if (strcmp(lt->dico[i].name,"IX") && strcmp(lt->dico[i].name,"IY") && strcmp(lt->dico[i].name,"PI") && strcmp(lt->dico[i].name,"ASSEMBLER_RASM")) {
-				SnapshotDicoInsert(lt->dico[i].name,(int)floor(lt->dico[i].v+0.5),NULL);
-			}
-		}
-	}
-}
-unsigned char *SnapshotDicoTree(struct s_assenv *ae, int *retidx)
+unsigned char *SnapshotDicoTable(struct s_assenv *ae, int *retidx)
 {
 	#undef FUNC
-	#define FUNC "SnapshotDicoTree"
+	#define FUNC "SnapshotDicoTable"
 
+	struct s_expr_dico **sorted;
 	unsigned char *sc;
 	int idx;
 	int i;
 
-	for (i=0;i<256;i++) {
-		if (ae->dicotree.radix[i]) {
-			SnapshotDicoTreeRecurse(ae->dicotree.radix[i]);
+	sorted=(struct s_expr_dico **)SymbolTableSorted(&ae->dicotable,offsetof(struct s_expr_dico,crc));
+	for (i=0;i<ae->dicotable.nentry;i++) {
+		if (strcmp(sorted[i]->name,"IX") && strcmp(sorted[i]->name,"IY") && strcmp(sorted[i]->name,"PI") && strcmp(sorted[i]->name,"ASSEMBLER_RASM")) {
+			SnapshotDicoInsert(ae,sorted[i]->name,(int)floor(sorted[i]->v+0.5),NULL);
 		}
 	}
+	MemFree(sorted);
 	
-	sc=SnapshotDicoInsert(NULL,0,&idx);
+	sc=SnapshotDicoInsert(ae,NULL,0,&idx);
 	*retidx=idx;
 	return sc;
 }
 
-void WarnLabelTreeRecurse(struct s_assenv *ae, struct s_crclabel_tree *lt)
+void WarnLabelTable(struct s_assenv *ae)
 {
 	#undef FUNC
-	#define FUNC "WarnLabelTreeRecurse"
+	#define FUNC "WarnLabelTable"
 
+	struct s_label **sorted;
 	int i;
 
-	for (i=0;i<256;i++) {
-		if (lt->radix[i]) {
-			WarnLabelTreeRecurse(ae,lt->radix[i]);
-		}
-	}
-	for (i=0;i<lt->nlabel;i++) {
-		if (!lt->label[i].used) {
-			if (!lt->label[i].name) {
-				rasm_printf(ae,KWARNING"[%s:%d] Warning: label %s declared but not used\n",ae->filename[lt->label[i].fileidx],lt->label[i].fileline,ae->wl[lt->label[i].iw].w);
+	sorted=(struct s_label **)SymbolTableSorted(&ae->labeltable,offsetof(struct s_label,crc));
+	for (i=0;i<ae->labeltable.nentry;i++) {
+		if (!sorted[i]->used) {
+			if (!sorted[i]->name) {
+				rasm_printf(ae,KWARNING"[%s:%d] Warning: label %s declared but not used\n",ae->filename[sorted[i]->fileidx],sorted[i]->fileline,ae->wl[sorted[i]->iw].w);
 			} else {
-				rasm_printf(ae,KWARNING"[%s:%d] Warning: label %s declared but not used\n",ae->filename[lt->label[i].fileidx],lt->label[i].fileline,lt->label[i].name);
+				rasm_printf(ae,KWARNING"[%s:%d] Warning: label %s declared but not used\n",ae->filename[sorted[i]->fileidx],sorted[i]->fileline,sorted[i]->name);
 			}
 		}
 	}
+	MemFree(sorted);
 }
-void WarnLabelTree(struct s_assenv *ae)
+void WarnDicoTable(struct s_assenv *ae)
 {
 	#undef FUNC
-	#define FUNC "WarnLabelTree"
+	#define FUNC "WarnDicoTable"
 
+	struct s_expr_dico **sorted;
 	int i;
 
-	for (i=0;i<256;i++) {
-		if (ae->labeltree.radix[i]) {
-			WarnLabelTreeRecurse(ae,ae->labeltree.radix[i]);
+	sorted=(struct s_expr_dico **)SymbolTableSorted(&ae->dicotable,offsetof(struct s_expr_dico,crc));
+	for (i=0;i<ae->dicotable.nentry;i++) {
+		if (strcmp(sorted[i]->name,"IX") && strcmp(sorted[i]->name,"IY") && strcmp(sorted[i]->name,"PI") && strcmp(sorted[i]->name,"ASSEMBLER_RASM") && sorted[i]->autorise_export) {
+			rasm_printf(ae,KWARNING"[%s:%d] Warning: variable %s declared but not used\n",ae->filename[ae->wl[sorted[i]->iw].ifile],ae->wl[sorted[i]->iw].l,sorted[i]->name);
 		}
 	}
+	MemFree(sorted);
 }
-void WarnDicoTreeRecurse(struct s_assenv *ae, struct s_crcdico_tree *lt)
+void ExportDicoTable(struct s_assenv *ae, char *zefile, char *zeformat)
 {
 	#undef FUNC
-	#define FUNC "WarnDicoTreeRecurse"
+	#define FUNC "ExportDicoTable"
 
+	struct s_expr_dico **sorted;
 	char symbol_line[1024];
 	int i;
 
-	for (i=0;i<256;i++) {
-		if (lt->radix[i]) {
-			WarnDicoTreeRecurse(ae,lt->radix[i]);
-		}
-	}
-	for (i=0;i<lt->ndico;i++) {
-		if (strcmp(lt->dico[i].name,"IX") && strcmp(lt->dico[i].name,"IY") && strcmp(lt->dico[i].name,"PI") && strcmp(lt->dico[i].name,"ASSEMBLER_RASM") && lt->dico[i].autorise_export) {
-			rasm_printf(ae,KWARNING"[%s:%d] Warning: variable %s declared but not used\n",ae->filename[ae->wl[lt->dico[i].iw].ifile],ae->wl[lt->dico[i].iw].l,lt->dico[i].name);
+	sorted=(struct s_expr_dico **)SymbolTableSorted(&ae->dicotable,offsetof(struct s_expr_dico,crc));
+	for (i=0;i<ae->dicotable.nentry;i++) {
+		if (strcmp(sorted[i]->name,"IX") && strcmp(sorted[i]->name,"IY") && strcmp(sorted[i]->name,"PI") && strcmp(sorted[i]->name,"ASSEMBLER_RASM") && sorted[i]->autorise_export) {
+			snprintf(symbol_line,sizeof(symbol_line)-1,zeformat,sorted[i]->name,(int)floor(sorted[i]->v+0.5));
+			symbol_line[sizeof(symbol_line)-1]=0xD;
+			FileWriteLine(zefile,symbol_line);
 		}
 	}
+	MemFree(sorted);
 }
-void WarnDicoTree(struct s_assenv *ae)
+void FreeDicoTable(struct s_assenv *ae)
 {
 	#undef FUNC
-	#define FUNC "ExportDicoTree"
-
-	int i;
+	#define FUNC "FreeDicoTable"
 
-	for (i=0;i<256;i++) {
-		if (ae->dicotree.radix[i]) {
-			WarnDicoTreeRecurse(ae,ae->dicotree.radix[i]);
-		}
-	}
+	/* entries and names are in the arena */
+	FreeSymbolTable(&ae->dicotable);
 }
-void ExportDicoTreeRecurse(struct s_crcdico_tree *lt, char *zefile, char *zeformat)
+struct s_expr_dico *SearchDico(struct s_assenv *ae, char *dico, int crc)
 {
 	#undef FUNC
-	#define FUNC "ExportDicoTreeRecurse"
+	#define FUNC "SearchDico"
 
-	char symbol_line[1024];
-	int i;
+	struct s_symbol_slot *slot;
+	struct s_expr_dico *retdico;
 
-	for (i=0;i<256;i++) {
-		if (lt->radix[i]) {
-			ExportDicoTreeRecurse(lt->radix[i],zefile,zeformat);
-		}
-	}
-	if (lt->mdico) {
-		for (i=0;i<lt->ndico;i++) {
-			if (strcmp(lt->dico[i].name,"IX") && strcmp(lt->dico[i].name,"IY") && strcmp(lt->dico[i].name,"PI") && strcmp(lt->dico[i].name,"ASSEMBLER_RASM") && lt->dico[i].autorise_export) {
-				snprintf(symbol_line,sizeof(symbol_line)-1,zeformat,lt->dico[i].name,(int)floor(lt->dico[i].v+0.5));
-				symbol_line[sizeof(symbol_line)-1]=0xD;
-				FileWriteLine(zefile,symbol_line);
-			}
-		}
-	}
+	/* REPEAT without counter variable */
+	if (!dico) return NULL;
+	slot=SymbolTableSearch(&ae->dicotable,dico,SymbolHash(dico));
+	if (!slot) return NULL;
+	retdico=(struct s_expr_dico *)slot->data;
+	retdico->used=1;
+	return retdico;
 }
-void ExportDicoTree(struct s_assenv *ae, char *zefile, char *zeformat)
+int DelDico(struct s_assenv *ae, char *dico, int crc)
 {
 	#undef FUNC
-	#define FUNC "ExportDicoTree"
+	#define FUNC "DelDico"
 
-	int i;
+	struct s_symbol_slot *slot;
 
-	for (i=0;i<256;i++) {
-		if (ae->dicotree.radix[i]) {
-			ExportDicoTreeRecurse(ae->dicotree.radix[i],zefile,zeformat);
-		}
-	}
+	slot=SymbolTableSearch(&ae->dicotable,dico,SymbolHash(dico));
+	if (!slot) return 0;
+	SymbolTableDelete(&ae->dicotable,slot);
+	return 1;
 }
-void FreeDicoTreeRecurse(struct s_crcdico_tree *lt)
-{
-	#undef FUNC
-	#define FUNC "FreeDicoTreeRecurse"
 
-	int i;
 
-	for (i=0;i<256;i++) {
-		if (lt->radix[i]) {
-			FreeDicoTreeRecurse(lt->radix[i]);
-		}
-	}
-	if (lt->mdico) {
-		for (i=0;i<lt->ndico;i++) {
-			MemFree(lt->dico[i].name);
-		}
-		MemFree(lt->dico);
-	}
-	MemFree(lt);
-}
-void FreeDicoTree(struct s_assenv *ae)
+void InsertUsedToTable(struct s_assenv *ae, char *used, int crc)
 {
 	#undef FUNC
-	#define FUNC "FreeDicoTree"
+	#define FUNC "InsertUsedToTable"
 
-	int i;
+	unsigned int hash;
 
-	for (i=0;i<256;i++) {
-		if (ae->dicotree.radix[i]) {
-			FreeDicoTreeRecurse(ae->dicotree.radix[i]);
-		}
-	}
-	if (ae->dicotree.mdico) {
-		for (i=0;i<ae->dicotree.ndico;i++) MemFree(ae->dicotree.dico[i].name);
-		MemFree(ae->dicotree.dico);
+	hash=SymbolHash(used);
+	/* no double */
+	if (!SymbolTableSearch(&ae->usedtable,used,hash)) {
+		SymbolTableInsert(&ae->arena,&ae->usedtable,used,hash,NULL);
 	}
 }
-struct s_expr_dico *SearchDico(struct s_assenv *ae, char *dico, int crc)
+void FreeUsedTable(struct s_assenv *ae)
 {
 	#undef FUNC
-	#define FUNC "SearchDico"
-
-	struct s_crcdico_tree *curdicotree;
-	struct s_expr_dico *retdico=NULL;
-	int i,radix,dek=32;
+	#define FUNC "FreeUsedTable"
 
-	curdicotree=&ae->dicotree;
-
-	while (dek) {
-		dek=dek-8;
-		radix=(crc>>dek)&0xFF;
-		if (curdicotree->radix[radix]) {
-			curdicotree=curdicotree->radix[radix];
-		} else {
-			/* radix not found, dico is not in index */
-			return NULL;
-		}
-	}
-	for (i=0;i<curdicotree->ndico;i++) {
-		if (strcmp(curdicotree->dico[i].name,dico)==0) {
-			curdicotree->dico[i].used=1;
-			return &curdicotree->dico[i];
-		}
-	}
-	return NULL;
+	FreeSymbolTable(&ae->usedtable);
 }
-int DelDico(struct s_assenv *ae, char *dico, int crc)
+int SearchUsed(struct s_assenv *ae, char *used, int crc)
 {
 	#undef FUNC
-	#define FUNC "DelDico"
-
-	struct s_crcdico_tree *curdicotree;
-	struct s_expr_dico *retdico=NULL;
-	int i,radix,dek=32;
-
-	curdicotree=&ae->dicotree;
+	#define FUNC "SearchUsed"
 
-	while (dek) {
-		dek=dek-8;
-		radix=(crc>>dek)&0xFF;
-		if (curdicotree->radix[radix]) {
-			curdicotree=curdicotree->radix[radix];
-		} else {
-			/* radix not found, dico is not in index */
-			return 0;
-		}
-	}
-	for (i=0;i<curdicotree->ndico;i++) {
-		if (strcmp(curdicotree->dico[i].name,dico)==0) {
-			/* must free memory */
-			MemFree(curdicotree->dico[i].name);
-			if (i<curdicotree->ndico-1) {
-				MemMove(&curdicotree->dico[i],&curdicotree->dico[i+1],(curdicotree->ndico-i-1)*sizeof(struct s_expr_dico));
-			}
-			curdicotree->ndico--;
-			return 1;
-		}
-	}
-	return 0;
+	return SymbolTableSearch(&ae->usedtable,used,SymbolHash(used))!=NULL;
 }
 
 
-void InsertUsedToTree(struct s_assenv *ae, char *used, int crc)
+
+void InsertTextToTable(struct s_assenv *ae, char *text, char *replace, int crc)
 {
 	#undef FUNC
-	#define FUNC "InsertUsedToTree"
+	#define FUNC "InsertTextToTable"
 
-	struct s_crcused_tree *curusedtree;
-	int radix,dek=32,i;
-	
-	curusedtree=&ae->usedtree;
-	while (dek) {
-		dek=dek-8;
-		radix=(crc>>dek)&0xFF;
-		if (curusedtree->radix[radix]) {
-			curusedtree=curusedtree->radix[radix];
-		} else {
-			curusedtree->radix[radix]=MemMalloc(sizeof(struct s_crcused_tree));
-			curusedtree=curusedtree->radix[radix];
-			memset(curusedtree,0,sizeof(struct s_crcused_tree));
-		}
-	}
-	for (i=0;i<curusedtree->nused;i++) if (strcmp(used,curusedtree->used[i])==0) break;
+	unsigned int hash;
+
+	hash=SymbolHash(text);
 	/* no double */
-	if (i==curusedtree->nused) {
-		FieldArrayAddDynamicValueConcat(&curusedtree->used,&curusedtree->nused,&curusedtree->mused,used);
+	if (!SymbolTableSearch(&ae->texttable,text,hash)) {
+		SymbolTableInsert(&ae->arena,&ae->texttable,text,hash,ArenaStrDup(&ae->arena,replace));
 	}
 }
-
-void FreeUsedTreeRecurse(struct s_crcused_tree *lt)
+void FreeTextTable(struct s_assenv *ae)
 {
 	#undef FUNC
-	#define FUNC "FreeUsedTreeRecurse"
-
-	int i;
+	#define FUNC "FreeTextTable"
 
-	for (i=0;i<256;i++) {
-		if (lt->radix[i]) {
-			FreeUsedTreeRecurse(lt->radix[i]);
-		}
-	}
-	if (lt->mused) {
-		for (i=0;i<lt->nused;i++) MemFree(lt->used[i]);
-		MemFree(lt->used);
-	}
-	MemFree(lt);
+	FreeSymbolTable(&ae->texttable);
 }
-void FreeUsedTree(struct s_assenv *ae)
+int SearchText(struct s_assenv *ae, char *text, int crc)
 {
 	#undef FUNC
-	#define FUNC "FreeUsedTree"
-
-	int i;
+	#define FUNC "SearchText"
 
-	for (i=0;i<256;i++) {
-		if (ae->usedtree.radix[i]) {
-			FreeUsedTreeRecurse(ae->usedtree.radix[i]);
-		}
-	}
+	return SymbolTableSearch(&ae->texttable,text,SymbolHash(text))!=NULL;
 }
-int SearchUsed(struct s_assenv *ae, char *used, int crc)
+
+
+void FreeLabelTable(struct s_assenv *ae)
 {
 	#undef FUNC
-	#define FUNC "SearchUsed"
+	#define FUNC "FreeLabelTable"
 
-	struct s_crcused_tree *curusedtree;
-	int i,radix,dek=32;
-
-	curusedtree=&ae->usedtree;
-	while (dek) {
-		dek=dek-8;
-		radix=(crc>>dek)&0xFF;
-		if (curusedtree->radix[radix]) {
-			curusedtree=curusedtree->radix[radix];
-		} else {
-			/* radix not found, used is not in index */
-			return 0;
-		}
-	}
-	for (i=0;i<curusedtree->nused;i++) {
-		if (strcmp(curusedtree->used[i],used)==0) {
-			return 1;
-		}
-	}
-	return 0;
-}
-
-
-
-void InsertTextToTree(struct s_assenv *ae, char *text, char *replace, int crc)
-{
-	#undef FUNC
-	#define FUNC "InsertTextToTree"
-
-	struct s_crcstring_tree *curstringtree;
-	int radix,dek=32,i;
-	
-	curstringtree=&ae->stringtree;
-	while (dek) {
-		dek=dek-8;
-		radix=(crc>>dek)&0xFF;
-		if (curstringtree->radix[radix]) {
-			curstringtree=curstringtree->radix[radix];
-		} else {
-			curstringtree->radix[radix]=MemMalloc(sizeof(struct s_crcused_tree));
-			curstringtree=curstringtree->radix[radix];
-			memset(curstringtree,0,sizeof(struct s_crcused_tree));
-		}
-	}
-	for (i=0;i<curstringtree->ntext;i++) if (strcmp(text,curstringtree->text[i])==0) break;
-	/* no double */
-	if (i==curstringtree->ntext) {
-		text=TxtStrDup(text);
-		replace=TxtStrDup(replace);
-		FieldArrayAddDynamicValueConcat(&curstringtree->text,&curstringtree->ntext,&curstringtree->mtext,text);
-		FieldArrayAddDynamicValueConcat(&curstringtree->replace,&curstringtree->nreplace,&curstringtree->mreplace,replace);
-	}
-}
-
-void FreeTextTreeRecurse(struct s_crcstring_tree *lt)
-{
-	#undef FUNC
-	#define FUNC "FreeTextTreeRecurse"
-
-	int i;
-
-	for (i=0;i<256;i++) {
-		if (lt->radix[i]) {
-			FreeTextTreeRecurse(lt->radix[i]);
-		}
-	}
-	if (lt->mtext) {
-		for (i=0;i<lt->ntext;i++) MemFree(lt->text[i]);
-		MemFree(lt->text);
-	}
-	MemFree(lt);
-}
-void FreeTextTree(struct s_assenv *ae)
-{
-	#undef FUNC
-	#define FUNC "FreeTextTree"
-
-	int i;
-
-	for (i=0;i<256;i++) {
-		if (ae->stringtree.radix[i]) {
-			FreeTextTreeRecurse(ae->stringtree.radix[i]);
-		}
-	}
-	if (ae->stringtree.mtext) MemFree(ae->stringtree.text);
-}
-int SearchText(struct s_assenv *ae, char *text, int crc)
-{
-	#undef FUNC
-	#define FUNC "SearchText"
-
-	struct s_crcstring_tree *curstringtree;
-	int i,radix,dek=32;
-
-	curstringtree=&ae->stringtree;
-	while (dek) {
-		dek=dek-8;
-		radix=(crc>>dek)&0xFF;
-		if (curstringtree->radix[radix]) {
-			curstringtree=curstringtree->radix[radix];
-		} else {
-			/* radix not found, used is not in index */
-			return 0;
-		}
-	}
-	for (i=0;i<curstringtree->ntext;i++) {
-		if (strcmp(curstringtree->text[i],text)==0) {
-			return 1;
-		}
-	}
-	return 0;
-}
-
-
-
-
-
-
-
-/*
-struct s_crclabel_tree {
-
-
-
-
-/*
-struct s_crclabel_tree {
-	struct s_crclabel_tree *radix[256];
-	struct s_label *label;
-	int nlabel,mlabel;
-};
-*/
-void FreeLabelTreeRecurse(struct s_crclabel_tree *lt)
-{
-	#undef FUNC
-	#define FUNC "FreeLabelTreeRecurse"
-
-	int i;
-
-	for (i=0;i<256;i++) {
-		if (lt->radix[i]) {
-			FreeLabelTreeRecurse(lt->radix[i]);
-		}
-	}
-	/* label.name already freed elsewhere as this one is a copy */
-	if (lt->mlabel) MemFree(lt->label);
-	MemFree(lt);
-}
-void FreeLabelTree(struct s_assenv *ae)
-{
-	#undef FUNC
-	#define FUNC "FreeLabelTree"
-
-	int i;
-
-	for (i=0;i<256;i++) {
-		if (ae->labeltree.radix[i]) {
-			FreeLabelTreeRecurse(ae->labeltree.radix[i]);
-		}
-	}
-	if (ae->labeltree.mlabel) MemFree(ae->labeltree.label);
-}
+	/* entries and interned names are in the arena */
+	FreeSymbolTable(&ae->labeltable);
+}
 
 struct s_label *SearchLabel(struct s_assenv *ae, char *label, int crc)
 {
 	#undef FUNC
 	#define FUNC "SearchLabel"
 
-	struct s_crclabel_tree *curlabeltree;
-	struct s_label *retlabel=NULL;
-	int i,radix,dek=32;
-//printf("searchLabel [%s]",label);
-	curlabeltree=&ae->labeltree;
-	while (dek) {
-		dek=dek-8;
-		radix=(crc>>dek)&0xFF;
-		if (curlabeltree->radix[radix]) {
-			curlabeltree=curlabeltree->radix[radix];
-		} else {
-			/* radix not found, label is not in index */
-//printf(" not found\n");
-			return NULL;
-		}
-	}
-	for (i=0;i<curlabeltree->nlabel;i++) {
-		if (!curlabeltree->label[i].name && strcmp(ae->wl[curlabeltree->label[i].iw].w,label)==0) {
-			curlabeltree->label[i].used=1;
-//printf(" found (global)\n");
-			return &curlabeltree->label[i];
-		} else if (curlabeltree->label[i].name && strcmp(curlabeltree->label[i].name,label)==0) {
-			curlabeltree->label[i].used=1;
-//printf(" found (local or proximity)\n");
-			return &curlabeltree->label[i];
-		}
-	}
-	return NULL;
+	struct s_symbol_slot *slot;
+	struct s_label *retlabel;
+
+	slot=SymbolTableSearch(&ae->labeltable,label,SymbolHash(label));
+	if (!slot) return NULL;
+	retlabel=(struct s_label *)slot->data;
+	retlabel->used=1;
+	return retlabel;
 }
 
 char *MakeLocalLabel(struct s_assenv *ae,char *varbuffer, int *retdek)
@@ -3264,15 +3879,14 @@ char *MakeLocalLabel(struct s_assenv *ae,char *varbuffer, int *retdek)
 	return locallabel;
 }
 
-char *TradExpression(char *zexp)
+char *TradExpression(struct s_assenv *ae, char *zexp)
 {
 	#undef FUNC
 	#define FUNC "TradExpression"
 	
-	static char *last_expression=NULL;
 	char *wstr;
 	
-	if (last_expression) {MemFree(last_expression);last_expression=NULL;}
+	if (ae->tradexpression) {MemFree(ae->tradexpression);ae->tradexpression=NULL;}
 	if (!zexp) return NULL;
 	
 	wstr=TxtStrDup(zexp);
@@ -3280,7 +3894,7 @@ char *TradExpression(char *zexp)
 	wstr=TxtReplace(wstr,"]",">>",0);
 	wstr=TxtReplace(wstr,"m","%",0);
 
-	last_expression=wstr;
+	ae->tradexpression=wstr;
 	return wstr;
 }
 
@@ -3384,7 +3998,320 @@ char *TranslateTag(struct s_assenv *ae, char *varbuffer, int *touched, int enabl
 		strncpy(varbuffer+tagidx,curvalstr,newlen); /* copy without zero terminator */
 	}
 
-	return varbuffer;
+	return varbuffer;
+}
+
+double ComputeExpressionExecute(struct s_assenv *ae,struct s_compute_element *computestack,int nbcomputestack,char *zeexpression,int didx)
+{
+	#undef FUNC
+	#define FUNC "ComputeExpressionExecute"
+
+	/* execution buffer of the assembly */
+	double *accu=ae->accu;
+	int i,paccu=0;
+	int accu_err=0;
+	double dummint;
+
+	/********************************************
+	        E X E C U T E        S T A C K
+	********************************************/
+	if (ae->maxam || ae->as80) {
+		int workinterval;
+		if (ae->as80) workinterval=0xFFFFFFFF; else workinterval=0xFFFF;
+		for (i=0;i<nbcomputestack;i++) {
+			switch (computestack[i].operator) {
+				/************************************************
+				  c a s e s   s h o u l d    b e    s o r t e d
+				************************************************/
+				case E_COMPUTE_OPERATION_PUSH_DATASTC:
+					if (ae->maccu<=paccu) {
+						ae->maccu=16+paccu;
+						accu=ae->accu=MemRealloc(accu,sizeof(double)*ae->maccu);
+					}
+					accu[paccu]=computestack[i].value;paccu++;
+					break;
+				case E_COMPUTE_OPERATION_OPEN:
+				case E_COMPUTE_OPERATION_CLOSE:/* cannot happend */ break;
+				case E_COMPUTE_OPERATION_ADD:if (paccu>1) accu[paccu-2]=((int)accu[paccu-2]+(int)accu[paccu-1])&workinterval;paccu--;break;
+				case E_COMPUTE_OPERATION_SUB:if (paccu>1) accu[paccu-2]=((int)accu[paccu-2]-(int)accu[paccu-1])&workinterval;paccu--;break;
+				case E_COMPUTE_OPERATION_MUL:if (paccu>1) accu[paccu-2]=((int)accu[paccu-2]*(int)accu[paccu-1])&workinterval;paccu--;break;
+				case E_COMPUTE_OPERATION_DIV:if (paccu>1) accu[paccu-2]=((int)accu[paccu-2]/(int)accu[paccu-1])&workinterval;paccu--;break;
+				case E_COMPUTE_OPERATION_AND:if (paccu>1) accu[paccu-2]=((int)accu[paccu-2]&(int)accu[paccu-1])&workinterval;paccu--;break;
+				case E_COMPUTE_OPERATION_OR:if (paccu>1) accu[paccu-2]=((int)accu[paccu-2]|(int)accu[paccu-1])&workinterval;paccu--;break;
+				case E_COMPUTE_OPERATION_XOR:if (paccu>1) accu[paccu-2]=((int)accu[paccu-2]^(int)accu[paccu-1])&workinterval;paccu--;break;
+				case E_COMPUTE_OPERATION_MOD:if (paccu>1) accu[paccu-2]=((int)accu[paccu-2]%(int)accu[paccu-1])&workinterval;paccu--;break;
+				case E_COMPUTE_OPERATION_SHL:if (paccu>1) accu[paccu-2]=((int)accu[paccu-2])<<((int)accu[paccu-1]);paccu--;break;
+				case E_COMPUTE_OPERATION_SHR:if (paccu>1) accu[paccu-2]=((int)accu[paccu-2])>>((int)accu[paccu-1]);paccu--;break;				
+				case E_COMPUTE_OPERATION_BAND:if (paccu>1) accu[paccu-2]=((int)accu[paccu-2]&&(int)accu[paccu-1])&workinterval;paccu--;break;
+				case E_COMPUTE_OPERATION_BOR:if (paccu>1) accu[paccu-2]=((int)accu[paccu-2]||(int)accu[paccu-1])&workinterval;paccu--;break;
+				/* comparison */
+				case E_COMPUTE_OPERATION_LOWER:if (paccu>1) accu[paccu-2]=((int)accu[paccu-2]&workinterval)<((int)accu[paccu-1]&workinterval);paccu--;break;
+				case E_COMPUTE_OPERATION_LOWEREQ:if (paccu>1) accu[paccu-2]=((int)accu[paccu-2]&workinterval)<=((int)accu[paccu-1]&workinterval);paccu--;break;
+				case E_COMPUTE_OPERATION_EQUAL:if (paccu>1) accu[paccu-2]=((int)accu[paccu-2]&workinterval)==((int)accu[paccu-1]&workinterval);paccu--;break;
+				case E_COMPUTE_OPERATION_NOTEQUAL:if (paccu>1) accu[paccu-2]=((int)accu[paccu-2]&workinterval)!=((int)accu[paccu-1]&workinterval);paccu--;break;
+				case E_COMPUTE_OPERATION_GREATER:if (paccu>1) accu[paccu-2]=((int)accu[paccu-2]&workinterval)>((int)accu[paccu-1]&workinterval);paccu--;break;
+				case E_COMPUTE_OPERATION_GREATEREQ:if (paccu>1) accu[paccu-2]=((int)accu[paccu-2]&workinterval)>=((int)accu[paccu-1]&workinterval);paccu--;break;
+				/* functions */
+				case E_COMPUTE_OPERATION_SIN:if (paccu>0) accu[paccu-1]=(int)sin(accu[paccu-1]*3.1415926545/180.0);break;
+				case E_COMPUTE_OPERATION_COS:if (paccu>0) accu[paccu-1]=(int)cos(accu[paccu-1]*3.1415926545/180.0);break;
+				case E_COMPUTE_OPERATION_ASIN:if (paccu>0) accu[paccu-1]=(int)asin(accu[paccu-1])*180.0/3.1415926545;break;
+				case E_COMPUTE_OPERATION_ACOS:if (paccu>0) accu[paccu-1]=(int)acos(accu[paccu-1])*180.0/3.1415926545;break;
+				case E_COMPUTE_OPERATION_ATAN:if (paccu>0) accu[paccu-1]=(int)atan(accu[paccu-1])*180.0/3.1415926545;break;
+				case E_COMPUTE_OPERATION_INT:break;
+				case E_COMPUTE_OPERATION_FLOOR:if (paccu>0) accu[paccu-1]=(int)floor(accu[paccu-1])&workinterval;break;
+				case E_COMPUTE_OPERATION_ABS:if (paccu>0) accu[paccu-1]=(int)fabs(accu[paccu-1])&workinterval;break;
+				case E_COMPUTE_OPERATION_EXP:if (paccu>0) accu[paccu-1]=(int)exp(accu[paccu-1])&workinterval;break;
+				case E_COMPUTE_OPERATION_LN:if (paccu>0) accu[paccu-1]=(int)log(accu[paccu-1])&workinterval;break;
+				case E_COMPUTE_OPERATION_LOG10:if (paccu>0) accu[paccu-1]=(int)log10(accu[paccu-1])&workinterval;break;
+				case E_COMPUTE_OPERATION_SQRT:if (paccu>0) accu[paccu-1]=(int)sqrt(accu[paccu-1])&workinterval;break;
+				case E_COMPUTE_OPERATION_LOW:if (paccu>0) accu[paccu-1]=((int)accu[paccu-1])&0xFF;break;
+				case E_COMPUTE_OPERATION_HIGH:if (paccu>0) accu[paccu-1]=(((int)accu[paccu-1])&0xFF00)>>8;break;
+				case E_COMPUTE_OPERATION_PSG:if (paccu>0) accu[paccu-1]=ae->psgfine[((int)accu[paccu-1])&0xFF];break;
+				case E_COMPUTE_OPERATION_RND:if (paccu>0) accu[paccu-1]=rand()%((int)accu[paccu-1]);break;
+				case E_COMPUTE_OPERATION_FRAC:if (paccu>0) accu[paccu-1]=((int)(accu[paccu-1]-(int)accu[paccu-1]));break;
+				case E_COMPUTE_OPERATION_CEIL:if (paccu>0) accu[paccu-1]=(int)ceil(accu[paccu-1])&workinterval;break;
+				case E_COMPUTE_OPERATION_GET_R:if (paccu>0) accu[paccu-1]=((((int)accu[paccu-1])&0xF0)>>4);break;
+				case E_COMPUTE_OPERATION_GET_V:if (paccu>0) accu[paccu-1]=((((int)accu[paccu-1])&0xF00)>>8);break;
+				case E_COMPUTE_OPERATION_GET_B:if (paccu>0) accu[paccu-1]=(((int)accu[paccu-1])&0xF);break;
+				case E_COMPUTE_OPERATION_SET_R:if (paccu>0) accu[paccu-1]=MinMaxInt(accu[paccu-1],0,15)<<4;break;
+				case E_COMPUTE_OPERATION_SET_V:if (paccu>0) accu[paccu-1]=MinMaxInt(accu[paccu-1],0,15)<<8;break;
+				case E_COMPUTE_OPERATION_SET_B:if (paccu>0) accu[paccu-1]=MinMaxInt(accu[paccu-1],0,15);break;
+				default:MakeError(ae,GetCurrentFile(ae),ae->wl[ae->idx].l,"invalid computing state! (%d)\n",GetExpFile(ae,didx),GetExpLine(ae,didx),computestack[i].operator);paccu=0;
+			}
+			if (!paccu) {
+				if (zeexpression[0]=='&') {
+					MakeError(ae,GetExpFile(ae,didx),GetExpLine(ae,didx),"Missing operand for calculation [%s] Did you use & for an hexadecimal value?\n",TradExpression(ae,zeexpression));
+				} else {
+					MakeError(ae,GetExpFile(ae,didx),GetExpLine(ae,didx),"Missing operand for calculation [%s]\n",TradExpression(ae,zeexpression));
+				}
+				accu_err=1;
+				break;
+			}
+		}
+	} else {
+		for (i=0;i<nbcomputestack;i++) {
+#if 0
+			int kk;
+			for (kk=0;kk<paccu;kk++) printf("stack[%d]=%lf\n",kk,accu[kk]);
+			if (computestack[i].operator==E_COMPUTE_OPERATION_PUSH_DATASTC) {
+				printf("pacc=%d push %.1lf\n",paccu,computestack[i].value);
+			} else {
+				printf("pacc=%d operation %s p=%d\n",paccu,computestack[i].operator==E_COMPUTE_OPERATION_MUL?"*":
+								computestack[i].operator==E_COMPUTE_OPERATION_ADD?"+":
+								computestack[i].operator==E_COMPUTE_OPERATION_DIV?"/":
+								computestack[i].operator==E_COMPUTE_OPERATION_SUB?"-":
+								computestack[i].operator==E_COMPUTE_OPERATION_BAND?"&&":
+								computestack[i].operator==E_COMPUTE_OPERATION_BOR?"||":
+								computestack[i].operator==E_COMPUTE_OPERATION_SHL?"<<":
+								computestack[i].operator==E_COMPUTE_OPERATION_SHR?">>":
+								computestack[i].operator==E_COMPUTE_OPERATION_LOWER?"<":
+								computestack[i].operator==E_COMPUTE_OPERATION_GREATER?">":
+								computestack[i].operator==E_COMPUTE_OPERATION_EQUAL?"==":
+								computestack[i].operator==E_COMPUTE_OPERATION_INT?"INT":
+								computestack[i].operator==E_COMPUTE_OPERATION_LOWEREQ?"<=":
+								computestack[i].operator==E_COMPUTE_OPERATION_GREATEREQ?">=":
+								computestack[i].operator==E_COMPUTE_OPERATION_OPEN?"(":
+								computestack[i].operator==E_COMPUTE_OPERATION_CLOSE?")":
+								"<autre>",computestack[i].priority);
+			}
+#endif
+			switch (computestack[i].operator) {
+				case E_COMPUTE_OPERATION_PUSH_DATASTC:
+					if (ae->maccu<=paccu) {
+						ae->maccu=16+paccu;
+						accu=ae->accu=MemRealloc(accu,sizeof(double)*ae->maccu);
+					}
+					accu[paccu]=computestack[i].value;paccu++;
+					break;
+				case E_COMPUTE_OPERATION_OPEN:
+				case E_COMPUTE_OPERATION_CLOSE: /* cannot happend */ break;
+				case E_COMPUTE_OPERATION_ADD:if (paccu>1) accu[paccu-2]+=accu[paccu-1];paccu--;break;
+				case E_COMPUTE_OPERATION_SUB:if (paccu>1) accu[paccu-2]-=accu[paccu-1];paccu--;break;
+				case E_COMPUTE_OPERATION_MUL:if (paccu>1) accu[paccu-2]*=accu[paccu-1];paccu--;break;
+				case E_COMPUTE_OPERATION_DIV:if (paccu>1) accu[paccu-2]/=accu[paccu-1];paccu--;break;
+				case E_COMPUTE_OPERATION_AND:if (paccu>1) accu[paccu-2]=((int)floor(accu[paccu-2]+0.5))&((int)floor(accu[paccu-1]+0.5));paccu--;break;
+				case E_COMPUTE_OPERATION_OR:if (paccu>1) accu[paccu-2]=((int)floor(accu[paccu-2]+0.5))|((int)floor(accu[paccu-1]+0.5));paccu--;break;
+				case E_COMPUTE_OPERATION_XOR:if (paccu>1) accu[paccu-2]=((int)floor(accu[paccu-2]+0.5))^((int)floor(accu[paccu-1]+0.5));paccu--;break;
+				case E_COMPUTE_OPERATION_NOT:/* half operator, half function */ if (paccu>0) accu[paccu-1]=!((int)floor(accu[paccu-1]+0.5));break;
+				case E_COMPUTE_OPERATION_MOD:if (paccu>1) accu[paccu-2]=((int)floor(accu[paccu-2]+0.5))%((int)floor(accu[paccu-1]+0.5));paccu--;break;
+				case E_COMPUTE_OPERATION_SHL:if (paccu>1) accu[paccu-2]=((int)floor(accu[paccu-2]+0.5))<<((int)floor(accu[paccu-1]+0.5));paccu--;break;
+				case E_COMPUTE_OPERATION_SHR:if (paccu>1) accu[paccu-2]=((int)floor(accu[paccu-2]+0.5))>>((int)floor(accu[paccu-1]+0.5));paccu--;break;				
+				case E_COMPUTE_OPERATION_BAND:if (paccu>1) accu[paccu-2]=((int)floor(accu[paccu-2]+0.5))&&((int)floor(accu[paccu-1]+0.5));paccu--;break;
+				case E_COMPUTE_OPERATION_BOR:if (paccu>1) accu[paccu-2]=((int)floor(accu[paccu-2]+0.5))||((int)floor(accu[paccu-1]+0.5));paccu--;break;
+				/* comparison */
+				case E_COMPUTE_OPERATION_LOWER:if (paccu>1) accu[paccu-2]=accu[paccu-2]<accu[paccu-1];paccu--;break;
+				case E_COMPUTE_OPERATION_LOWEREQ:if (paccu>1) accu[paccu-2]=accu[paccu-2]<=accu[paccu-1];paccu--;break;
+				case E_COMPUTE_OPERATION_EQUAL:if (paccu>1) accu[paccu-2]=fabs(accu[paccu-2]-accu[paccu-1])<0.000001;paccu--;break;
+				case E_COMPUTE_OPERATION_NOTEQUAL:if (paccu>1) accu[paccu-2]=accu[paccu-2]!=accu[paccu-1];paccu--;break;
+				case E_COMPUTE_OPERATION_GREATER:if (paccu>1) accu[paccu-2]=accu[paccu-2]>accu[paccu-1];paccu--;break;
+				case E_COMPUTE_OPERATION_GREATEREQ:if (paccu>1) accu[paccu-2]=accu[paccu-2]>=accu[paccu-1];paccu--;break;
+				/* functions */
+				case E_COMPUTE_OPERATION_SIN:if (paccu>0) accu[paccu-1]=sin(accu[paccu-1]*3.1415926545/180.0);break;
+				case E_COMPUTE_OPERATION_COS:if (paccu>0) accu[paccu-1]=cos(accu[paccu-1]*3.1415926545/180.0);break;
+				case E_COMPUTE_OPERATION_ASIN:if (paccu>0) accu[paccu-1]=asin(accu[paccu-1])*180.0/3.1415926545;break;
+				case E_COMPUTE_OPERATION_ACOS:if (paccu>0) accu[paccu-1]=acos(accu[paccu-1])*180.0/3.1415926545;break;
+				case E_COMPUTE_OPERATION_ATAN:if (paccu>0) accu[paccu-1]=atan(accu[paccu-1])*180.0/3.1415926545;break;
+				case E_COMPUTE_OPERATION_INT:if (paccu>0) accu[paccu-1]=floor(accu[paccu-1]+0.5);break;
+				case E_COMPUTE_OPERATION_FLOOR:if (paccu>0) accu[paccu-1]=floor(accu[paccu-1]);break;
+				case E_COMPUTE_OPERATION_ABS:if (paccu>0) accu[paccu-1]=fabs(accu[paccu-1]);break;
+				case E_COMPUTE_OPERATION_EXP:if (paccu>0) accu[paccu-1]=exp(accu[paccu-1]);break;
+				case E_COMPUTE_OPERATION_LN:if (paccu>0) accu[paccu-1]=log(accu[paccu-1]);break;
+				case E_COMPUTE_OPERATION_LOG10:if (paccu>0) accu[paccu-1]=log10(accu[paccu-1]);break;
+				case E_COMPUTE_OPERATION_SQRT:if (paccu>0) accu[paccu-1]=sqrt(accu[paccu-1]);break;
+				case E_COMPUTE_OPERATION_LOW:if (paccu>0) accu[paccu-1]=((int)floor(accu[paccu-1]+0.5))&0xFF;break;
+				case E_COMPUTE_OPERATION_HIGH:if (paccu>0) accu[paccu-1]=(((int)floor(accu[paccu-1]+0.5))&0xFF00)>>8;break;
+				case E_COMPUTE_OPERATION_PSG:if (paccu>0) accu[paccu-1]=ae->psgfine[((int)floor(accu[paccu-1]+0.5))&0xFF];break;
+				case E_COMPUTE_OPERATION_RND:if (paccu>0) accu[paccu-1]=rand()%((int)accu[paccu-1]);break;
+				case E_COMPUTE_OPERATION_FRAC:if (paccu>0) accu[paccu-1]=modf(accu[paccu-1],&dummint);break;
+				case E_COMPUTE_OPERATION_CEIL:if (paccu>0) accu[paccu-1]=ceil(accu[paccu-1]);break;
+				case E_COMPUTE_OPERATION_GET_R:if (paccu>0) accu[paccu-1]=((((int)accu[paccu-1])&0xF0)>>4);break;
+				case E_COMPUTE_OPERATION_GET_V:if (paccu>0) accu[paccu-1]=((((int)accu[paccu-1])&0xF00)>>8);break;
+				case E_COMPUTE_OPERATION_GET_B:if (paccu>0) accu[paccu-1]=(((int)accu[paccu-1])&0xF);break;
+				case E_COMPUTE_OPERATION_SET_R:if (paccu>0) accu[paccu-1]=MinMaxInt(accu[paccu-1],0,15)<<4;break;
+				case E_COMPUTE_OPERATION_SET_V:if (paccu>0) accu[paccu-1]=MinMaxInt(accu[paccu-1],0,15)<<8;break;
+				case E_COMPUTE_OPERATION_SET_B:if (paccu>0) accu[paccu-1]=MinMaxInt(accu[paccu-1],0,15);break;
+				default:MakeError(ae,GetCurrentFile(ae),ae->wl[ae->idx].l,"invalid computing state! (%d)\n",GetExpFile(ae,didx),GetExpLine(ae,didx),computestack[i].operator);paccu=0;
+			}
+			if (!paccu) {
+				if (zeexpression[0]=='&') {
+					MakeError(ae,GetExpFile(ae,didx),GetExpLine(ae,didx),"Missing operand for calculation [%s] Did you use & for an hexadecimal value?\n",TradExpression(ae,zeexpression));
+				} else {
+					MakeError(ae,GetExpFile(ae,didx),GetExpLine(ae,didx),"Missing operand for calculation [%s]\n",TradExpression(ae,zeexpression));
+				}
+				accu_err=1;
+				break;
+			}
+		}
+	}
+	if (paccu==1) {
+		return accu[0];
+	} else if (!accu_err) {
+		if (paccu) {
+			MakeError(ae,GetExpFile(ae,didx),GetExpLine(ae,didx),"Missing operator\n");
+		} else {
+			MakeError(ae,GetExpFile(ae,didx),GetExpLine(ae,didx),"Missing operand for calculation\n");
+		}
+		return 0;
+	} else {
+		return 0;
+	}
+}
+
+/*
+	compiled expressions are cached by their text, symbols are looked up again at each
+	evaluation so the values are always up to date
+*/
+struct s_compiled_expression *SearchCompiledExpression(struct s_assenv *ae,char *zeexpression)
+{
+	#undef FUNC
+	#define FUNC "SearchCompiledExpression"
+
+	struct s_symbol_slot *slot;
+
+	slot=SymbolTableSearch(&ae->compiledtable,zeexpression,SymbolHash(zeexpression));
+	if (!slot) return NULL;
+	return (struct s_compiled_expression *)slot->data;
+}
+
+void CompileExpression(struct s_assenv *ae,char *zeexpression,struct s_compute_element *computestack,int nbcomputestack,int nbsymbol)
+{
+	#undef FUNC
+	#define FUNC "CompileExpression"
+
+	struct s_compiled_expression *compiled;
+	int i;
+
+	compiled=ArenaAlloc(&ae->arena,sizeof(struct s_compiled_expression));
+	compiled->nbprogram=nbcomputestack;
+	compiled->program=ArenaAlloc(&ae->arena,sizeof(struct s_compute_element)*nbcomputestack);
+	memcpy(compiled->program,computestack,sizeof(struct s_compute_element)*nbcomputestack);
+	compiled->nbsymbol=nbsymbol;
+	if (nbsymbol) {
+		compiled->symbol=ArenaAlloc(&ae->arena,sizeof(struct s_compute_symbol)*nbsymbol);
+		for (i=0;i<nbsymbol;i++) {
+			compiled->symbol[i]=ae->computectx->symbol[i];
+			compiled->symbol[i].name=ArenaStrDup(&ae->arena,ae->computectx->symbolname+ae->computectx->symbol[i].iname);
+			compiled->symbol[i].hash=SymbolHash(compiled->symbol[i].name);
+		}
+		/* link each symbol to its push in the program */
+		for (i=0;i<nbcomputestack;i++) {
+			if (computestack[i].operator==E_COMPUTE_OPERATION_PUSH_DATASTC && computestack[i].symbol) {
+				compiled->symbol[computestack[i].symbol-1].iprogram=i;
+			}
+		}
+	} else {
+		compiled->symbol=NULL;
+	}
+	SymbolTableInsert(&ae->arena,&ae->compiledtable,zeexpression,SymbolHash(zeexpression),compiled);
+}
+
+/* return 0 when a symbol cannot be resolved without the full evaluator */
+int ResolveCompiledExpression(struct s_assenv *ae,struct s_compiled_expression *compiled,int ptr)
+{
+	#undef FUNC
+	#define FUNC "ResolveCompiledExpression"
+
+	struct s_compute_symbol *cursym;
+	struct s_symbol_slot *slot;
+	struct s_expr_dico *curdic;
+	struct s_label *curlabel;
+	double curval;
+	int i;
+
+	for (i=0;i<compiled->nbsymbol;i++) {
+		cursym=&compiled->symbol[i];
+		if (cursym->name[0]=='$' && !cursym->name[1]) {
+			curval=ptr;
+		} else if ((slot=SymbolTableSearch(&ae->dicotable,cursym->name,cursym->hash))!=NULL) {
+			curdic=(struct s_expr_dico *)slot->data;
+			curdic->used=1;
+			curval=curdic->v;
+		} else if ((slot=SymbolTableSearch(&ae->labeltable,cursym->name,cursym->hash))!=NULL) {
+			curlabel=(struct s_label *)slot->data;
+			curlabel->used=1;
+			/* labels inside crunched blocks depend on the expression location */
+			if (ae->stage<2 && curlabel->lz!=-1) return 0;
+			curval=curlabel->ptr;
+		} else {
+			return 0;
+		}
+		if (cursym->minus) curval=-curval;
+		compiled->program[cursym->iprogram].value=curval;
+	}
+	return 1;
+}
+
+void FreeCompiledExpression(struct s_assenv *ae)
+{
+	#undef FUNC
+	#define FUNC "FreeCompiledExpression"
+
+	/* programs and symbols are in the arena */
+	FreeSymbolTable(&ae->compiledtable);
+}
+
+int PushComputeSymbol(struct s_assenv *ae,int *nbsymbol,int *isymbolname,char *name,int crc,int minus)
+{
+	#undef FUNC
+	#define FUNC "PushComputeSymbol"
+
+	struct s_compute_symbol cursym;
+	int lenname;
+
+	lenname=strlen(name)+1;
+	if (*isymbolname+lenname>ae->computectx->maxsymbolname) {
+		ae->computectx->maxsymbolname=(*isymbolname+lenname)*2;
+		ae->computectx->symbolname=MemRealloc(ae->computectx->symbolname,ae->computectx->maxsymbolname);
+	}
+	memcpy(ae->computectx->symbolname+*isymbolname,name,lenname);
+	cursym.name=NULL;
+	cursym.iname=*isymbolname;
+	cursym.crc=crc;
+	cursym.minus=minus;
+	cursym.iprogram=0;
+	*isymbolname+=lenname;
+	ObjectArrayAddDynamicValueConcat((void **)&ae->computectx->symbol,nbsymbol,&ae->computectx->maxsymbol,&cursym,sizeof(cursym));
+	return *nbsymbol;
 }
 
 double ComputeExpressionCore(struct s_assenv *ae,char *original_zeexpression,int ptr, int didx)
@@ -3392,12 +4319,7 @@ double ComputeExpressionCore(struct s_assenv *ae,char *original_zeexpression,int
 	#undef FUNC
 	#define FUNC "ComputeExpressionCore"
 
-	/* static execution buffers */
-	static double *accu=NULL;
-	static int maccu=0;
-	static struct s_compute_element *computestack=NULL;
-	static int maxcomputestack=0;
-	int i,j,paccu=0;
+	int i,j;
 	int nbtokenstack=0;
 	int nbcomputestack=0;
 	int nboperatorstack=0;
@@ -3408,7 +4330,6 @@ double ComputeExpressionCore(struct s_assenv *ae,char *original_zeexpression,int
 	int idx=0,crc,icheck,is_binary,ivar=0;
 	char asciivalue[11];
 	unsigned char c;
-	int accu_err=0;
 	/* backup alias replace */
 	char *zeexpression,*expr;
 	int original=1;
@@ -3425,14 +4346,16 @@ double ComputeExpressionCore(struct s_assenv *ae,char *original_zeexpression,int
 	/* extended replace in labels */
 	int curly=0,curlyflag=0;
 	char *Automate;
-	double dummint;
+	/* compiled expression cache */
+	struct s_compiled_expression *compiled;
+	int cacheable=1,cursymbol,nbsymbol=0,isymbolname=0,nberr;
 
 	/* memory cleanup */
-	if (!ae) {
-		if (maccu) MemFree(accu);
-		accu=NULL;maccu=0;
-		if (maxcomputestack) MemFree(computestack);
-		computestack=NULL;maxcomputestack=0;
+	if (!original_zeexpression) {
+		if (ae->maccu) MemFree(ae->accu);
+		ae->accu=NULL;ae->maccu=0;
+		if (ae->maxcomputestack) MemFree(ae->computestack);
+		ae->computestack=NULL;ae->maxcomputestack=0;
 #if 0	
 		if (maxivar) MemFree(varbuffer);
 		if (maxtokenstack) MemFree(tokenstack);
@@ -3457,6 +4380,12 @@ double ComputeExpressionCore(struct s_assenv *ae,char *original_zeexpression,int
 	if (!zeexpression[0]) {
 		return 0;
 	}
+	/* already compiled? */
+	compiled=SearchCompiledExpression(ae,zeexpression);
+	if (compiled && ResolveCompiledExpression(ae,compiled,ptr)) {
+		return ComputeExpressionExecute(ae,compiled->program,compiled->nbprogram,zeexpression,didx);
+	}
+	nberr=ae->nberr;
 	/* double hack if the first value is negative */
 	if (zeexpression[0]=='-') {
 		if (ae->AutomateExpressionValidCharFirst[(int)zeexpression[1]&0xFF]) {
@@ -3476,8 +4405,9 @@ double ComputeExpressionCore(struct s_assenv *ae,char *original_zeexpression,int
 					sprintf(asciivalue,"#%03X",zeexpression[idx+2]);
 					memcpy(zeexpression+idx,asciivalue,4);
 					idx+=3;
+					cacheable=0;
 				} else {
-					MakeError(ae,GetExpFile(ae,didx),GetExpLine(ae,didx),"Only single escaped char may be quoted [%s]\n",TradExpression(zeexpression));
+					MakeError(ae,GetExpFile(ae,didx),GetExpLine(ae,didx),"Only single escaped char may be quoted [%s]\n",TradExpression(ae,zeexpression));
 					zeexpression[0]=0;
 					return 0;
 				}
@@ -3485,8 +4415,9 @@ double ComputeExpressionCore(struct s_assenv *ae,char *original_zeexpression,int
 					sprintf(asciivalue,"#%02X",zeexpression[idx+1]);
 					memcpy(zeexpression+idx,asciivalue,3);
 					idx+=2;
+					cacheable=0;
 			} else {
-				MakeError(ae,GetExpFile(ae,didx),GetExpLine(ae,didx),"Only single char may be quoted [%s]\n",TradExpression(zeexpression));
+				MakeError(ae,GetExpFile(ae,didx),GetExpLine(ae,didx),"Only single char may be quoted [%s]\n",TradExpression(ae,zeexpression));
 				zeexpression[0]=0;
 				return 0;
 			}
@@ -3578,7 +4509,7 @@ double ComputeExpressionCore(struct s_assenv *ae,char *original_zeexpression,int
 					c='e'; // boolean EQUAL
 				/* cannot affect data inside an expression */
 				} else {
-					MakeError(ae,GetExpFile(ae,didx),GetExpLine(ae,didx),"expression [%s] cannot set variable inside an expression\n",TradExpression(zeexpression));
+					MakeError(ae,GetExpFile(ae,didx),GetExpLine(ae,didx),"expression [%s] cannot set variable inside an expression\n",TradExpression(ae,zeexpression));
 					return 0;
 				}
 				break;
@@ -3601,7 +4532,7 @@ double ComputeExpressionCore(struct s_assenv *ae,char *original_zeexpression,int
 					}
 					ae->computectx->varbuffer[ivar]=0;
 					if (ivar<2) {
-						MakeError(ae,GetExpFile(ae,didx),GetExpLine(ae,didx),"expression [%s] invalid minus sign\n",TradExpression(zeexpression));
+						MakeError(ae,GetExpFile(ae,didx),GetExpLine(ae,didx),"expression [%s] invalid minus sign\n",TradExpression(ae,zeexpression));
 						if (!original) {
 							MemFree(zeexpression);
 						}
@@ -3692,13 +4623,13 @@ double ComputeExpressionCore(struct s_assenv *ae,char *original_zeexpression,int
 				}
 				ae->computectx->varbuffer[ivar]=0;
 				if (!ivar) {
-					MakeError(ae,GetExpFile(ae,didx),GetExpLine(ae,didx),"invalid char (%d=%c) expression [%s]\n",c,c>31?c:' ',TradExpression(zeexpression));
+					MakeError(ae,GetExpFile(ae,didx),GetExpLine(ae,didx),"invalid char (%d=%c) expression [%s]\n",c,c>31?c:' ',TradExpression(ae,zeexpression));
 					if (!original) {
 						MemFree(zeexpression);
 					}
 					return 0;
 				} else if (curly) {
-					MakeError(ae,GetExpFile(ae,didx),GetExpLine(ae,didx),"wrong curly brackets in expression [%s]\n",TradExpression(zeexpression));
+					MakeError(ae,GetExpFile(ae,didx),GetExpLine(ae,didx),"wrong curly brackets in expression [%s]\n",TradExpression(ae,zeexpression));
 					if (!original) {
 						MemFree(zeexpression);
 					}
@@ -3717,7 +4648,7 @@ double ComputeExpressionCore(struct s_assenv *ae,char *original_zeexpression,int
 			************************************/
 			stackelement=ae->AutomateElement[c];
 			if (stackelement.operator>E_COMPUTE_OPERATION_GREATEREQ) {
-				MakeError(ae,GetExpFile(ae,didx),GetExpLine(ae,didx),"expression [%s] has unknown operator %c (%d)\n",TradExpression(zeexpression),c>31?c:'.',c);
+				MakeError(ae,GetExpFile(ae,didx),GetExpLine(ae,didx),"expression [%s] has unknown operator %c (%d)\n",TradExpression(ae,zeexpression),c>31?c:'.',c);
 			}
 			/* stackelement.value isn't used */
 		} else {
@@ -3728,6 +4659,7 @@ double ComputeExpressionCore(struct s_assenv *ae,char *original_zeexpression,int
 	printf("value [%s]\n",ae->computectx->varbuffer);
 #endif
 			if (ae->computectx->varbuffer[0]=='-') minusptr=1; else minusptr=0;
+			cursymbol=0;
 			/* constantes ou variables/labels */
 			switch (ae->computectx->varbuffer[minusptr]) {
 				case '0':
@@ -3735,7 +4667,7 @@ double ComputeExpressionCore(struct s_assenv *ae,char *original_zeexpression,int
 					if (ae->computectx->varbuffer[minusptr+1]=='X' && ae->AutomateHexa[ae->computectx->varbuffer[minusptr+2]]) {
 						for (icheck=minusptr+3;ae->computectx->varbuffer[icheck];icheck++) {
 							if (ae->AutomateHexa[ae->computectx->varbuffer[icheck]]) continue;
-							MakeError(ae,GetExpFile(ae,didx),GetExpLine(ae,didx),"expression [%s] - %s is not a valid hex number\n",TradExpression(zeexpression),ae->computectx->varbuffer);
+							MakeError(ae,GetExpFile(ae,didx),GetExpLine(ae,didx),"expression [%s] - %s is not a valid hex number\n",TradExpression(ae,zeexpression),ae->computectx->varbuffer);
 							break;
 						}
 						curval=strtol(ae->computectx->varbuffer+minusptr+2,NULL,16);
@@ -3745,7 +4677,7 @@ double ComputeExpressionCore(struct s_assenv *ae,char *original_zeexpression,int
 					if (ae->computectx->varbuffer[minusptr+1]=='B' && (ae->computectx->varbuffer[minusptr+2]>='0' && ae->computectx->varbuffer[minusptr+2]<='1')) {
 						for (icheck=minusptr+3;ae->computectx->varbuffer[icheck];icheck++) {
 							if (ae->computectx->varbuffer[icheck]>='0' && ae->computectx->varbuffer[icheck]<='1') continue;
-							MakeError(ae,GetExpFile(ae,didx),GetExpLine(ae,didx),"expression [%s] - %s is not a valid binary number\n",TradExpression(zeexpression),ae->computectx->varbuffer);
+							MakeError(ae,GetExpFile(ae,didx),GetExpLine(ae,didx),"expression [%s] - %s is not a valid binary number\n",TradExpression(ae,zeexpression),ae->computectx->varbuffer);
 							break;
 						}
 						curval=strtol(ae->computectx->varbuffer+minusptr+2,NULL,2);
@@ -3755,7 +4687,7 @@ double ComputeExpressionCore(struct s_assenv *ae,char *original_zeexpression,int
 					if (ae->computectx->varbuffer[minusptr+1]=='O' && (ae->computectx->varbuffer[minusptr+2]>='0' && ae->computectx->varbuffer[minusptr+2]<='5')) {
 						for (icheck=minusptr+3;ae->computectx->varbuffer[icheck];icheck++) {
 							if (ae->computectx->varbuffer[icheck]>='0' && ae->computectx->varbuffer[icheck]<='5') continue;
-							MakeError(ae,GetExpFile(ae,didx),GetExpLine(ae,didx),"expression [%s] - %s is not a valid octal number\n",TradExpression(zeexpression),ae->computectx->varbuffer);
+							MakeError(ae,GetExpFile(ae,didx),GetExpLine(ae,didx),"expression [%s] - %s is not a valid octal number\n",TradExpression(ae,zeexpression),ae->computectx->varbuffer);
 							break;
 						}
 						curval=strtol(ae->computectx->varbuffer+minusptr+2,NULL,2);
@@ -3778,19 +4710,19 @@ double ComputeExpressionCore(struct s_assenv *ae,char *original_zeexpression,int
 							case 'H':
 								for (icheck=minusptr;ae->computectx->varbuffer[icheck+1];icheck++) {
 									if (ae->AutomateHexa[ae->computectx->varbuffer[icheck]]) continue;
-									MakeError(ae,GetExpFile(ae,didx),GetExpLine(ae,didx),"expression [%s] - %s is not a valid hex number\n",TradExpression(zeexpression),ae->computectx->varbuffer);
+									MakeError(ae,GetExpFile(ae,didx),GetExpLine(ae,didx),"expression [%s] - %s is not a valid hex number\n",TradExpression(ae,zeexpression),ae->computectx->varbuffer);
 								}
 								curval=strtol(ae->computectx->varbuffer+minusptr,NULL,16);
 								break;
 							case 'B':
 								for (icheck=minusptr;ae->computectx->varbuffer[icheck+1];icheck++) {
 									if (ae->computectx->varbuffer[icheck]=='0' || ae->computectx->varbuffer[icheck]=='1') continue;
-									MakeError(ae,GetExpFile(ae,didx),GetExpLine(ae,didx),"expression [%s] - %s is not a valid binary number\n",TradExpression(zeexpression),ae->computectx->varbuffer);
+									MakeError(ae,GetExpFile(ae,didx),GetExpLine(ae,didx),"expression [%s] - %s is not a valid binary number\n",TradExpression(ae,zeexpression),ae->computectx->varbuffer);
 								}
 								curval=strtol(ae->computectx->varbuffer+minusptr,NULL,2);
 								break;
 							default:
-								MakeError(ae,GetExpFile(ae,didx),GetExpLine(ae,didx),"expression [%s] - %s is not a valid number\n",TradExpression(zeexpression),ae->computectx->varbuffer);
+								MakeError(ae,GetExpFile(ae,didx),GetExpLine(ae,didx),"expression [%s] - %s is not a valid number\n",TradExpression(ae,zeexpression),ae->computectx->varbuffer);
 						}
 						icheck=0;
 						break;
@@ -3800,11 +4732,11 @@ double ComputeExpressionCore(struct s_assenv *ae,char *original_zeexpression,int
 				case '%':
 					/* check number */
 					if (!ae->computectx->varbuffer[minusptr+1]) {
-						MakeError(ae,GetExpFile(ae,didx),GetExpLine(ae,didx),"expression [%s] - %s is an empty binary number\n",TradExpression(zeexpression),ae->computectx->varbuffer);
+						MakeError(ae,GetExpFile(ae,didx),GetExpLine(ae,didx),"expression [%s] - %s is an empty binary number\n",TradExpression(ae,zeexpression),ae->computectx->varbuffer);
 					}
 					for (icheck=minusptr+1;ae->computectx->varbuffer[icheck];icheck++) {
 						if (ae->computectx->varbuffer[icheck]=='0' || ae->computectx->varbuffer[icheck]=='1') continue;
-						MakeError(ae,GetExpFile(ae,didx),GetExpLine(ae,didx),"expression [%s] - %s is not a valid binary number\n",TradExpression(zeexpression),ae->computectx->varbuffer);
+						MakeError(ae,GetExpFile(ae,didx),GetExpLine(ae,didx),"expression [%s] - %s is not a valid binary number\n",TradExpression(ae,zeexpression),ae->computectx->varbuffer);
 						break;
 					}
 					curval=strtol(ae->computectx->varbuffer+minusptr+1,NULL,2);
@@ -3812,11 +4744,11 @@ double ComputeExpressionCore(struct s_assenv *ae,char *original_zeexpression,int
 				case '#':
 					/* check number */
 					if (!ae->computectx->varbuffer[minusptr+1]) {
-						MakeError(ae,GetExpFile(ae,didx),GetExpLine(ae,didx),"expression [%s] - %s is an empty hex number\n",TradExpression(zeexpression),ae->computectx->varbuffer);
+						MakeError(ae,GetExpFile(ae,didx),GetExpLine(ae,didx),"expression [%s] - %s is an empty hex number\n",TradExpression(ae,zeexpression),ae->computectx->varbuffer);
 					}
 					for (icheck=minusptr+1;ae->computectx->varbuffer[icheck];icheck++) {
 						if (ae->AutomateHexa[ae->computectx->varbuffer[icheck]]) continue;
-						MakeError(ae,GetExpFile(ae,didx),GetExpLine(ae,didx),"expression [%s] - %s is not a valid hex number\n",TradExpression(zeexpression),ae->computectx->varbuffer);
+						MakeError(ae,GetExpFile(ae,didx),GetExpLine(ae,didx),"expression [%s] - %s is not a valid hex number\n",TradExpression(ae,zeexpression),ae->computectx->varbuffer);
 						break;
 					}
 					curval=strtol(ae->computectx->varbuffer+minusptr+1,NULL,16);
@@ -3827,7 +4759,7 @@ double ComputeExpressionCore(struct s_assenv *ae,char *original_zeexpression,int
 						if (ae->computectx->varbuffer[minusptr+0]=='$' && ae->AutomateHexa[ae->computectx->varbuffer[minusptr+1]]) {
 							for (icheck=minusptr+2;ae->computectx->varbuffer[icheck];icheck++) {
 								if (ae->AutomateHexa[ae->computectx->varbuffer[icheck]]) continue;
-								MakeError(ae,GetExpFile(ae,didx),GetExpLine(ae,didx),"expression [%s] - %s is not a valid hex number\n",TradExpression(zeexpression),ae->computectx->varbuffer);
+								MakeError(ae,GetExpFile(ae,didx),GetExpLine(ae,didx),"expression [%s] - %s is not a valid hex number\n",TradExpression(ae,zeexpression),ae->computectx->varbuffer);
 								break;
 							}
 							curval=strtol(ae->computectx->varbuffer+minusptr+1,NULL,16);
@@ -3837,7 +4769,7 @@ double ComputeExpressionCore(struct s_assenv *ae,char *original_zeexpression,int
 						if (ae->computectx->varbuffer[minusptr+0]=='@' &&  ((ae->computectx->varbuffer[minusptr+1]>='0' && ae->computectx->varbuffer[minusptr+1]<='7'))) {
 							for (icheck=minusptr+2;ae->computectx->varbuffer[icheck];icheck++) {
 								if (ae->computectx->varbuffer[icheck]>='0' && ae->computectx->varbuffer[icheck]<='7') continue;
-								MakeError(ae,GetExpFile(ae,didx),GetExpLine(ae,didx),"expression [%s] - %s is not a valid octal number\n",TradExpression(zeexpression),ae->computectx->varbuffer);
+								MakeError(ae,GetExpFile(ae,didx),GetExpLine(ae,didx),"expression [%s] - %s is not a valid octal number\n",TradExpression(ae,zeexpression),ae->computectx->varbuffer);
 								break;
 							}
 							curval=strtol(ae->computectx->varbuffer+minusptr+1,NULL,8);
@@ -3862,6 +4794,7 @@ double ComputeExpressionCore(struct s_assenv *ae,char *original_zeexpression,int
 						char *minivarbuffer;
 						int touched;
 
+						cacheable=0;
 						/* besoin d'un sous-contexte */
 						minivarbuffer=TxtStrDup(ae->computectx->varbuffer+minusptr);
 						ae->computectx=&ae->ctx2;
@@ -3902,7 +4835,7 @@ double ComputeExpressionCore(struct s_assenv *ae,char *original_zeexpression,int
 								allow_minus_as_sign=1;
 								idx++;
 							} else {
-								MakeError(ae,GetExpFile(ae,didx),GetExpLine(ae,didx),"expression [%s] - %s is a reserved keyword!\n",TradExpression(zeexpression),math_keyword[imkey].mnemo);
+								MakeError(ae,GetExpFile(ae,didx),GetExpLine(ae,didx),"expression [%s] - %s is a reserved keyword!\n",TradExpression(ae,zeexpression),math_keyword[imkey].mnemo);
 								curval=0;
 								idx++;
 							}
@@ -3914,6 +4847,7 @@ double ComputeExpressionCore(struct s_assenv *ae,char *original_zeexpression,int
 					
 					if (ae->computectx->varbuffer[minusptr+0]=='$' && ae->computectx->varbuffer[minusptr+1]==0) {
 						curval=ptr;
+						if (cacheable) cursymbol=PushComputeSymbol(ae,&nbsymbol,&isymbolname,ae->computectx->varbuffer+minusptr,crc,minusptr);
 					} else {
 #if TRACE_COMPUTE_EXPRESSION
 	printf("search dico [%s]\n",ae->computectx->varbuffer+minusptr);
@@ -3924,6 +4858,7 @@ double ComputeExpressionCore(struct s_assenv *ae,char *original_zeexpression,int
 	printf("trouv valeur=%.2lf\n",curdic->v);
 #endif
 							curval=curdic->v;
+							if (cacheable) cursymbol=PushComputeSymbol(ae,&nbsymbol,&isymbolname,ae->computectx->varbuffer+minusptr,crc,minusptr);
 							break;
 						} else {
 							/* getbank hack */
@@ -3980,8 +4915,9 @@ double ComputeExpressionCore(struct s_assenv *ae,char *original_zeexpression,int
 									}
 								}
 							} else {
-								MakeError(ae,GetExpFile(ae,didx),GetExpLine(ae,didx),"expression [%s] - %s is an unknown prefix!\n",TradExpression(zeexpression),ae->computectx->varbuffer);
+								MakeError(ae,GetExpFile(ae,didx),GetExpLine(ae,didx),"expression [%s] - %s is an unknown prefix!\n",TradExpression(ae,zeexpression),ae->computectx->varbuffer);
 							}
+							if (bank) cacheable=0;
 							/* limited label translation while processing crunched blocks
 							   ae->curlz == current crunched block processed
 							   expression->crunch_block=0 -> oui
@@ -3995,6 +4931,11 @@ printf("search label [%s]\n",ae->computectx->varbuffer+minusptr+bank);
 #endif
 								curlabel=SearchLabel(ae,ae->computectx->varbuffer+minusptr+bank,crc);
 								if (curlabel) {
+									if (!bank && (ae->stage>=2 || curlabel->lz==-1)) {
+										if (cacheable) cursymbol=PushComputeSymbol(ae,&nbsymbol,&isymbolname,ae->computectx->varbuffer+minusptr,crc,minusptr);
+									} else {
+										cacheable=0;
+									}
 									if (ae->stage<2) {
 										if (curlabel->lz==-1) {
 											if (!bank) {
@@ -4008,7 +4949,7 @@ printf("page=%d | ptr=%X ibank=%d\n",page,curlabel->ptr,curlabel->ibank);
 														if (curlabel->ibank<BANK_MAX_NUMBER) {
 															curval=ae->setgate[curlabel->ibank];
 														} else {
-															MakeError(ae,GetExpFile(ae,didx),GetExpLine(ae,didx),"expression [%s] cannot use PAGESET - label [%s] is in a temporary space!\n",TradExpression(zeexpression),ae->computectx->varbuffer);
+															MakeError(ae,GetExpFile(ae,didx),GetExpLine(ae,didx),"expression [%s] cannot use PAGESET - label [%s] is in a temporary space!\n",TradExpression(ae,zeexpression),ae->computectx->varbuffer);
 															curval=curlabel->ibank;
 														}
 														break;
@@ -4021,7 +4962,7 @@ printf("page=%d | ptr=%X ibank=%d\n",page,curlabel->ptr,curlabel->ibank);
 																curval=ae->bankgate[curlabel->ibank];
 															}
 														} else {
-															MakeError(ae,GetExpFile(ae,didx),GetExpLine(ae,didx),"expression [%s] cannot use PAGE - label [%s] is in a temporary space!\n",TradExpression(zeexpression),ae->computectx->varbuffer);
+															MakeError(ae,GetExpFile(ae,didx),GetExpLine(ae,didx),"expression [%s] cannot use PAGE - label [%s] is in a temporary space!\n",TradExpression(ae,zeexpression),ae->computectx->varbuffer);
 															curval=curlabel->ibank;
 														}
 														break;
@@ -4044,7 +4985,7 @@ printf("page=%d | ptr=%X ibank=%d\n",page,curlabel->ptr,curlabel->ibank);
 																	/* 4M expansion compliant */
 																	curval=ae->setgate[curlabel->ibank];
 																} else {
-																	MakeError(ae,GetExpFile(ae,didx),GetExpLine(ae,didx),"expression [%s] cannot use PAGESET - label [%s] is in a temporary space!\n",TradExpression(zeexpression),ae->computectx->varbuffer);
+																	MakeError(ae,GetExpFile(ae,didx),GetExpLine(ae,didx),"expression [%s] cannot use PAGESET - label [%s] is in a temporary space!\n",TradExpression(ae,zeexpression),ae->computectx->varbuffer);
 																	curval=curlabel->ibank;
 																}
 																break;
@@ -4057,7 +4998,7 @@ printf("page=%d | ptr=%X ibank=%d\n",page,curlabel->ptr,curlabel->ibank);
 																		curval=ae->bankgate[curlabel->ibank];
 																	}
 																} else {
-																	MakeError(ae,GetExpFile(ae,didx),GetExpLine(ae,didx),"expression [%s] cannot use PAGE - label [%s] is in a temporary space!\n",TradExpression(zeexpression),ae->computectx->varbuffer);
+																	MakeError(ae,GetExpFile(ae,didx),GetExpLine(ae,didx),"expression [%s] cannot use PAGE - label [%s] is in a temporary space!\n",TradExpression(ae,zeexpression),ae->computectx->varbuffer);
 																	curval=curlabel->ibank;
 																}
 																break;
@@ -4082,7 +5023,7 @@ printf("stage 2 | page=%d | ptr=%X ibank=%d\n",page,curlabel->ptr,curlabel->iban
 													if (curlabel->ibank<BANK_MAX_NUMBER) {
 														curval=ae->setgate[curlabel->ibank];
 													} else {
-														MakeError(ae,GetExpFile(ae,didx),GetExpLine(ae,didx),"expression [%s] cannot use PAGESET - label [%s] is in a temporary space!\n",TradExpression(zeexpression),ae->computectx->varbuffer);
+														MakeError(ae,GetExpFile(ae,didx),GetExpLine(ae,didx),"expression [%s] cannot use PAGESET - label [%s] is in a temporary space!\n",TradExpression(ae,zeexpression),ae->computectx->varbuffer);
 														curval=curlabel->ibank;
 													}
 													break;
@@ -4095,7 +5036,7 @@ printf("stage 2 | page=%d | ptr=%X ibank=%d\n",page,curlabel->ptr,curlabel->iban
 															curval=ae->bankgate[curlabel->ibank];
 														}
 													} else {
-														MakeError(ae,GetExpFile(ae,didx),GetExpLine(ae,didx),"expression [%s] cannot use PAGE - label [%s] is in a temporary space!\n",TradExpression(zeexpression),ae->computectx->varbuffer);
+														MakeError(ae,GetExpFile(ae,didx),GetExpLine(ae,didx),"expression [%s] cannot use PAGE - label [%s] is in a temporary space!\n",TradExpression(ae,zeexpression),ae->computectx->varbuffer);
 														curval=curlabel->ibank;
 													}
 													break;
@@ -4109,6 +5050,7 @@ printf("stage 2 | page=%d | ptr=%X ibank=%d\n",page,curlabel->ptr,curlabel->iban
 										}
 									}
 								} else {
+									cacheable=0;
 									/***********
 										to allow aliases declared after use
 									***********/
@@ -4192,9 +5134,9 @@ printf("stage 2 | page=%d | ptr=%X ibank=%d\n",page,curlabel->ptr,curlabel->iban
 											} else {
 												/* in case the expression is a register */
 												if (IsRegister(ae->computectx->varbuffer+minusptr)) {
-													MakeError(ae,GetExpFile(ae,didx),GetExpLine(ae,didx),"cannot use register %s in this context\n",TradExpression(zeexpression));
+													MakeError(ae,GetExpFile(ae,didx),GetExpLine(ae,didx),"cannot use register %s in this context\n",TradExpression(ae,zeexpression));
 												} else {
-													MakeError(ae,GetExpFile(ae,didx),GetExpLine(ae,didx),"expression [%s] keyword [%s] not found in variables, labels or aliases\n",TradExpression(zeexpression),ae->computectx->varbuffer+minusptr);
+													MakeError(ae,GetExpFile(ae,didx),GetExpLine(ae,didx),"expression [%s] keyword [%s] not found in variables, labels or aliases\n",TradExpression(ae,zeexpression),ae->computectx->varbuffer+minusptr);
 													if (ae->extended_error) {
 														char *lookstr;
 														lookstr=StringLooksLike(ae,ae->computectx->varbuffer+minusptr);
@@ -4216,6 +5158,7 @@ printf("stage 2 | page=%d | ptr=%X ibank=%d\n",page,curlabel->ptr,curlabel->iban
 			if (minusptr) curval=-curval;
 			stackelement.operator=E_COMPUTE_OPERATION_PUSH_DATASTC;
 			stackelement.value=curval;
+			stackelement.symbol=cursymbol;
 			/* priority isn't used */
 			
 			allow_minus_as_sign=0;
@@ -4292,7 +5235,7 @@ printf("stage 2 | page=%d | ptr=%X ibank=%d\n",page,curlabel->ptr,curlabel->iban
 #if DEBUG_STACK
 printf("data\n");
 #endif
-				ObjectArrayAddDynamicValueConcat((void **)&computestack,&nbcomputestack,&maxcomputestack,&ae->computectx->tokenstack[itoken],sizeof(stackelement));
+				ObjectArrayAddDynamicValueConcat((void **)&ae->computestack,&nbcomputestack,&ae->maxcomputestack,&ae->computectx->tokenstack[itoken],sizeof(stackelement));
 				break;
 			case E_COMPUTE_OPERATION_OPEN:
 				ObjectArrayAddDynamicValueConcat((void **)&ae->computectx->operatorstack,&nboperatorstack,&ae->computectx->maxoperatorstack,&ae->computectx->tokenstack[itoken],sizeof(stackelement));
@@ -4309,7 +5252,7 @@ printf("close\n");
 				okclose=0;
 				while (o2>=0) {
 					if (ae->computectx->operatorstack[o2].operator!=E_COMPUTE_OPERATION_OPEN) {
-						ObjectArrayAddDynamicValueConcat((void **)&computestack,&nbcomputestack,&maxcomputestack,&ae->computectx->operatorstack[o2],sizeof(stackelement));
+						ObjectArrayAddDynamicValueConcat((void **)&ae->computestack,&nbcomputestack,&ae->maxcomputestack,&ae->computectx->operatorstack[o2],sizeof(stackelement));
 						nboperatorstack--;
 #if DEBUG_STACK
 printf("op--\n");
@@ -4327,7 +5270,7 @@ printf("discard )\n");
 					}
 				}
 				if (!okclose) {
-					MakeError(ae,GetExpFile(ae,didx),GetExpLine(ae,didx),"missing parenthesis [%s]\n",TradExpression(zeexpression));
+					MakeError(ae,GetExpFile(ae,didx),GetExpLine(ae,didx),"missing parenthesis [%s]\n",TradExpression(ae,zeexpression));
 					if (!original) {
 						MemFree(zeexpression);
 					}
@@ -4335,7 +5278,7 @@ printf("discard )\n");
 				}
 				/* if upper token is a function then pop from the stack */
 				if (o2>=0 && ae->computectx->operatorstack[o2].operator>=E_COMPUTE_OPERATION_SIN) {
-					ObjectArrayAddDynamicValueConcat((void **)&computestack,&nbcomputestack,&maxcomputestack,&ae->computectx->operatorstack[o2],sizeof(stackelement));
+					ObjectArrayAddDynamicValueConcat((void **)&ae->computestack,&nbcomputestack,&ae->maxcomputestack,&ae->computectx->operatorstack[o2],sizeof(stackelement));
 					nboperatorstack--;
 #if DEBUG_STACK
 printf("pop function\n");
@@ -4367,7 +5310,7 @@ printf("operator\n");
 				o2=nboperatorstack-1;
 				while (o2>=0 && ae->computectx->operatorstack[o2].operator!=E_COMPUTE_OPERATION_OPEN) {
 					if (ae->computectx->tokenstack[itoken].priority>=ae->computectx->operatorstack[o2].priority || ae->computectx->operatorstack[o2].operator>=E_COMPUTE_OPERATION_SIN) {
-						ObjectArrayAddDynamicValueConcat((void **)&computestack,&nbcomputestack,&maxcomputestack,&ae->computectx->operatorstack[o2],sizeof(stackelement));
+						ObjectArrayAddDynamicValueConcat((void **)&ae->computestack,&nbcomputestack,&ae->maxcomputestack,&ae->computectx->operatorstack[o2],sizeof(stackelement));
 						nboperatorstack--;
 						o2--;
 					} else {
@@ -4410,195 +5353,16 @@ printf("ajout de la fonction\n");
 	}
 	/* pop remaining operators */
 	while (nboperatorstack>0) {
-		ObjectArrayAddDynamicValueConcat((void **)&computestack,&nbcomputestack,&maxcomputestack,&ae->computectx->operatorstack[--nboperatorstack],sizeof(stackelement));
+		ObjectArrayAddDynamicValueConcat((void **)&ae->computestack,&nbcomputestack,&ae->maxcomputestack,&ae->computectx->operatorstack[--nboperatorstack],sizeof(stackelement));
 	}
 	
-	/********************************************
-	        E X E C U T E        S T A C K
-	********************************************/
-	if (ae->maxam || ae->as80) {
-		int workinterval;
-		if (ae->as80) workinterval=0xFFFFFFFF; else workinterval=0xFFFF;
-		for (i=0;i<nbcomputestack;i++) {
-			switch (computestack[i].operator) {
-				/************************************************
-				  c a s e s   s h o u l d    b e    s o r t e d
-				************************************************/
-				case E_COMPUTE_OPERATION_PUSH_DATASTC:
-					if (maccu<=paccu) {
-						maccu=16+paccu;
-						accu=MemRealloc(accu,sizeof(double)*maccu);
-					}
-					accu[paccu]=computestack[i].value;paccu++;
-					break;
-				case E_COMPUTE_OPERATION_OPEN:
-				case E_COMPUTE_OPERATION_CLOSE:/* cannot happend */ break;
-				case E_COMPUTE_OPERATION_ADD:if (paccu>1) accu[paccu-2]=((int)accu[paccu-2]+(int)accu[paccu-1])&workinterval;paccu--;break;
-				case E_COMPUTE_OPERATION_SUB:if (paccu>1) accu[paccu-2]=((int)accu[paccu-2]-(int)accu[paccu-1])&workinterval;paccu--;break;
-				case E_COMPUTE_OPERATION_MUL:if (paccu>1) accu[paccu-2]=((int)accu[paccu-2]*(int)accu[paccu-1])&workinterval;paccu--;break;
-				case E_COMPUTE_OPERATION_DIV:if (paccu>1) accu[paccu-2]=((int)accu[paccu-2]/(int)accu[paccu-1])&workinterval;paccu--;break;
-				case E_COMPUTE_OPERATION_AND:if (paccu>1) accu[paccu-2]=((int)accu[paccu-2]&(int)accu[paccu-1])&workinterval;paccu--;break;
-				case E_COMPUTE_OPERATION_OR:if (paccu>1) accu[paccu-2]=((int)accu[paccu-2]|(int)accu[paccu-1])&workinterval;paccu--;break;
-				case E_COMPUTE_OPERATION_XOR:if (paccu>1) accu[paccu-2]=((int)accu[paccu-2]^(int)accu[paccu-1])&workinterval;paccu--;break;
-				case E_COMPUTE_OPERATION_MOD:if (paccu>1) accu[paccu-2]=((int)accu[paccu-2]%(int)accu[paccu-1])&workinterval;paccu--;break;
-				case E_COMPUTE_OPERATION_SHL:if (paccu>1) accu[paccu-2]=((int)accu[paccu-2])<<((int)accu[paccu-1]);paccu--;break;
-				case E_COMPUTE_OPERATION_SHR:if (paccu>1) accu[paccu-2]=((int)accu[paccu-2])>>((int)accu[paccu-1]);paccu--;break;				
-				case E_COMPUTE_OPERATION_BAND:if (paccu>1) accu[paccu-2]=((int)accu[paccu-2]&&(int)accu[paccu-1])&workinterval;paccu--;break;
-				case E_COMPUTE_OPERATION_BOR:if (paccu>1) accu[paccu-2]=((int)accu[paccu-2]||(int)accu[paccu-1])&workinterval;paccu--;break;
-				/* comparison */
-				case E_COMPUTE_OPERATION_LOWER:if (paccu>1) accu[paccu-2]=((int)accu[paccu-2]&workinterval)<((int)accu[paccu-1]&workinterval);paccu--;break;
-				case E_COMPUTE_OPERATION_LOWEREQ:if (paccu>1) accu[paccu-2]=((int)accu[paccu-2]&workinterval)<=((int)accu[paccu-1]&workinterval);paccu--;break;
-				case E_COMPUTE_OPERATION_EQUAL:if (paccu>1) accu[paccu-2]=((int)accu[paccu-2]&workinterval)==((int)accu[paccu-1]&workinterval);paccu--;break;
-				case E_COMPUTE_OPERATION_NOTEQUAL:if (paccu>1) accu[paccu-2]=((int)accu[paccu-2]&workinterval)!=((int)accu[paccu-1]&workinterval);paccu--;break;
-				case E_COMPUTE_OPERATION_GREATER:if (paccu>1) accu[paccu-2]=((int)accu[paccu-2]&workinterval)>((int)accu[paccu-1]&workinterval);paccu--;break;
-				case E_COMPUTE_OPERATION_GREATEREQ:if (paccu>1) accu[paccu-2]=((int)accu[paccu-2]&workinterval)>=((int)accu[paccu-1]&workinterval);paccu--;break;
-				/* functions */
-				case E_COMPUTE_OPERATION_SIN:if (paccu>0) accu[paccu-1]=(int)sin(accu[paccu-1]*3.1415926545/180.0);break;
-				case E_COMPUTE_OPERATION_COS:if (paccu>0) accu[paccu-1]=(int)cos(accu[paccu-1]*3.1415926545/180.0);break;
-				case E_COMPUTE_OPERATION_ASIN:if (paccu>0) accu[paccu-1]=(int)asin(accu[paccu-1])*180.0/3.1415926545;break;
-				case E_COMPUTE_OPERATION_ACOS:if (paccu>0) accu[paccu-1]=(int)acos(accu[paccu-1])*180.0/3.1415926545;break;
-				case E_COMPUTE_OPERATION_ATAN:if (paccu>0) accu[paccu-1]=(int)atan(accu[paccu-1])*180.0/3.1415926545;break;
-				case E_COMPUTE_OPERATION_INT:break;
-				case E_COMPUTE_OPERATION_FLOOR:if (paccu>0) accu[paccu-1]=(int)floor(accu[paccu-1])&workinterval;break;
-				case E_COMPUTE_OPERATION_ABS:if (paccu>0) accu[paccu-1]=(int)fabs(accu[paccu-1])&workinterval;break;
-				case E_COMPUTE_OPERATION_EXP:if (paccu>0) accu[paccu-1]=(int)exp(accu[paccu-1])&workinterval;break;
-				case E_COMPUTE_OPERATION_LN:if (paccu>0) accu[paccu-1]=(int)log(accu[paccu-1])&workinterval;break;
-				case E_COMPUTE_OPERATION_LOG10:if (paccu>0) accu[paccu-1]=(int)log10(accu[paccu-1])&workinterval;break;
-				case E_COMPUTE_OPERATION_SQRT:if (paccu>0) accu[paccu-1]=(int)sqrt(accu[paccu-1])&workinterval;break;
-				case E_COMPUTE_OPERATION_LOW:if (paccu>0) accu[paccu-1]=((int)accu[paccu-1])&0xFF;break;
-				case E_COMPUTE_OPERATION_HIGH:if (paccu>0) accu[paccu-1]=(((int)accu[paccu-1])&0xFF00)>>8;break;
-				case E_COMPUTE_OPERATION_PSG:if (paccu>0) accu[paccu-1]=ae->psgfine[((int)accu[paccu-1])&0xFF];break;
-				case E_COMPUTE_OPERATION_RND:if (paccu>0) accu[paccu-1]=rand()%((int)accu[paccu-1]);break;
-				case E_COMPUTE_OPERATION_FRAC:if (paccu>0) accu[paccu-1]=((int)(accu[paccu-1]-(int)accu[paccu-1]));break;
-				case E_COMPUTE_OPERATION_CEIL:if (paccu>0) accu[paccu-1]=(int)ceil(accu[paccu-1])&workinterval;break;
-				case E_COMPUTE_OPERATION_GET_R:if (paccu>0) accu[paccu-1]=((((int)accu[paccu-1])&0xF0)>>4);break;
-				case E_COMPUTE_OPERATION_GET_V:if (paccu>0) accu[paccu-1]=((((int)accu[paccu-1])&0xF00)>>8);break;
-				case E_COMPUTE_OPERATION_GET_B:if (paccu>0) accu[paccu-1]=(((int)accu[paccu-1])&0xF);break;
-				case E_COMPUTE_OPERATION_SET_R:if (paccu>0) accu[paccu-1]=MinMaxInt(accu[paccu-1],0,15)<<4;break;
-				case E_COMPUTE_OPERATION_SET_V:if (paccu>0) accu[paccu-1]=MinMaxInt(accu[paccu-1],0,15)<<8;break;
-				case E_COMPUTE_OPERATION_SET_B:if (paccu>0) accu[paccu-1]=MinMaxInt(accu[paccu-1],0,15);break;
-				default:MakeError(ae,GetCurrentFile(ae),ae->wl[ae->idx].l,"invalid computing state! (%d)\n",GetExpFile(ae,didx),GetExpLine(ae,didx),computestack[i].operator);paccu=0;
-			}
-			if (!paccu) {
-				if (zeexpression[0]=='&') {
-					MakeError(ae,GetExpFile(ae,didx),GetExpLine(ae,didx),"Missing operand for calculation [%s] Did you use & for an hexadecimal value?\n",TradExpression(zeexpression));
-				} else {
-					MakeError(ae,GetExpFile(ae,didx),GetExpLine(ae,didx),"Missing operand for calculation [%s]\n",TradExpression(zeexpression));
-				}
-				accu_err=1;
-				break;
-			}
-		}
-	} else {
-		for (i=0;i<nbcomputestack;i++) {
-#if 0
-			int kk;
-			for (kk=0;kk<paccu;kk++) printf("stack[%d]=%lf\n",kk,accu[kk]);
-			if (computestack[i].operator==E_COMPUTE_OPERATION_PUSH_DATASTC) {
-				printf("pacc=%d push %.1lf\n",paccu,computestack[i].value);
-			} else {
-				printf("pacc=%d operation %s p=%d\n",paccu,computestack[i].operator==E_COMPUTE_OPERATION_MUL?"*":
-								computestack[i].operator==E_COMPUTE_OPERATION_ADD?"+":
-								computestack[i].operator==E_COMPUTE_OPERATION_DIV?"/":
-								computestack[i].operator==E_COMPUTE_OPERATION_SUB?"-":
-								computestack[i].operator==E_COMPUTE_OPERATION_BAND?"&&":
-								computestack[i].operator==E_COMPUTE_OPERATION_BOR?"||":
-								computestack[i].operator==E_COMPUTE_OPERATION_SHL?"<<":
-								computestack[i].operator==E_COMPUTE_OPERATION_SHR?">>":
-								computestack[i].operator==E_COMPUTE_OPERATION_LOWER?"<":
-								computestack[i].operator==E_COMPUTE_OPERATION_GREATER?">":
-								computestack[i].operator==E_COMPUTE_OPERATION_EQUAL?"==":
-								computestack[i].operator==E_COMPUTE_OPERATION_INT?"INT":
-								computestack[i].operator==E_COMPUTE_OPERATION_LOWEREQ?"<=":
-								computestack[i].operator==E_COMPUTE_OPERATION_GREATEREQ?">=":
-								computestack[i].operator==E_COMPUTE_OPERATION_OPEN?"(":
-								computestack[i].operator==E_COMPUTE_OPERATION_CLOSE?")":
-								"<autre>",computestack[i].priority);
-			}
-#endif
-			switch (computestack[i].operator) {
-				case E_COMPUTE_OPERATION_PUSH_DATASTC:
-					if (maccu<=paccu) {
-						maccu=16+paccu;
-						accu=MemRealloc(accu,sizeof(double)*maccu);
-					}
-					accu[paccu]=computestack[i].value;paccu++;
-					break;
-				case E_COMPUTE_OPERATION_OPEN:
-				case E_COMPUTE_OPERATION_CLOSE: /* cannot happend */ break;
-				case E_COMPUTE_OPERATION_ADD:if (paccu>1) accu[paccu-2]+=accu[paccu-1];paccu--;break;
-				case E_COMPUTE_OPERATION_SUB:if (paccu>1) accu[paccu-2]-=accu[paccu-1];paccu--;break;
-				case E_COMPUTE_OPERATION_MUL:if (paccu>1) accu[paccu-2]*=accu[paccu-1];paccu--;break;
-				case E_COMPUTE_OPERATION_DIV:if (paccu>1) accu[paccu-2]/=accu[paccu-1];paccu--;break;
-				case E_COMPUTE_OPERATION_AND:if (paccu>1) accu[paccu-2]=((int)floor(accu[paccu-2]+0.5))&((int)floor(accu[paccu-1]+0.5));paccu--;break;
-				case E_COMPUTE_OPERATION_OR:if (paccu>1) accu[paccu-2]=((int)floor(accu[paccu-2]+0.5))|((int)floor(accu[paccu-1]+0.5));paccu--;break;
-				case E_COMPUTE_OPERATION_XOR:if (paccu>1) accu[paccu-2]=((int)floor(accu[paccu-2]+0.5))^((int)floor(accu[paccu-1]+0.5));paccu--;break;
-				case E_COMPUTE_OPERATION_NOT:/* half operator, half function */ if (paccu>0) accu[paccu-1]=!((int)floor(accu[paccu-1]+0.5));break;
-				case E_COMPUTE_OPERATION_MOD:if (paccu>1) accu[paccu-2]=((int)floor(accu[paccu-2]+0.5))%((int)floor(accu[paccu-1]+0.5));paccu--;break;
-				case E_COMPUTE_OPERATION_SHL:if (paccu>1) accu[paccu-2]=((int)floor(accu[paccu-2]+0.5))<<((int)floor(accu[paccu-1]+0.5));paccu--;break;
-				case E_COMPUTE_OPERATION_SHR:if (paccu>1) accu[paccu-2]=((int)floor(accu[paccu-2]+0.5))>>((int)floor(accu[paccu-1]+0.5));paccu--;break;				
-				case E_COMPUTE_OPERATION_BAND:if (paccu>1) accu[paccu-2]=((int)floor(accu[paccu-2]+0.5))&&((int)floor(accu[paccu-1]+0.5));paccu--;break;
-				case E_COMPUTE_OPERATION_BOR:if (paccu>1) accu[paccu-2]=((int)floor(accu[paccu-2]+0.5))||((int)floor(accu[paccu-1]+0.5));paccu--;break;
-				/* comparison */
-				case E_COMPUTE_OPERATION_LOWER:if (paccu>1) accu[paccu-2]=accu[paccu-2]<accu[paccu-1];paccu--;break;
-				case E_COMPUTE_OPERATION_LOWEREQ:if (paccu>1) accu[paccu-2]=accu[paccu-2]<=accu[paccu-1];paccu--;break;
-				case E_COMPUTE_OPERATION_EQUAL:if (paccu>1) accu[paccu-2]=fabs(accu[paccu-2]-accu[paccu-1])<0.000001;paccu--;break;
-				case E_COMPUTE_OPERATION_NOTEQUAL:if (paccu>1) accu[paccu-2]=accu[paccu-2]!=accu[paccu-1];paccu--;break;
-				case E_COMPUTE_OPERATION_GREATER:if (paccu>1) accu[paccu-2]=accu[paccu-2]>accu[paccu-1];paccu--;break;
-				case E_COMPUTE_OPERATION_GREATEREQ:if (paccu>1) accu[paccu-2]=accu[paccu-2]>=accu[paccu-1];paccu--;break;
-				/* functions */
-				case E_COMPUTE_OPERATION_SIN:if (paccu>0) accu[paccu-1]=sin(accu[paccu-1]*3.1415926545/180.0);break;
-				case E_COMPUTE_OPERATION_COS:if (paccu>0) accu[paccu-1]=cos(accu[paccu-1]*3.1415926545/180.0);break;
-				case E_COMPUTE_OPERATION_ASIN:if (paccu>0) accu[paccu-1]=asin(accu[paccu-1])*180.0/3.1415926545;break;
-				case E_COMPUTE_OPERATION_ACOS:if (paccu>0) accu[paccu-1]=acos(accu[paccu-1])*180.0/3.1415926545;break;
-				case E_COMPUTE_OPERATION_ATAN:if (paccu>0) accu[paccu-1]=atan(accu[paccu-1])*180.0/3.1415926545;break;
-				case E_COMPUTE_OPERATION_INT:if (paccu>0) accu[paccu-1]=floor(accu[paccu-1]+0.5);break;
-				case E_COMPUTE_OPERATION_FLOOR:if (paccu>0) accu[paccu-1]=floor(accu[paccu-1]);break;
-				case E_COMPUTE_OPERATION_ABS:if (paccu>0) accu[paccu-1]=fabs(accu[paccu-1]);break;
-				case E_COMPUTE_OPERATION_EXP:if (paccu>0) accu[paccu-1]=exp(accu[paccu-1]);break;
-				case E_COMPUTE_OPERATION_LN:if (paccu>0) accu[paccu-1]=log(accu[paccu-1]);break;
-				case E_COMPUTE_OPERATION_LOG10:if (paccu>0) accu[paccu-1]=log10(accu[paccu-1]);break;
-				case E_COMPUTE_OPERATION_SQRT:if (paccu>0) accu[paccu-1]=sqrt(accu[paccu-1]);break;
-				case E_COMPUTE_OPERATION_LOW:if (paccu>0) accu[paccu-1]=((int)floor(accu[paccu-1]+0.5))&0xFF;break;
-				case E_COMPUTE_OPERATION_HIGH:if (paccu>0) accu[paccu-1]=(((int)floor(accu[paccu-1]+0.5))&0xFF00)>>8;break;
-				case E_COMPUTE_OPERATION_PSG:if (paccu>0) accu[paccu-1]=ae->psgfine[((int)floor(accu[paccu-1]+0.5))&0xFF];break;
-				case E_COMPUTE_OPERATION_RND:if (paccu>0) accu[paccu-1]=rand()%((int)accu[paccu-1]);break;
-				case E_COMPUTE_OPERATION_FRAC:if (paccu>0) accu[paccu-1]=modf(accu[paccu-1],&dummint);break;
-				case E_COMPUTE_OPERATION_CEIL:if (paccu>0) accu[paccu-1]=ceil(accu[paccu-1]);break;
-				case E_COMPUTE_OPERATION_GET_R:if (paccu>0) accu[paccu-1]=((((int)accu[paccu-1])&0xF0)>>4);break;
-				case E_COMPUTE_OPERATION_GET_V:if (paccu>0) accu[paccu-1]=((((int)accu[paccu-1])&0xF00)>>8);break;
-				case E_COMPUTE_OPERATION_GET_B:if (paccu>0) accu[paccu-1]=(((int)accu[paccu-1])&0xF);break;
-				case E_COMPUTE_OPERATION_SET_R:if (paccu>0) accu[paccu-1]=MinMaxInt(accu[paccu-1],0,15)<<4;break;
-				case E_COMPUTE_OPERATION_SET_V:if (paccu>0) accu[paccu-1]=MinMaxInt(accu[paccu-1],0,15)<<8;break;
-				case E_COMPUTE_OPERATION_SET_B:if (paccu>0) accu[paccu-1]=MinMaxInt(accu[paccu-1],0,15);break;
-				default:MakeError(ae,GetCurrentFile(ae),ae->wl[ae->idx].l,"invalid computing state! (%d)\n",GetExpFile(ae,didx),GetExpLine(ae,didx),computestack[i].operator);paccu=0;
-			}
-			if (!paccu) {
-				if (zeexpression[0]=='&') {
-					MakeError(ae,GetExpFile(ae,didx),GetExpLine(ae,didx),"Missing operand for calculation [%s] Did you use & for an hexadecimal value?\n",TradExpression(zeexpression));
-				} else {
-					MakeError(ae,GetExpFile(ae,didx),GetExpLine(ae,didx),"Missing operand for calculation [%s]\n",TradExpression(zeexpression));
-				}
-				accu_err=1;
-				break;
-			}
-		}
-	}
+	curval=ComputeExpressionExecute(ae,ae->computestack,nbcomputestack,zeexpression,didx);
 	if (!original) {
 		MemFree(zeexpression);
+	} else if (cacheable && !compiled && ae->nberr==nberr) {
+		CompileExpression(ae,zeexpression,ae->computestack,nbcomputestack,nbsymbol);
 	}
-	if (paccu==1) {
-		return accu[0];
-	} else if (!accu_err) {
-		if (paccu) {
-			MakeError(ae,GetExpFile(ae,didx),GetExpLine(ae,didx),"Missing operator\n");
-		} else {
-			MakeError(ae,GetExpFile(ae,didx),GetExpLine(ae,didx),"Missing operand for calculation\n");
-		}
-		return 0;
-	} else {
-		return 0;
-	}
+	return curval;
 }
 int RoundComputeExpressionCore(struct s_assenv *ae,char *zeexpression,int ptr,int didx) {
 	return floor(ComputeExpressionCore(ae,zeexpression,ptr,didx)+ae->rough);
@@ -4610,7 +5374,7 @@ void ExpressionSetDicoVar(struct s_assenv *ae,char *name, double v)
 	#define FUNC "ExpressionSetDicoVar"
 
 	struct s_expr_dico curdic;
-	curdic.name=TxtStrDup(name);
+	curdic.name=name;
 	curdic.crc=GetCRC(name);
 	curdic.v=v;
 	curdic.iw=ae->idx;
@@ -4618,10 +5382,9 @@ void ExpressionSetDicoVar(struct s_assenv *ae,char *name, double v)
 	//ObjectArrayAddDynamicValueConcat((void**)&ae->dico,&ae->idic,&ae->mdic,&curdic,sizeof(curdic));
 	if (SearchLabel(ae,curdic.name,curdic.crc)) {
 		MakeError(ae,GetCurrentFile(ae),GetExpLine(ae,0),"cannot create variable [%s] as there is already a label with the same name\n",name);
-		MemFree(curdic.name);
 		return;
 	}
-	InsertDicoToTree(ae,&curdic);
+	InsertDicoToTable(ae,&curdic);
 }
 
 double ComputeExpression(struct s_assenv *ae,char *expr, int ptr, int didx, int expected_eval)
@@ -4767,8 +5530,6 @@ void ExpressionFastTranslate(struct s_assenv *ae, char **ptr_expr, int fullrepla
 
 	struct s_label *curlabel;
 	struct s_expr_dico *curdic;
-	static char *varbuffer=NULL;
-	static int ivar=0,maxivar=1;
 	char curval[256]={0};
 	int c,lenw=0,idx=0,crc,startvar,newlen,ialias,found_replace,yves,dek,reidx,lenbuf,rlen,tagoffset;
 	double v;
@@ -4778,15 +5539,15 @@ void ExpressionFastTranslate(struct s_assenv *ae, char **ptr_expr, int fullrepla
 	char *Automate;
 	int recurse=-1,recursecount=0;
 	
-	if (!ae || !ptr_expr) {
-		if (varbuffer) MemFree(varbuffer);
-		varbuffer=NULL;
-		maxivar=1;
-		ivar=0;
+	if (!ptr_expr) {
+		if (ae->fastvarbuffer) MemFree(ae->fastvarbuffer);
+		ae->fastvarbuffer=NULL;
+		ae->fastmaxivar=1;
+		ae->fastivar=0;
 		return;
 	}
 	/* be sure to have at least some bytes allocated */
-	StateMachineResizeBuffer(&varbuffer,128,&maxivar);
+	StateMachineResizeBuffer(&ae->fastvarbuffer,128,&ae->fastmaxivar);
 	expr=*ptr_expr;
 
 //printf("fast [%s]\n",expr);
@@ -4871,12 +5632,12 @@ void ExpressionFastTranslate(struct s_assenv *ae, char **ptr_expr, int fullrepla
 			default:
 				startvar=idx;
 				if (ae->AutomateExpressionValidCharFirst[((int)c)&0xFF]) {
-					varbuffer[ivar++]=c;
+					ae->fastvarbuffer[ae->fastivar++]=c;
 					if (c=='{') {
 						/* this is only tag and not a formula */
 						curly++;
 					}
-					StateMachineResizeBuffer(&varbuffer,ivar,&maxivar);
+					StateMachineResizeBuffer(&ae->fastvarbuffer,ae->fastivar,&ae->fastmaxivar);
 					idx++;
 					c=expr[idx];
 
@@ -4892,14 +5653,14 @@ void ExpressionFastTranslate(struct s_assenv *ae, char **ptr_expr, int fullrepla
 								Automate=ae->AutomateExpressionValidChar;
 							}
 						}
-						varbuffer[ivar++]=c;
-						StateMachineResizeBuffer(&varbuffer,ivar,&maxivar);
+						ae->fastvarbuffer[ae->fastivar++]=c;
+						StateMachineResizeBuffer(&ae->fastvarbuffer,ae->fastivar,&ae->fastmaxivar);
 						idx++;
 						c=expr[idx];
 					}
 				}
-				varbuffer[ivar]=0;
-				if (!ivar) {
+				ae->fastvarbuffer[ae->fastivar]=0;
+				if (!ae->fastivar) {
 					MakeError(ae,GetCurrentFile(ae),GetExpLine(ae,0),"invalid expression [%s] c=[%c] idx=%d\n",expr,c,idx);
 					return;
 				} else if (curly) {
@@ -4907,25 +5668,25 @@ void ExpressionFastTranslate(struct s_assenv *ae, char **ptr_expr, int fullrepla
 					return;
 				}
 		}
-		if (ivar && (varbuffer[0]<'0' || varbuffer[0]>'9')) {
+		if (ae->fastivar && (ae->fastvarbuffer[0]<'0' || ae->fastvarbuffer[0]>'9')) {
 			/* numbering var or label */
 			if (curlyflag) {
 				char *minivarbuffer;
 				int touched;
 //printf("ExpressionFastTranslate curly\n");
-				minivarbuffer=TranslateTag(ae,TxtStrDup(varbuffer), &touched,0,E_TAGOPTION_NONE|(fullreplace?0:E_TAGOPTION_PRESERVE));
-				StateMachineResizeBuffer(&varbuffer,strlen(minivarbuffer)+1,&maxivar);
-				strcpy(varbuffer,minivarbuffer);
-				newlen=strlen(varbuffer);
+				minivarbuffer=TranslateTag(ae,TxtStrDup(ae->fastvarbuffer), &touched,0,E_TAGOPTION_NONE|(fullreplace?0:E_TAGOPTION_PRESERVE));
+				StateMachineResizeBuffer(&ae->fastvarbuffer,strlen(minivarbuffer)+1,&ae->fastmaxivar);
+				strcpy(ae->fastvarbuffer,minivarbuffer);
+				newlen=strlen(ae->fastvarbuffer);
 				lenw=strlen(expr);
 				/* must update source */
-				if (newlen>ivar) {
+				if (newlen>ae->fastivar) {
 					/* realloc bigger */
-					expr=*ptr_expr=MemRealloc(expr,lenw+newlen-ivar+1);
+					expr=*ptr_expr=MemRealloc(expr,lenw+newlen-ae->fastivar+1);
 				}
-				if (newlen!=ivar ) {
+				if (newlen!=ae->fastivar ) {
 					lenw=strlen(expr);
-					MemMove(expr+startvar+newlen,expr+startvar+ivar,lenw-startvar-ivar+1);
+					MemMove(expr+startvar+newlen,expr+startvar+ae->fastivar,lenw-startvar-ae->fastivar+1);
 				}
 				strncpy(expr+startvar,minivarbuffer,newlen); /* copy without zero terminator */
 				idx=startvar+newlen;
@@ -4933,15 +5694,15 @@ void ExpressionFastTranslate(struct s_assenv *ae, char **ptr_expr, int fullrepla
 				MemFree(minivarbuffer);
 				curlyflag=0;
 				/******* ivar must be updated in case of label or alias following ***********/
-				ivar=newlen;
+				ae->fastivar=newlen;
 			}
 			
 			/* recherche dans dictionnaire et remplacement */
-			crc=GetCRC(varbuffer);
+			crc=GetCRC(ae->fastvarbuffer);
 			found_replace=0;
 			/* pour les affectations ou les tests conditionnels on ne remplace pas le dico (pour le Push oui par contre!) */
 			if (fullreplace) {
-				if (varbuffer[0]=='$' && !varbuffer[1]) {
+				if (ae->fastvarbuffer[0]=='$' && !ae->fastvarbuffer[1]) {
 					#ifdef OS_WIN
 					snprintf(curval,sizeof(curval)-1,"%d",ae->codeadr);
 					newlen=strlen(curval);
@@ -4949,23 +5710,23 @@ void ExpressionFastTranslate(struct s_assenv *ae, char **ptr_expr, int fullrepla
 					newlen=snprintf(curval,sizeof(curval)-1,"%d",ae->codeadr);
 					#endif
 					lenw=strlen(expr);
-					if (newlen>ivar) {
+					if (newlen>ae->fastivar) {
 						/* realloc bigger */
-						expr=*ptr_expr=MemRealloc(expr,lenw+newlen-ivar+1);
+						expr=*ptr_expr=MemRealloc(expr,lenw+newlen-ae->fastivar+1);
 					}
-					if (newlen!=ivar ) {
-						MemMove(expr+startvar+newlen,expr+startvar+ivar,lenw-startvar-ivar+1);
+					if (newlen!=ae->fastivar ) {
+						MemMove(expr+startvar+newlen,expr+startvar+ae->fastivar,lenw-startvar-ae->fastivar+1);
 						found_replace=1;
 					}
 					strncpy(expr+startvar,curval,newlen); /* copy without zero terminator */
 					idx=startvar+newlen;
-					ivar=0;
+					ae->fastivar=0;
 					found_replace=1;
 				} else {
-					curdic=SearchDico(ae,varbuffer,crc);
+					curdic=SearchDico(ae,ae->fastvarbuffer,crc);
 					if (curdic) {
 						v=curdic->v;
-//printf("ExpressionFastTranslate (full) -> replace var (%s=%0.1lf)\n",varbuffer,v);
+//printf("ExpressionFastTranslate (full) -> replace var (%s=%0.1lf)\n",ae->fastvarbuffer,v);
 
 						#ifdef OS_WIN
 						snprintf(curval,sizeof(curval)-1,"%lf",v);
@@ -4975,23 +5736,23 @@ void ExpressionFastTranslate(struct s_assenv *ae, char **ptr_expr, int fullrepla
 						newlen=TrimFloatingPointString(curval);
 						#endif
 						lenw=strlen(expr);
-						if (newlen>ivar) {
+						if (newlen>ae->fastivar) {
 							/* realloc bigger */
-							expr=*ptr_expr=MemRealloc(expr,lenw+newlen-ivar+1);
+							expr=*ptr_expr=MemRealloc(expr,lenw+newlen-ae->fastivar+1);
 						}
-						if (newlen!=ivar ) {
-							MemMove(expr+startvar+newlen,expr+startvar+ivar,lenw-startvar-ivar+1);
+						if (newlen!=ae->fastivar ) {
+							MemMove(expr+startvar+newlen,expr+startvar+ae->fastivar,lenw-startvar-ae->fastivar+1);
 						}
 						strncpy(expr+startvar,curval,newlen); /* copy without zero terminator */
 						idx=startvar+newlen;
-						ivar=0;
+						ae->fastivar=0;
 						found_replace=1;
 					}
 				}
 			}
 			/* on cherche aussi dans les labels existants */
 			if (!found_replace) {
-				curlabel=SearchLabel(ae,varbuffer,crc);
+				curlabel=SearchLabel(ae,ae->fastvarbuffer,crc);
 				if (curlabel) {
 					if (!curlabel->lz || ae->stage>1) {
 						yves=curlabel->ptr;
@@ -5003,23 +5764,23 @@ void ExpressionFastTranslate(struct s_assenv *ae, char **ptr_expr, int fullrepla
 						newlen=snprintf(curval,sizeof(curval)-1,"%d",yves);
 						#endif
 						lenw=strlen(expr);
-						if (newlen>ivar) {
+						if (newlen>ae->fastivar) {
 							/* realloc bigger */
-							expr=*ptr_expr=MemRealloc(expr,lenw+newlen-ivar+1);
+							expr=*ptr_expr=MemRealloc(expr,lenw+newlen-ae->fastivar+1);
 						}
-						if (newlen!=ivar ) {
-							MemMove(expr+startvar+newlen,expr+startvar+ivar,lenw-startvar-ivar+1);
+						if (newlen!=ae->fastivar ) {
+							MemMove(expr+startvar+newlen,expr+startvar+ae->fastivar,lenw-startvar-ae->fastivar+1);
 						}
 						strncpy(expr+startvar,curval,newlen); /* copy without zero terminator */
 						found_replace=1;
 						idx=startvar+newlen;
-						ivar=0;
+						ae->fastivar=0;
 					}
 				}		
 			}
 			/* non trouve on cherche dans les alias */
 			if (!found_replace) {
-				if ((ialias=SearchAlias(ae,crc,varbuffer))>=0) {
+				if ((ialias=SearchAlias(ae,crc,ae->fastvarbuffer))>=0) {
 					newlen=ae->alias[ialias].len;
 					lenw=strlen(expr);
 					/* infinite replacement check */
@@ -5034,41 +5795,41 @@ void ExpressionFastTranslate(struct s_assenv *ae, char **ptr_expr, int fullrepla
 							recursecount++;
 						}
 					}
-					if (newlen>ivar) {
+					if (newlen>ae->fastivar) {
 						/* realloc bigger */
-						expr=*ptr_expr=MemRealloc(expr,lenw+newlen-ivar+1);
+						expr=*ptr_expr=MemRealloc(expr,lenw+newlen-ae->fastivar+1);
 					}
-					if (newlen!=ivar) {
-						MemMove(expr+startvar+newlen,expr+startvar+ivar,lenw-startvar-ivar+1);
+					if (newlen!=ae->fastivar) {
+						MemMove(expr+startvar+newlen,expr+startvar+ae->fastivar,lenw-startvar-ae->fastivar+1);
 					}
 					strncpy(expr+startvar,ae->alias[ialias].translation,newlen); /* copy without zero terminator */
 					found_replace=1;
 					/* need to parse again alias because of delayed declarations */
 					recurse=startvar;
 					idx=startvar;
-					ivar=0;
+					ae->fastivar=0;
 				} else {
 				}
 			}
 			if (!found_replace) {
 				//printf("fasttranslate test local label\n");
 				/* non trouve c'est peut-etre un label local - mais pas de l'octal */
-				if (varbuffer[0]=='@' && (varbuffer[1]<'0' || varbuffer[1]>'9')) {
+				if (ae->fastvarbuffer[0]=='@' && (ae->fastvarbuffer[1]<'0' || ae->fastvarbuffer[1]>'9')) {
 					char *zepoint;
-					lenbuf=strlen(varbuffer);
-//printf("MakeLocalLabel(ae,varbuffer,&dek); (1)\n");
-					locallabel=MakeLocalLabel(ae,varbuffer,&dek);
+					lenbuf=strlen(ae->fastvarbuffer);
+//printf("MakeLocalLabel(ae,ae->fastvarbuffer,&dek); (1)\n");
+					locallabel=MakeLocalLabel(ae,ae->fastvarbuffer,&dek);
 //printf("exprin =[%s]   rlen=%d dek-lenbuf=%d\n",expr,rlen,dek-lenbuf);
 					/*** le grand remplacement ***/
 					/* local to macro or loop */
 					rlen=strlen(expr+startvar+lenbuf)+1;
 					expr=*ptr_expr=MemRealloc(expr,strlen(expr)+dek+1);
 					/* move end of expression in order to insert local ID */
-					zepoint=strchr(varbuffer,'.');
+					zepoint=strchr(ae->fastvarbuffer,'.');
 					if (zepoint) {
 						/* far proximity access */
 						int suffixlen,dotpos;
-						dotpos=(zepoint-varbuffer);
+						dotpos=(zepoint-ae->fastvarbuffer);
 						suffixlen=lenbuf-dotpos;
 
 						MemMove(expr+startvar+dotpos+dek,expr+startvar+dotpos,rlen+suffixlen);
@@ -5082,11 +5843,11 @@ void ExpressionFastTranslate(struct s_assenv *ae, char **ptr_expr, int fullrepla
 					MemFree(locallabel);
 					found_replace=1;
 //printf("exprout=[%s]\n",expr);
-				} else if (varbuffer[0]=='.' && (varbuffer[1]<'0' || varbuffer[1]>'9')) {
+				} else if (ae->fastvarbuffer[0]=='.' && (ae->fastvarbuffer[1]<'0' || ae->fastvarbuffer[1]>'9')) {
 					/* proximity label */
-					lenbuf=strlen(varbuffer);
-//printf("MakeLocalLabel(ae,varbuffer,&dek); (2)\n");
-					locallabel=MakeLocalLabel(ae,varbuffer,&dek);
+					lenbuf=strlen(ae->fastvarbuffer);
+//printf("MakeLocalLabel(ae,ae->fastvarbuffer,&dek); (2)\n");
+					locallabel=MakeLocalLabel(ae,ae->fastvarbuffer,&dek);
 					/*** le grand remplacement ***/
 					rlen=strlen(expr+startvar+lenbuf)+1;
 					dek=strlen(locallabel);
@@ -5100,30 +5861,30 @@ void ExpressionFastTranslate(struct s_assenv *ae, char **ptr_expr, int fullrepla
 
 //@@TODO ajouter une recherche d'alias?
 
-				} else if (varbuffer[0]=='{') {
-					if (strncmp(varbuffer,"{BANK}",6)==0 || strncmp(varbuffer,"{PAGE}",6)==0) tagoffset=6; else
-					if (strncmp(varbuffer,"{PAGESET}",9)==0) tagoffset=9; else
-					if (strncmp(varbuffer,"{SIZEOF}",8)==0) tagoffset=8; else
+				} else if (ae->fastvarbuffer[0]=='{') {
+					if (strncmp(ae->fastvarbuffer,"{BANK}",6)==0 || strncmp(ae->fastvarbuffer,"{PAGE}",6)==0) tagoffset=6; else
+					if (strncmp(ae->fastvarbuffer,"{PAGESET}",9)==0) tagoffset=9; else
+					if (strncmp(ae->fastvarbuffer,"{SIZEOF}",8)==0) tagoffset=8; else
 					{
 						tagoffset=0;
 						MakeError(ae,GetCurrentFile(ae),GetExpLine(ae,0),"Unknown prefix tag\n");
 					}
 					
-					if (varbuffer[tagoffset]=='@') {
+					if (ae->fastvarbuffer[tagoffset]=='@') {
 						char *zepoint;
 						startvar+=tagoffset;
-						lenbuf=strlen(varbuffer+tagoffset);
-//printf("MakeLocalLabel(ae,varbuffer,&dek); (3)\n");
-						locallabel=MakeLocalLabel(ae,varbuffer+tagoffset,&dek);
+						lenbuf=strlen(ae->fastvarbuffer+tagoffset);
+//printf("MakeLocalLabel(ae,ae->fastvarbuffer,&dek); (3)\n");
+						locallabel=MakeLocalLabel(ae,ae->fastvarbuffer+tagoffset,&dek);
 						/*** le grand remplacement ***/
 						rlen=strlen(expr+startvar+lenbuf)+1;
 						expr=*ptr_expr=MemRealloc(expr,strlen(expr)+dek+1);
 						/* move end of expression in order to insert local ID */
-						zepoint=strchr(varbuffer,'.');
+						zepoint=strchr(ae->fastvarbuffer,'.');
 						if (zepoint) {
 							/* far proximity access */
 							int suffixlen,dotpos;
-							dotpos=(zepoint-varbuffer);
+							dotpos=(zepoint-ae->fastvarbuffer);
 							suffixlen=lenbuf-dotpos;
 
 							MemMove(expr+startvar+dotpos+dek,expr+startvar+dotpos,rlen+suffixlen);
@@ -5136,14 +5897,14 @@ void ExpressionFastTranslate(struct s_assenv *ae, char **ptr_expr, int fullrepla
 						idx+=dek;
 						MemFree(locallabel);
 						found_replace=1;
-					} else if (varbuffer[tagoffset]=='$') {
+					} else if (ae->fastvarbuffer[tagoffset]=='$') {
 						int tagvalue=-1;
-						if (strcmp(varbuffer,"{BANK}$")==0) {
+						if (strcmp(ae->fastvarbuffer,"{BANK}$")==0) {
 							if (ae->forcecpr) {
 								if (ae->activebank<32) {
 									tagvalue=ae->activebank;
 								} else {
-									MakeError(ae,GetCurrentFile(ae),GetExpLine(ae,0),"expression [%s] cannot use BANK $ in a temporary space!\n",TradExpression(expr));
+									MakeError(ae,GetCurrentFile(ae),GetExpLine(ae,0),"expression [%s] cannot use BANK $ in a temporary space!\n",TradExpression(ae,expr));
 									tagvalue=0;
 								}
 							} else if (ae->forcesnapshot) {
@@ -5156,11 +5917,11 @@ void ExpressionFastTranslate(struct s_assenv *ae, char **ptr_expr, int fullrepla
 								}
 									
 								} else {
-									MakeError(ae,GetCurrentFile(ae),GetExpLine(ae,0),"expression [%s] cannot use BANK $ in a temporary space!\n",TradExpression(expr));
+									MakeError(ae,GetCurrentFile(ae),GetExpLine(ae,0),"expression [%s] cannot use BANK $ in a temporary space!\n",TradExpression(ae,expr));
 									tagvalue=0;
 								}
 							}
-						} else if (strcmp(varbuffer,"{PAGE}$")==0) {
+						} else if (strcmp(ae->fastvarbuffer,"{PAGE}$")==0) {
 							if (ae->activebank<BANK_MAX_NUMBER) {
 								if (ae->bankset[ae->activebank>>2]) {
 									tagvalue=ae->bankgate[(ae->activebank&0x1FC)+(ae->codeadr>>14)];
@@ -5168,15 +5929,15 @@ void ExpressionFastTranslate(struct s_assenv *ae, char **ptr_expr, int fullrepla
 									tagvalue=ae->bankgate[ae->activebank];
 								}
 							} else {
-								MakeError(ae,GetCurrentFile(ae),GetExpLine(ae,0),"expression [%s] cannot use PAGE $ in a temporary space!\n",TradExpression(expr));
+								MakeError(ae,GetCurrentFile(ae),GetExpLine(ae,0),"expression [%s] cannot use PAGE $ in a temporary space!\n",TradExpression(ae,expr));
 								tagvalue=ae->activebank;
 							}
-						} else if (strcmp(varbuffer,"{PAGESET}$")==0) {
+						} else if (strcmp(ae->fastvarbuffer,"{PAGESET}$")==0) {
 							if (ae->activebank<BANK_MAX_NUMBER) {
 								tagvalue=ae->setgate[ae->activebank];
 								//if (ae->activebank>3) tagvalue=((ae->activebank>>2)-1)*8+0xC2; else tagvalue=0xC0;
 							} else {
-								MakeError(ae,GetCurrentFile(ae),GetExpLine(ae,0),"expression [%s] cannot use PAGESET $ in a temporary space!\n",TradExpression(expr));
+								MakeError(ae,GetCurrentFile(ae),GetExpLine(ae,0),"expression [%s] cannot use PAGESET $ in a temporary space!\n",TradExpression(ae,expr));
 								tagvalue=ae->activebank;
 							}
 						}
@@ -5188,17 +5949,17 @@ void ExpressionFastTranslate(struct s_assenv *ae, char **ptr_expr, int fullrepla
 						newlen=snprintf(curval,sizeof(curval)-1,"%d",tagvalue);
 						#endif
 						lenw=strlen(expr);
-						if (newlen>ivar) {
+						if (newlen>ae->fastivar) {
 							/* realloc bigger */
-							expr=*ptr_expr=MemRealloc(expr,lenw+newlen-ivar+1);
+							expr=*ptr_expr=MemRealloc(expr,lenw+newlen-ae->fastivar+1);
 						}
-						if (newlen!=ivar ) {
-							MemMove(expr+startvar+newlen,expr+startvar+ivar,lenw-startvar-ivar+1);
+						if (newlen!=ae->fastivar ) {
+							MemMove(expr+startvar+newlen,expr+startvar+ae->fastivar,lenw-startvar-ae->fastivar+1);
 							found_replace=1;
 						}
 						strncpy(expr+startvar,curval,newlen); /* copy without zero terminator */
 						idx=startvar+newlen;
-						ivar=0;
+						ae->fastivar=0;
 						found_replace=1;
 					}
 				}
@@ -5209,7 +5970,7 @@ void ExpressionFastTranslate(struct s_assenv *ae, char **ptr_expr, int fullrepla
 			
 			
 			
-			if (!found_replace && strcmp(varbuffer,"REPEAT_COUNTER")==0) {
+			if (!found_replace && strcmp(ae->fastvarbuffer,"REPEAT_COUNTER")==0) {
 				if (ae->ir) {
 					yves=ae->repeat[ae->ir-1].repeat_counter;
 					#ifdef OS_WIN
@@ -5219,23 +5980,23 @@ void ExpressionFastTranslate(struct s_assenv *ae, char **ptr_expr, int fullrepla
 					newlen=snprintf(curval,sizeof(curval)-1,"%d",yves);
 					#endif
 					lenw=strlen(expr);
-					if (newlen>ivar) {
+					if (newlen>ae->fastivar) {
 						/* realloc bigger */
-						expr=*ptr_expr=MemRealloc(expr,lenw+newlen-ivar+1);
+						expr=*ptr_expr=MemRealloc(expr,lenw+newlen-ae->fastivar+1);
 					}
-					if (newlen!=ivar ) {
-						MemMove(expr+startvar+newlen,expr+startvar+ivar,lenw-startvar-ivar+1);
+					if (newlen!=ae->fastivar ) {
+						MemMove(expr+startvar+newlen,expr+startvar+ae->fastivar,lenw-startvar-ae->fastivar+1);
 						found_replace=1;
 					}
 					strncpy(expr+startvar,curval,newlen); /* copy without zero terminator */
 					found_replace=1;
 					idx=startvar+newlen;
-					ivar=0;
+					ae->fastivar=0;
 				} else {
 					MakeError(ae,GetCurrentFile(ae),GetExpLine(ae,0),"cannot use REPEAT_COUNTER outside repeat loop\n");
 				}
 			}
-			if (!found_replace && strcmp(varbuffer,"WHILE_COUNTER")==0) {
+			if (!found_replace && strcmp(ae->fastvarbuffer,"WHILE_COUNTER")==0) {
 				if (ae->iw) {
 					yves=ae->whilewend[ae->iw-1].while_counter;
 					#ifdef OS_WIN
@@ -5245,28 +6006,28 @@ void ExpressionFastTranslate(struct s_assenv *ae, char **ptr_expr, int fullrepla
 					newlen=snprintf(curval,sizeof(curval)-1,"%d",yves);
 					#endif
 					lenw=strlen(expr);
-					if (newlen>ivar) {
+					if (newlen>ae->fastivar) {
 						/* realloc bigger */
-						expr=*ptr_expr=MemRealloc(expr,lenw+newlen-ivar+1);
+						expr=*ptr_expr=MemRealloc(expr,lenw+newlen-ae->fastivar+1);
 					}
-					if (newlen!=ivar ) {
-						MemMove(expr+startvar+newlen,expr+startvar+ivar,lenw-startvar-ivar+1);
+					if (newlen!=ae->fastivar ) {
+						MemMove(expr+startvar+newlen,expr+startvar+ae->fastivar,lenw-startvar-ae->fastivar+1);
 						found_replace=1;
 					}
 					strncpy(expr+startvar,curval,newlen); /* copy without zero terminator */
 					found_replace=1;
 					idx=startvar+newlen;
-					ivar=0;
+					ae->fastivar=0;
 				} else {
 					MakeError(ae,GetCurrentFile(ae),GetExpLine(ae,0),"cannot use WHILE_COUNTER outside repeat loop\n");
 				}
 			}
 			/* unknown symbol -> add to used symbol pool */
 			if (!found_replace) {
-				InsertUsedToTree(ae,varbuffer,crc);
+				InsertUsedToTable(ae,ae->fastvarbuffer,crc);
 			}
 		}
-		ivar=0;
+		ae->fastivar=0;
 	}
 }
 
@@ -5276,7 +6037,7 @@ void PushExpression(struct s_assenv *ae,int iw,enum e_expression zetype)
 	#define FUNC "PushExpression"
 	
 	struct s_expression curexp={0};
-	int startptr=0;
+	int startptr=0,lenw;
 
 	if (!ae->nocode) {
 		curexp.iw=iw;
@@ -5319,8 +6080,17 @@ void PushExpression(struct s_assenv *ae,int iw,enum e_expression zetype)
 			ae->codeadr+=startptr;
 			/* ok mais les labels locaux des macros? */
 			if (ae->ir || ae->iw || ae->imacro) {
-				curexp.reference=TxtStrDup(ae->wl[iw].w);
-				ExpressionFastTranslate(ae,&curexp.reference,1);
+				/* translate in a reusable buffer then keep the result in the arena */
+				lenw=strlen(ae->wl[iw].w)+1;
+				if (lenw>ae->referencebuffersize) {
+					ae->referencebuffer=MemRealloc(ae->referencebuffer,lenw);
+					ae->referencebuffersize=lenw;
+				}
+				memcpy(ae->referencebuffer,ae->wl[iw].w,lenw);
+				ExpressionFastTranslate(ae,&ae->referencebuffer,1);
+				/* the translation may have shrunk the buffer */
+				ae->referencebuffersize=strlen(ae->referencebuffer)+1;
+				curexp.reference=ArenaStrDup(&ae->arena,ae->referencebuffer);
 			} else {
 				ExpressionFastTranslate(ae,&ae->wl[iw].w,1);
 			}
@@ -5456,7 +6226,7 @@ char *MakeAMSDOS_name(struct s_assenv *ae, char *filename)
 	#undef FUNC
 	#define FUNC "MakeAMSDOS_name"
 
-	static char amsdos_name[12];
+	char *amsdos_name=ae->amsdosname;
 	int i,ia;
 	char *pp;
 	/* warning */
@@ -5785,7 +6555,7 @@ int EDSK_addfile(struct s_assenv *ae,char *edskfilename,int facenumber, char *fi
 	size=insize+128;
 	data=MemMalloc(size);
 	strcpy(amsdos_name,MakeAMSDOS_name(ae,filename));
-	memcpy(data,MakeAMSDOSHeader(run,offset,offset+insize,amsdos_name),128);
+	memcpy(data,MakeAMSDOSHeader(ae,run,offset,offset+insize,amsdos_name),128);
 	memcpy(data+128,indata,insize);
 	/* overwrite check */
 #if TRACE_EDSK
@@ -6243,7 +7013,7 @@ void PopAllSave(struct s_assenv *ae)
 			IDval[1]=((wrksize+128)>>8) & 0xFF;
 			FileWriteBinary(filename,(char *)IDval,2); // block len
 			nbblock=1;
-			AmsdosHeader=MakeAMSDOSHeader(run,offset,offset+size,MakeAMSDOS_name(ae,filename));
+			AmsdosHeader=MakeAMSDOSHeader(ae,run,offset,offset+size,MakeAMSDOS_name(ae,filename));
 			FileWriteBinary(filename,(char *)AmsdosHeader,128);
 			if (size<=2048-128) {
 				FileWriteBinary(filename,(char*)ae->mem[ae->save[is].ibank]+offset,size);
@@ -6274,7 +7044,7 @@ void PopAllSave(struct s_assenv *ae)
 			rasm_printf(ae,KIO"Write binary file %s (%d byte%s)\n",filename,size,size>1?"s":"");
 			FileRemoveIfExists(filename);
 			if (ae->save[is].amsdos) {
-				AmsdosHeader=MakeAMSDOSHeader(run,offset,offset+size,MakeAMSDOS_name(ae,filename));
+				AmsdosHeader=MakeAMSDOSHeader(ae,run,offset,offset+size,MakeAMSDOS_name(ae,filename));
 				FileWriteBinary(filename,(char *)AmsdosHeader,128);
 			}		
 			FileWriteBinary(filename,(char*)ae->mem[ae->save[is].ibank]+offset,size);
@@ -6298,7 +7068,6 @@ void PopAllExpression(struct s_assenv *ae, int crunched_zone)
 	#undef FUNC
 	#define FUNC "PopAllExpression"
 	
-	static int first=1;
 	double v;
 	long r;
 	int i;
@@ -6322,16 +7091,16 @@ void PopAllExpression(struct s_assenv *ae, int crunched_zone)
 	} else {
 		/* on rescanne tout pour combler les trous */
 		ae->stage=2;
-		first=1;
+		ae->popfirst=1;
 	}
 	
-	for (i=first;i<ae->ie;i++) {
+	for (i=ae->popfirst;i<ae->ie;i++) {
 		/* first compute only crunched expression (0,1,2,3,...) then (-1) at the end */
 		if (crunched_zone>=0) {
 			/* calcul des expressions en zone crunch */
 			if (ae->expression[i].lz<crunched_zone) continue;
 			if (ae->expression[i].lz>crunched_zone) {
-				first=i;
+				ae->popfirst=i;
 				break;
 			}
 		} else {
@@ -6442,27 +7211,24 @@ void PopAllExpression(struct s_assenv *ae, int crunched_zone)
 	}
 }
 
-void InsertLabelToTree(struct s_assenv *ae, struct s_label *label)
+void InsertLabelToTable(struct s_assenv *ae, struct s_label *label)
 {
 	#undef FUNC
-	#define FUNC "InsertLabelToTree"
+	#define FUNC "InsertLabelToTable"
 
-	struct s_crclabel_tree *curlabeltree;
-	int radix,dek=32;
+	struct s_symbol_slot *slot;
+	struct s_label *newlabel;
+	char *name;
 
-	curlabeltree=&ae->labeltree;
-	while (dek) {
-		dek=dek-8;
-		radix=(label->crc>>dek)&0xFF;
-		if (curlabeltree->radix[radix]) {
-			curlabeltree=curlabeltree->radix[radix];
-		} else {
-			curlabeltree->radix[radix]=MemMalloc(sizeof(struct s_crclabel_tree));
-			curlabeltree=curlabeltree->radix[radix];
-			memset(curlabeltree,0,sizeof(struct s_crclabel_tree));
-		}
+	newlabel=ArenaAlloc(&ae->arena,sizeof(struct s_label));
+	*newlabel=*label;
+	name=label->name?label->name:ae->wl[label->iw].w;
+	slot=SymbolTableInsert(&ae->arena,&ae->labeltable,name,SymbolHash(name),newlabel);
+	/* local and generated names are interned, the caller copy is released */
+	if (label->name) {
+		MemFree(label->name);
+		label->name=newlabel->name=slot->name;
 	}
-	ObjectArrayAddDynamicValueConcat((void**)&curlabeltree->label,&curlabeltree->nlabel,&curlabeltree->mlabel,&label[0],sizeof(struct s_label));
 }
 
 /* use by structure mechanism and label import to add fake labels */
@@ -6478,8 +7244,8 @@ void PushLabelLight(struct s_assenv *ae, struct s_label *curlabel) {
 		MemFree(curlabel->name);
 	} else {
 		curlabel->backidx=ae->il;
+		InsertLabelToTable(ae,curlabel);
 		ObjectArrayAddDynamicValueConcat((void **)&ae->label,&ae->il,&ae->ml,curlabel,sizeof(struct s_label));
-		InsertLabelToTree(ae,curlabel);
 	}				
 }
 void PushLabel(struct s_assenv *ae)
@@ -6692,8 +7458,8 @@ void PushLabel(struct s_assenv *ae)
 		curlabel.fileline=ae->wl[ae->idx].l;
 		curlabel.autorise_export=ae->autorise_export;
 		curlabel.backidx=ae->il;
+		InsertLabelToTable(ae,&curlabel);
 		ObjectArrayAddDynamicValueConcat((void **)&ae->label,&ae->il,&ae->ml,&curlabel,sizeof(curlabel));
-		InsertLabelToTree(ae,&curlabel);
 	}
 
 	if (!touched) MemFree(varbuffer);
@@ -9016,7 +9782,12 @@ void _DEFS(struct s_assenv *ae) {
 			if (r<0) {
 				MakeError(ae,GetCurrentFile(ae),ae->wl[ae->idx].l,"DEFS size must be greater or equal to zero\n");
 			}
-			for (i=0;i<r;i++) {
+			if (r>0 && !ae->nocode && StringIsByteLiteral(ae->wl[ae->idx+1].w)) {
+				/* constant filler, no expression to resolve */
+				v=RoundComputeExpressionCore(ae,ae->wl[ae->idx+1].w,ae->codeadr,0);
+				___output_fill(ae,v,r);
+				ae->nop+=r;
+			} else for (i=0;i<r;i++) {
 				/* keep flexibility */
 				PushExpression(ae,ae->idx+1,E_EXPRESSION_0V8);
 				ae->nop+=1;
@@ -9028,17 +9799,16 @@ void _DEFS(struct s_assenv *ae) {
 			v=0;
 			if (r<0) {
 				MakeError(ae,GetCurrentFile(ae),ae->wl[ae->idx].l,"DEFS size must be greater or equal to zero\n");
-			}
-			for (i=0;i<r;i++) {
-				___output(ae,v);
-				ae->nop+=1;
+			} else {
+				___output_fill(ae,v,r);
+				ae->nop+=r;
 			}
 		}
 	} while (!ae->wl[ae->idx].t);
 }
 
 void _DEFS_struct(struct s_assenv *ae) {
-	int i,r,v;
+	int r,v;
 	if (ae->wl[ae->idx].t) {
 		MakeError(ae,GetCurrentFile(ae),ae->wl[ae->idx].l,"Syntax is DEFS repeat,value or DEFS repeat\n");
 	} else do {
@@ -9050,10 +9820,9 @@ void _DEFS_struct(struct s_assenv *ae) {
 			v=RoundComputeExpressionCore(ae,ae->wl[ae->idx+1].w,ae->codeadr,0);
 			if (r<0) {
 				MakeError(ae,GetCurrentFile(ae),ae->wl[ae->idx].l,"DEFS size must be greater or equal to zero\n");
-			}
-			for (i=0;i<r;i++) {
-				___output(ae,v);
-				ae->nop+=1;
+			} else {
+				___output_fill(ae,v,r);
+				ae->nop+=r;
 			}
 			ae->idx++;
 		} else if (ae->wl[ae->idx].t==1) {
@@ -9062,10 +9831,9 @@ void _DEFS_struct(struct s_assenv *ae) {
 			v=0;
 			if (r<0) {
 				MakeError(ae,GetCurrentFile(ae),ae->wl[ae->idx].l,"DEFS size must be greater or equal to zero\n");
-			}
-			for (i=0;i<r;i++) {
-				___output(ae,v);
-				ae->nop+=1;
+			} else {
+				___output_fill(ae,v,r);
+				ae->nop+=r;
 			}
 		}
 	} while (!ae->wl[ae->idx].t);
@@ -9613,6 +10381,33 @@ void __LZEXO(struct s_assenv *ae) {
 	ae->lz=ae->ilz;
 	ObjectArrayAddDynamicValueConcat((void**)&ae->lzsection,&ae->ilz,&ae->mlz,&curlz,sizeof(curlz));
 }
+void __LZAPU(struct s_assenv *ae) {
+	struct s_lz_section curlz;
+	
+	if (!ae->wl[ae->idx].t) {
+		MakeError(ae,GetCurrentFile(ae),ae->wl[ae->idx].l,"LZ directive does not need any parameter\n");
+		return;
+	}
+	#ifdef NO_3RD_PARTIES
+		MakeError(ae,GetCurrentFile(ae),ae->wl[ae->idx].l,"Cannot use 3rd parties cruncher with this version of RASM\n",GetCurrentFile(ae),ae->wl[ae->idx].l);
+		FreeAssenv(ae);
+		exit(-5);
+	#endif
+	
+	if (ae->lz>=0 && ae->lz<ae->ilz) {
+		MakeError(ae,GetCurrentFile(ae),ae->wl[ae->idx].l,"Cannot start a new LZ section inside another one (%d)\n",GetCurrentFile(ae),ae->wl[ae->idx].l,ae->lz);
+		FreeAssenv(ae);
+		exit(-5);
+	}
+	curlz.iw=ae->idx;
+	curlz.iorgzone=ae->io-1;
+	curlz.ibank=ae->activebank;
+	curlz.memstart=ae->outputadr;
+	curlz.memend=-1;
+	curlz.lzversion=17;
+	ae->lz=ae->ilz;
+	ObjectArrayAddDynamicValueConcat((void**)&ae->lzsection,&ae->ilz,&ae->mlz,&curlz,sizeof(curlz));
+}
 void __LZ48(struct s_assenv *ae) {
 	struct s_lz_section curlz;
 
@@ -10001,8 +10796,10 @@ void __CHARSET(struct s_assenv *ae) {
 
 void __MACRO(struct s_assenv *ae) {
 	struct s_macro curmacro={0};
+	struct s_macro_slot slot;
 	char *referentfilename,*zeparam;
 	int refidx,idx,getparam=1;
+	int i,iw,generic;
 	struct s_wordlist curwl;
 	
 	if (!ae->wl[ae->idx].t && ae->wl[ae->idx+1].t!=2) {
@@ -10051,6 +10848,28 @@ void __MACRO(struct s_assenv *ae) {
 		if (ae->wl[idx].t==2) {
 			MakeError(ae,GetCurrentFile(ae),ae->wl[ae->idx].l,"Macro was not closed\n");
 		}
+		/* parameter slots, without brackets (AS80) or with bracket in names every word is replaced the old way */
+		if (curmacro.nbparam) {
+			for (i=0;i<curmacro.nbparam;i++) {
+				if (ae->as80 || strpbrk(curmacro.param[i]+1,"{}")!=curmacro.param[i]+strlen(curmacro.param[i])-1) break;
+			}
+			generic=i<curmacro.nbparam;
+			for (iw=0;iw<curmacro.nbword;iw++) {
+				slot.iw=iw;
+				if (generic || (StringIsQuote(curmacro.wc[iw].w) && strchr(curmacro.wc[iw].w,'{'))) {
+					/* tags inside quotes are uppercased during the replacement */
+					slot.iparam=-1;
+					ObjectArrayAddDynamicValueConcat((void**)&curmacro.slot,&curmacro.islot,&curmacro.mslot,&slot,sizeof(slot));
+				} else if (strchr(curmacro.wc[iw].w,'{')) {
+					for (i=0;i<curmacro.nbparam;i++) {
+						if (strstr(curmacro.wc[iw].w,curmacro.param[i])) {
+							slot.iparam=i;
+							ObjectArrayAddDynamicValueConcat((void**)&curmacro.slot,&curmacro.islot,&curmacro.mslot,&slot,sizeof(slot));
+						}
+					}
+				}
+			}
+		}
 		ObjectArrayAddDynamicValueConcat((void**)&ae->macro,&ae->imacro,&ae->mmacro,&curmacro,sizeof(curmacro));
 		/* le quicksort n'est pas optimal mais on n'est pas suppos en crer des milliers */
 		qsort(ae->macro,ae->imacro,sizeof(struct s_macro),cmpmacros);
@@ -10063,10 +10882,16 @@ void __MACRO(struct s_assenv *ae) {
 	}
 }
 
+/*
+	the call stays in place and links to the expansion appended after the program words,
+	the expansion links back to the word following the call. Nothing is moved so a call
+	costs the size of the macro, a repeated call follows the link to the same expansion
+*/
 struct s_wordlist *__MACRO_EXECUTE(struct s_assenv *ae, int imacro) {
-	struct s_wordlist *cpybackup;
-	int nbparam=0,idx,i,j,idad;
+	struct s_macro_slot *slot;
+	int nbparam=0,idx,i,j,is;
 	int ifile,iline,iu,lenparam;
+	int ibody,nbbody,generic,lastiw;
 	double v;
 	struct s_macro_position curmacropos={0};
 	char *zeparam=NULL,*txtparamlist;
@@ -10123,12 +10948,6 @@ struct s_wordlist *__MACRO_EXECUTE(struct s_assenv *ae, int imacro) {
 			}
 			ae->idx++;
 		} else {
-			/* free macro call as we will overwrite it */
-			MemFree(ae->wl[ae->idx].w);
-			/* is there a void to free? */
-			if (reload) {
-				MemFree(ae->wl[ae->idx+1].w);
-			}
 			/* eval parameters? */
 			for (i=0;i<nbparam;i++) {
 				if (strncmp(ae->wl[ae->idx+1+i].w,"{EVAL}",6)==0) {
@@ -10144,71 +10963,68 @@ struct s_wordlist *__MACRO_EXECUTE(struct s_assenv *ae, int imacro) {
 					ae->wl[ae->idx+1+i].w=zeparam;
 				}
 			}
-			/* backup parameters */
-			cpybackup=MemMalloc((nbparam+1)*sizeof(struct s_wordlist));
-			for (i=0;i<nbparam;i++) {
-				cpybackup[i]=ae->wl[ae->idx+1+i];
+			/* append the expansion and its return link */
+			nbbody=ae->macro[imacro].nbword;
+			ibody=ae->nbword;
+			if (ibody+nbbody+1>ae->maxword) {
+				ae->maxword=(ibody+nbbody+1)*2;
+				ae->wl=MemRealloc(ae->wl,ae->maxword*sizeof(struct s_wordlist));
+			}
+			iline=ae->wl[ae->idx].l;
+			ifile=ae->wl[ae->idx].ifile;
+			for (i=0;i<nbbody;i++) {
+				ae->wl[ibody+i].w=TxtStrDup(ae->macro[imacro].wc[i].w);
+				ae->wl[ibody+i].l=iline;
+				ae->wl[ibody+i].ifile=ifile;
+				/* @@@sujet a evolution, ou double controle */
+				ae->wl[ibody+i].t=ae->macro[imacro].wc[i].t;
+				ae->wl[ibody+i].e=ae->macro[imacro].wc[i].e;
+				ae->wl[ibody+i].link=0;
 			}
+			ae->wl[ibody+nbbody].w=TxtStrDup("MEND");
+			ae->wl[ibody+nbbody].l=iline;
+			ae->wl[ibody+nbbody].ifile=ifile;
+			ae->wl[ibody+nbbody].t=1;
+			ae->wl[ibody+nbbody].e=0;
+			ae->wl[ibody+nbbody].link=ae->idx+1+nbparam+reload;
+			ae->nbword+=nbbody+1;
+			ae->wl[ae->idx].link=ibody;
+
 			/* insert macro position */
-			curmacropos.start=ae->idx;
-			curmacropos.end=ae->idx+ae->macro[imacro].nbword;
+			curmacropos.start=ibody;
+			curmacropos.end=ibody+nbbody;
 			curmacropos.value=ae->macrocounter;
 			ObjectArrayAddDynamicValueConcat((void**)&ae->macropos,&ae->imacropos,&ae->mmacropos,&curmacropos,sizeof(curmacropos));
 			
 			/* are we in a repeat/while block? */
 			for (iu=0;iu<ae->ir;iu++) if (ae->repeat[iu].maxim<ae->imacropos) ae->repeat[iu].maxim=ae->imacropos;
 			for (iu=0;iu<ae->iw;iu++) if (ae->whilewend[iu].maxim<ae->imacropos) ae->whilewend[iu].maxim=ae->imacropos;
-			
-			/* update daddy macropos */
-			for (idad=0;idad<ae->imacropos-1;idad++) {
-				if (ae->macropos[idad].end>curmacropos.start) {
-					ae->macropos[idad].end+=ae->macro[imacro].nbword-1-nbparam-reload; /* coz la macro compte un mot! */
-				}
-			}
-			
-	#if 0
-			for (idad=0;idad<ae->imacropos;idad++) {
-				printf("macropos[%d]=%d -> %d\n",idad,ae->macropos[idad].start,ae->macropos[idad].end);
-			}
-	#endif		
-			/* insert at macro position and replace macro+parameters */
-			if (ae->macro[imacro].nbword>1+nbparam+reload) {
-				ae->nbword+=ae->macro[imacro].nbword-1-nbparam-reload;
-				ae->wl=MemRealloc(ae->wl,ae->nbword*sizeof(struct s_wordlist));
-			} else {
-				/* si on rduit pas de realloc pour ne pas perdre de donnees */
-				ae->nbword+=ae->macro[imacro].nbword-1-nbparam-reload;
-			}
-			iline=ae->wl[ae->idx].l;
-			ifile=ae->wl[ae->idx].ifile;
-			MemMove(&ae->wl[ae->idx+ae->macro[imacro].nbword],&ae->wl[ae->idx+reload+nbparam+1],(ae->nbword-ae->idx-ae->macro[imacro].nbword)*sizeof(struct s_wordlist));
 
-			for (i=0;i<ae->macro[imacro].nbword;i++) {
-				ae->wl[i+ae->idx].w=TxtStrDup(ae->macro[imacro].wc[i].w);
-				ae->wl[i+ae->idx].l=iline;
-				ae->wl[i+ae->idx].ifile=ifile;
-				/* @@@sujet a evolution, ou double controle */
-				ae->wl[i+ae->idx].t=ae->macro[imacro].wc[i].t;
-				ae->wl[i+ae->idx].e=ae->macro[imacro].wc[i].e;
-			}
-			/* replace */
-			idx=ae->idx;
+			/* replace parameters in the slots, a bracket in a value may build another tag so every parameter is tried in turn */
+			generic=0;
 			for (i=0;i<nbparam;i++) {
-				for (j=idx;j<idx+ae->macro[imacro].nbword;j++) {
-					/* tags in upper case for replacement in quotes */
-					if (StringIsQuote(ae->wl[j].w)) {
-						int lm,touched;
-						for (lm=touched=0;ae->wl[j].w[lm];lm++) {
-							if (ae->wl[j].w[lm]=='{') touched++; else if (ae->wl[j].w[lm]=='}') touched--; else if (touched) ae->wl[j].w[lm]=toupper(ae->wl[j].w[lm]);
+				if (strpbrk(ae->wl[ae->idx+1+i].w,"{}")) generic=1;
+			}
+			slot=ae->macro[imacro].slot;
+			for (is=0,lastiw=-1;is<ae->macro[imacro].islot && nbparam;is++) {
+				j=ibody+slot[is].iw;
+				if (slot[is].iparam==-1 || generic) {
+					if (slot[is].iw==lastiw) continue;
+					for (i=0;i<nbparam;i++) {
+						/* tags in upper case for replacement in quotes */
+						if (StringIsQuote(ae->wl[j].w)) {
+							int lm,touched;
+							for (lm=touched=0;ae->wl[j].w[lm];lm++) {
+								if (ae->wl[j].w[lm]=='{') touched++; else if (ae->wl[j].w[lm]=='}') touched--; else if (touched) ae->wl[j].w[lm]=toupper(ae->wl[j].w[lm]);
+							}
 						}
+						ae->wl[j].w=TxtReplace(ae->wl[j].w,ae->macro[imacro].param[i],ae->wl[ae->idx+1+i].w,0);
 					}
-					ae->wl[j].w=TxtReplace(ae->wl[j].w,ae->macro[imacro].param[i],cpybackup[i].w,0);
+				} else {
+					ae->wl[j].w=TxtReplace(ae->wl[j].w,ae->macro[imacro].param[slot[is].iparam],ae->wl[ae->idx+1+slot[is].iparam].w,0);
 				}
-				MemFree(cpybackup[i].w);
+				lastiw=slot[is].iw;
 			}
-			MemFree(cpybackup);
-			/* macro replaced, need to rollback index */
-			//ae->idx--;
 		}
 	}
 	/* a chaque appel de macro on incremente le compteur pour les labels locaux */
@@ -11302,9 +12118,9 @@ void ___org_new(struct s_assenv *ae, int nocode) {
 	orgzone.nocode=ae->nocode=nocode;
 
 	if (nocode) {
-		___output=___internal_output_nocode;
+		ae->output=___internal_output_nocode;
 	} else {
-		___output=___internal_output;
+		ae->output=___internal_output;
 	}
 	
 	ObjectArrayAddDynamicValueConcat((void**)&ae->orgzone,&ae->io,&ae->mo,&orgzone,sizeof(orgzone));
@@ -11398,11 +12214,11 @@ void __STRUCT(struct s_assenv *ae) {
 					ae->idx++;
 					
 					/* wrapper for data capture */
-					instruction[ICRC_DEFB].makemnemo=_DEFB_struct;instruction[ICRC_DB].makemnemo=_DEFB_struct;
-					instruction[ICRC_DEFW].makemnemo=_DEFW_struct;instruction[ICRC_DW].makemnemo=_DEFW_struct;
-					instruction[ICRC_DEFI].makemnemo=_DEFI_struct;
-					instruction[ICRC_DEFR].makemnemo=_DEFR_struct;instruction[ICRC_DR].makemnemo=_DEFR_struct;
-					instruction[ICRC_DEFS].makemnemo=_DEFS_struct;instruction[ICRC_DS].makemnemo=_DEFS_struct;
+					ae->makemnemo[ICRC_DEFB]=_DEFB_struct;ae->makemnemo[ICRC_DB]=_DEFB_struct;
+					ae->makemnemo[ICRC_DEFW]=_DEFW_struct;ae->makemnemo[ICRC_DW]=_DEFW_struct;
+					ae->makemnemo[ICRC_DEFI]=_DEFI_struct;
+					ae->makemnemo[ICRC_DEFR]=_DEFR_struct;ae->makemnemo[ICRC_DR]=_DEFR_struct;
+					ae->makemnemo[ICRC_DEFS]=_DEFS_struct;ae->makemnemo[ICRC_DS]=_DEFS_struct;
 				}
 			} else {
 				MakeError(ae,GetCurrentFile(ae),ae->wl[ae->idx].l,"STRUCT cannot be declared inside previous opened STRUCT [%s] Line %d\n",ae->backup_filename,ae->backup_line);
@@ -11580,9 +12396,7 @@ printf("struct (almost) legacy filler from %d to %d-1\n",localsize,ae->rasmstruc
 						cursize+=ae->rasmstruct[irs].rasmstructfield[i].size;
 					}
 					for (;i<ae->rasmstruct[irs].irasmstructfield;i++) {
-						for (j=0;j<ae->rasmstruct[irs].rasmstructfield[i].idata;j++) {
-							___output(ae,ae->rasmstruct[irs].rasmstructfield[i].data[j]);
-						}
+						___output_block(ae,ae->rasmstruct[irs].rasmstructfield[i].data,ae->rasmstruct[irs].rasmstructfield[i].idata);
 					}
 					nbelem--;
 				}
@@ -11635,16 +12449,16 @@ void __ENDSTRUCT(struct s_assenv *ae) {
 
 			/* unwrap data capture */
 			if (ae->as80==1) {/* not for UZ80 */
-				instruction[ICRC_DEFB].makemnemo=_DEFB_as80;instruction[ICRC_DB].makemnemo=_DEFB_as80;
-				instruction[ICRC_DEFW].makemnemo=_DEFW_as80;instruction[ICRC_DW].makemnemo=_DEFW_as80;
-				instruction[ICRC_DEFI].makemnemo=_DEFI_as80;
+				ae->makemnemo[ICRC_DEFB]=_DEFB_as80;ae->makemnemo[ICRC_DB]=_DEFB_as80;
+				ae->makemnemo[ICRC_DEFW]=_DEFW_as80;ae->makemnemo[ICRC_DW]=_DEFW_as80;
+				ae->makemnemo[ICRC_DEFI]=_DEFI_as80;
 			} else {
-				instruction[ICRC_DEFB].makemnemo=_DEFB;instruction[ICRC_DB].makemnemo=_DEFB;
-				instruction[ICRC_DEFW].makemnemo=_DEFW;instruction[ICRC_DW].makemnemo=_DEFW;
-				instruction[ICRC_DEFI].makemnemo=_DEFI;
+				ae->makemnemo[ICRC_DEFB]=_DEFB;ae->makemnemo[ICRC_DB]=_DEFB;
+				ae->makemnemo[ICRC_DEFW]=_DEFW;ae->makemnemo[ICRC_DW]=_DEFW;
+				ae->makemnemo[ICRC_DEFI]=_DEFI;
 			}
-			instruction[ICRC_DEFR].makemnemo=_DEFR;instruction[ICRC_DR].makemnemo=_DEFR;
-			instruction[ICRC_DEFS].makemnemo=_DEFS;instruction[ICRC_DS].makemnemo=_DEFS;
+			ae->makemnemo[ICRC_DEFR]=_DEFR;ae->makemnemo[ICRC_DR]=_DEFR;
+			ae->makemnemo[ICRC_DEFS]=_DEFS;ae->makemnemo[ICRC_DS]=_DEFS;
 
 			/* like there was no byte */
 			ae->outputadr=ae->backup_outputadr;
@@ -11666,7 +12480,6 @@ void __MEMSPACE(struct s_assenv *ae) {
 	}
 }
 
-int (*_internal_getsample)(unsigned char *data, int *idx);
 #undef FUNC
 #define FUNC "_internal_AudioGetSampleValue"
 
@@ -11702,8 +12515,7 @@ int _isLittleEndian() /* from lz4.h */
     return one.c[0];
 }
 
-unsigned char * __internal_floatinversion(unsigned char *data) {
-	static unsigned char bswap[4];
+unsigned char * __internal_floatinversion(unsigned char *data, unsigned char *bswap) {
 	bswap[0]=data[3];
 	bswap[1]=data[2];
 	bswap[2]=data[1];
@@ -11720,9 +12532,10 @@ int __internal_getsample32bigbig(unsigned char *data, int *idx) {
 	return cursample;
 }
 int __internal_getsample32biglittle(unsigned char *data, int *idx) {
+	unsigned char bswap[4];
 	float fsample;
 	int cursample;
-	fsample=*((float*)(__internal_floatinversion(data+*idx)));
+	fsample=*((float*)(__internal_floatinversion(data+*idx,bswap)));
 	*idx=*idx+4;
 	cursample=(floor)((fsample+1.0)*127.5+0.5);
 	return cursample;
@@ -11744,9 +12557,12 @@ void _AudioLoadSample(struct s_assenv *ae, unsigned char *data, int filesize, en
 	double accumulator;
 	unsigned char samplevalue=0, sampleprevious=0;
 	int samplerepeat=0,ipause;
+	unsigned char *buffer;
+	int ibuffer=0;
 
 	unsigned char *subchunk;
 	int subchunksize;
+	int (*_internal_getsample)(unsigned char *data, int *idx)=NULL;
 
 	if (filesize<sizeof(struct s_wav_header)) {
 		MakeError(ae,GetCurrentFile(ae),ae->wl[ae->idx].l,"WAV import - this file is too small to be a valid WAV!\n");
@@ -11838,6 +12654,8 @@ printf("nbsample=%d (sze=%d,chn=%d,bps=%d) st=%c\n",nbsample,controlsize,nbchann
 #endif
 	
 	idx=subchunk-data;
+	/* samples are converted in a buffer then output at once, DMA may emit up to 4 bytes per sample */
+	buffer=MemMalloc(nbsample*4+16);
 	switch (sample_type) {
 		default:
 		case AUDIOSAMPLE_SMP:
@@ -11854,7 +12672,7 @@ printf("nbsample=%d (sze=%d,chn=%d,bps=%d) st=%c\n",nbsample,controlsize,nbchann
 				samplevalue=ae->psgfine[cursample];
 				
 				/* output */
-				___output(ae,samplevalue);
+				buffer[ibuffer++]=samplevalue;
 			}
 			break;
 		case AUDIOSAMPLE_SM2:
@@ -11873,7 +12691,7 @@ printf("nbsample=%d (sze=%d,chn=%d,bps=%d) st=%c\n",nbsample,controlsize,nbchann
 				}
 				
 				/* output */
-				___output(ae,samplevalue);
+				buffer[ibuffer++]=samplevalue;
 			}
 			break;
 		case AUDIOSAMPLE_SM4:
@@ -11899,7 +12717,7 @@ printf("nbsample=%d (sze=%d,chn=%d,bps=%d) st=%c\n",nbsample,controlsize,nbchann
 					samplevalue=(samplevalue<<2)+(ae->psgtab[cursample]>>2);
 				}
 				/* output */
-				___output(ae,samplevalue);
+				buffer[ibuffer++]=samplevalue;
 			}
 			break;
 		case AUDIOSAMPLE_DMA:
@@ -11921,16 +12739,16 @@ printf("nbsample=%d (sze=%d,chn=%d,bps=%d) st=%c\n",nbsample,controlsize,nbchann
 				} else {
 					if (!samplerepeat) {
 						/* DMA output */
-						___output(ae,sampleprevious);
-						___output(ae,0x0A); /* volume canal C */
+						buffer[ibuffer++]=sampleprevious;
+						buffer[ibuffer++]=0x0A; /* volume canal C */
 					} else {
 						/* DMA pause */
-						___output(ae,sampleprevious);
-						___output(ae,0x0A); /* volume canal C */
+						buffer[ibuffer++]=sampleprevious;
+						buffer[ibuffer++]=0x0A; /* volume canal C */
 						while (samplerepeat) {
 							ipause=samplerepeat<4096?samplerepeat:4095;
-							___output(ae,ipause&0xFF);
-							___output(ae,0x10 | ((ipause>>8) &0xF)); /* pause */
+							buffer[ibuffer++]=ipause&0xFF;
+							buffer[ibuffer++]=0x10 | ((ipause>>8) &0xF); /* pause */
 							
 							samplerepeat-=4096;
 							if (samplerepeat<0) samplerepeat=0;
@@ -11941,23 +12759,25 @@ printf("nbsample=%d (sze=%d,chn=%d,bps=%d) st=%c\n",nbsample,controlsize,nbchann
 			}
 			if (samplerepeat) {
 				/* DMA pause */
-				___output(ae,sampleprevious);
-				___output(ae,0x0A); /* volume canal C */
+				buffer[ibuffer++]=sampleprevious;
+				buffer[ibuffer++]=0x0A; /* volume canal C */
 				while (samplerepeat) {
 					ipause=samplerepeat<4096?samplerepeat:4095;
-					___output(ae,ipause&0xFF);
-					___output(ae,0x10 | ((ipause>>8) &0xF)); /* pause */
+					buffer[ibuffer++]=ipause&0xFF;
+					buffer[ibuffer++]=0x10 | ((ipause>>8) &0xF); /* pause */
 					
 					samplerepeat-=4096;
 					if (samplerepeat<0) samplerepeat=0;
 				}
 			}
-			___output(ae,0);
-			___output(ae,0x0A); /* volume canal C */
-			___output(ae,0x20);
-			___output(ae,0x40); /* stop or reloop? */
+			buffer[ibuffer++]=0;
+			buffer[ibuffer++]=0x0A; /* volume canal C */
+			buffer[ibuffer++]=0x20;
+			buffer[ibuffer++]=0x40; /* stop or reloop? */
 			break;
 	}
+	___output_block(ae,buffer,ibuffer);
+	MemFree(buffer);
 }
 
 /*
@@ -12144,7 +12964,6 @@ printf(" -> VTILES loading\n");
 			struct s_hexbin *curhexbin;
 			char *newfilename;
 			int lm,touched;
-			unsigned char *newdata=NULL;
 			
 #if TRACE_HEXBIN
 printf("Hexbin -> as only the assembler know how to deal with var,\n");
@@ -12173,55 +12992,9 @@ printf("Hexbin -> surprise! we found the file!\n");
 				}
 				FileReadBinaryClose(newfilename);
 
-				switch (curhexbin->crunch) {
-					#ifndef NO_3RD_PARTIES
-					case 4:
-						newdata=LZ4_crunch(curhexbin->data,curhexbin->datalen,&curhexbin->datalen);
-						MemFree(curhexbin->data);
-						curhexbin->data=newdata;
-						#if TRACE_PREPRO
-						rasm_printf(ae,KVERBOSE"crunched with LZ4 into %d byte(s)\n",curhexbin->datalen);
-						#endif
-						break;
-					case 7:
-						{
-						size_t slzlen;
-						newdata=ZX7_compress(optimize(curhexbin->data, curhexbin->datalen), curhexbin->data, curhexbin->datalen, &slzlen);
-						curhexbin->datalen=slzlen;
-						MemFree(curhexbin->data);
-						curhexbin->data=newdata;
-						#if TRACE_PREPRO
-						rasm_printf(ae,KVERBOSE"crunched with ZX7 into %d byte(s)\n",curhexbin->datalen);
-						#endif
-						}
-						break;
-					case 8:
-						rasm_printf(ae,KWARNING"Exomizer is crunching %.1fkb this may take a while, be patient...\n",curhexbin->datalen/1024.0);
-						newdata=Exomizer_crunch(curhexbin->data,curhexbin->datalen,&curhexbin->datalen);
-						MemFree(curhexbin->data);
-						curhexbin->data=newdata;
-						#if TRACE_PREPRO
-						rasm_printf(ae,KVERBOSE"crunched with Exomizer into %d byte(s)\n",curhexbin->datalen);
-						#endif
-						break;
-					#endif
-					case 48:
-						newdata=LZ48_crunch(curhexbin->data,curhexbin->datalen,&curhexbin->datalen);
-						MemFree(curhexbin->data);
-						curhexbin->data=newdata;
-						#if TRACE_PREPRO
-						rasm_printf(ae,KVERBOSE"crunched with LZ48 into %d byte(s)\n",curhexbin->datalen);
-						#endif
-						break;
-					case 49:
-						newdata=LZ49_crunch(curhexbin->data,curhexbin->datalen,&curhexbin->datalen);
-						MemFree(curhexbin->data);
-						curhexbin->data=newdata;
-						#if TRACE_PREPRO
-						rasm_printf(ae,KVERBOSE"crunched with LZ49 into %d byte(s)\n",curhexbin->datalen);
-						#endif
-						break;
-					default:break;
+				if (curhexbin->crunch) {
+					PushCrunchedFile(ae,curhexbin->data,curhexbin->datalen,curhexbin->crunch,hbinidx);
+					PopAllCrunchedFiles(ae);
 				}
 				deload=1;
 			} else {
@@ -12266,11 +13039,12 @@ printf("taille nulle et offset=%d -> conversion en %d\n",offset,size);
 						MakeError(ae,GetCurrentFile(ae),ae->wl[ae->idx].l,"INCBIN size+offset is greater than filesize\n");
 					} else {
 						if (revert) {
+							unsigned char *reorder;
 							int p;
-							p=size-1;
-							while (p>=0) {
-								___output(ae,ae->hexbin[hbinidx].data[p--]);
-							}
+							reorder=MemMalloc(size);
+							for (p=0;p<size;p++) reorder[p]=ae->hexbin[hbinidx].data[size-1-p];
+							___output_block(ae,reorder,size);
+							MemFree(reorder);
 						} else if (itiles) {
 							/* tiles data reordering */
 							int tx,ty,it,width;
@@ -12278,18 +13052,24 @@ printf("taille nulle et offset=%d -> conversion en %d\n",offset,size);
 							if (size % (tilex*8)) {
 								MakeError(ae,GetCurrentFile(ae),ae->wl[ae->idx].l,"INCBIN ITILES cannot reorder tiles %d bytewidth with file of size %d\n",tilex,size);
 							} else {
+								unsigned char *reorder,*src;
+								int p=0;
+								reorder=MemMalloc(size);
+								src=ae->hexbin[hbinidx].data;
 								it=0;
 								while (it<size) {
-									for (tx=0;tx<tilex;tx++)    ___output(ae,ae->hexbin[hbinidx].data[it+tx+0*tilex]);
-									for (tx=tilex-1;tx>=0;tx--) ___output(ae,ae->hexbin[hbinidx].data[it+tx+1*tilex]);
-									for (tx=0;tx<tilex;tx++)    ___output(ae,ae->hexbin[hbinidx].data[it+tx+3*tilex]);
-									for (tx=tilex-1;tx>=0;tx--) ___output(ae,ae->hexbin[hbinidx].data[it+tx+2*tilex]);
-									for (tx=0;tx<tilex;tx++)    ___output(ae,ae->hexbin[hbinidx].data[it+tx+6*tilex]);
-									for (tx=tilex-1;tx>=0;tx--) ___output(ae,ae->hexbin[hbinidx].data[it+tx+7*tilex]);
-									for (tx=0;tx<tilex;tx++)    ___output(ae,ae->hexbin[hbinidx].data[it+tx+5*tilex]);
-									for (tx=tilex-1;tx>=0;tx--) ___output(ae,ae->hexbin[hbinidx].data[it+tx+4*tilex]);
+									for (tx=0;tx<tilex;tx++)    reorder[p++]=src[it+tx+0*tilex];
+									for (tx=tilex-1;tx>=0;tx--) reorder[p++]=src[it+tx+1*tilex];
+									for (tx=0;tx<tilex;tx++)    reorder[p++]=src[it+tx+3*tilex];
+									for (tx=tilex-1;tx>=0;tx--) reorder[p++]=src[it+tx+2*tilex];
+									for (tx=0;tx<tilex;tx++)    reorder[p++]=src[it+tx+6*tilex];
+									for (tx=tilex-1;tx>=0;tx--) reorder[p++]=src[it+tx+7*tilex];
+									for (tx=0;tx<tilex;tx++)    reorder[p++]=src[it+tx+5*tilex];
+									for (tx=tilex-1;tx>=0;tx--) reorder[p++]=src[it+tx+4*tilex];
 									it+=tilex*8;
 								}
+								___output_block(ae,reorder,size);
+								MemFree(reorder);
 							}
 						} else if (remap) {
 							/* tiles data reordering */
@@ -12300,11 +13080,16 @@ printf("taille nulle et offset=%d -> conversion en %d\n",offset,size);
 							if ((size % remap) || (remap*width>size)) {
 								MakeError(ae,GetCurrentFile(ae),ae->wl[ae->idx].l,"INCBIN REMAP cannot reorder %d columns%s with file of size %d\n",remap,remap>1?"s":"",size);
 							} else {
+								unsigned char *reorder;
+								int p=0;
+								reorder=MemMalloc(size);
 								for (it=0;it<remap;it++) {
 									for (tx=0;tx<width;tx++) {
-										___output(ae,ae->hexbin[hbinidx].data[it+tx*remap]);
+										reorder[p++]=ae->hexbin[hbinidx].data[it+tx*remap];
 									}
 								}
+								___output_block(ae,reorder,size);
+								MemFree(reorder);
 							}
 							
 						} else if (vtiles) {
@@ -12319,27 +13104,27 @@ printf("taille nulle et offset=%d -> conversion en %d\n",offset,size);
 #if TRACE_HEXBIN
 printf("Hexbin -> re-tiling MAP! width=%d\n",width);
 #endif
+								unsigned char *reorder;
+								reorder=MemMalloc(size);
 								for (idx=tilex=tiley=0;idx<size;idx++) {
-									___output(ae,ae->hexbin[hbinidx].data[tilex+tiley*width]);
+									reorder[idx]=ae->hexbin[hbinidx].data[tilex+tiley*width];
 									tiley++;
 									if (tiley>=vtiles) {
 										tiley=0;
 										tilex++;
 									}
 								}
+								___output_block(ae,reorder,size);
+								MemFree(reorder);
 							}
 						} else {
 							/* legacy HEXBIN */
 							if (overwritecheck) {
-								for (idx=offset;idx<size+offset;idx++) {
-									___output(ae,ae->hexbin[hbinidx].data[idx]);
-								}
+								___output_block(ae,ae->hexbin[hbinidx].data+offset,size);
 							} else {
 								___org_close(ae);
 								___org_new(ae,0);
-								for (idx=offset;idx<size+offset;idx++) {
-									___output(ae,ae->hexbin[hbinidx].data[idx]);
-								}
+								___output_block(ae,ae->hexbin[hbinidx].data+offset,size);
 								/* hack to disable overwrite check */
 								ae->orgzone[ae->io-1].nocode=2;
 								___org_close(ae);
@@ -12608,6 +13393,7 @@ struct s_asm_keyword instruction[]={
 {"NAMEBANK",0,__NameBANK},
 {"LIMIT",0,__LIMIT},
 {"LZEXO",0,__LZEXO},
+{"LZAPU",0,__LZAPU},
 {"LZX7",0,__LZX7},
 {"LZ4",0,__LZ4},
 {"LZ48",0,__LZ48},
@@ -12632,6 +13418,125 @@ struct s_asm_keyword instruction[]={
 {"",0,NULL}
 };
 
+/* index of a keyword in instruction[] or -1 */
+int KeywordSearch(char *w, int crc)
+{
+	#undef FUNC
+	#define FUNC "KeywordSearch"
+
+	int ik;
+
+	ik=keywordslot[KEYWORD_HASH(crc)];
+	if (ik!=-1 && instruction[ik].crc==crc && strcmp(instruction[ik].mnemo,w)==0) return ik;
+	return -1;
+}
+
+/*
+ queue the crunch of a LZ section, from a copy as the memory may move before the job is done
+*/
+int PushCrunchedSection(struct s_assenv *ae, int i)
+{
+	#undef FUNC
+	#define FUNC "PushCrunchedSection"
+
+	unsigned char *input_data;
+	int input_size;
+
+	input_size=ae->lzsection[i].memend-ae->lzsection[i].memstart;
+	if (!input_size) {
+		rasm_printf(ae,KWARNING"[%s:%d] Warning: crunched section is empty\n",ae->filename[ae->wl[ae->lzsection[i].iw].ifile],ae->wl[ae->lzsection[i].iw].l);
+		return -1;
+	}
+	input_data=MemMalloc(input_size);
+	memcpy(input_data,ae->mem[ae->lzsection[i].ibank]+ae->lzsection[i].memstart,input_size);
+	return PushCrunchedFile(ae,input_data,input_size,ae->lzsection[i].lzversion,-1);
+}
+/*
+ replace a LZ section with its crunched data then relocate what follows in the same ORG zone
+ the previous sections of the ORG zone are relocated first
+*/
+void RelocateCrunchedSection(struct s_assenv *ae, int i, int *lzjob, char *lzdone)
+{
+	#undef FUNC
+	#define FUNC "RelocateCrunchedSection"
+
+	struct s_rasm_thread *rasm_thread;
+	struct s_label *curlabel;
+	unsigned char *lzdata=NULL;
+	int lzlen=0,lzshift,lzmove,input_size;
+	int iorgzone,ibank,il;
+
+	iorgzone=ae->lzsection[i].iorgzone;
+	ibank=ae->lzsection[i].ibank;
+	for (il=0;il<i;il++) {
+		if (!lzdone[il] && ae->lzsection[il].iorgzone==iorgzone && ae->lzsection[il].ibank==ibank) {
+			RelocateCrunchedSection(ae,il,lzjob,lzdone);
+		}
+	}
+	lzdone[i]=1;
+
+	input_size=ae->lzsection[i].memend-ae->lzsection[i].memstart;
+	if (lzjob[i]>=0) {
+		rasm_thread=WaitCrunchedFile(ae,lzjob[i]);
+		if (!rasm_thread->dataout) {
+			rasm_printf(ae,"Internal error - unknown crunch method %d\n",ae->lzsection[i].lzversion);
+			exit(-12);
+		}
+		lzdata=rasm_thread->dataout;
+		lzlen=rasm_thread->lenout;
+		rasm_thread->dataout=NULL;
+	}
+	//rasm_printf(ae,"lzsection[%d] type=%d start=%04X end=%04X crunched size=%d\n",i,ae->lzsection[i].lzversion,ae->lzsection[i].memstart,ae->lzsection[i].memend,lzlen);
+
+	if (input_size<lzlen) {
+		MakeError(ae,ae->filename[ae->wl[ae->lzsection[i].iw].ifile],ae->wl[ae->lzsection[i].iw].l,"As the LZ section cannot crunch data, Rasm may not guarantee assembled file!\n");
+	}
+
+	lzshift=lzlen-(ae->lzsection[i].memend-ae->lzsection[i].memstart);
+	if (lzshift>0) {
+		MemMove(ae->mem[ae->lzsection[i].ibank]+ae->lzsection[i].memend+lzshift,ae->mem[ae->lzsection[i].ibank]+ae->lzsection[i].memend,65536-ae->lzsection[i].memend-lzshift);
+	} else if (lzshift<0) {
+		lzmove=ae->orgzone[iorgzone].memend-ae->lzsection[i].memend;
+		if (lzmove) {
+			MemMove(ae->mem[ae->lzsection[i].ibank]+ae->lzsection[i].memend+lzshift,ae->mem[ae->lzsection[i].ibank]+ae->lzsection[i].memend,lzmove);
+		}
+	}
+	if (lzdata) {
+		memcpy(ae->mem[ae->lzsection[i].ibank]+ae->lzsection[i].memstart,lzdata,lzlen);
+		MemFree(lzdata);
+	}
+	/*******************************************************************
+	  l a b e l    a n d    e x p r e s s i o n    r e l o c a t i o n
+	*******************************************************************/
+	/* relocate labels in the same ORG zone AND after the current crunched section */
+	il=ae->lzsection[i].ilabel;
+	while (il<ae->il && ae->label[il].iorgzone==iorgzone && ae->label[il].ibank==ibank) {
+		curlabel=SearchLabel(ae,ae->label[il].iw!=-1?ae->wl[ae->label[il].iw].w:ae->label[il].name,ae->label[il].crc);
+		/* CANNOT be NULL */
+		curlabel->ptr+=lzshift;
+		//printf("label [%s] shifte de %d valeur #%04X -> #%04X\n",curlabel->iw!=-1?ae->wl[curlabel->iw].w:curlabel->name,lzshift,curlabel->ptr-lzshift,curlabel->ptr);
+		il++;
+	}
+	/* relocate expressions in the same ORG zone AND after the current crunched section */
+	il=ae->lzsection[i].iexpr;
+	while (il<ae->ie && ae->expression[il].iorgzone==iorgzone && ae->expression[il].ibank==ibank) {
+		ae->expression[il].wptr+=lzshift;
+		ae->expression[il].ptr+=lzshift;
+		//printf("expression [%s] shiftee ptr=#%04X wptr=#%04X\n", ae->expression[il].reference?ae->expression[il].reference:ae->wl[ae->expression[il].iw].w, ae->expression[il].ptr, ae->expression[il].wptr);
+		il++;
+	}
+	/* relocate crunched sections in the same ORG zone AND after the current crunched section */
+	il=i+1;
+	while (il<ae->ilz && ae->lzsection[il].iorgzone==iorgzone && ae->lzsection[il].ibank==ibank) {
+		//rasm_printf(ae,"reloger lzsection[%d] O%d B%d\n",il,ae->lzsection[il].iorgzone,ae->lzsection[il].ibank);
+		ae->lzsection[il].memstart+=lzshift;
+		ae->lzsection[il].memend+=lzshift;
+		il++;
+	}
+	/* relocate current ORG zone */
+	ae->orgzone[iorgzone].memend+=lzshift;
+}
+
 int Assemble(struct s_assenv *ae, unsigned char **dataout, int *lenout, struct s_rasm_info **debug)
 {
 	#undef FUNC
@@ -12641,17 +13546,12 @@ int Assemble(struct s_assenv *ae, unsigned char **dataout, int *lenout, struct s
 	struct s_expression curexp={0};
 	struct s_wordlist *wordlist;
 	struct s_expr_dico curdico={0};
-	struct s_label *curlabel;
 	int icrc,curcrc,i,j,k;
-	unsigned char *lzdata=NULL;
-	int lzlen,lzshift,input_size;
-	size_t slzlen;
-	unsigned char *input_data;
 	struct s_orgzone orgzone={0};
-	int iorgzone,ibank,offset,endoffset;
+	int offset,endoffset;
 	int il,maxrom;
 	char *TMP_filename=NULL;
-	int minmem=65536,maxmem=0,lzmove;
+	int minmem=65536,maxmem=0;
 	char symbol_line[1024];
 	int ifast,executed;
 	/* debug */
@@ -12678,7 +13578,7 @@ printf("*** assembling ***\n");
 	/* default orgzone */
 	orgzone.ibank=BANK_MAX_NUMBER;
 	ObjectArrayAddDynamicValueConcat((void**)&ae->orgzone,&ae->io,&ae->mo,&orgzone,sizeof(orgzone));
-	___output=___internal_output;
+	ae->output=___internal_output;
 	/* init des automates */
 	InitAutomate(ae->AutomateHexa,AutomateHexaDefinition);
 	InitAutomate(ae->AutomateDigit,AutomateDigitDefinition);
@@ -12804,43 +13704,15 @@ printf("*** assembling ***\n");
 	/* add a fictive expression to simplify test when parsing expressions */
 	ObjectArrayAddDynamicValueConcat((void **)&ae->expression,&ae->ie,&ae->me,&curexp,sizeof(curexp));
 	
-	/* compute CRC for keywords and directives */
-	for (icrc=0;instruction[icrc].mnemo[0];icrc++) instruction[icrc].crc=GetCRC(instruction[icrc].mnemo);
-	for (icrc=0;math_keyword[icrc].mnemo[0];icrc++) math_keyword[icrc].crc=GetCRC(math_keyword[icrc].mnemo);
+	/* the shared keyword table is read only, each assembly patches its own dispatch */
+	for (icrc=0;instruction[icrc].mnemo[0];icrc++);
+	ae->makemnemo=MemMalloc(icrc*sizeof(*ae->makemnemo));
+	for (icrc=0;instruction[icrc].mnemo[0];icrc++) ae->makemnemo[icrc]=instruction[icrc].makemnemo;
 
 	if (ae->as80==1) { /* not for UZ80 */
-		for (icrc=0;instruction[icrc].mnemo[0];icrc++) {
-			if (strcmp(instruction[icrc].mnemo,"DEFB")==0 || strcmp(instruction[icrc].mnemo,"DB")==0) {
-				instruction[icrc].makemnemo=_DEFB_as80;
-			} else if (strcmp(instruction[icrc].mnemo,"DEFW")==0 || strcmp(instruction[icrc].mnemo,"DW")==0) {
-				instruction[icrc].makemnemo=_DEFW_as80;
-			} else if (strcmp(instruction[icrc].mnemo,"DEFI")==0) {
-				instruction[icrc].makemnemo=_DEFI_as80;
-			}
-		}
-	}
-	
-	for (icrc=0;instruction[icrc].mnemo[0];icrc++) {
-		/* get indexes for DEF instructions */
-		if (strcmp(instruction[icrc].mnemo,"DEFB")==0) {
-			ICRC_DEFB=icrc;
-		} else if (strcmp(instruction[icrc].mnemo,"DB")==0) {
-			ICRC_DB=icrc;
-		} else if (strcmp(instruction[icrc].mnemo,"DEFW")==0) {
-			ICRC_DEFW=icrc;
-		} else if (strcmp(instruction[icrc].mnemo,"DW")==0) {
-			ICRC_DW=icrc;
-		} else if (strcmp(instruction[icrc].mnemo,"DEFR")==0) {
-			ICRC_DEFR=icrc;
-		} else if (strcmp(instruction[icrc].mnemo,"DR")==0) {
-			ICRC_DR=icrc;
-		} else if (strcmp(instruction[icrc].mnemo,"DEFS")==0) {
-			ICRC_DEFS=icrc;
-		} else if (strcmp(instruction[icrc].mnemo,"DS")==0) {
-			ICRC_DS=icrc;
-		} else if (strcmp(instruction[icrc].mnemo,"DEFI")==0) {
-			ICRC_DEFI=icrc;
-		}
+		ae->makemnemo[ICRC_DEFB]=_DEFB_as80;ae->makemnemo[ICRC_DB]=_DEFB_as80;
+		ae->makemnemo[ICRC_DEFW]=_DEFW_as80;ae->makemnemo[ICRC_DW]=_DEFW_as80;
+		ae->makemnemo[ICRC_DEFI]=_DEFI_as80;
 	}
 	
 	/* Execution des mots clefs */
@@ -12855,7 +13727,13 @@ printf("-loop\n");
 #endif
 	
 	ae->idx=1;
+	ae->iwmacro=ae->nbword;
 	while (wordlist[ae->idx].t!=2) {
+		/* expanded macro call or end of expansion */
+		if (wordlist[ae->idx].link) {
+			ae->idx=wordlist[ae->idx].link;
+			continue;
+		}
 		curcrc=GetCRC(wordlist[ae->idx].w);
 		/*********************
 		 d e b u g   i n f o
@@ -12969,7 +13847,7 @@ printf("-loop\n");
 		}
 		if (ae->imacropos) {
 			/* are we still in a macro? */
-			if (ae->idx>=ae->macropos[0].end) {
+			if (ae->idx<ae->iwmacro) {
 				/* are we out of all repetition blocks? */
 				if (!ae->ir && !ae->iw) {
 					ae->imacropos=0;
@@ -12990,18 +13868,12 @@ printf("-loop\n");
 		  e x e c u t e    i n s t r u c t i o n
 		*****************************************/
 		executed=0;
-		if ((ifast=ae->fastmatch[(int)wordlist[ae->idx].w[0]])!=-1) {
-			while (instruction[ifast].mnemo[0]==wordlist[ae->idx].w[0]) {
-				if (instruction[ifast].crc==curcrc && strcmp(instruction[ifast].mnemo,wordlist[ae->idx].w)==0) {
+		if ((ifast=KeywordSearch(wordlist[ae->idx].w,curcrc))!=-1) {
 #if TRACE_ASSEMBLE
 printf("-> mnemo\n");
 #endif
-					instruction[ifast].makemnemo(ae);
-					executed=1;
-					break;
-				}
-				ifast++;
-			}
+			ae->makemnemo[ifast](ae);
+			executed=1;
 		}
 		/*****************************************
 		       e x e c u t e    m a c r o
@@ -13102,97 +13974,62 @@ printf("crunch if any\n");
 	         c r u n c h   L Z   s e c t i o n s
 	***************************************************/
 	if (!ae->stop || !ae->nberr) {
+		int *lzjob;
+		char *lzexpr,*lzshared,*lzdone;
+
+		lzjob=MemMalloc(sizeof(int)*(ae->ilz+1));
+		lzexpr=MemMalloc(ae->ilz+1);
+		lzshared=MemMalloc(ae->ilz+1);
+		lzdone=MemMalloc(ae->ilz+1);
+		memset(lzexpr,0,ae->ilz+1);
+		memset(lzshared,0,ae->ilz+1);
+		memset(lzdone,0,ae->ilz+1);
+		/* sections with expressions inside must wait for the relocation of the previous sections */
+		for (i=0;i<ae->ie;i++) {
+			if (ae->expression[i].lz>=0 && ae->expression[i].lz<ae->ilz) lzexpr[ae->expression[i].lz]=1;
+		}
+		/* labels outside crunched sections may be used everywhere, the sections before them must be relocated first */
 		for (i=0;i<ae->ilz;i++) {
-			/* compute labels and expression inside crunched blocks */
-			PopAllExpression(ae,i);
-			
-			ae->curlz=i;
-			iorgzone=ae->lzsection[i].iorgzone;
-			ibank=ae->lzsection[i].ibank;
-			input_data=&ae->mem[ae->lzsection[i].ibank][ae->lzsection[i].memstart];
-			input_size=ae->lzsection[i].memend-ae->lzsection[i].memstart;
-//printf("grouik (%d) %s\n",ae->lzsection[i].lzversion,ae->lzsection[i].lzversion==8?"mizou":"");
-			if (!input_size) {
-				rasm_printf(ae,KWARNING"[%s:%d] Warning: crunched section is empty\n",GetCurrentFile(ae),ae->wl[ae->idx].l);
-			} else {
-				switch (ae->lzsection[i].lzversion) {
-					case 7:
-						#ifndef NO_3RD_PARTIES
-						lzdata=ZX7_compress(optimize(input_data, input_size), input_data, input_size, &slzlen);
-						lzlen=slzlen;
-						#endif
-						break;
-					case 4:
-						#ifndef NO_3RD_PARTIES
-						lzdata=LZ4_crunch(input_data,input_size,&lzlen);
-						#endif
-						break;
-					case 8:
-						#ifndef NO_3RD_PARTIES
-						rasm_printf(ae,KWARNING"Exomizer is crunching %.1fkb this may take a while, be patient...\n",input_size/1024.0);
-
-						lzdata=Exomizer_crunch(input_data,input_size,&lzlen);
-						#endif
-						break;
-					case 48:
-						lzdata=LZ48_crunch(input_data,input_size,&lzlen);
-						break;
-					case 49:
-						lzdata=LZ49_crunch(input_data,input_size,&lzlen);
-						break;
-					default:
-						rasm_printf(ae,"Internal error - unknown crunch method %d\n",ae->lzsection[i].lzversion);
-						exit(-12);
+			il=ae->lzsection[i].ilabel;
+			while (il<ae->il && ae->label[il].iorgzone==ae->lzsection[i].iorgzone && ae->label[il].ibank==ae->lzsection[i].ibank) {
+				if (ae->label[il].lz==-1) {
+					lzshared[i]=1;
+					break;
 				}
+				il++;
 			}
-			//rasm_printf(ae,"lzsection[%d] type=%d start=%04X end=%04X crunched size=%d\n",i,ae->lzsection[i].lzversion,ae->lzsection[i].memstart,ae->lzsection[i].memend,lzlen);
-
-			if (input_size<lzlen) {
-				MakeError(ae,ae->filename[ae->wl[ae->lzsection[i].iw].ifile],ae->wl[ae->lzsection[i].iw].l,"As the LZ section cannot crunch data, Rasm may not guarantee assembled file!\n");
+		}
+		/* sections without expression are final, crunch them all right now */
+		for (i=0;i<ae->ilz;i++) {
+			lzjob[i]=-1;
+			if (!lzexpr[i]) {
+				lzjob[i]=PushCrunchedSection(ae,i);
 			}
-
-			lzshift=lzlen-(ae->lzsection[i].memend-ae->lzsection[i].memstart);
-			if (lzshift>0) {
-				MemMove(ae->mem[ae->lzsection[i].ibank]+ae->lzsection[i].memend+lzshift,ae->mem[ae->lzsection[i].ibank]+ae->lzsection[i].memend,65536-ae->lzsection[i].memend-lzshift);
-			} else if (lzshift<0) {
-				lzmove=ae->orgzone[iorgzone].memend-ae->lzsection[i].memend;
-				if (lzmove) {
-					MemMove(ae->mem[ae->lzsection[i].ibank]+ae->lzsection[i].memend+lzshift,ae->mem[ae->lzsection[i].ibank]+ae->lzsection[i].memend,lzmove);
+		}
+		for (i=0;i<ae->ilz;i++) {
+			if (lzexpr[i]) {
+				for (il=0;il<i;il++) {
+					if (!lzdone[il] && (lzshared[il] || (ae->lzsection[il].iorgzone==ae->lzsection[i].iorgzone && ae->lzsection[il].ibank==ae->lzsection[i].ibank))) {
+						RelocateCrunchedSection(ae,il,lzjob,lzdone);
+					}
 				}
 			}
-			memcpy(ae->mem[ae->lzsection[i].ibank]+ae->lzsection[i].memstart,lzdata,lzlen);
-			MemFree(lzdata);
-			/*******************************************************************
-			  l a b e l    a n d    e x p r e s s i o n    r e l o c a t i o n
-			*******************************************************************/
-			/* relocate labels in the same ORG zone AND after the current crunched section */
-			il=ae->lzsection[i].ilabel;
-			while (il<ae->il && ae->label[il].iorgzone==iorgzone && ae->label[il].ibank==ibank) {
-				curlabel=SearchLabel(ae,ae->label[il].iw!=-1?wordlist[ae->label[il].iw].w:ae->label[il].name,ae->label[il].crc);
-				/* CANNOT be NULL */
-				curlabel->ptr+=lzshift;
-				//printf("label [%s] shifte de %d valeur #%04X -> #%04X\n",curlabel->iw!=-1?wordlist[curlabel->iw].w:curlabel->name,lzshift,curlabel->ptr-lzshift,curlabel->ptr);
-				il++;
-			}
-			/* relocate expressions in the same ORG zone AND after the current crunched section */
-			il=ae->lzsection[i].iexpr;
-			while (il<ae->ie && ae->expression[il].iorgzone==iorgzone && ae->expression[il].ibank==ibank) {
-				ae->expression[il].wptr+=lzshift;
-				ae->expression[il].ptr+=lzshift;
-				//printf("expression [%s] shiftee ptr=#%04X wptr=#%04X\n", ae->expression[il].reference?ae->expression[il].reference:wordlist[ae->expression[il].iw].w, ae->expression[il].ptr, ae->expression[il].wptr);
-				il++;
-			}
-			/* relocate crunched sections in the same ORG zone AND after the current crunched section */
-			il=i+1;
-			while (il<ae->ilz && ae->lzsection[il].iorgzone==iorgzone && ae->lzsection[il].ibank==ibank) {
-				//rasm_printf(ae,"reloger lzsection[%d] O%d B%d\n",il,ae->lzsection[il].iorgzone,ae->lzsection[il].ibank);
-				ae->lzsection[il].memstart+=lzshift;
-				ae->lzsection[il].memend+=lzshift;
-				il++;
+			/* compute labels and expression inside crunched blocks */
+			ae->curlz=i;
+			PopAllExpression(ae,i);
+			if (lzexpr[i]) {
+				lzjob[i]=PushCrunchedSection(ae,i);
 			}
-			/* relocate current ORG zone */
-			ae->orgzone[iorgzone].memend+=lzshift;
 		}
+		/* relocation in the sections order */
+		for (i=0;i<ae->ilz;i++) {
+			if (!lzdone[i]) RelocateCrunchedSection(ae,i,lzjob,lzdone);
+		}
+		PopAllCrunchedFiles(ae);
+		MemFree(lzjob);
+		MemFree(lzexpr);
+		MemFree(lzshared);
+		MemFree(lzdone);
 		if (ae->ilz) {
 			/* compute expression placed after the last crunched block */
 			PopAllExpression(ae,ae->ilz);
@@ -13616,12 +14453,12 @@ printf("output files\n");
 									unsigned char *subchunk=NULL;
 									int retidx=0;
 									/* var are part of fast tree search structure */
-									subchunk=SnapshotDicoTree(ae,&retidx);
+									subchunk=SnapshotDicoTable(ae,&retidx);
 									if (retidx) {
 										symbchunk=MemRealloc(symbchunk,idx+retidx);
 										memcpy(symbchunk+idx,subchunk,retidx);
 										idx+=retidx;
-										SnapshotDicoInsert("FREE",0,&retidx);
+										SnapshotDicoInsert(ae,"FREE",0,&retidx);
 									}
 								}
 								if (ae->export_equ) {
@@ -13705,7 +14542,7 @@ printf("output files\n");
 					if (!ae->flux) {
 						rasm_printf(ae,KIO"Write binary file %s (%d byte%s)\n",TMP_filename,maxmem-minmem,maxmem-minmem>1?"s":"");
 						if (ae->amsdos) {
-							AmsdosHeader=MakeAMSDOSHeader(minmem,minmem,maxmem,TMP_filename); //@@TODO
+							AmsdosHeader=MakeAMSDOSHeader(ae,minmem,minmem,maxmem,TMP_filename); //@@TODO
 							FileWriteBinary(TMP_filename,(char *)AmsdosHeader,128);
 						}
 						if (maxmem-minmem>0) {
@@ -13737,8 +14574,8 @@ printf("output files\n");
 					}
 				}
 			}
-			WarnLabelTree(ae);
-			WarnDicoTree(ae);
+			WarnLabelTable(ae);
+			WarnDicoTable(ae);
 		}
 
 		/****************************
@@ -13798,7 +14635,7 @@ printf("output files\n");
 					MAKE_SYMBOL_NAME
 					if (ae->export_var) {
 						/* var are part of fast tree search structure */
-						ExportDicoTree(ae,TMP_filename,"%s %04X");
+						ExportDicoTable(ae,TMP_filename,"%s %04X");
 					}
 					if (ae->export_equ) {
 						for (i=0;i<ae->ialias;i++) {
@@ -13835,7 +14672,7 @@ printf("output files\n");
 					MAKE_SYMBOL_NAME
 					if (ae->export_var) {
 						/* var are part of fast tree search structure */
-						ExportDicoTree(ae,TMP_filename,ae->flexible_export);
+						ExportDicoTable(ae,TMP_filename,ae->flexible_export);
 					}
 					if (ae->export_equ) {
 						for (i=0;i<ae->ialias;i++) {
@@ -13872,7 +14709,7 @@ printf("output files\n");
 					MAKE_SYMBOL_NAME
 					if (ae->export_var) {
 						/* var are part of fast tree search structure */
-						ExportDicoTree(ae,TMP_filename,"%s #%04X\n");
+						ExportDicoTable(ae,TMP_filename,"%s #%04X\n");
 					}
 					if (ae->export_equ) {
 						for (i=0;i<ae->ialias;i++) {
@@ -13909,7 +14746,7 @@ printf("output files\n");
 					MAKE_SYMBOL_NAME
 					if (ae->export_var) {
 						/* var are part of fast tree search structure */
-						ExportDicoTree(ae,TMP_filename,"%s EQU 0%04XH\n");
+						ExportDicoTable(ae,TMP_filename,"%s EQU 0%04XH\n");
 					}
 					if (ae->export_equ) {
 						for (i=0;i<ae->ialias;i++) {
@@ -13946,7 +14783,7 @@ printf("output files\n");
 					MAKE_SYMBOL_NAME
 					if (ae->export_var) {
 						/* var are part of fast tree search structure */
-						ExportDicoTree(ae,TMP_filename,"%s #%X B0\n");
+						ExportDicoTable(ae,TMP_filename,"%s #%X B0\n");
 					}
 					if (ae->export_equ) {
 						for (i=0;i<ae->ialias;i++) {
@@ -14223,6 +15060,289 @@ int cmpkeyword(const void * a, const void * b)
 	return strcmp(sa->mnemo,sb->mnemo);
 }
 
+/* sort keywords, compute their CRC and the DEF indexes once for all the assemblies of the process */
+void _internal_InitKeywordTables(void)
+{
+	#undef FUNC
+	#define FUNC "_internal_InitKeywordTables"
+
+	int icrc,i;
+
+	for (icrc=0;instruction[icrc].mnemo[0];icrc++);
+	qsort(instruction,icrc,sizeof(struct s_asm_keyword),cmpkeyword);
+	for (icrc=0;instruction[icrc].mnemo[0];icrc++) instruction[icrc].crc=GetCRC(instruction[icrc].mnemo);
+	for (icrc=0;math_keyword[icrc].mnemo[0];icrc++) math_keyword[icrc].crc=GetCRC(math_keyword[icrc].mnemo);
+
+	/* perfect hash of the keywords */
+	for (i=0;i<(1<<KEYWORD_HASH_BITS);i++) keywordslot[i]=-1;
+	for (icrc=0;instruction[icrc].mnemo[0];icrc++) {
+		if (keywordslot[KEYWORD_HASH(instruction[icrc].crc)]!=-1) {
+			printf("Internal error - keyword %s collides in the hash, z80table.h must be generated again with z80gen.py\n",instruction[icrc].mnemo);
+			exit(INTERNAL_ERROR);
+		}
+		keywordslot[KEYWORD_HASH(instruction[icrc].crc)]=icrc;
+	}
+
+	for (icrc=0;instruction[icrc].mnemo[0];icrc++) {
+		/* get indexes for DEF instructions */
+		if (strcmp(instruction[icrc].mnemo,"DEFB")==0) {
+			ICRC_DEFB=icrc;
+		} else if (strcmp(instruction[icrc].mnemo,"DB")==0) {
+			ICRC_DB=icrc;
+		} else if (strcmp(instruction[icrc].mnemo,"DEFW")==0) {
+			ICRC_DEFW=icrc;
+		} else if (strcmp(instruction[icrc].mnemo,"DW")==0) {
+			ICRC_DW=icrc;
+		} else if (strcmp(instruction[icrc].mnemo,"DEFR")==0) {
+			ICRC_DEFR=icrc;
+		} else if (strcmp(instruction[icrc].mnemo,"DR")==0) {
+			ICRC_DR=icrc;
+		} else if (strcmp(instruction[icrc].mnemo,"DEFS")==0) {
+			ICRC_DEFS=icrc;
+		} else if (strcmp(instruction[icrc].mnemo,"DS")==0) {
+			ICRC_DS=icrc;
+		} else if (strcmp(instruction[icrc].mnemo,"DEFI")==0) {
+			ICRC_DEFI=icrc;
+		}
+	}
+}
+void InitKeywordTables(void)
+{
+	#undef FUNC
+	#define FUNC "InitKeywordTables"
+
+#ifdef RASM_THREAD
+	static pthread_once_t keyword_once=PTHREAD_ONCE_INIT;
+	pthread_once(&keyword_once,_internal_InitKeywordTables);
+#else
+	static int keyword_init=0;
+	if (!keyword_init) {
+		_internal_InitKeywordTables();
+		keyword_init=1;
+	}
+#endif
+}
+
+/*
+	preprocessing cache (-cache option)
+	
+	the wordlist depends on the whole source (macro names, words merged across lines)
+	so the entry is for the main file, it is used only if every file read is unchanged
+	and every file looked for is still missing, otherwise everything is preprocessed again
+*/
+void CacheAddDependency(struct s_assenv *ae, char *filename, enum e_cachedep_type type, unsigned char *data, int len)
+{
+	#undef FUNC
+	#define FUNC "CacheAddDependency"
+
+	struct s_cachedep curdep;
+
+	if (!ae->cachedir) return;
+	curdep.filename=TxtStrDup(filename);
+	curdep.type=type;
+	curdep.len=len;
+	curdep.hash=data?RasmHash(data,len,RASM_HASH_INIT):0;
+	ObjectArrayAddDynamicValueConcat((void**)&ae->cachedep,&ae->icachedep,&ae->mcachedep,&curdep,sizeof(curdep));
+}
+
+/* read a source file as FileReadLines and keep its hash for the preprocessing cache */
+char **PreProcessingReadLines(struct s_assenv *ae, char *filename)
+{
+	#undef FUNC
+	#define FUNC "PreProcessingReadLines"
+
+	unsigned char *bigbuffer;
+	int file_size;
+
+	bigbuffer=_internal_readbinaryfile(filename,&file_size);
+	CacheAddDependency(ae,filename,E_CACHEDEP_CONTENT,bigbuffer,file_size);
+	return _internal_splittextbuffer(bigbuffer,file_size,':');
+}
+
+/* options changing the preprocessing are part of the key */
+char *PreProcessingCacheName(struct s_assenv *ae, char *filename)
+{
+	#undef FUNC
+	#define FUNC "PreProcessingCacheName"
+
+	unsigned long long hash;
+	int i;
+
+	hash=RasmHash((unsigned char *)RASM_VERSION,strlen(RASM_VERSION),RASM_HASH_INIT);
+	hash=RasmHash((unsigned char *)filename,strlen(filename)+1,hash);
+	hash=RasmHash((unsigned char *)&ae->as80,sizeof(int),hash);
+	for (i=0;i<ae->ipath;i++) hash=RasmHash((unsigned char *)ae->includepath[i],strlen(ae->includepath[i])+1,hash);
+	return CacheEntryName(ae->cachedir,hash,".pre");
+}
+
+void PreProcessingCacheSave(struct s_assenv *ae, char *filename, struct s_wordlist *wordlist, int nbword)
+{
+	#undef FUNC
+	#define FUNC "PreProcessingCacheSave"
+
+	struct s_cachebuffer cb={0};
+	char *entryname;
+	int i;
+
+	CacheBufferWrite(&cb,"RASMPRE1",8);
+	CacheBufferWriteInt(&cb,ae->icachedep);
+	for (i=0;i<ae->icachedep;i++) {
+		CacheBufferWriteString(&cb,ae->cachedep[i].filename);
+		CacheBufferWriteInt(&cb,ae->cachedep[i].type);
+		CacheBufferWriteInt(&cb,ae->cachedep[i].len);
+		CacheBufferWrite(&cb,&ae->cachedep[i].hash,sizeof(unsigned long long));
+	}
+	CacheBufferWriteInt(&cb,ae->ifile);
+	for (i=0;i<ae->ifile;i++) {
+		CacheBufferWriteString(&cb,ae->filename[i]);
+	}
+	/* binaries are read again, only the name and the kind of hexbin are kept */
+	CacheBufferWriteInt(&cb,ae->ih);
+	for (i=0;i<ae->ih;i++) {
+		CacheBufferWriteString(&cb,ae->hexbin[i].filename);
+		CacheBufferWriteInt(&cb,ae->hexbin[i].crunch);
+		CacheBufferWriteInt(&cb,ae->hexbin[i].datalen<0?ae->hexbin[i].datalen:0);
+	}
+	CacheBufferWriteInt(&cb,nbword);
+	for (i=0;i<nbword;i++) {
+		CacheBufferWriteString(&cb,wordlist[i].w);
+		CacheBufferWriteInt(&cb,wordlist[i].l);
+		CacheBufferWriteInt(&cb,wordlist[i].t);
+		CacheBufferWriteInt(&cb,wordlist[i].e);
+		CacheBufferWriteInt(&cb,wordlist[i].ifile);
+	}
+	entryname=PreProcessingCacheName(ae,filename);
+	CacheWriteEntry(entryname,&cb);
+	MemFree(entryname);
+	MemFree(cb.data);
+}
+
+/* check the files the entry depends on */
+int _internal_PreProcessingCacheCheck(struct s_cachebuffer *cb)
+{
+	#undef FUNC
+	#define FUNC "_internal_PreProcessingCacheCheck"
+
+	unsigned long long hash;
+	unsigned char *data;
+	char *depname;
+	int ndep,type,len,filelen,ok=1;
+
+	if (!CacheBufferReadInt(cb,&ndep)) return 0;
+	while (ok && ndep--) {
+		if ((depname=CacheBufferReadString(cb))==NULL) return 0;
+		if (!CacheBufferReadInt(cb,&type) || !CacheBufferReadInt(cb,&len) || !CacheBufferRead(cb,&hash,sizeof(hash))) ok=0;
+		else switch (type) {
+			case E_CACHEDEP_CONTENT:
+				if (!FileExists(depname) || FileGetSize(depname)!=len) {
+					ok=0;
+				} else {
+					data=_internal_readbinaryfile(depname,&filelen);
+					if (RasmHash(data,filelen,RASM_HASH_INIT)!=hash) ok=0;
+					MemFree(data);
+				}
+				break;
+			case E_CACHEDEP_MISSING:if (FileExists(depname)) ok=0;break;
+			case E_CACHEDEP_EXISTS:if (!FileExists(depname)) ok=0;break;
+			default:ok=0;
+		}
+		MemFree(depname);
+	}
+	return ok;
+}
+
+/* return 1 when the wordlist, the files and the hexbins were restored from the cache */
+int PreProcessingCacheLoad(struct s_assenv *ae, char *filename)
+{
+	#undef FUNC
+	#define FUNC "PreProcessingCacheLoad"
+
+	struct s_cachebuffer cb;
+	struct s_wordlist *wordlist=NULL;
+	struct s_hexbin *hexbin=NULL;
+	char **zefile=NULL;
+	char *entryname;
+	char magic[8];
+	int nfile=0,nhexbin=0,nbword=0,i=0,j=0,k=0,ok;
+
+	entryname=PreProcessingCacheName(ae,filename);
+	ok=CacheReadEntry(entryname,&cb);
+	MemFree(entryname);
+	if (!ok) return 0;
+
+	ok=CacheBufferRead(&cb,magic,8) && memcmp(magic,"RASMPRE1",8)==0 && _internal_PreProcessingCacheCheck(&cb);
+	/* read everything before touching the assembly environment */
+	if (ok && CacheBufferReadInt(&cb,&nfile) && nfile>0 && nfile<=cb.len) {
+		zefile=MemMalloc(nfile*sizeof(char *));
+		for (i=0;i<nfile && (zefile[i]=CacheBufferReadString(&cb))!=NULL;i++);
+		ok=i==nfile;
+	} else ok=0;
+	if (ok && CacheBufferReadInt(&cb,&nhexbin) && nhexbin>=0 && nhexbin<=cb.len) {
+		hexbin=MemMalloc((nhexbin+1)*sizeof(struct s_hexbin));
+		for (j=0;j<nhexbin && (hexbin[j].filename=CacheBufferReadString(&cb))!=NULL;j++) {
+			if (!CacheBufferReadInt(&cb,&hexbin[j].crunch) || !CacheBufferReadInt(&cb,&hexbin[j].datalen)
+				|| (hexbin[j].datalen==0 && !FileExists(hexbin[j].filename))) {
+				MemFree(hexbin[j].filename);
+				break;
+			}
+		}
+		ok=j==nhexbin;
+	} else ok=0;
+	if (ok && CacheBufferReadInt(&cb,&nbword) && nbword>0 && nbword<=cb.len) {
+		wordlist=MemMalloc(nbword*sizeof(struct s_wordlist));
+		for (k=0;k<nbword && (wordlist[k].w=CacheBufferReadString(&cb))!=NULL;k++) {
+			wordlist[k].link=0;
+			if (!CacheBufferReadInt(&cb,&wordlist[k].l) || !CacheBufferReadInt(&cb,&wordlist[k].t)
+				|| !CacheBufferReadInt(&cb,&wordlist[k].e) || !CacheBufferReadInt(&cb,&wordlist[k].ifile)
+				|| wordlist[k].ifile<0 || wordlist[k].ifile>=nfile) {
+				MemFree(wordlist[k].w);
+				break;
+			}
+		}
+		ok=k==nbword && cb.pos==cb.len;
+	} else ok=0;
+	MemFree(cb.data);
+
+	if (!ok) {
+		while (i>0) MemFree(zefile[--i]);
+		while (j>0) MemFree(hexbin[--j].filename);
+		while (k>0) MemFree(wordlist[--k].w);
+		if (zefile) MemFree(zefile);
+		if (hexbin) MemFree(hexbin);
+		if (wordlist) MemFree(wordlist);
+		return 0;
+	}
+
+	for (i=0;i<nfile;i++) {
+		FieldArrayAddDynamicValueConcat(&ae->filename,&ae->ifile,&ae->maxfile,zefile[i]);
+		MemFree(zefile[i]);
+	}
+	MemFree(zefile);
+	for (j=0;j<nhexbin;j++) {
+		if (!hexbin[j].datalen) {
+			/* binaries are read and crunched as in the preprocessing */
+			hexbin[j].rawlen=hexbin[j].datalen=FileGetSize(hexbin[j].filename);
+			hexbin[j].data=MemMalloc(hexbin[j].datalen*1.3+10);
+			if (FileReadBinary(hexbin[j].filename,(char*)hexbin[j].data,hexbin[j].datalen)!=hexbin[j].datalen) {
+				rasm_printf(ae,"read error on %s",hexbin[j].filename);
+				exit(2);
+			}
+			FileReadBinaryClose(hexbin[j].filename);
+			if (hexbin[j].crunch) {
+				PushCrunchedFile(ae,hexbin[j].data,hexbin[j].datalen,hexbin[j].crunch,ae->ih);
+			}
+		} else {
+			/* TAG + info */
+			hexbin[j].data=MemMalloc(2);
+		}
+		ObjectArrayAddDynamicValueConcat((void**)&ae->hexbin,&ae->ih,&ae->mh,&hexbin[j],sizeof(struct s_hexbin));
+	}
+	MemFree(hexbin);
+	ae->wl=wordlist;
+	ae->nbword=ae->maxword=nbword;
+	return 1;
+}
+
 struct s_assenv *PreProcessing(char *filename, int flux, const char *datain, int datalen, struct s_parameter *param)
 {
 	#undef FUNC
@@ -14250,7 +15370,6 @@ struct s_assenv *PreProcessing(char *filename, int flux, const char *datain, int
 	char Automate[256]={0};
 	struct s_hexbin curhexbin;
 	char *newlistingline=NULL;
-	unsigned char *newdata;
 	struct s_label curlabel={0};
 	char *labelsep1;
 	char **labelines=NULL;
@@ -14275,8 +15394,7 @@ struct s_assenv *PreProcessing(char *filename, int flux, const char *datain, int
 	int quote_type=0;
 	int incbin=0,include=0,crunch=0;
 	int rewrite=0,hadcomma=0;
-	int nbinstruction;
-	int ifast,texpr;
+	int texpr;
 	int ispace=0;
 
 #if TRACE_GENERALE
@@ -14300,6 +15418,12 @@ printf("malloc\n");
 printf("memset\n");
 #endif
 	memset(ae,0,sizeof(struct s_assenv));
+	ae->fastmaxivar=1;
+	ae->popfirst=1;
+#ifdef RASM_THREAD
+	ae->maxthread=sysconf(_SC_NPROCESSORS_ONLN);
+	if (ae->maxthread<1) ae->maxthread=1;
+#endif
 
 #if TRACE_PREPRO
 printf("paramz 1\n");
@@ -14357,6 +15481,21 @@ printf("paramz 1\n");
 		ae->mpath=param->mpath;
 		/* old inline params */
 		ae->dependencies=param->dependencies;
+		/* preprocessing and crunch cache */
+		if (param->cachedir) {
+			if (!FileExists(param->cachedir)) {
+#ifdef OS_WIN
+				_mkdir(param->cachedir);
+#else
+				mkdir(param->cachedir,0755);
+#endif
+			}
+			if (FileExists(param->cachedir)) {
+				ae->cachedir=param->cachedir;
+			} else {
+				rasm_printf(ae,KWARNING"cannot create cache directory [%s], cache is disabled\n",param->cachedir);
+			}
+		}
 	}
 #if TRACE_PREPRO
 printf("init 0\n");
@@ -14546,10 +15685,7 @@ printf("nbbank=%d initialised\n",ae->nbbank);
 	}
 	
 	if (param) rasm_printf(ae,KAYGREEN"Pre-processing [%s]\n",param->filename);
-	for (nbinstruction=0;instruction[nbinstruction].mnemo[0];nbinstruction++);
-	qsort(instruction,nbinstruction,sizeof(struct s_asm_keyword),cmpkeyword);
-	for (i=0;i<256;i++) { ae->fastmatch[i]=-1; }
-	for (i=0;i<nbinstruction;i++) { if (ae->fastmatch[(int)instruction[i].mnemo[0]]==-1) ae->fastmatch[(int)instruction[i].mnemo[0]]=i; } 
+	InitKeywordTables();
 	for (i=0;CharWord[i];i++) {Automate[((int)CharWord[i])&0xFF]=1;}
 	 /* separators */
 	Automate[' ']=2;
@@ -14577,8 +15713,20 @@ printf("read file/flux\n");
 printf("-read/flux\n");
 #endif
 
+	/* sources unchanged since the last run, the cached wordlist replaces the preprocessing */
+	if (!ae->flux && ae->cachedir && PreProcessingCacheLoad(ae,filename)) {
+		MemFree(bval);
+		MemFree(qval);
+		MemFree(w);
+		if (param) {
+			MemFree(param->filename);
+		}
+		PopAllCrunchedFiles(ae);
+		return ae;
+	}
+
 	if (!ae->flux) {
-		zelines=FileReadLines(filename);
+		zelines=PreProcessingReadLines(ae,filename);
 		FieldArrayAddDynamicValueConcat(&ae->filename,&ae->ifile,&ae->maxfile,filename);
 	} else {
 		int flux_nblines=0;
@@ -14694,10 +15842,13 @@ printf("-comz/include\n");
 					if (FileExists(filename_toread)) {
 						fileok=1;
 					} else {
+						CacheAddDependency(ae,filename_toread,E_CACHEDEP_MISSING,NULL,0);
 						for (ilookfile=0;ilookfile<ae->ipath && !fileok;ilookfile++) {
 							filename_toread=MergePath(ae,ae->includepath[ilookfile],qval);
 							if (FileExists(filename_toread)) {
 								fileok=1;
+							} else {
+								CacheAddDependency(ae,filename_toread,E_CACHEDEP_MISSING,NULL,0);
 							}
 						}
 					}
@@ -14705,6 +15856,7 @@ printf("-comz/include\n");
 					curhexbin.filename=TxtStrDup(filename_toread);
 					curhexbin.crunch=crunch;
 					if (fileok) {
+						CacheAddDependency(ae,filename_toread,E_CACHEDEP_EXISTS,NULL,0);
 						/* lecture */
 						curhexbin.rawlen=curhexbin.datalen=FileGetSize(filename_toread);
 						curhexbin.data=MemMalloc(curhexbin.datalen*1.3+10);
@@ -14714,6 +15866,7 @@ printf("-comz/include\n");
 								case 4:rasm_printf(ae,KBLUE"inclz4 [%s] size=%d\n",filename_toread,curhexbin.datalen);break;
 								case 7:rasm_printf(ae,KBLUE"incsx7 [%s] size=%d\n",filename_toread,curhexbin.datalen);break;
 								case 8:rasm_printf(ae,KBLUE"incexo [%s] size=%d\n",filename_toread,curhexbin.datalen);break;
+								case 17:rasm_printf(ae,KBLUE"incapu [%s] size=%d\n",filename_toread,curhexbin.datalen);break;
 								case 88:rasm_printf(ae,KBLUE"incexb [%s] size=%d\n",filename_toread,curhexbin.datalen);break;
 								case 48:rasm_printf(ae,KBLUE"incl48 [%s] size=%d\n",filename_toread,curhexbin.datalen);break;
 								case 49:rasm_printf(ae,KBLUE"incl49 [%s] size=%d\n",filename_toread,curhexbin.datalen);break;
@@ -14725,55 +15878,9 @@ printf("-comz/include\n");
 							exit(2);
 						}
 						FileReadBinaryClose(filename_toread);
-						switch (crunch) {
-							#ifndef NO_3RD_PARTIES
-							case 4:
-								newdata=LZ4_crunch(curhexbin.data,curhexbin.datalen,&curhexbin.datalen);
-								MemFree(curhexbin.data);
-								curhexbin.data=newdata;
-								#if TRACE_PREPRO
-								rasm_printf(ae,KVERBOSE"crunched with LZ4 into %d byte(s)\n",curhexbin.datalen);
-								#endif
-								break;
-							case 7:
-								{
-								size_t slzlen;
-								newdata=ZX7_compress(optimize(curhexbin.data, curhexbin.datalen), curhexbin.data, curhexbin.datalen, &slzlen);
-								curhexbin.datalen=slzlen;
-								MemFree(curhexbin.data);
-								curhexbin.data=newdata;
-								#if TRACE_PREPRO
-								rasm_printf(ae,KVERBOSE"crunched with ZX7 into %d byte(s)\n",curhexbin.datalen);
-								#endif
-								}
-								break;
-							case 8:
-						rasm_printf(ae,KWARNING"Exomizer is crunching %.1fkb this may take a while, be patient...\n",curhexbin.datalen/1024.0);
-								newdata=Exomizer_crunch(curhexbin.data,curhexbin.datalen,&curhexbin.datalen);
-								MemFree(curhexbin.data);
-								curhexbin.data=newdata;
-								#if TRACE_PREPRO
-								rasm_printf(ae,KVERBOSE"crunched with Exomizer into %d byte(s)\n",curhexbin.datalen);
-								#endif
-								break;
-							#endif
-							case 48:
-								newdata=LZ48_crunch(curhexbin.data,curhexbin.datalen,&curhexbin.datalen);
-								MemFree(curhexbin.data);
-								curhexbin.data=newdata;
-								#if TRACE_PREPRO
-								rasm_printf(ae,KVERBOSE"crunched with LZ48 into %d byte(s)\n",curhexbin.datalen);
-								#endif
-								break;
-							case 49:
-								newdata=LZ49_crunch(curhexbin.data,curhexbin.datalen,&curhexbin.datalen);
-								MemFree(curhexbin.data);
-								curhexbin.data=newdata;
-								#if TRACE_PREPRO
-								rasm_printf(ae,KVERBOSE"crunched into with LZ49 %d byte(s)\n",curhexbin.datalen);
-								#endif
-								break;
-							default:break;
+						if (crunch) {
+							/* crunched while the sources are read, see PopAllCrunchedFiles */
+							PushCrunchedFile(ae,curhexbin.data,curhexbin.datalen,crunch,ae->ih);
 						}
 					} else {
 						/* TAG + info */
@@ -14801,10 +15908,13 @@ printf("-comz/include\n");
 					if (FileExists(filename_toread)) {
 						fileok=1;
 					} else {
+						CacheAddDependency(ae,filename_toread,E_CACHEDEP_MISSING,NULL,0);
 						for (ilookfile=0;ilookfile<ae->ipath && !fileok;ilookfile++) {
 							filename_toread=MergePath(ae,ae->includepath[ilookfile],qval);
 							if (FileExists(filename_toread)) {
 								fileok=1;
+							} else {
+								CacheAddDependency(ae,filename_toread,E_CACHEDEP_MISSING,NULL,0);
 							}
 						}
 					}
@@ -14816,7 +15926,7 @@ printf("-comz/include\n");
 						#endif
 						
 						/* lecture */
-						listing_include=FileReadLines(filename_toread);
+						listing_include=PreProcessingReadLines(ae,filename_toread);
 						FieldArrayAddDynamicValueConcat(&ae->filename,&ae->ifile,&ae->maxfile,filename_toread);
 						/* virer les commentaires + pr-traitement */
 						EarlyPrepSrc(ae,listing_include,ae->filename[ae->ifile-1]);
@@ -14904,6 +16014,15 @@ printf("-comz/include\n");
 					if (c==quote_type) {
 						waiting_quote=2;
 					}
+				} else if (strcmp(bval,"INCAPU")==0) {
+					incbin=1;
+					crunch=17;
+					waiting_quote=1;
+					rewrite=idx-6-1;
+					/* quote right after keyword */
+					if (c==quote_type) {
+						waiting_quote=2;
+					}
 				} else if (strcmp(bval,"INCZX7")==0) {
 					incbin=1;
 					crunch=7;
@@ -15219,26 +16338,20 @@ printf("macro trigger w=[%s]\n",curw.w);
 								macro_trigger=0;
 							} else {
 								int keymatched=0;
-								if ((ifast=ae->fastmatch[(int)curw.w[0]])!=-1) {
-									while (instruction[ifast].mnemo[0]==curw.w[0]) {
-										if (strcmp(instruction[ifast].mnemo,curw.w)==0) {
-											keymatched=1;														
-											if (strcmp(curw.w,"MACRO")==0 || strcmp(curw.w,"STRUCT")==0 || strcmp(curw.w,"WRITE")==0) {
+								if (KeywordSearch(curw.w,GetCRC(curw.w))!=-1) {
+									keymatched=1;														
+									if (strcmp(curw.w,"MACRO")==0 || strcmp(curw.w,"STRUCT")==0 || strcmp(curw.w,"WRITE")==0) {
 /* @@TODO AS80 compatibility patch!!! */
-												macro_trigger=curw.w[0];
-											} else {
-												Automate[' ']=1;
-												Automate['\t']=1;
-												ispace=0;
-												/* instruction en cours, le reste est a interpreter comme une expression */
+										macro_trigger=curw.w[0];
+									} else {
+										Automate[' ']=1;
+										Automate['\t']=1;
+										ispace=0;
+										/* instruction en cours, le reste est a interpreter comme une expression */
 #if TRACE_PREPRO
 printf("instruction en cours\n");												
 #endif
-												texpr=1;
-											}
-											break;
-										}
-										ifast++;
+										texpr=1;
 									}
 								}
 								if (!keymatched) {
@@ -15374,14 +16487,8 @@ printf("mot precedent=[%s] t=%d\n",wordlist[nbword-1].w,wordlist[nbword-1].t);
 							/* il y avait un mot avant alors on va reorganiser la ligne */
 							/* patch NOT -> SAUF si c'est une directive */
 							int keymatched=0;
-							if ((ifast=ae->fastmatch[(int)wordlist[nbword-1].w[0]])!=-1) {
-								while (instruction[ifast].mnemo[0]==wordlist[nbword-1].w[0]) {
-									if (strcmp(instruction[ifast].mnemo,wordlist[nbword-1].w)==0) {
-										keymatched=1;														
-										break;
-									}
-									ifast++;
-								}
+							if (KeywordSearch(wordlist[nbword-1].w,GetCRC(wordlist[nbword-1].w))!=-1) {
+								keymatched=1;
 							}
 							if (!keymatched) {
 								int macrocrc;
@@ -15452,6 +16559,7 @@ printf("END\n");
 	rasm_printf(ae,KVERBOSE"wordlist contains %d element%s\n",nbword,nbword>1?"s":"");
 #endif
 	ae->nbword=nbword;
+	ae->maxword=maxword;
 
 	/* switch words for macro declaration with AS80 & UZ80 */
 	if (param && param->as80) {
@@ -15474,6 +16582,10 @@ printf("END\n");
 printf("free\n");
 #endif
 
+	if (ae->cachedir && !ae->flux && !ae->nberr) {
+		PreProcessingCacheSave(ae,filename,wordlist,nbword);
+	}
+
 	MemFree(bval);
 	MemFree(qval);
 	MemFree(w);
@@ -15495,6 +16607,8 @@ printf("free\n");
 	if (MacroFast) MemFree(MacroFast);
 	if (TABwindex) MemFree(TABwindex);
 	if (TABrindex) MemFree(TABrindex);
+	/* binaries were crunched in background while reading the sources */
+	PopAllCrunchedFiles(ae);
 #if TRACE_PREPRO
 printf("return ae\n");
 #endif
@@ -15580,6 +16694,8 @@ int RasmAssembleInfo(const char *datain, int lenin, unsigned char **dataout, int
 							
 #define AUTOTEST_MACROPAR	"macro unemac, param1, param2:defb '{param1}':defb {param2}:mend:unemac grouik,'grouik'"
 
+#define AUTOTEST_MACROLINK	"macro inner,v:defb {v}:mend:macro outer,a,b:inner {a}:defb '{b}':inner {b}:mend:repeat 2,i:outer i,3:rend:outer 5,4"
+
 #define AUTOTEST_OPCODES "nop::ld bc,#1234::ld (bc),a::inc bc:inc b:dec b:ld b,#12:rlca:ex af,af':add hl,bc:ld a,(bc):dec bc:" \
                          "inc c:dec c:ld c,#12:rrca::djnz $:ld de,#1234:ld (de),a:inc de:inc d:dec d:ld d,#12:rla:jr $:" \
                          "add hl,de:ld a,(de):dec de:inc e:dec e:ld e,#12:rra::jr nz,$:ld hl,#1234:ld (#1234),hl:inc hl:inc h:" \
@@ -15756,6 +16872,8 @@ int RasmAssembleInfo(const char *datain, int lenin, unsigned char **dataout, int
 
 #define AUTOTEST_VAREQU		"label1 equ #C000:label2 equ (label1*2)/16:label3 equ label1-label2:label4 equ 15:var1=50*3+2:var2=12*label1:var3=label4-8:var4=label2:nop"
 
+#define AUTOTEST_EXPRCACHE	"org #100:v=0:repeat 4:defb v*3+lab-$,-v:v=v+1:rend:lab:defb lab-$+1,lab-$+1"
+
 #define AUTOTEST_FORMAT		"hexa=#12A+$23B+45Ch+0x56D:deci=123.45+-78.54*2-(7-7)*2:bina=0b101010+1010b-%1111:assert hexa==3374 && deci==-33.63 && bina==37:nop"
 
 #define AUTOTEST_CHARSET	"charset 'abcde',0:defb 'abcde':defb 'a','b','c','d','e':defb 'a',1*'b','c'*1,1*'d','e'*1:charset:" \
@@ -15766,9 +16884,16 @@ int RasmAssembleInfo(const char *datain, int lenin, unsigned char **dataout, int
 #define AUTOTEST_NOCODE		"let monorg=$:NoCode:Org 0:Element1 db 0:Element2 dw 3:Element3 ds 50:Element4 defb 'rdd':Org 0:pouet defb 'nop':" \
 							"Code:Org monorg:cpt=$+element2+element3+element4:defs cpt,0"
 
+#define AUTOTEST_DEFSFILL	"org #100:defs 300,#AA:defs 4,7:defs 3:defs 2,$&255:nocode:defs 10,1:code:defs 1,255"
+
+#define AUTOTEST_DEFSLIMIT	"org #FFF0:defs 32,1"
+
 #define AUTOTEST_LZSEGMENT	"org #100:debut:jr nz,zend:lz48:repeat 128:nop:rend:lzclose:jp zend:lz48:repeat 2:dec a:jr nz,@next:ld a,5:@next:jp debut:rend:" \
 							"lzclose:zend"
 
+#define AUTOTEST_LZX7LAST	"lzx7:repeat 100,i:defb i&7,i&15,3:rend:lzclose"
+#define AUTOTEST_LZX7REUSE	"lzx7:repeat 100,i:defb 3,i&7,i&15:rend:lzclose:lzx7:defs 1000,#AA:defb 1,2:lzclose:" AUTOTEST_LZX7LAST
+
 #define AUTOTEST_PAGETAG	"bankset 0:org #5000:label1:bankset 1:org #9000:label2:bankset 2:" \
 							"assert {page}label1==0x7FC0:assert {page}label2==0x7FC6:assert {pageset}label1==#7FC0:assert {pageset}label2==#7FC2:nop"
 							
@@ -15858,6 +16983,10 @@ int RasmAssembleInfo(const char *datain, int lenin, unsigned char **dataout, int
 
 #define AUTOTEST_LZ4	"lz4:repeat 10:nop:rend:defb 'roudoudoudouoneatxkjhgfdskljhsdfglkhnopnopnopnop':lzclose"
 
+#define AUTOTEST_LZAPU	"org #100:debut:jp zend:lzapu:repeat 128:nop:rend:defb 'roudoudou':lzclose:zend:jp debut"
+
+#define AUTOTEST_LZMULTI	"org #100:lzapu:repeat 64:nop:rend:lzclose:zend:org #200:lzapu:ld hl,zend:repeat 64:nop:rend:lzclose:jp zend"
+
 #define AUTOTEST_MAXERROR	"repeat 20:aglapi:rend:nop"
 
 #define AUTOTEST_ENHANCED_LD	"ld h,(ix+11): ld l,(ix+10): ld h,(iy+21): ld l,(iy+20): ld b,(ix+11): ld c,(ix+10):" \
@@ -16004,6 +17133,30 @@ void MiniDump(unsigned char *opcode, int opcodelen) {
 	printf("\n");
 }
 						
+#ifdef RASM_THREAD
+struct s_autotest_thread {
+	const char *source;
+	unsigned char *opcode;
+	int opcodelen,ret;
+};
+/* assemble the same source many times and check the result never changes */
+void *_internal_AutotestThread(void *param)
+{
+	struct s_autotest_thread *autotest_thread=(struct s_autotest_thread *)param;
+	unsigned char *opcode;
+	int opcodelen,i;
+
+	autotest_thread->ret=RasmAssemble(autotest_thread->source,strlen(autotest_thread->source),&autotest_thread->opcode,&autotest_thread->opcodelen);
+	for (i=0;i<16 && !autotest_thread->ret;i++) {
+		opcode=NULL;opcodelen=0;
+		if (RasmAssemble(autotest_thread->source,strlen(autotest_thread->source),&opcode,&opcodelen)
+		 || opcodelen!=autotest_thread->opcodelen || (opcodelen && memcmp(opcode,autotest_thread->opcode,opcodelen))) autotest_thread->ret=1;
+		if (opcode) MemFree(opcode);
+	}
+	return NULL;
+}
+#endif
+
 void RasmAutotest(void)
 {
 	#undef FUNC
@@ -16069,8 +17222,8 @@ void RasmAutotest(void)
 	SimplifyPath(tmpstr1);if (strcmp(tmpstr1,tmpstr2)) {printf("Autotest %03d ERROR (Core:SimplifyPath6) %s!=%s\n",cpt,tmpstr1,tmpstr2);exit(-1);}
 	cpt++;
 	printf(".");fflush(stdout);
-	if (strcmp(GetPath("/home/roudoudou/"),"/home/roudoudou/")) {printf("Autotest %03d ERROR (Core:GetPath0) [%s]\n",cpt,GetPath("/home/roudoudou/"));exit(-1);}
-	if (strcmp(GetPath("/home/roudoudou"),"/home/")) {printf("Autotest %03d ERROR (Core:GetPath1) [%s]\n",cpt,GetPath("/home/roudoudou"));exit(-1);}
+	if (strcmp(GetPath("/home/roudoudou/",tmpstr2),"/home/roudoudou/")) {printf("Autotest %03d ERROR (Core:GetPath0) [%s]\n",cpt,GetPath("/home/roudoudou/",tmpstr2));exit(-1);}
+	if (strcmp(GetPath("/home/roudoudou",tmpstr2),"/home/")) {printf("Autotest %03d ERROR (Core:GetPath1) [%s]\n",cpt,GetPath("/home/roudoudou",tmpstr2));exit(-1);}
 	cpt++;
 	#endif
 #endif
@@ -16225,11 +17378,59 @@ printf("testing delayed RUN OK\n");
 	if (!ret && opcodelen==23 && opcode[1]==21 && opcode[9]==23) {} else {printf("Autotest %03d ERROR (LZ segment relocation)\n",cpt);exit(-1);}
 	if (opcode) MemFree(opcode);opcode=NULL;cpt++;
 printf("testing LZ segment relocation OK\n");
+
+	/* ZX7 context reused by several sections must give the same data as a fresh one */
+	ret=RasmAssemble(AUTOTEST_LZX7LAST,strlen(AUTOTEST_LZX7LAST),&opcode,&opcodelen);
+	if (!ret && opcodelen>2) {} else {printf("Autotest %03d ERROR (ZX7 crunch)\n",cpt);exit(-1);}
+	tmpstr3=MemMalloc(opcodelen);
+	memcpy(tmpstr3,opcode,opcodelen);
+	filelen=opcodelen;
+	if (opcode) MemFree(opcode);opcode=NULL;cpt++;
+	ret=RasmAssemble(AUTOTEST_LZX7REUSE,strlen(AUTOTEST_LZX7REUSE),&opcode,&opcodelen);
+	if (!ret && opcodelen>filelen && memcmp(opcode+opcodelen-filelen,tmpstr3,filelen)==0) {} else {printf("Autotest %03d ERROR (ZX7 context reuse)\n",cpt);exit(-1);}
+	MemFree(tmpstr3);
+	if (opcode) MemFree(opcode);opcode=NULL;cpt++;
+printf("testing ZX7 context reuse OK\n");
+
+	/* optimal LZ48/LZ49 parse must round-trip and never be larger than the legacy one */
+	tmpstr3=MemMalloc(8192);
+	for (i=chk=0;i<8192;i++) {
+		chk=(int)(((unsigned int)chk*1103515245U+12345U)&0x7FFFFFFF);
+		if (i && (chk>>16)&3) tmpstr3[i]=tmpstr3[i>=300?i-((chk>>18)&255)-1:i/2]; else tmpstr3[i]=chk>>20;
+	}
+	for (idx=0;idx<2;idx++) {
+		unsigned char *lzlegacy,*lzoptimal,*lzcheck;
+		int lzlegacylen,lzoptimallen;
+
+		lzlegacy=idx?LZ49_encode_legacy((unsigned char*)tmpstr3,8192,&lzlegacylen):LZ48_encode_legacy((unsigned char*)tmpstr3,8192,&lzlegacylen);
+		lzoptimal=idx?LZ49_encode_optimal((unsigned char*)tmpstr3,8192,&lzoptimallen):LZ48_encode_optimal((unsigned char*)tmpstr3,8192,&lzoptimallen);
+		lzcheck=MemMalloc(8192+256);
+		if (lzoptimallen<=lzlegacylen && LZ48_decrunch(lzoptimal,lzcheck,idx)==8192 && memcmp(lzcheck,tmpstr3,8192)==0) {} else {printf("Autotest %03d ERROR (LZ4%d optimal crunch %d>%d)\n",cpt,8+idx,lzoptimallen,lzlegacylen);exit(-1);}
+		MemFree(lzlegacy);
+		MemFree(lzoptimal);
+		MemFree(lzcheck);
+	}
+	MemFree(tmpstr3);cpt++;
+printf("testing LZ48/LZ49 optimal crunch OK\n");
 	
 	ret=RasmAssemble(AUTOTEST_LZ4,strlen(AUTOTEST_LZ4),&opcode,&opcodelen);
 	if (!ret && opcodelen==49 && opcode[0]==0x15 && opcode[4]==0x44 && opcode[0xB]==0xF0) {} else {printf("Autotest %03d ERROR (LZ4 segment)\n",cpt);MiniDump(opcode,opcodelen);exit(-1);}
 	if (opcode) MemFree(opcode);opcode=NULL;cpt++;
 printf("testing LZ4 segment OK\n");
+
+#ifndef NO_3RD_PARTIES
+	ret=RasmAssemble(AUTOTEST_LZAPU,strlen(AUTOTEST_LZAPU),&opcode,&opcodelen);
+	if (!ret && opcodelen>6 && opcode[0]==0xC3 && opcode[1]+opcode[2]*256==0x100+opcodelen-3 && opcode[opcodelen-3]==0xC3 && opcode[opcodelen-2]==0 && opcode[opcodelen-1]==1
+		&& apultra_decompress(opcode+3,(unsigned char*)tmpstr1,opcodelen-6,sizeof(tmpstr1),0,0)==137 && tmpstr1[0]==0 && tmpstr1[127]==0 && !memcmp(tmpstr1+128,"roudoudou",9)) {} else {printf("Autotest %03d ERROR (apultra segment)\n",cpt);MiniDump(opcode,opcodelen);exit(-1);}
+	if (opcode) MemFree(opcode);opcode=NULL;cpt++;
+printf("testing apultra segment OK\n");
+
+	ret=RasmAssemble(AUTOTEST_LZMULTI,strlen(AUTOTEST_LZMULTI),&opcode,&opcodelen);
+	if (!ret && opcodelen>0x106 && opcode[opcodelen-3]==0xC3 && opcode[opcodelen-2]+opcode[opcodelen-1]*256<0x100+64
+		&& apultra_decompress(opcode+0x100,(unsigned char*)tmpstr1,opcodelen-0x103,sizeof(tmpstr1),0,0)==67 && tmpstr1[0]==0x21 && !memcmp(tmpstr1+1,opcode+opcodelen-2,2)) {} else {printf("Autotest %03d ERROR (crunched sections in many ORG)\n",cpt);MiniDump(opcode,opcodelen);exit(-1);}
+	if (opcode) MemFree(opcode);opcode=NULL;cpt++;
+printf("testing crunched sections in many ORG OK\n");
+#endif
 	
 	ret=RasmAssemble(AUTOTEST_DEFS,strlen(AUTOTEST_DEFS),&opcode,&opcodelen);
 	if (!ret && opcodelen==256 && opcode[0]==0) {} else {printf("Autotest %03d ERROR (defs)\n",cpt);exit(-1);}
@@ -16305,11 +17506,28 @@ printf("testing SWITCH/CASE OK\n");
 	if (!ret && opcodelen==57) {} else {printf("Autotest %03d ERROR (code/nocode)\n",cpt);exit(-1);}
 	if (opcode) MemFree(opcode);opcode=NULL;cpt++;
 printf("testing code/nocode OK\n");
+
+	ret=RasmAssemble(AUTOTEST_DEFSFILL,strlen(AUTOTEST_DEFSFILL),&opcode,&opcodelen);
+	if (!ret && opcodelen==320) {
+		for (i=0;i<300;i++) if (opcode[i]!=0xAA) break;
+		if (i<300 || memcmp(opcode+300,"\7\7\7\7\0\0\0\x33\x33",9) || opcode[309]!=0 || opcode[319]!=255) ret=1;
+	}
+	if (!ret) {} else {printf("Autotest %03d ERROR (DEFS bulk fill)\n",cpt);MiniDump(opcode,opcodelen);exit(-1);}
+	if (opcode) MemFree(opcode);opcode=NULL;cpt++;
+	ret=RasmAssemble(AUTOTEST_DEFSLIMIT,strlen(AUTOTEST_DEFSLIMIT),&opcode,&opcodelen);
+	if (ret) {} else {printf("Autotest %03d ERROR (DEFS output limit)\n",cpt);exit(-1);}
+	if (opcode) MemFree(opcode);opcode=NULL;cpt++;
+printf("testing DEFS bulk fill OK\n");
 	
 	ret=RasmAssemble(AUTOTEST_VAREQU,strlen(AUTOTEST_VAREQU),&opcode,&opcodelen);
 	if (!ret) {} else {printf("Autotest %03d ERROR (var & equ)\n",cpt);exit(-1);}
 	if (opcode) MemFree(opcode);opcode=NULL;cpt++;
 printf("testing var & equ OK\n");
+
+	ret=RasmAssemble(AUTOTEST_EXPRCACHE,strlen(AUTOTEST_EXPRCACHE),&opcode,&opcodelen);
+	if (!ret && opcodelen==10 && opcode[0]==8 && opcode[1]==0 && opcode[2]==9 && opcode[3]==0xFF && opcode[6]==11 && opcode[7]==0xFD && opcode[8]==1 && opcode[9]==0) {} else {printf("Autotest %03d ERROR (compiled expression cache)\n",cpt);MiniDump(opcode,opcodelen);exit(-1);}
+	if (opcode) MemFree(opcode);opcode=NULL;cpt++;
+printf("testing compiled expression cache OK\n");
 	
 	ret=RasmAssemble(AUTOTEST_CHARSET,strlen(AUTOTEST_CHARSET),&opcode,&opcodelen);
 	if (!ret) {} else {printf("Autotest %03d ERROR (simple charset)\n",cpt);exit(-1);}
@@ -16350,6 +17568,11 @@ printf("testing assert usage (+prepro regression cases) OK\n");
 	if (!ret && opcodelen==12 && memcmp(opcode,"GROUIKgrouik",12)==0) {} else {printf("Autotest %03d ERROR (macro string param)\n",cpt);exit(-1);}
 	if (opcode) MemFree(opcode);opcode=NULL;cpt++;
 printf("testing macro string parameter OK\n");
+
+	ret=RasmAssemble(AUTOTEST_MACROLINK,strlen(AUTOTEST_MACROLINK),&opcode,&opcodelen);
+	if (!ret && opcodelen==9 && memcmp(opcode,"\1\x33\3\2\x33\3\5\x34\4",9)==0) {} else {printf("Autotest %03d ERROR (nested macro expansions)\n",cpt);MiniDump(opcode,opcodelen);exit(-1);}
+	if (opcode) MemFree(opcode);opcode=NULL;cpt++;
+printf("testing nested macro expansions OK\n");
 	
 	ret=RasmAssemble(AUTOTEST_MACRO_ADV,strlen(AUTOTEST_MACRO_ADV),&opcode,&opcodelen);
 	if (!ret) {} else {printf("Autotest %03d ERROR (macro param)\n",cpt);exit(-1);}
@@ -16552,6 +17775,83 @@ printf("testing internal error struct OK\n");
 	if (opcode) MemFree(opcode);opcode=NULL;cpt++;
 printf("testing internal label struct OK\n");
 
+#ifdef RASM_THREAD
+	/* concurrent assemblies must not share state, STRUCT and NOCODE switch the DEF and output routines */
+	{
+		const char *autotest_source[3]={AUTOTEST_STRUCT,AUTOTEST_NOCODE,AUTOTEST_EXPRCACHE};
+		struct s_autotest_thread autotest_thread[12];
+		pthread_t autotest_tid[12];
+
+		for (i=0;i<12;i++) {
+			autotest_thread[i].source=autotest_source[i%3];
+			autotest_thread[i].opcode=NULL;
+			autotest_thread[i].opcodelen=0;
+			if (pthread_create(&autotest_tid[i],NULL,_internal_AutotestThread,&autotest_thread[i])) {printf("Autotest %03d ERROR (concurrent assemblies) cannot start thread\n",cpt);exit(-1);}
+		}
+		for (i=0;i<12;i++) pthread_join(autotest_tid[i],NULL);
+		for (i=0;i<12;i++) {
+			if (autotest_thread[i].ret || autotest_thread[i].opcodelen!=autotest_thread[i%3].opcodelen
+			 || (autotest_thread[i].opcodelen && memcmp(autotest_thread[i].opcode,autotest_thread[i%3].opcode,autotest_thread[i].opcodelen))) {printf("Autotest %03d ERROR (concurrent assemblies)\n",cpt);exit(-1);}
+		}
+		for (i=0;i<12;i++) if (autotest_thread[i].opcode) MemFree(autotest_thread[i].opcode);
+		cpt++;
+	}
+printf("testing concurrent assemblies OK\n");
+#endif
+
+	/* crunched data written in the disk cache must be read back for the same data and cruncher only */
+	{
+		unsigned char *lzdata[2];
+		int lzlen[2];
+		char *entryname,*cachedir,*tmpdir;
+
+		/* in a directory of its own, removed afterwards */
+#ifdef OS_WIN
+		cachedir=_tempnam(NULL,"rasm");
+		if (!cachedir || _mkdir(cachedir)) {printf("Autotest %03d ERROR (disk cache directory)\n",cpt);exit(-1);}
+#else
+		tmpdir=getenv("TMPDIR");
+		if (!tmpdir || !*tmpdir) tmpdir="/tmp";
+		cachedir=MemMalloc(strlen(tmpdir)+16);
+		sprintf(cachedir,"%s/rasmXXXXXX",tmpdir);
+		if (!mkdtemp(cachedir)) {printf("Autotest %03d ERROR (disk cache directory)\n",cpt);exit(-1);}
+#endif
+		lzdata[0]=CrunchData(48,(unsigned char *)AUTOTEST_STRUCT,strlen(AUTOTEST_STRUCT),&lzlen[0],cachedir,NULL);
+		lzdata[1]=CacheGetCrunch(cachedir,48,(unsigned char *)AUTOTEST_STRUCT,strlen(AUTOTEST_STRUCT),&lzlen[1]);
+		if (!lzdata[0] || !lzdata[1] || lzlen[0]!=lzlen[1] || memcmp(lzdata[0],lzdata[1],lzlen[0])
+			|| CacheGetCrunch(cachedir,49,(unsigned char *)AUTOTEST_STRUCT,strlen(AUTOTEST_STRUCT),&lzlen[1])) {printf("Autotest %03d ERROR (disk cache)\n",cpt);exit(-1);}
+		for (i=0;i<2;i++) MemFree(lzdata[i]);
+		entryname=CacheEntryName(cachedir,CacheCrunchHash(48,(unsigned char *)AUTOTEST_STRUCT,strlen(AUTOTEST_STRUCT)),".lz");
+		FileRemoveIfExists(entryname);
+		MemFree(entryname);
+#ifdef OS_WIN
+		_rmdir(cachedir);
+		free(cachedir);
+#else
+		rmdir(cachedir);
+		MemFree(cachedir);
+#endif
+		cpt++;
+	}
+printf("testing disk cache OK\n");
+
+#ifdef RASM_SERVER
+	/* crunched data must come back from the server cache without crunching again */
+	{
+		unsigned char *lzdata[2];
+		int lzlen[2];
+
+		servercache_active=1;
+		for (i=0;i<2;i++) lzdata[i]=CrunchData(48,(unsigned char *)AUTOTEST_STRUCT,strlen(AUTOTEST_STRUCT),&lzlen[i],NULL,NULL);
+		if (nservercache!=1 || !lzdata[0] || !lzdata[1] || lzlen[0]!=lzlen[1] || memcmp(lzdata[0],lzdata[1],lzlen[0])) {printf("Autotest %03d ERROR (server cache)\n",cpt);exit(-1);}
+		for (i=0;i<2;i++) MemFree(lzdata[i]);
+		_internal_ServerCacheReset();
+		servercache_active=0;
+		cpt++;
+	}
+printf("testing server cache OK\n");
+#endif
+
 #ifdef RDD
 	printf("\n%d bytes\n",_static_library_memory_used);
 
@@ -16798,6 +18098,213 @@ unsigned char *LZ49_encode_legacy(unsigned char *data, int length, int *retlengt
 	return odata;
 }
 
+/*
+	optimal parse shared by LZ48 and LZ49
+	both formats pay a token and an offset byte per match whatever the offset, so only the
+	longest match at each position matters. A literal run costs one more byte when it reaches
+	the token limit then every 255 bytes, same for a match from 18 bytes
+	matches are found with hash chains over the 3 first bytes, limited to the offset window
+*/
+#define LZ48_NICE_LENGTH 273
+
+int *_internal_LZ48_optimal_parse(unsigned char *data, int length, int window, int literallimit, int **retoffset)
+{
+	#undef FUNC
+	#define FUNC "LZ48_optimal_parse"
+
+	int *head,*chain,*cost,*literal,*prevpos,*prevlen,*matchlen,*matchoffset;
+	int p,q,m,c,h,cand,curlen,maxlen,maxoffset,maxm,skip=0;
+
+	head=MemMalloc(65536*sizeof(int));
+	chain=MemMalloc(length*sizeof(int));
+	cost=MemMalloc((length+1)*sizeof(int));
+	literal=MemMalloc((length+1)*sizeof(int));
+	prevpos=MemMalloc((length+1)*sizeof(int));
+	prevlen=MemMalloc((length+1)*sizeof(int));
+	matchoffset=MemMalloc((length+1)*sizeof(int));
+	for (h=0;h<65536;h++) head[h]=-1;
+	for (p=0;p<=length;p++) {
+		cost[p]=0x7FFFFFFF;
+		matchoffset[p]=0;
+	}
+	/* first byte is always a raw literal */
+	cost[1]=1;
+	literal[1]=0;
+	prevpos[1]=0;
+	prevlen[1]=0;
+
+	for (q=0;q<length;q++) {
+		/* longest match in the window */
+		maxlen=maxoffset=0;
+		if (q+2<length) {
+			h=((data[q]<<16|data[q+1]<<8|data[q+2])*2654435761U)>>16;
+			if (q && q>=skip) {
+				for (cand=head[h];cand>=0 && q-cand<=window;cand=chain[cand]) {
+					if (data[cand+maxlen]!=data[q+maxlen]) continue;
+					for (curlen=0;q+curlen<length && data[cand+curlen]==data[q+curlen];curlen++);
+					if (curlen>maxlen) {
+						maxlen=curlen;
+						maxoffset=q-cand;
+						if (maxlen>=LZ48_NICE_LENGTH || q+maxlen==length) break;
+					}
+				}
+			}
+			chain[q]=head[h];
+			head[h]=q;
+		}
+		if (!q) continue;
+
+		/* literal */
+		c=cost[q]+1;
+		if (literal[q]+1==literallimit || (literal[q]+1>literallimit && (literal[q]+1-literallimit)%255==0)) c++;
+		if (c<cost[q+1]) {
+			cost[q+1]=c;
+			literal[q+1]=literal[q]+1;
+			prevpos[q+1]=q;
+			prevlen[q+1]=0;
+		}
+		/* matches, every length up to the longest */
+		if (maxlen>=3) {
+			matchoffset[q]=maxoffset;
+			/* no search inside a long match */
+			if (maxlen>=LZ48_NICE_LENGTH) skip=q+maxlen;
+			maxm=maxlen<LZ48_NICE_LENGTH?maxlen:LZ48_NICE_LENGTH-1;
+			for (m=3;m<=maxlen;m++) {
+				if (m>maxm) m=maxlen;
+				c=cost[q]+2;
+				if (m>=18) c+=1+(m-18)/255;
+				if (c<cost[q+m] || (c==cost[q+m] && literal[q+m])) {
+					cost[q+m]=c;
+					literal[q+m]=0;
+					prevpos[q+m]=q;
+					prevlen[q+m]=m;
+				}
+			}
+		}
+	}
+
+	/* walk back the path, matchlen[p] is the length of the match starting at p */
+	matchlen=head;
+	MemFree(chain);
+	if (length+1>65536) matchlen=MemRealloc(matchlen,(length+1)*sizeof(int));
+	for (p=0;p<=length;p++) matchlen[p]=0;
+	for (p=length;p>1;p=prevpos[p]) {
+		if (prevlen[p]) matchlen[prevpos[p]]=prevlen[p];
+	}
+
+	MemFree(cost);
+	MemFree(literal);
+	MemFree(prevpos);
+	MemFree(prevlen);
+	*retoffset=matchoffset;
+	return matchlen;
+}
+
+unsigned char *LZ48_encode_optimal(unsigned char *data, int length, int *retlength)
+{
+	#undef FUNC
+	#define FUNC "LZ48_encode_optimal"
+
+	int *matchlen,*matchoffset;
+	int current=1,ioutput=1,literaloffset=1;
+	unsigned char *odata;
+
+	/* short data keep the legacy encoding */
+	if (length<5) return LZ48_encode_legacy(data,length,retlength);
+
+	odata=MemMalloc((size_t)length*1.5+10);
+	/* first byte always literal */
+	odata[0]=data[0];
+
+	matchlen=_internal_LZ48_optimal_parse(data,length,255,15,&matchoffset);
+	while (current<length) {
+		if (matchlen[current]) {
+			ioutput+=LZ48_encode_block(odata+ioutput,data,literaloffset,current-literaloffset,matchoffset[current],matchlen[current]);
+			current+=matchlen[current];
+			literaloffset=current;
+		} else {
+			current++;
+		}
+	}
+	ioutput+=LZ48_encode_block(odata+ioutput,data,literaloffset,current-literaloffset,0,0);
+	MemFree(matchlen);
+	MemFree(matchoffset);
+	*retlength=ioutput;
+	return odata;
+}
+
+unsigned char *LZ49_encode_optimal(unsigned char *data, int length, int *retlength)
+{
+	#undef FUNC
+	#define FUNC "LZ49_encode_optimal"
+
+	int *matchlen,*matchoffset;
+	int current=1,ioutput=1,literaloffset=1;
+	unsigned char *odata;
+
+	/* short data keep the legacy encoding */
+	if (length<5) return LZ49_encode_legacy(data,length,retlength);
+
+	odata=MemMalloc((size_t)length*1.5+10);
+	/* first byte always literal */
+	odata[0]=data[0];
+
+	matchlen=_internal_LZ48_optimal_parse(data,length,511,7,&matchoffset);
+	while (current<length) {
+		if (matchlen[current]) {
+			ioutput+=LZ49_encode_block(odata+ioutput,data,literaloffset,current-literaloffset,matchoffset[current],matchlen[current]);
+			current+=matchlen[current];
+			literaloffset=current;
+		} else {
+			current++;
+		}
+	}
+	ioutput+=LZ49_encode_block(odata+ioutput,data,literaloffset,current-literaloffset,0,0);
+	MemFree(matchlen);
+	MemFree(matchoffset);
+	*retlength=ioutput;
+	return odata;
+}
+
+/* C version of decrunch/lz48decrunch_v006.asm and decrunch/lz49decrunch_v001.asm, returns the output size */
+int LZ48_decrunch(unsigned char *src, unsigned char *dst, int lz49)
+{
+	#undef FUNC
+	#define FUNC "LZ48_decrunch"
+
+	int isrc=0,idst=0,token,length,offset,v;
+
+	dst[idst++]=src[isrc++];
+	while (1) {
+		token=src[isrc++];
+		length=lz49?(token>>4)&7:token>>4;
+		if (length==(lz49?7:15)) {
+			do {
+				v=src[isrc++];
+				length+=v;
+			} while (v==255);
+		}
+		while (length--) dst[idst++]=src[isrc++];
+		length=(token&15)+3;
+		if (length==18) {
+			do {
+				v=src[isrc++];
+				length+=v;
+			} while (v==255);
+		}
+		if (lz49 && (token&0x80)) {
+			offset=256+((src[isrc++]+1)&255);
+		} else {
+			if (src[isrc]==255) return idst;
+			offset=src[isrc++]+1;
+		}
+		while (length--) {
+			dst[idst]=dst[idst-offset];
+			idst++;
+		}
+	}
+}
+
 
 /***************************************
 	semi-generic body of program
@@ -16816,7 +18323,7 @@ void Usage(int help)
 	
 	printf("%s (c) 2017 Edouard BERGE (use -n option to display all licenses)\n",RASM_VERSION);
 	#ifndef NO_3RD_PARTIES
-	printf("LZ4 (c) Yann Collet / ZX7 (c) Einar Saukas / Exomizer 2 (c) Magnus Lind\n");
+	printf("LZ4 (c) Yann Collet / ZX7 (c) Einar Saukas / Exomizer 2 (c) Magnus Lind / apultra (c) Emmanuel Marty\n");
 	#endif
 	printf("\n");
 	printf("SYNTAX: rasm <inputfile> [options]\n");
@@ -16834,6 +18341,7 @@ void Usage(int help)
 		printf("-ok <breakpoint filename>choose a full filename for breakpoint output\n");
 		printf("-I<path>                 set a path for files to read\n");
 		printf("-no                      disable all file output\n");
+		printf("-cache <directory>       keep preprocessing and crunched data between runs\n");
 		printf("DEPENDENCIES EXPORT:\n");
 		printf("-depend=make             output dependencies on a single line\n");
 		printf("-depend=list             output dependencies as a list\n");
@@ -16872,6 +18380,13 @@ void Usage(int help)
 		printf("-xr            extended error display\n");
 		printf("-w             disable warnings\n");
 		printf("-void          force void usage with macro without parameter\n");
+		#ifdef RASM_SERVER
+		printf("SERVER:\n");
+		printf("-server [socket] stay resident and assemble the jobs sent on the socket\n");
+		printf("                 files and crunched data are kept between jobs\n");
+		printf("                 socket defaults to $XDG_RUNTIME_DIR/rasm.sock or /tmp/rasm-<uid>.sock\n");
+		printf("RASM_SERVER=<socket> environment variable sends the jobs to the server\n");
+		#endif
 		printf("\n");
 	} else {
 		printf("use option -h for help\n");
@@ -17010,6 +18525,29 @@ printf(" *\n");
 printf(" *   4. The names of this software and/or it's copyright holders may not be\n");
 printf(" *   used to endorse or promote products derived from this software without\n");
 printf(" *   specific prior written permission.\n");
+
+
+printf("\n\n\n\n");
+printf("******* license of apultra cruncher ***********\n\n\n\n");
+
+
+printf(" * Copyright (C) 2019 Emmanuel Marty\n");
+printf(" *\n");
+printf(" * This software is provided 'as-is', without any express or implied\n");
+printf(" * warranty.  In no event will the authors be held liable for any damages\n");
+printf(" * arising from the use of this software.\n");
+printf(" *\n");
+printf(" * Permission is granted to anyone to use this software for any purpose,\n");
+printf(" * including commercial applications, and to alter it and redistribute it\n");
+printf(" * freely, subject to the following restrictions:\n");
+printf(" *\n");
+printf(" * 1. The origin of this software must not be misrepresented; you must not\n");
+printf(" *    claim that you wrote the original software. If you use this software\n");
+printf(" *    in a product, an acknowledgment in the product documentation would be\n");
+printf(" *    appreciated but is not required.\n");
+printf(" * 2. Altered source versions must be plainly marked as such, and must not be\n");
+printf(" *    misrepresented as being the original software.\n");
+printf(" * 3. This notice may not be removed or altered from any source distribution.\n");
 #endif
 
 printf("\n\n");
@@ -17082,6 +18620,12 @@ int ParseOptions(char **argv,int argc, struct s_parameter *param)
 		param->checkmode=1;
 	} else if (strcmp(argv[i],"-no")==0) {
 		param->checkmode=1;
+	} else if (strcmp(argv[i],"-cache")==0) {
+		if (i+1<argc) {
+			param->cachedir=argv[++i];
+		} else {
+			Usage(1);
+		}
 	} else if (strcmp(argv[i],"-w")==0) {
 		param->nowarning=1;
 	} else if (argv[i][0]=='-')	{
@@ -17281,6 +18825,354 @@ void GetParametersFromCommandLine(int argc, char **argv, struct s_parameter *par
 	if (param->export_local && !param->export_sym) Usage(1); //  revoir?
 }
 
+#ifdef RASM_SERVER
+/*
+	server mode
+	
+	rasm -server keeps running on a local socket, when RASM_SERVER is set to the socket path
+	the regular command line sends the job to the server instead of assembling it
+	the server runs each job in a forked child with the client stdout/stderr, the child
+	inherits the files and crunched data of the previous jobs and sends back the new ones
+	compiled expressions are not kept between jobs, they bind the symbols of one assembly
+	client and server only talk to a process of the same user
+*/
+struct s_servercachehead {
+	int lz;
+	int keylen;
+	int datalen;
+	long long stamp;
+};
+
+int _internal_ServerWrite(int fd, void *data, int len)
+{
+	#undef FUNC
+	#define FUNC "_internal_ServerWrite"
+
+	unsigned char *ptr=data;
+	int n;
+
+	while (len>0) {
+		n=write(fd,ptr,len);
+		if (n<0 && errno==EINTR) continue;
+		if (n<=0) return 0;
+		ptr+=n;
+		len-=n;
+	}
+	return 1;
+}
+
+int _internal_ServerRead(int fd, void *data, int len)
+{
+	#undef FUNC
+	#define FUNC "_internal_ServerRead"
+
+	unsigned char *ptr=data;
+	int n;
+
+	while (len>0) {
+		n=read(fd,ptr,len);
+		if (n<0 && errno==EINTR) continue;
+		if (n<=0) return 0;
+		ptr+=n;
+		len-=n;
+	}
+	return 1;
+}
+
+/* called at exit of a job, whatever the way it ends */
+void _internal_ServerSendCache(void)
+{
+	#undef FUNC
+	#define FUNC "_internal_ServerSendCache"
+
+	struct s_servercachehead head;
+	int i;
+
+	for (i=0;i<nservercache;i++) {
+		if (!servercache[i].fresh) continue;
+		head.lz=servercache[i].lz;
+		head.keylen=servercache[i].keylen;
+		head.datalen=servercache[i].datalen;
+		head.stamp=servercache[i].stamp;
+		if (!_internal_ServerWrite(servercache_pipe,&head,sizeof(head))
+		 || !_internal_ServerWrite(servercache_pipe,servercache[i].key,head.keylen)
+		 || !_internal_ServerWrite(servercache_pipe,servercache[i].data,head.datalen)) break;
+	}
+	close(servercache_pipe);
+}
+
+void _internal_ServerReceiveCache(int fd)
+{
+	#undef FUNC
+	#define FUNC "_internal_ServerReceiveCache"
+
+	struct s_servercachehead head;
+	unsigned char *key,*data;
+
+	while (_internal_ServerRead(fd,&head,sizeof(head))) {
+		if (head.keylen<0 || head.datalen<0) break;
+		key=MemMalloc(head.keylen+1);
+		data=MemMalloc(head.datalen+1);
+		if (_internal_ServerRead(fd,key,head.keylen) && _internal_ServerRead(fd,data,head.datalen)) {
+			ServerCachePut(head.lz,key,head.keylen,head.stamp,data,head.datalen,0);
+		}
+		MemFree(key);
+		MemFree(data);
+	}
+}
+
+/* the user private runtime directory when there is one, /tmp is shared with the other users */
+char *RasmServerPath(char *sockpath)
+{
+	#undef FUNC
+	#define FUNC "RasmServerPath"
+
+	static char defaultpath[PATH_MAX];
+	char *rundir;
+
+	if (sockpath) return sockpath;
+	if ((sockpath=getenv("RASM_SERVER"))!=NULL && *sockpath) return sockpath;
+	if ((rundir=getenv("XDG_RUNTIME_DIR"))!=NULL && *rundir && strlen(rundir)+16<PATH_MAX) {
+		sprintf(defaultpath,"%s/rasm.sock",rundir);
+	} else {
+		sprintf(defaultpath,"/tmp/rasm-%d.sock",(int)getuid());
+	}
+	return defaultpath;
+}
+
+/* anyone may bind a socket in /tmp first, the other end must run as the same user */
+int RasmServerPeerIsUser(int fd)
+{
+	#undef FUNC
+	#define FUNC "RasmServerPeerIsUser"
+
+#ifdef SO_PEERCRED
+	struct ucred cred;
+	socklen_t len=sizeof(cred);
+
+	if (getsockopt(fd,SOL_SOCKET,SO_PEERCRED,&cred,&len) || len!=sizeof(cred)) return 0;
+	return cred.uid==getuid();
+#else
+	uid_t uid;
+	gid_t gid;
+
+	if (getpeereid(fd,&uid,&gid)) return 0;
+	return uid==getuid();
+#endif
+}
+
+/*
+	RasmServerJob
+	
+	a job is the length of the request with the client stdout and stderr
+	then the working directory and the arguments, all zero terminated
+	the answer is the wait status of the job
+*/
+void RasmServerJob(int lfd, int cfd)
+{
+	#undef FUNC
+	#define FUNC "RasmServerJob"
+
+	struct s_parameter param={0};
+	struct msghdr msg={0};
+	struct cmsghdr *cmsg;
+	struct iovec iov;
+	char control[CMSG_SPACE(2*sizeof(int))];
+	int fds[2]={-1,-1},cachepipe[2];
+	char *job=NULL,**argv=NULL;
+	int joblen,argc,i,status;
+	pid_t pid;
+
+	if (!RasmServerPeerIsUser(cfd)) return;
+	iov.iov_base=&joblen;
+	iov.iov_len=sizeof(int);
+	msg.msg_iov=&iov;
+	msg.msg_iovlen=1;
+	msg.msg_control=control;
+	msg.msg_controllen=sizeof(control);
+	if (recvmsg(cfd,&msg,0)!=sizeof(int)) return;
+	cmsg=CMSG_FIRSTHDR(&msg);
+	if (!cmsg || cmsg->cmsg_level!=SOL_SOCKET || cmsg->cmsg_type!=SCM_RIGHTS || cmsg->cmsg_len!=CMSG_LEN(2*sizeof(int))) return;
+	memcpy(fds,CMSG_DATA(cmsg),2*sizeof(int));
+
+	status=INTERNAL_ERROR<<8;
+	if (joblen>0 && joblen<1024*1024) {
+		job=MemMalloc(joblen+1);
+		if (_internal_ServerRead(cfd,job,joblen)) {
+			job[joblen]=0;
+			/* argv[0] is not sent */
+			argc=1;
+			argv=MemMalloc(sizeof(char *));
+			for (i=strlen(job)+1;i<joblen;i+=strlen(job+i)+1) {
+				argv=MemRealloc(argv,(argc+1)*sizeof(char *));
+				argv[argc++]=job+i;
+			}
+			argv[0]="rasm";
+
+			if (pipe(cachepipe)==0) {
+				fflush(stdout);
+				pid=fork();
+				if (pid==0) {
+					close(lfd);
+					close(cfd);
+					close(cachepipe[0]);
+					signal(SIGPIPE,SIG_DFL);
+					dup2(fds[0],1);
+					dup2(fds[1],2);
+					close(fds[0]);
+					close(fds[1]);
+					servercache_pipe=cachepipe[1];
+					atexit(_internal_ServerSendCache);
+					if (chdir(job)) {
+						printf("cannot change directory to %s\n",job);
+						exit(ABORT_ERROR);
+					}
+					param.maxerr=20;
+					param.rough=0.5;
+					GetParametersFromCommandLine(argc,argv,&param);
+					exit(Rasm(&param));
+				}
+				close(cachepipe[1]);
+				if (pid>0) {
+					/* read everything before waiting, the child may fill the pipe */
+					_internal_ServerReceiveCache(cachepipe[0]);
+					while (waitpid(pid,&status,0)<0 && errno==EINTR);
+				}
+				close(cachepipe[0]);
+			}
+		}
+		if (argv) MemFree(argv);
+		MemFree(job);
+	}
+	close(fds[0]);
+	close(fds[1]);
+	_internal_ServerWrite(cfd,&status,sizeof(int));
+}
+
+void RasmServer(char *sockpath)
+{
+	#undef FUNC
+	#define FUNC "RasmServer"
+
+	struct sockaddr_un addr={0};
+	mode_t oldmask;
+	int lfd,cfd;
+
+	sockpath=RasmServerPath(sockpath);
+	if (strlen(sockpath)>=sizeof(addr.sun_path)) {
+		printf("socket path too long %s\n",sockpath);
+		exit(ABORT_ERROR);
+	}
+	addr.sun_family=AF_UNIX;
+	strcpy(addr.sun_path,sockpath);
+	lfd=socket(AF_UNIX,SOCK_STREAM,0);
+	if (lfd<0) {
+		printf("cannot create socket\n");
+		exit(ABORT_ERROR);
+	}
+	if (connect(lfd,(struct sockaddr *)&addr,sizeof(addr))==0) {
+		printf("a rasm server is already listening on %s\n",sockpath);
+		exit(ABORT_ERROR);
+	}
+	close(lfd);
+	/* stale socket from a previous server */
+	unlink(sockpath);
+	lfd=socket(AF_UNIX,SOCK_STREAM,0);
+	oldmask=umask(077);
+	if (lfd<0 || bind(lfd,(struct sockaddr *)&addr,sizeof(addr)) || listen(lfd,16)) {
+		printf("cannot listen on %s\n",sockpath);
+		exit(ABORT_ERROR);
+	}
+	umask(oldmask);
+	/* a client leaving before the answer must not kill the server */
+	signal(SIGPIPE,SIG_IGN);
+	InitKeywordTables();
+	servercache_active=1;
+	printf("%s server listening on %s\n",RASM_VERSION,sockpath);
+	fflush(stdout);
+
+	while (1) {
+		cfd=accept(lfd,NULL,NULL);
+		if (cfd<0) {
+			if (errno==EINTR) continue;
+			printf("cannot accept job on %s\n",sockpath);
+			exit(INTERNAL_ERROR);
+		}
+		RasmServerJob(lfd,cfd);
+		close(cfd);
+	}
+}
+
+/*
+	RasmClient
+	
+	send the job to the server, return only if there is no server to assemble locally
+*/
+void RasmClient(char *sockpath, int argc, char **argv)
+{
+	#undef FUNC
+	#define FUNC "RasmClient"
+
+	struct sockaddr_un addr={0};
+	struct msghdr msg={0};
+	struct cmsghdr *cmsg;
+	struct iovec iov;
+	char control[CMSG_SPACE(2*sizeof(int))]={0};
+	int fds[2]={1,2};
+	char cwd[PATH_MAX];
+	char *job;
+	int fd,joblen,i,l,status;
+
+	if (strlen(sockpath)>=sizeof(addr.sun_path) || !getcwd(cwd,PATH_MAX)) return;
+	addr.sun_family=AF_UNIX;
+	strcpy(addr.sun_path,sockpath);
+	fd=socket(AF_UNIX,SOCK_STREAM,0);
+	if (fd<0) return;
+	if (connect(fd,(struct sockaddr *)&addr,sizeof(addr))) {
+		close(fd);
+		return;
+	}
+	if (!RasmServerPeerIsUser(fd)) {
+		printf(KWARNING"rasm server on %s is run by another user, assembling locally"KNORMAL"\n",sockpath);
+		close(fd);
+		return;
+	}
+
+	joblen=strlen(cwd)+1;
+	for (i=1;i<argc;i++) joblen+=strlen(argv[i])+1;
+	job=MemMalloc(joblen);
+	strcpy(job,cwd);
+	l=strlen(cwd)+1;
+	for (i=1;i<argc;i++) {
+		strcpy(job+l,argv[i]);
+		l+=strlen(argv[i])+1;
+	}
+
+	iov.iov_base=&joblen;
+	iov.iov_len=sizeof(int);
+	msg.msg_iov=&iov;
+	msg.msg_iovlen=1;
+	msg.msg_control=control;
+	msg.msg_controllen=sizeof(control);
+	cmsg=CMSG_FIRSTHDR(&msg);
+	cmsg->cmsg_level=SOL_SOCKET;
+	cmsg->cmsg_type=SCM_RIGHTS;
+	cmsg->cmsg_len=CMSG_LEN(2*sizeof(int));
+	memcpy(CMSG_DATA(cmsg),fds,2*sizeof(int));
+	fflush(stdout);
+	if (sendmsg(fd,&msg,0)!=sizeof(int) || !_internal_ServerWrite(fd,job,joblen) || !_internal_ServerRead(fd,&status,sizeof(int))) {
+		printf(KWARNING"rasm server on %s did not answer, assembling locally"KNORMAL"\n",sockpath);
+		close(fd);
+		MemFree(job);
+		return;
+	}
+	close(fd);
+	MemFree(job);
+	if (WIFEXITED(status)) exit(WEXITSTATUS(status));
+	exit(INTERNAL_ERROR);
+}
+#endif
+
 /*
 	main
 	
@@ -17300,6 +19192,14 @@ int main(int argc, char **argv)
 	param.maxerr=20;
 	param.rough=0.5;
 
+	#ifdef RASM_SERVER
+	if (argc>1 && (strcmp(argv[1],"-server")==0 || strcmp(argv[1],"--server")==0)) {
+		RasmServer(argc>2?argv[2]:NULL);
+	}
+	if (getenv("RASM_SERVER") && *getenv("RASM_SERVER")) {
+		RasmClient(RasmServerPath(NULL),argc,argv);
+	}
+	#endif
 	GetParametersFromCommandLine(argc,argv,&param);
 	ret=Rasm(&param);
 	#ifdef RDD
@@ -0,0 +1,71 @@
+#!/usr/bin/env python3
+#
+# z80table.h generator for rasm
+#
+# - perfect hash parameters for the keyword table (instruction[] in rasm_v0119.c)
+#
+# usage: z80gen.py [-o z80table.h]
+#
+# the table must be regenerated when a keyword is added to rasm, rasm stops with
+# an internal error when two keywords collide in the hash
+#
+import random
+import re
+from argparse import ArgumentParser
+
+RASM_SOURCE = "rasm_v0119.c"
+
+
+def getcrc(s):
+    """GetCRC of rasm"""
+    crc = 0x12345678
+    for c in s.encode("latin-1"):
+        crc = ((crc << 9) ^ (crc + c)) & 0xFFFFFFFF
+    return crc
+
+
+def perfecthash(crcs, minbits, tries=200000):
+    """multiplicative hash (crc*mult)>>(32-bits) without collision"""
+    rnd = random.Random(0x5A5A)
+    for bits in range(minbits, 16):
+        for _ in range(tries):
+            mult = rnd.getrandbits(32) | 1
+            slots = set()
+            for crc in crcs:
+                h = ((crc * mult) & 0xFFFFFFFF) >> (32 - bits)
+                if h in slots:
+                    break
+                slots.add(h)
+            else:
+                return bits, mult
+    raise SystemExit("no perfect hash found")
+
+
+def keywords():
+    src = open(RASM_SOURCE, encoding="latin-1").read()
+    table = src[src.index("struct s_asm_keyword instruction[]={"):]
+    table = table[:table.index("};")]
+    return re.findall(r'^\{"([^"]+)",', table, re.M)
+
+
+def generate(out):
+    kbits, kmult = perfecthash([getcrc(k) for k in keywords()], 8)
+
+    w = out.write
+    w("/* generated by z80gen.py, do not edit */\n\n")
+    w("/* keyword lookup, (crc*mult)>>(32-bits) has no collision for the keywords of instruction[] */\n")
+    w("#define KEYWORD_HASH_BITS %d\n" % kbits)
+    w("#define KEYWORD_HASH(crc) ((((unsigned int)(crc))*0x%08XU)>>(32-KEYWORD_HASH_BITS))\n" % kmult)
+
+
+def main():
+    parser = ArgumentParser(description="z80table.h generator for rasm")
+    parser.add_argument("-o", dest="output", default="z80table.h", help="output file (default: z80table.h)")
+    args = parser.parse_args()
+
+    with open(args.output, "w", newline="\n") as out:
+        generate(out)
+
+
+if __name__ == "__main__":
+    main()
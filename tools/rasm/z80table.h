@@ -0,0 +1,5 @@
+/* generated by z80gen.py, do not edit */
+
+/* keyword lookup, (crc*mult)>>(32-bits) has no collision for the keywords of instruction[] */
+#define KEYWORD_HASH_BITS 10
+#define KEYWORD_HASH(crc) ((((unsigned int)(crc))*0x86F92E15U)>>(32-KEYWORD_HASH_BITS))
@@ -6,6 +6,7 @@ To sum up:
 - all include files and C sources were merged in a single file
 - existing logs were removed (except error logs)
 - main were removed and wrapper added
+- optimize works on a reusable context with index based hash chains
 
 
  * (c) Copyright 2012 by Einar Saukas. All rights reserved.
@@ -35,18 +36,28 @@ To sum up:
 #define ZX7_MAX_OFFSET  2176  /* range 1..2176 */
 #define ZX7_MAX_LEN    65536  /* range 2..65536 */
 
-typedef struct match_t {
-    size_t index;
-    struct match_t *next;
-} Match;
-
 typedef struct optimal_t {
     size_t bits;
     int offset;
     int len;
 } Optimal;
 
-Optimal *optimize(unsigned char *input_data, size_t input_size);
+/* buffers kept from one crunch to the next, positions stored in head/chain/max are
+   biased by base so entries of previous runs are seen as empty without any clearing */
+typedef struct zx7_context_t {
+    int *min;
+    int *max;
+    int *head;
+    int *chain;
+    Optimal *optimal;
+    size_t size;
+    int base;
+} ZX7_Context;
+
+ZX7_Context *ZX7_context_new(void);
+void ZX7_context_free(ZX7_Context *ctx);
+
+Optimal *optimize(ZX7_Context *ctx, unsigned char *input_data, size_t input_size);
 
 unsigned char *ZX7_compress(Optimal *optimal, unsigned char *input_data, size_t input_size, size_t *output_size);
 
@@ -90,45 +101,90 @@ int count_bits(int offset, int len) {
     return 1 + (offset > 128 ? 12 : 8) + elias_gamma_bits(len-1);
 }
 
-Optimal* optimize(unsigned char *input_data, size_t input_size) {
-    size_t *min;
-    size_t *max;
-    Match *matches;
-    Match *match_slots;
+ZX7_Context *ZX7_context_new(void) {
+    ZX7_Context *ctx;
+
+    ctx = (ZX7_Context *)calloc(1, sizeof(ZX7_Context));
+    if (ctx) {
+        ctx->min = (int *)calloc(ZX7_MAX_OFFSET+1, sizeof(int));
+        ctx->max = (int *)calloc(ZX7_MAX_OFFSET+1, sizeof(int));
+        ctx->head = (int *)calloc(256*256, sizeof(int));
+    }
+    if (!ctx || !ctx->min || !ctx->max || !ctx->head) {
+         fprintf(stderr, "Error: Insufficient memory\n");
+         exit(1);
+    }
+    return ctx;
+}
+
+void ZX7_context_free(ZX7_Context *ctx) {
+    if (!ctx) return;
+    free(ctx->min);
+    free(ctx->max);
+    free(ctx->head);
+    free(ctx->chain);
+    free(ctx->optimal);
+    free(ctx);
+}
+
+/* the returned array belongs to the context and is valid until the next call */
+Optimal* optimize(ZX7_Context *ctx, unsigned char *input_data, size_t input_size) {
+    int *min;
+    int *max;
+    int *head;
+    int *chain;
     Optimal *optimal;
-    Match *match;
+    int base;
     int match_index;
+    int candidate;
     int offset;
     size_t len;
     size_t best_len;
     size_t bits;
     size_t i;
 
-    /* allocate all data structures at once */
-    min = (size_t *)calloc(ZX7_MAX_OFFSET+1, sizeof(size_t));
-    max = (size_t *)calloc(ZX7_MAX_OFFSET+1, sizeof(size_t));
-    matches = (Match *)calloc(256*256, sizeof(Match));
-    match_slots = (Match *)calloc(input_size, sizeof(Match));
-    optimal = (Optimal *)calloc(input_size, sizeof(Optimal));
-
-    if (!min || !max || !matches || !match_slots || !optimal) {
-         fprintf(stderr, "Error: Insufficient memory\n");
-         exit(1);
+    /* grow the per position buffers only when needed */
+    if (input_size > ctx->size) {
+        free(ctx->chain);
+        free(ctx->optimal);
+        ctx->size = input_size;
+        ctx->chain = (int *)malloc(input_size*sizeof(int));
+        ctx->optimal = (Optimal *)malloc(input_size*sizeof(Optimal));
+        if (!ctx->chain || !ctx->optimal) {
+             fprintf(stderr, "Error: Insufficient memory\n");
+             exit(1);
+        }
     }
+    /* the bias would overflow, clear tables once */
+    if (input_size >= (size_t)(0x7FFFFFFF - ctx->base)) {
+        memset(ctx->head, 0, 256*256*sizeof(int));
+        memset(ctx->max, 0, (ZX7_MAX_OFFSET+1)*sizeof(int));
+        ctx->base = 0;
+    }
+    min = ctx->min;
+    max = ctx->max;
+    head = ctx->head;
+    chain = ctx->chain;
+    optimal = ctx->optimal;
+    base = ctx->base;
 
     /* first byte is always literal */
     optimal[0].bits = 8;
+    optimal[0].offset = 0;
+    optimal[0].len = 0;
 
     /* process remaining bytes */
     for (i = 1; i < input_size; i++) {
 
         optimal[i].bits = optimal[i-1].bits + 9;
+        optimal[i].offset = 0;
+        optimal[i].len = 0;
         match_index = input_data[i-1] << 8 | input_data[i];
         best_len = 1;
-        for (match = &matches[match_index]; match->next != NULL && best_len < ZX7_MAX_LEN; match = match->next) {
-            offset = i - match->next->index;
+        /* chains are sorted by decreasing position, stop at the first one out of range */
+        for (candidate = head[match_index]; candidate > base && best_len < ZX7_MAX_LEN; candidate = chain[candidate-base]) {
+            offset = i - (candidate-base);
             if (offset > ZX7_MAX_OFFSET) {
-                match->next = NULL;
                 break;
             }
 
@@ -141,7 +197,7 @@ Optimal* optimize(unsigned char *input_data, size_t input_size) {
                         optimal[i].offset = offset;
                         optimal[i].len = len;
                     }
-                } else if (i+1 == max[offset]+len && max[offset] != 0) {
+                } else if (max[offset] > base && i+1 == (size_t)(max[offset]-base)+len) {
                     len = i-min[offset];
                     if (len > best_len) {
                         len = best_len;
@@ -152,15 +208,12 @@ Optimal* optimize(unsigned char *input_data, size_t input_size) {
                 }
             }
             min[offset] = i+1-len;
-            max[offset] = i;
+            max[offset] = base+i;
         }
-        match_slots[i].index = i;
-        match_slots[i].next = matches[match_index].next;
-        matches[match_index].next = &match_slots[i];
+        chain[i] = head[match_index];
+        head[match_index] = base+i;
     }
-
-    /* save time by releasing the largest block only, the O.S. will clean everything else later */
-    free(match_slots);
+    ctx->base = base+input_size;
 
     return optimal;
 }